@@ -0,0 +1,214 @@
+/**
+ * @file FlatHashMap.h
+ * @brief open addressing hash map keyed on 64 bit integers, used on per message lookup paths where std::map costs a tree walk and a node allocation per insert.
+ * Entries are stored inline in a single power of 2 sized array, probed linearly.
+ * Erase uses backward shift deletion, so lookups never traverse tombstones and the table does not degrade under insert/erase churn.
+ * Not thread safe.
+ * @version 0.1
+ *
+ */
+#ifndef FLATHASHMAP_H
+#define FLATHASHMAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "DiggiAssert.h"
+
+///initial slot count of a FlatHashMap, must be power of 2
+#define FLAT_HASH_MAP_INITIAL_CAPACITY 64
+
+/**
+ * @brief hash map from uint64_t to V, with std::map like semantics for find, operator[] and erase.
+ * V must be trivially copyable, and value initialized entries are returned for keys inserted through operator[].
+ * Pointers returned by find() and operator[] are invalidated by any later insert or erase.
+ * @tparam V value type
+ */
+template <typename V>
+class FlatHashMap
+{
+	typedef struct slot_t
+	{
+		uint64_t key;
+		V value;
+		bool used;
+	} slot_t;
+
+	///slot array
+	slot_t *slots;
+	///slot count, power of 2
+	size_t capacity;
+	///occupied slots
+	size_t count;
+
+	/**
+	 * @brief home slot of key, fibonacci hashing spreads sequential flow ids across the table.
+	 *
+	 * @param key
+	 * @return size_t slot index
+	 */
+	size_t home(uint64_t key) const
+	{
+		return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+	}
+	/**
+	 * @brief double slot array and reinsert all entries, keeps load factor below 1/2
+	 *
+	 */
+	void grow()
+	{
+		auto old_slots = slots;
+		auto old_capacity = capacity;
+		capacity = capacity * 2;
+		slots = new slot_t[capacity]();
+		DIGGI_ASSERT(slots);
+		for (size_t i = 0; i < old_capacity; i++)
+		{
+			if (old_slots[i].used)
+			{
+				auto idx = home(old_slots[i].key);
+				while (slots[idx].used)
+				{
+					idx = (idx + 1) & (capacity - 1);
+				}
+				slots[idx] = old_slots[i];
+			}
+		}
+		delete[] old_slots;
+	}
+
+public:
+	FlatHashMap() : capacity(FLAT_HASH_MAP_INITIAL_CAPACITY), count(0)
+	{
+		slots = new slot_t[capacity]();
+		DIGGI_ASSERT(slots);
+	}
+	FlatHashMap(const FlatHashMap &) = delete;
+	FlatHashMap &operator=(const FlatHashMap &) = delete;
+	~FlatHashMap()
+	{
+		delete[] slots;
+	}
+	/**
+	 * @brief lookup entry, a miss does not insert.
+	 *
+	 * @param key
+	 * @return V* value, nullptr if key is not present
+	 */
+	V *find(uint64_t key)
+	{
+		auto idx = home(key);
+		while (slots[idx].used)
+		{
+			if (slots[idx].key == key)
+			{
+				return &slots[idx].value;
+			}
+			idx = (idx + 1) & (capacity - 1);
+		}
+		return nullptr;
+	}
+	/**
+	 * @brief lookup entry, inserting a value initialized entry on miss.
+	 *
+	 * @param key
+	 * @return V& value
+	 */
+	V &operator[](uint64_t key)
+	{
+		auto found = find(key);
+		if (found != nullptr)
+		{
+			return *found;
+		}
+		if ((count + 1) * 2 > capacity)
+		{
+			grow();
+		}
+		auto idx = home(key);
+		while (slots[idx].used)
+		{
+			idx = (idx + 1) & (capacity - 1);
+		}
+		slots[idx].used = true;
+		slots[idx].key = key;
+		slots[idx].value = V();
+		count++;
+		return slots[idx].value;
+	}
+	/**
+	 * @brief remove entry.
+	 * Following entries of the same probe run are shifted back into the freed slot.
+	 * @param key
+	 * @return size_t 1 if entry was removed, 0 if not present, as std::map::erase
+	 */
+	size_t erase(uint64_t key)
+	{
+		auto idx = home(key);
+		while (slots[idx].used && slots[idx].key != key)
+		{
+			idx = (idx + 1) & (capacity - 1);
+		}
+		if (!slots[idx].used)
+		{
+			return 0;
+		}
+		auto hole = idx;
+		auto next = (hole + 1) & (capacity - 1);
+		while (slots[next].used)
+		{
+			/*
+				entry may fill the hole unless its home lies cyclically in (hole, next]
+			*/
+			auto desired = home(slots[next].key);
+			if (((next - desired) & (capacity - 1)) >= ((next - hole) & (capacity - 1)))
+			{
+				slots[hole] = slots[next];
+				hole = next;
+			}
+			next = (next + 1) & (capacity - 1);
+		}
+		slots[hole] = slot_t();
+		count--;
+		return 1;
+	}
+	/**
+	 * @brief count of entries
+	 *
+	 * @return size_t
+	 */
+	size_t size() const
+	{
+		return count;
+	}
+	/**
+	 * @brief invoke f(key, value) for each entry, in no particular order.
+	 * f must not insert or erase entries.
+	 * @tparam F callable taking (uint64_t, V&)
+	 * @param f
+	 */
+	template <typename F>
+	void forEach(F f)
+	{
+		for (size_t i = 0; i < capacity; i++)
+		{
+			if (slots[i].used)
+			{
+				f(slots[i].key, slots[i].value);
+			}
+		}
+	}
+	/**
+	 * @brief remove all entries, retains slot array
+	 *
+	 */
+	void clear()
+	{
+		for (size_t i = 0; i < capacity; i++)
+		{
+			slots[i] = slot_t();
+		}
+		count = 0;
+	}
+};
+
+#endif
@@ -62,7 +62,8 @@ typedef struct async_work_t {
 	int thread_id;
 	size_t rate_limit;
 	size_t current_rate;
-	size_t pad;
+	///clock reading when scheduled, only set when the threadpool is profiling, 0 otherwise
+	uint64_t enqueue_tsc;
 }async_work_t;
 
 COMPILE_TIME_ASSERT(sizeof(async_work_t) == (64));
@@ -112,6 +113,9 @@ typedef enum msg_type_t {
 	NET_CLOSE_MSG_TYPE,
     NET_RAND_MSG_TYPE,
     DIGGI_SIGNAL_TYPE_EXIT,
+    DIGGI_COALESCED_MESSAGE_TYPE,
+    DIGGI_STREAM_MESSAGE_TYPE,
+    DIGGI_SESSION_RESUME_TYPE,
 } msg_type_t;
 
 typedef enum msg_payload_type_t {
@@ -43,18 +43,41 @@ typedef struct lf_buffer_t {
 	void  ** ptr_array_;
     volatile unsigned long Q_SIZE;
     volatile unsigned long Q_MASK;
+	// single producer single consumer mode, see lf_new_spsc
+	int spsc_;
+	// doorbell futex word, incremented by producers when consumers are parked, see lf_park
+	volatile int doorbell_ ____cacheline_aligned;
+	// count of consumers currently parked on doorbell
+	volatile int parked_;
+	// producers check for parked consumers after send, see lf_enable_doorbell
+	int doorbell_enabled_;
 }lf_buffer_t;
 
 
 lf_buffer_t * lf_new(size_t size, size_t prod, size_t cons);
+lf_buffer_t * lf_new_spsc(size_t size);
 
 void lf_destroy(lf_buffer_t *lf);
 
 void lf_send(lf_buffer_t *lf, void *msg, size_t requesting_thread);
+int lf_try_send(lf_buffer_t *lf, void *msg, size_t requesting_thread);
+unsigned long lf_free_slots(lf_buffer_t *lf);
 
 void* lf_recieve(lf_buffer_t *lf, size_t requesting_thread);
 void* lf_try_recieve(lf_buffer_t *lf, size_t requesting_thread);
 
+void lf_send_batch(lf_buffer_t *lf, void **msgs, size_t n, size_t requesting_thread);
+size_t lf_try_recieve_batch(lf_buffer_t *lf, void **out, size_t max, size_t requesting_thread);
+
+void lf_enable_doorbell(lf_buffer_t *lf);
+void lf_park(lf_buffer_t *lf, uint64_t timeout_usec);
+void lf_park_unless(lf_buffer_t *lf, lf_buffer_t *other, uint64_t timeout_usec);
+void lf_ring(lf_buffer_t *lf);
+#ifndef DIGGI_ENCLAVE
+void lf_doorbell_wait(lf_buffer_t *lf, int seq, uint64_t timeout_usec);
+void lf_doorbell_wake(lf_buffer_t *lf);
+#endif
+
 /*
 LOCKFREE_RB_H
 */
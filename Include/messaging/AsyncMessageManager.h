@@ -22,6 +22,8 @@
 #include "telemetry.h"
 #include "misc.h"
 #include "runtime/DiggiAPI.h"
+#include "FlatHashMap.h"
+#include "AsyncContext.h"
 #
 /**
  * @brief struct for storing destination queue, for direct instance to instance adressing
@@ -45,6 +47,98 @@ typedef struct name_service_update_t
 #define DIGGI_BASE_IDLE_SLEEP_USEC (uint64_t)1
 /// peak sleep interval for linear backoff algorithm, determines responsiveness of thread to incomming messages.
 #define PEAK_LINEAR_BACKOFF (uint64_t)8192
+/// maximum messages dequeued from the input queue by a single message pump invocation
+#define AMM_PUMP_BATCH_SIZE 16
+/// message types below this value are built in, and their handlers are held in a dense array. Application defined types are hashed.
+#define AMM_DENSE_TYPE_COUNT ((size_t)DIGGI_SESSION_RESUME_TYPE + 1)
+/// outbound messages up to this size, including header, are eligible for coalescing
+#define AMM_COALESCE_MAX_MSG_SIZE DIGGI_MEM_CLASS_0_SIZE
+/// requested size of a coalesced container message, including header
+#define AMM_COALESCE_CONTAINER_SIZE DIGGI_MEM_CLASS_1_SIZE
+/// destinations with pending coalesced messages tracked at once, per thread
+#define AMM_COALESCE_SLOTS 8
+
+/// delay between attempts to drain messages parked on a full destination queue
+#define AMM_BACKPRESSURE_RETRY_USEC (uint64_t)50
+/// parked messages per destination before the sender yields until the destination drains
+#define AMM_BACKPRESSURE_MAX_BACKLOG 1024
+
+/// status passed to a flow callback, without a message, when no reply arrived before the flow deadline
+#define AMM_FLOW_TIMEOUT -1
+/// status passed to a flow callback, without a message, when the flow is cancelled through cancelFlows
+#define AMM_FLOW_CANCELLED -2
+/// expired or cancelled flow ids remembered individually, so late replies are dropped instead of mistaken for typed messages.
+/// Replies to older locally initiated flows are recognised by id, @see AsyncMessageManager::isExpiredFlow
+#define AMM_EXPIRED_FLOW_HISTORY 256
+
+/**
+ * @brief one-off continuation of an outstanding message flow
+ *
+ */
+typedef struct async_flow_t
+{
+    ///callback for next message of flow
+    async_cb_t cb;
+    ///calle managed context pointer delivered to callback
+    void *arg;
+    ///destination of last message sent on flow, used for bulk cancellation
+    aid_t dest;
+    ///sequence number of the armed deadline timer, 0 if the flow waits without deadline
+    uint64_t timer;
+} async_flow_t;
+
+/**
+ * @brief credit accounting towards a single destination instance.
+ * Credits are the free slots of the destination input queue, returned as the reciever drains it.
+ * Messages sent without credit are parked in a per destination backlog, linked through msg_t::pad[0], and sent in order once credit returns.
+ */
+typedef struct peer_credit_t
+{
+    ///destination input queue, or the untrusted runtime queue for remote destinations
+    lf_buffer_t *queue;
+    ///free slots observed at last send
+    size_t credits;
+    ///messages enqueued on destination queue
+    uint64_t sent;
+    ///sends which found no credit, and were parked
+    uint64_t stalls;
+    ///parked messages, oldest first
+    msg_t *backlog_head;
+    msg_t *backlog_tail;
+    size_t backlog;
+    size_t backlog_peak;
+} peer_credit_t;
+
+/**
+ * @brief pending coalesced messages towards a single destination lane.
+ * The first message is held as is, and only copied into a container once a second message arrives.
+ */
+typedef struct coalesce_slot_t
+{
+    ///destination, including lane
+    aid_t dest;
+    ///first pending message, sent unwrapped if no other message follows
+    msg_t *first;
+    ///container of type DIGGI_COALESCED_MESSAGE_TYPE, nullptr while only first is pending
+    msg_t *container;
+    ///capacity of container, including header
+    size_t capacity;
+} coalesce_slot_t;
+/**
+ * @brief inbound messages of a type without registered handler, parked until the type is registered.
+ * Messages are linked through msg_t::pad[0], and delivered in order of arrival.
+ */
+typedef struct pending_type_t
+{
+    ///parked messages, oldest first
+    msg_t *head;
+    msg_t *tail;
+    size_t count;
+    ///thread which parked the messages, and on which they are delivered
+    int thread;
+    ///set while delivery of parked messages is scheduled
+    bool flush_scheduled;
+} pending_type_t;
 /**
  * @brief class defintion implementing the IAsyncMessageManger interface.
  * 
@@ -56,6 +150,12 @@ class AsyncMessageManager : public IAsyncMessageManager
 #include <gtest/gtest_prod.h>
     FRIEND_TEST(asyncmessagemanager, simple_source_sink_test);
     FRIEND_TEST(asyncmessagemanager, simple_continuation_source_sink);
+    FRIEND_TEST(asyncmessagemanager, inbound_delivery_allocation_free);
+    FRIEND_TEST(asyncmessagemanager, flow_hash_routing);
+    FRIEND_TEST(asyncmessagemanager, coalesced_small_messages);
+    FRIEND_TEST(asyncmessagemanager, credit_backpressure);
+    FRIEND_TEST(asyncmessagemanager, flow_timeout_and_cancel);
+    FRIEND_TEST(asyncmessagemanager, pending_type_delivered_on_register);
 #endif
     /// monotonic increasing identifier for creating async flow ids(message ids)
     unsigned long monotonic_msg_id;
@@ -66,16 +166,69 @@ class AsyncMessageManager : public IAsyncMessageManager
     uint64_t nomessage_event_cnt;
     ///signal bolean to stopp polling in the event of shutdown
     volatile bool stop;
+    ///spread inbound flows across threads on a hash of their source lane, configured by "message-flow-routing"
+    bool flow_routing;
+    ///pack small outbound messages to the same destination into one container, configured by "message-coalescing"
+    bool coalescing;
+    ///time pending messages may wait for further messages, configured by "message-coalescing-window-usec". 0 flushes once the current callback returns
+    uint64_t coalesce_window_us;
+    ///set while a flush of pending coalesced messages is scheduled
+    bool coalesce_flush_scheduled;
+    coalesce_slot_t coalesce_pending[AMM_COALESCE_SLOTS];
+    ///credit accounting per destination, indexed on aid_t with thread field cleared
+    FlatHashMap<peer_credit_t> peer_credits;
+    ///destinations with parked messages
+    std::vector<uint64_t> backlogged_peers;
+    ///set while a drain of parked messages is scheduled
+    bool backpressure_retry_scheduled;
+    ///last sequence number handed to a flow deadline timer
+    uint64_t flow_timer_seq;
+    ///recently expired or cancelled flow ids, oldest overwritten first
+    uint64_t expired_flows[AMM_EXPIRED_FLOW_HISTORY];
+    size_t expired_flows_next;
+    ///membership of expired_flows
+    FlatHashMap<uint8_t> expired_flow_set;
+    ///highest flow id evicted from expired_flows, flows without callback at or below it have expired
+    unsigned long expired_flow_floor;
+    ///recieves replies to expired or cancelled flows, dropped if no callback is registered
+    async_work_t late_reply_handler;
     static bool async_source_cb(msg_async_response_t *resp);
-    static void defered_async_source_cb(void *ptr, int status);
+    static void pending_type_flush_cb(void *ctx, int status);
+    void parkPendingType(msg_t *msg);
+    void flushPendingType(msg_type_t ty);
     static void async_source_cb_thread_change(void *ptr, int status);
     static void async_message_pump(void *ctx, int status);
+    static void async_message_deliver(AsyncMessageManager *_this, msg_t *msg);
+    static void coalesce_flush_cb(void *ctx, int status);
+    void coalesce(msg_t *msg);
+    void flushCoalesced(coalesce_slot_t *slot);
+    void flushCoalesced(aid_t destination);
+    void flushCoalesced();
+    void unpackCoalesced(msg_t *container);
+    void configureCoalescing();
+    static void backpressure_retry_cb(void *ctx, int status);
+    peer_credit_t *peerCredit(aid_t destination);
+    void enqueueOutbound(msg_t *msg);
+    bool drainBacklog(peer_credit_t *peer);
+    static void flow_timeout_cb(void *ctx, int status);
+    void expireFlow(unsigned long id, int status);
+    bool isExpiredFlow(unsigned long id);
     lf_buffer_t *getTargetBuffer(aid_t destination);
+    async_work_t *findTypeHandler(msg_type_t ty);
+    size_t inboundThread(msg_t *msg);
+    uint8_t outboundLane(msg_t *msg);
 
     /*Concurrent access is not allowed, all acces by single thread*/
-    std::map<uint64_t, async_work_t> async_handler_map;
-    std::map<msg_type_t, async_work_t> type_handler_map;
-    std::map<uint64_t, lf_buffer_t *> outbound_map;
+    ///one-off flow callbacks, indexed on message id
+    FlatHashMap<async_flow_t> async_handler_map;
+    ///typed callbacks for built in message types, indexed on msg_type_t. Unregistered entries have a null cb
+    async_work_t type_handlers[AMM_DENSE_TYPE_COUNT];
+    ///typed callbacks for application defined message types
+    FlatHashMap<async_work_t> type_handler_map;
+    ///messages recieved before their type was registered, indexed on msg_type_t
+    FlatHashMap<pending_type_t> pending_types;
+    ///input queues of local instances, indexed on aid_t with thread field cleared
+    FlatHashMap<lf_buffer_t *> outbound_map;
     /// thread safe message manager implements the IMessageManager interface, which returns the correct SecureMessageManager based on threadid
     IThreadSafeMM *tsafemm;
     /// own instances unique identifier
@@ -87,8 +240,8 @@ public:
     lf_buffer_t *output;
     /// thread id relative to global ordering to ensure correct lockfree thread addressing on outbound queues.
     size_t global_thread_id;
-    /// global message object buffer storing preallocated message objects for quick consumption by instances.
-    lf_buffer_t *global_mem_buf;
+    /// global size-classed message object pool storing preallocated message objects for quick consumption by instances.
+    msg_pool_t *global_mem_buf;
 
     AsyncMessageManager(
         IDiggiAPI *dapi,
@@ -96,14 +249,14 @@ public:
         lf_buffer_t *output_q,
         std::vector<name_service_update_t> outbound_queues,
         size_t global_thread_id,
-        lf_buffer_t *global_mem_buf);
+        msg_pool_t *global_mem_buf);
     AsyncMessageManager(
         IDiggiAPI *dapi,
         lf_buffer_t *input_q,
         lf_buffer_t *output_q,
         std::vector<name_service_update_t> outbound_queues,
         size_t global_thread_id,
-        lf_buffer_t *global_mem_buf,
+        msg_pool_t *global_mem_buf,
         IThreadSafeMM *tsafemm);
     ~AsyncMessageManager();
 
@@ -115,6 +268,9 @@ public:
 
     void registerTypeCallback(async_cb_t cb, msg_type_t ty, void *arg);
     void UnregisterTypeCallback(msg_type_t ty);
+    static bool flowRoutingConfigured(IDiggiAPI *dapi);
+    static bool isLocalFlow(unsigned long id, aid_t self);
+    static size_t flowHashThread(aid_t src, size_t threads);
     /*
 	different thread
 	*/
@@ -124,9 +280,16 @@ public:
     msg_t *allocateMessage(aid_t source, aid_t dest, size_t payload_size, msg_convention_t async);
     /*await response*/
     void sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr);
+    void sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr, uint64_t timeout_us);
     void endAsync(msg_t *msg);
+    size_t cancelFlows(aid_t destination);
+    size_t cancelFlows();
+    void registerLateReplyCallback(async_cb_t cb, void *arg);
     /*one way*/
     void sendMessage(msg_t *msg);
+    bool trySendMessage(msg_t *msg);
+    size_t peerCredits(aid_t destination);
+    std::string creditStatsCsv();
 };
 
 #endif
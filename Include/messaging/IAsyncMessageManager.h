@@ -27,8 +27,12 @@ public:
 
 	/*await response*/
 	virtual void sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr) = 0;
+	virtual void sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr, uint64_t timeout_us) = 0;
 
 	virtual void endAsync(msg_t *msg) = 0;
+	virtual size_t cancelFlows(aid_t destination) = 0;
+	virtual size_t cancelFlows() = 0;
+	virtual void registerLateReplyCallback(async_cb_t cb, void *arg) = 0;
 
 	/*one way*/
 	virtual void sendMessage(msg_t *msg) = 0;
@@ -1,10 +1,23 @@
 #ifndef IMESSAGE_MANAGER_H
 #define IMESSAGE_MANAGER_H
 #include "datatypes.h"
+#include "DiggiAssert.h"
 #include <string>
 #include <vector>
 #include <map>
 
+/*
+	one message of a batch encrypted under a single key, tag is written to p_out_mac
+*/
+typedef struct crypto_batch_item_t {
+	const uint8_t *p_src;
+	uint32_t src_len;
+	uint8_t *p_dst;
+	const uint8_t *p_iv;
+	uint32_t iv_len;
+	sgx_aes_gcm_128bit_tag_t *p_out_mac;
+} crypto_batch_item_t;
+
 class ICryptoImplementation {
 public:
 	ICryptoImplementation(){}
@@ -34,6 +47,32 @@ public:
 		const sgx_aes_gcm_128bit_tag_t *p_in_mac
 	) = 0;
 
+	/*
+		encrypt several messages under the same key, implementations may amortize key setup across the batch
+	*/
+	virtual sgx_status_t encryptBatch(
+		const sgx_aes_gcm_128bit_key_t *p_key,
+		crypto_batch_item_t *items,
+		size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			auto sts = encrypt(p_key, items[i].p_src, items[i].src_len, items[i].p_dst, items[i].p_iv, items[i].iv_len, NULL, 0, items[i].p_out_mac);
+			if (sts != SGX_SUCCESS)
+			{
+				return sts;
+			}
+		}
+		return SGX_SUCCESS;
+	}
+
+	/*
+		the key is no longer used by any session of the calling thread, implementations caching key material must drop it
+	*/
+	virtual void retireKey(const sgx_aes_gcm_128bit_key_t *p_key)
+	{
+	}
+
 };
 
 class IMessageManager {
@@ -43,11 +82,25 @@ public:
 	virtual ~IMessageManager() {};
 	virtual void endAsync(msg_t *msg) = 0;
 	virtual void Send(msg_t *msg, async_cb_t cb, void *cb_context) = 0;
+	/*
+		response deadline, 0 waits indefinitely
+		implementations without flow deadlines only support 0
+	*/
+	virtual void Send(msg_t *msg, async_cb_t cb, void *cb_context, uint64_t timeout_us) { DIGGI_ASSERT(timeout_us == 0); Send(msg, cb, cb_context); }
 	virtual msg_t *allocateMessage(std::string destination, size_t payload_size, msg_convention_t async, msg_delivery_t delivery) = 0;
     virtual msg_t *allocateMessage(aid_t destination, size_t payload_size, msg_convention_t async, msg_delivery_t delivery) = 0;
 	virtual msg_t *allocateMessage(msg_t *msg, size_t payload_size) = 0;
 	virtual void registerTypeCallback(async_cb_t cb, msg_type_t type, void * ctx) = 0;
 	virtual std::map<std::string, aid_t> getfuncNames () = 0;
+	/*
+		streaming channels for payloads exceeding a single message, @see StreamChannelManager
+		not supported by implementations which do not override them
+	*/
+	virtual uint64_t openStream(std::string destination, msg_delivery_t delivery) { DIGGI_ASSERT(false); return 0; }
+	virtual uint64_t openStream(aid_t destination, msg_delivery_t delivery) { DIGGI_ASSERT(false); return 0; }
+	virtual bool writeStream(uint64_t stream, const uint8_t *buf, size_t size) { DIGGI_ASSERT(false); return false; }
+	virtual void closeStream(uint64_t stream) { DIGGI_ASSERT(false); }
+	virtual void registerStreamCallback(async_cb_t cb, void *ctx) { DIGGI_ASSERT(false); }
 };
 
 #endif
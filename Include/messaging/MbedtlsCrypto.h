@@ -0,0 +1,80 @@
+/**
+ * @file MbedtlsCrypto.h
+ * @brief message crypto implementation on the vendored mbedtls AES-GCM, as an alternative to the per call SGX SDK api.
+ * @version 0.1
+ *
+ */
+#ifndef MBEDTLS_CRYPTO_H
+#define MBEDTLS_CRYPTO_H
+#include "datatypes.h"
+#include "messaging/IMessageManager.h"
+#include "mbedtls/gcm.h"
+
+/// expanded keys cached per thread, one per peer session in active use
+#define MBEDTLS_CRYPTO_KEY_SLOTS 8
+/// messages encrypted together by encryptBatch
+#define MBEDTLS_CRYPTO_BATCH_LANES 4
+/// AES blocks encrypted together by encryptBatch
+#define MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT 8
+
+/**
+ * @brief cached GCM context of a single key
+ *
+ */
+typedef struct mbedtls_crypto_key_slot_t
+{
+    sgx_aes_gcm_128bit_key_t key;
+    ///expanded AES key schedule and GHASH tables
+    mbedtls_gcm_context gcm;
+    ///clock value at last use, least recently used slot is evicted
+    uint64_t last_use;
+    bool used;
+} mbedtls_crypto_key_slot_t;
+
+/**
+ * @brief Implementation of crypto api interface for use in Secure Message Manager, using AES-128 GCM from the vendored mbedtls.
+ * mbedtls uses AES-NI for block encryption and PCLMULQDQ for GHASH when the cpu supports them (MBEDTLS_AESNI_C).
+ * The SGX SDK api expands the key and GHASH tables on every call, which dominates the cost of small messages.
+ * This implementation keeps expanded keys in a small per thread cache.
+ * Evicted and retired keys are zeroed, the secure message manager retires keys it no longer uses through retireKey.
+ * encryptBatch is multi buffer: the CTR keystream of up to MBEDTLS_CRYPTO_BATCH_LANES messages is computed MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT AES-NI blocks at a time,
+ * and GHASH runs per message on PCLMULQDQ.
+ * Interoperable with SGXCryptoImpl, messages encrypted by one are decrypted by the other.
+ * Selected by the "mbedtls-crypto" func configuration.
+ */
+class MbedtlsCryptoImpl : public ICryptoImplementation
+{
+    mbedtls_gcm_context *context(const sgx_aes_gcm_128bit_key_t *p_key);
+
+public:
+    sgx_status_t encrypt(
+        const sgx_aes_gcm_128bit_key_t *p_key,
+        const uint8_t *p_src,
+        uint32_t src_len,
+        uint8_t *p_dst,
+        const uint8_t *p_iv,
+        uint32_t iv_len,
+        const uint8_t *p_aad,
+        uint32_t aad_len,
+        sgx_aes_gcm_128bit_tag_t *p_out_mac);
+
+    sgx_status_t decrypt(
+        const sgx_aes_gcm_128bit_key_t *p_key,
+        const uint8_t *p_src,
+        uint32_t src_len,
+        uint8_t *p_dst,
+        const uint8_t *p_iv,
+        uint32_t iv_len,
+        const uint8_t *p_aad,
+        uint32_t aad_len,
+        const sgx_aes_gcm_128bit_tag_t *p_in_mac);
+
+    sgx_status_t encryptBatch(
+        const sgx_aes_gcm_128bit_key_t *p_key,
+        crypto_batch_item_t *items,
+        size_t count);
+
+    void retireKey(const sgx_aes_gcm_128bit_key_t *p_key);
+};
+
+#endif
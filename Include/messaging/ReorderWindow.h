@@ -0,0 +1,78 @@
+/**
+ * @file ReorderWindow.h
+ * @brief header file for ReorderWindow, holding messages which arrive ahead of their turn in a session until they may be delivered in order.
+ * @see SecureMessageManager::RecieveMessageHandlerAsync
+ * @version 0.1
+ *
+ */
+#ifndef REORDER_WINDOW_H
+#define REORDER_WINDOW_H
+#include <map>
+#include "datatypes.h"
+#include "misc.h"
+#include "DiggiAssert.h"
+
+/// messages held in the ring of each session, ahead of the next expected session count. Must be power of 2
+#define REORDER_WINDOW_SIZE 64
+/// message copies up to this size are pooled, larger are allocated per copy
+#define REORDER_COPY_SIZE DIGGI_MEM_CLASS_1_SIZE
+/// free pooled message copies retained per thread
+#define REORDER_COPY_POOL_MAX 256
+
+/**
+ * @brief an early message and the callback it is delivered to.
+ *
+ */
+typedef struct reorder_slot_t
+{
+    /// copy of message in trusted memory, nullptr while slot is unused
+    msg_t *msg;
+    async_cb_t cb;
+    void *context;
+    /// delivered through a typed callback rather than as part of a flow
+    bool typed;
+} reorder_slot_t;
+
+/**
+ * @brief per thread reordering statistics of a SecureMessageManager.
+ *
+ */
+typedef struct reorder_stat_t
+{
+    /// messages delivered on arrival
+    uint64_t in_order;
+    /// messages held until preceding messages arrived
+    uint64_t reordered;
+    /// held messages which were too far ahead for the ring
+    uint64_t overflowed;
+    /// message copies served from the pool
+    uint64_t pooled_copies;
+    /// message copies allocated on the heap
+    uint64_t heap_copies;
+    /// messages currently held, across all sessions
+    uint64_t depth;
+    /// most messages held at once
+    uint64_t max_depth;
+} reorder_stat_t;
+
+/**
+ * @brief Fixed capacity ring of early messages in a session, indexed by session count.
+ * Only messages less than REORDER_WINDOW_SIZE ahead of the expected session count are held in the ring,
+ * which never allocates. Messages further ahead are held in an overflow map, so none are dropped.
+ * Messages are not copied, callers own the messages held.
+ */
+class ReorderWindow
+{
+    reorder_slot_t ring[REORDER_WINDOW_SIZE];
+    std::map<uint64_t, reorder_slot_t> overflow;
+    size_t held;
+
+public:
+    ReorderWindow();
+    bool store(uint64_t expected, const reorder_slot_t *slot);
+    bool take(uint64_t session_count, reorder_slot_t *slot);
+    bool takeAny(reorder_slot_t *slot);
+    size_t size();
+};
+
+#endif
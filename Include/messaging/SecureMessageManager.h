@@ -23,6 +23,7 @@
 #include <map>
 #include <cassert>
 #include <string.h>
+#include <stddef.h>
 #include "messaging/AsyncMessageManager.h"
 #include "sgx/DynamicEnclaveMeasurement.h"
 #include "messaging/network_ra.h"
@@ -38,9 +39,12 @@
 #include "telemetry.h"
 #include "Logging.h"
 #include "runtime/DiggiAPI.h"
+#include "messaging/StreamChannel.h"
 #include "messaging/Util.h"
 #include "misc.h"
 #include "storage/TamperProofLog.h"
+#include "messaging/SessionKeyCache.h"
+#include "messaging/ReorderWindow.h"
 
 //
 //
@@ -104,7 +108,10 @@ public:
         uint32_t aad_len,
         const sgx_aes_gcm_128bit_tag_t *p_in_mac)
     {
-        memcpy(p_dst, p_src, src_len);
+        /*
+            inbound messages are decrypted in place
+        */
+        memmove(p_dst, p_src, src_len);
         return SGX_SUCCESS;
     }
 };
@@ -173,7 +180,24 @@ public:
 class SecureMessageManager;
 
 ///Context object for capturing message and callback info, in use when doing order preserving processing of incomming messages in SecureStorageManager::RecieveMessageHandlerAsync
-typedef struct AsyncContext<msg_t *, async_cb_t, void *, SecureMessageManager *, bool> secure_message_context_t;
+///item6 holds the response deadline of a send in microseconds, 0 if none
+typedef struct AsyncContext<msg_t *, async_cb_t, void *, SecureMessageManager *, bool, uint64_t> secure_message_context_t;
+
+/**
+ * @brief progress of resuming a session from the session key cache, @see SecureMessageManager::resumeSession
+ *
+ */
+typedef enum session_resume_state_t
+{
+    /// session not established by resumption
+    SESSION_RESUME_NONE,
+    /// own resume request outstanding
+    SESSION_RESUME_PENDING,
+    /// peer resumes towards this instance at the same time, and won the tie
+    SESSION_RESUME_YIELDED,
+    /// session resumed
+    SESSION_RESUME_DONE,
+} session_resume_state_t;
 
 /**
  * @brief Cryptographic and integrity context per target recipient.
@@ -223,16 +247,40 @@ typedef struct key_exchange_context_t
     SecureMessageManager *parent_manager;
     /// output queue for prepared messages pending successfull attesation handshake, should be empty once initially depleted
     std::vector<secure_message_context_t *> outputqueue;
-    /// input message map for preserving ordering according to message session_id, key-ed on session id.
-    std::map<uint64_t, secure_message_context_t *> inputqueue;
+    /// early input messages held for preserving ordering according to message session count.
+    ReorderWindow inputqueue;
     ///callback specified for handling output queue once attestation handshake is done.
     async_cb_t key_exchange_session_done;
     /// remote attestation context used during handshake
     sgx_ra_context_t ra_context;
+    /// session_resume_state_t, sessions resumed from the session key cache are not overwritten by later attestations.
+    uint32_t resume_state;
+    /// own nonce while a resume request is pending, the peer nonce once resumed.
+    uint8_t resume_nonce[SESSION_RESUME_NONCE_SIZE];
+    /// nonce of the challenge issued to a peer requesting resumption, valid while resume_challenged is set
+    uint8_t resume_challenge[SESSION_RESUME_NONCE_SIZE];
+    /// set while a challenge is unanswered, a challenge authenticates a single resumption
+    uint32_t resume_challenged;
+    /// waits for the group attestation of this thread rather than attesting on its own, @see SecureMessageManager::joinGroupAttestation
+    uint32_t group_pending;
+    /// key epoch, advanced once the nonce passes the rekey threshold, @see SecureMessageManager::rekey
+    uint32_t key_epoch;
+    /// key of the previous epoch, kept to decrypt messages sent before the switch
+    sgx_ec_key_128bit_t prev_key;
+    /// nonce of the previous epoch
+    uint32_t prev_session_id;
 } key_exchange_context_t;
 
-/// max decrypted message size, used as temporary buffer in trusted memory to decrypt message into.
-#define SGX_RECIEVEBUFSIZE 1024 * 1024
+/// offset of the ciphertext within secure_message_t, inbound messages are decrypted in place at this offset.
+#define SMM_CIPHERTEXT_OFFSET offsetof(secure_message_t, message_aes_gcm_data.payload)
+/// offset of the trusted copy of an inbound message within its allocation, so the header placed in front of the decrypted payload is 8 byte aligned.
+#define SMM_DECRYPT_ALIGN_SHIFT ((8 - (SMM_CIPHERTEXT_OFFSET % 8)) % 8)
+/// nonces per key epoch, far below UINT32_MAX so messages of the previous epoch still decrypt after a switch
+#define SMM_REKEY_THRESHOLD (1U << 30)
+/// offset of the key epoch in the GCM IV of a secure message, following the nonce
+#define SMM_IV_EPOCH_OFFSET sizeof(uint32_t)
+/// messages of an output queue encrypted per call to ICryptoImplementation::encryptBatch, bounds message pool buffers held before send
+#define SMM_ENCRYPT_BATCH_SIZE 16
 
 /**
  * @brief class definition for SMM
@@ -244,6 +292,9 @@ class SecureMessageManager : public IMessageManager
 #ifdef TEST_DEBUG
 #include <gtest/gtest_prod.h>
     FRIEND_TEST(threadsafe_messagemanager, secure_test_many_send_recieve);
+    FRIEND_TEST(threadsafe_messagemanager, secure_rekey);
+    FRIEND_TEST(threadsafe_messagemanager, secure_flush_batch);
+    FRIEND_TEST(threadsafe_messagemanager, secure_resume_replay);
 #endif
     /// friend class definitions for attestation call flows, which require internals of SMM to work.
     friend class AttestationClient;
@@ -256,7 +307,6 @@ private:
     /// AMM api reference, used to process incomming and outgoing messages, handle all callback deliveries.
     IAsyncMessageManager *messageService;
 
-    char sgx_recieve_buffer[SGX_RECIEVEBUFSIZE];
     /// own uniqe diggi instance id
     aid_t self;
     /// own thread id, each SMM and AMM is associated with a unique id. AMM guarantees delivery to same thread.
@@ -269,17 +319,55 @@ private:
     bool started_attest;
     /// Bool specifying if SMM is in trusted root mode, only usable by trusted root. field specified in configuration.json, built into binary to disallow modification.
     bool trusted_root_func;
+    /// inbound flows are spread across threads by the AMM, so remotely initiated flows keep the lane of the remote thread. @see AsyncMessageManager::inboundThread
+    bool flow_routing;
+    /// shared context through which replies to timed out or cancelled flows pass the ordering logic, before being dropped
+    secure_message_context_t *late_reply_ctx;
+    /// streaming channels of this thread, chunks are sent and recieved through this SMM
+    StreamChannelManager *streams;
+    /// attested keys of peers persisted across restarts, nullptr unless "session-key-cache" is configured.
+    SessionKeyCache *session_keys;
+    /// "attest-at-startup" configured, sessions towards all peers are established before application traffic. @see SecureMessageManager::connectAll
+    bool attest_at_startup;
+    /// nonces per key epoch, "rekey-threshold" in func configuration, SMM_REKEY_THRESHOLD by default
+    uint32_t rekey_threshold;
+    /// free copies of early messages, reused across sessions of this thread
+    std::vector<msg_t *> reorder_copies;
+    reorder_stat_t reorder_stats;
 
     void dh_key_exchange_initiator(key_exchange_context_t *kec);
+    void startGroupAttestation();
+    bool joinGroupAttestation(key_exchange_context_t *kec);
+    void completeGroupAttestation();
+    void connectAll();
+    static void ConnectAllHandler(void *ptr, int status);
+    bool resumeSession(key_exchange_context_t *kec);
+    uint32_t acceptResume(aid_t initiator, aid_t responder, const session_resume_t *request, session_resume_t *answer);
+    bool acceptConfirm(aid_t initiator, aid_t responder, const session_resume_t *confirm);
+    void completeResume(key_exchange_context_t *kec);
+    msg_t *copyEarlyMessage(msg_t *msg);
+    void releaseEarlyMessage(msg_t *copy);
+    void releaseHeld(key_exchange_context_t *kec);
+    static void SessionResumeHandler(void *ptr, int status);
+    static void SessionResumeResponseHandler(void *ptr, int status);
 
     static void RecieveMessageHandlerAsync(void *info, int status);
     void decryptAndDeliver(msg_async_response_t *ctxmsg, secure_message_context_t *ctx, bool typed);
     static void SessionRequestHandler(void *ptr, int status);
     static void SendMessageAsyncInternal(void *ptr, int status);
+    static msg_t *prepareSend(secure_message_context_t *ctx, crypto_batch_item_t *item);
+    static void dispatchSend(secure_message_context_t *ctx, msg_t *send);
+    static void flushOutputQueue(key_exchange_context_t *kec);
     static void RecieveMessageHandlerInternal(void *info, int status);
+    static void LateReplyHandler(void *info, int status);
     void registerTypeCallback(async_cb_t cb, msg_type_t type, void *ctx);
+    static void deriveEpochKey(const sgx_ec_key_128bit_t *current, uint32_t epoch, sgx_ec_key_128bit_t *next);
+    static void rekey(key_exchange_context_t *kec, const sgx_ec_key_128bit_t *next);
+    static void resetKeyEpoch(key_exchange_context_t *kec);
+    static void retireKey(key_exchange_context_t *kec, const sgx_ec_key_128bit_t *key);
     static void encrypt(key_exchange_context_t *kec, uint8_t *inp_buff, size_t inp_buff_len, secure_message_t *req_message);
-    static void decrypt(secure_message_t *resp_message, key_exchange_context_t *kec, char *out_buff, size_t *out_buff_len);
+    static void prepareEncrypt(key_exchange_context_t *kec, uint8_t *inp_buff, size_t inp_buff_len, secure_message_t *req_message, crypto_batch_item_t *item);
+    static void decrypt(secure_message_t *resp_message, key_exchange_context_t *kec, uint8_t *out_buff, size_t *out_buff_len);
 
 public:
     /// map holding aid to crypto and integrity context per target recipient of outbound messages
@@ -305,8 +393,15 @@ public:
     msg_t *allocateMessage(msg_t *msg, size_t payload_size);
     void endAsync(msg_t *msg);
     void Send(msg_t *msg, async_cb_t cb, void *ptr);
+    void Send(msg_t *msg, async_cb_t cb, void *ptr, uint64_t timeout_us);
+    uint64_t openStream(std::string destination, msg_delivery_t delivery);
+    uint64_t openStream(aid_t destination, msg_delivery_t delivery);
+    bool writeStream(uint64_t stream, const uint8_t *buf, size_t size);
+    void closeStream(uint64_t stream);
+    void registerStreamCallback(async_cb_t cb, void *ctx);
     std::map<std::string, aid_t> getfuncNames();
     void StopRecording();
+    reorder_stat_t reorderStats();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+/**
+ * @file SessionKeyCache.h
+ * @brief sealed cache of attested session keys, allowing a restarted instance to resume sessions without a new attestation round.
+ * @see SecureMessageManager::resumeSession
+ * @version 0.1
+ *
+ */
+#ifndef SESSION_KEY_CACHE_H
+#define SESSION_KEY_CACHE_H
+#include <map>
+#include <string>
+#include "datatypes.h"
+#include "Seal.h"
+#include "sgx_ecp_types.h"
+
+/// default lifetime of a cached key, counted from the attestation which established it
+#define SESSION_KEY_CACHE_DEFAULT_TTL_SEC (uint64_t)3600
+/// identifies a cache file, and its layout version
+#define SESSION_KEY_CACHE_MAGIC (uint32_t)0x534b4332
+/// size of resume nonces
+#define SESSION_RESUME_NONCE_SIZE 16
+/// size of HMAC-SHA256 tags in resume messages
+#define SESSION_RESUME_MAC_SIZE 32
+
+/**
+ * @brief cached key of a single peer
+ *
+ */
+typedef struct session_key_cache_entry_t
+{
+    aid_t other_id;
+    /// attested key shared with peer
+    sgx_ec_key_128bit_t key;
+    /// wall clock expiry in seconds since epoch
+    uint64_t expires;
+} session_key_cache_entry_t;
+
+/**
+ * @brief plaintext layout of a cache file, sealed as a single block.
+ *
+ */
+typedef struct session_key_cache_header_t
+{
+    uint32_t magic;
+    uint32_t count;
+    /// latest clock reading of the enclave which sealed the cache, @see SessionKeyCache::current
+    uint64_t clock;
+} session_key_cache_header_t;
+
+/// entries which fit in a single sealed block
+#define SESSION_KEY_CACHE_MAX_ENTRIES ((SPACE_PER_BLOCK - sizeof(session_key_cache_header_t)) / sizeof(session_key_cache_entry_t))
+
+typedef enum session_resume_status_t
+{
+    /// initiator requests resumption with a fresh nonce, authenticated with the cached key
+    SESSION_RESUME_REQUEST,
+    /// responder challenges the initiator with a fresh nonce, authenticated with the cached key
+    SESSION_RESUME_CHALLENGE,
+    /// responder has no valid key, initiator falls back to attestation
+    SESSION_RESUME_NACK,
+    /// responder is resuming towards the initiator itself, and wins the tie
+    SESSION_RESUME_BUSY,
+    /// initiator answers the challenge, proves possession of the derived key
+    SESSION_RESUME_CONFIRM,
+} session_resume_status_t;
+
+/**
+ * @brief payload of DIGGI_SESSION_RESUME_TYPE messages, sent in cleartext.
+ *
+ */
+typedef struct session_resume_t
+{
+    uint32_t status;
+    uint8_t nonce_initiator[SESSION_RESUME_NONCE_SIZE];
+    uint8_t nonce_responder[SESSION_RESUME_NONCE_SIZE];
+    uint8_t mac[SESSION_RESUME_MAC_SIZE];
+} session_resume_t;
+
+/**
+ * @brief Cache of keys established by attestation, keyed on peer identity.
+ * Persisted to the host file system sealed to the enclave, so only an enclave of the same signer may restore it.
+ * Keys are never used directly after a restart, as message nonces restart from 0.
+ * Instead resumed sessions use a key derived from the cached key and fresh nonces from both peers, @see deriveResumeKey.
+ * Entries expire a fixed time after the attestation which established them, resumption does not extend their lifetime.
+ * @warning expiry relies on the host clock, as enclaves have no trusted wall clock.
+ * The cache never observes the clock going backwards, so an untrusted host can not revive expired entries by rolling it back,
+ * but a host which holds the clock back from the start keeps entries alive past their lifetime.
+ */
+class SessionKeyCache
+{
+    std::string path;
+    uint64_t ttl_sec;
+    ISealingAlgorithm *sealer;
+    std::map<uint64_t, session_key_cache_entry_t> entries;
+    /// latest clock reading observed, restored from the cache file
+    uint64_t clock_floor;
+    uint64_t current();
+
+protected:
+    virtual uint64_t now();
+
+public:
+    SessionKeyCache(std::string path, uint64_t ttl_sec, ISealingAlgorithm *sealer);
+    virtual ~SessionKeyCache();
+    size_t load();
+    bool persist();
+    void put(aid_t other, const sgx_ec_key_128bit_t *key);
+    bool get(aid_t other, sgx_ec_key_128bit_t *key);
+    void erase(aid_t other);
+    size_t size();
+
+    static void deriveResumeKey(
+        const sgx_ec_key_128bit_t *base,
+        aid_t initiator,
+        aid_t responder,
+        const session_resume_t *resume,
+        sgx_ec_key_128bit_t *derived);
+    static void resumeMac(
+        const sgx_ec_key_128bit_t *key,
+        aid_t initiator,
+        aid_t responder,
+        const session_resume_t *resume,
+        uint8_t *mac);
+    static bool verifyResumeMac(
+        const sgx_ec_key_128bit_t *key,
+        aid_t initiator,
+        aid_t responder,
+        const session_resume_t *resume);
+};
+
+#ifndef DIGGI_ENCLAVE
+/*
+    File access of the cache, only availible in untrusted memory. Enclaves reach it through ocall_session_cache_read/write.
+*/
+int session_cache_file_read(const char *path, uint8_t *buf, size_t size);
+int session_cache_file_write(const char *path, uint8_t *buf, size_t size);
+#endif
+
+#endif
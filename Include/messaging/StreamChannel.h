@@ -0,0 +1,142 @@
+/**
+ * @file StreamChannel.h
+ * @brief header file for StreamChannelManager, transferring payloads larger than a single message object as an ordered stream of chunks.
+ * @version 0.1
+ *
+ */
+#ifndef STREAM_CHANNEL_H
+#define STREAM_CHANNEL_H
+#include <map>
+#include <string>
+#include <utility>
+#include "datatypes.h"
+#include "misc.h"
+#include "DiggiAssert.h"
+#include "Logging.h"
+#include "threading/IThreadPool.h"
+#include "messaging/IMessageManager.h"
+
+/// payload bytes carried per chunk. Chunks are sized to the 64KB pool class, leaving headroom for message, encryption and chunk headers
+#define STREAM_CHUNK_PAYLOAD (DIGGI_MEM_CLASS_2_SIZE - 1024)
+/// chunks a sender may have in flight without acknowledgement, before write blocks
+#define STREAM_WINDOW_CHUNKS 16
+/// chunks consumed by the reciever between acknowledgements
+#define STREAM_ACK_INTERVAL (STREAM_WINDOW_CHUNKS / 2)
+
+/**
+ * @brief operation carried by a message of type DIGGI_STREAM_MESSAGE_TYPE
+ *
+ */
+typedef enum stream_op_t
+{
+    STREAM_OPEN,
+    STREAM_DATA,
+    STREAM_CLOSE,
+    STREAM_ACK
+} stream_op_t;
+
+/**
+ * @brief header prefixed to the payload of each stream message
+ *
+ */
+typedef struct stream_header_t
+{
+    ///stream_op_t
+    uint32_t op;
+    uint32_t pad;
+    ///stream identifier, unique per sending thread
+    uint64_t stream;
+    ///sequence number of chunk, or count of chunks consumed for acknowledgements
+    uint64_t seq;
+} stream_header_t;
+
+/**
+ * @brief chunk delivered to a stream callback, in the order it was written.
+ * data is only valid for the duration of the callback, and must be copied if retained.
+ */
+typedef struct stream_chunk_t
+{
+    ///stream identifier, unique per source
+    uint64_t stream;
+    ///sending instance
+    aid_t source;
+    ///offset of data within stream
+    uint64_t offset;
+    const uint8_t *data;
+    size_t size;
+    ///set on the final callback of a stream, which carries no data
+    bool last;
+    ///context pointer given at registration
+    void *context;
+} stream_chunk_t;
+
+/**
+ * @brief sending side state of a stream
+ *
+ */
+typedef struct stream_out_t
+{
+    aid_t destination;
+    msg_delivery_t delivery;
+    ///next chunk sequence number
+    uint64_t next_seq;
+    ///chunks acknowledged by reciever
+    uint64_t acked;
+} stream_out_t;
+
+/**
+ * @brief recieving side state of a stream
+ *
+ */
+typedef struct stream_in_t
+{
+    ///expected chunk sequence number
+    uint64_t next_seq;
+    ///bytes delivered so far
+    uint64_t offset;
+    ///chunks consumed since last acknowledgement
+    uint64_t unacked;
+} stream_in_t;
+
+/**
+ * @brief Streaming channels between instances, layered on a per thread message manager.
+ * Written data is split into chunks of STREAM_CHUNK_PAYLOAD, each sent as a regular message through the message manager as it is produced,
+ * so chunks are encrypted and sent while later chunks are still being written.
+ * At most STREAM_WINDOW_CHUNKS unacknowledged chunks are in flight per stream, a writer exceeding the window yields until the reciever acknowledges.
+ * Message managers deliver messages from a peer in order, so chunks surface on the reciever in the order written.
+ * Not thread safe, one instance per thread, and streams are used on the thread which opened them.
+ */
+class StreamChannelManager
+{
+    IMessageManager *mngr;
+    IThreadPool *threadpool;
+    ILog *log;
+    ///last stream identifier handed out
+    uint64_t stream_counter;
+    ///set once the stream message type is registered with the message manager
+    bool registered;
+    ///reciever callback for chunks, nullptr if this thread does not accept streams
+    async_cb_t chunk_cb;
+    void *chunk_ctx;
+    ///open outbound streams, indexed on stream id
+    std::map<uint64_t, stream_out_t> outbound;
+    ///open inbound streams, indexed on source and stream id
+    std::map<std::pair<uint64_t, uint64_t>, stream_in_t> inbound;
+
+    static void stream_message_cb(void *ptr, int status);
+    void registerHandler();
+    void sendControl(aid_t destination, msg_delivery_t delivery, stream_op_t op, uint64_t stream, uint64_t seq);
+    void handleChunk(msg_t *msg, stream_header_t *header);
+    void handleAck(msg_t *msg, stream_header_t *header);
+
+public:
+    StreamChannelManager(IMessageManager *mngr, IThreadPool *threadpool, ILog *log);
+    ~StreamChannelManager();
+    uint64_t openStream(aid_t destination, msg_delivery_t delivery);
+    bool writeStream(uint64_t stream, const uint8_t *buf, size_t size);
+    void closeStream(uint64_t stream);
+    void registerStreamCallback(async_cb_t cb, void *ctx);
+    size_t inFlight(uint64_t stream);
+};
+
+#endif
@@ -36,6 +36,9 @@ class ThreadSafeMessageManager : public IMessageManager, public IThreadSafeMM
 #include <gtest/gtest_prod.h>
     FRIEND_TEST(threadsafe_messagemanager, secure_test_many_send_recieve);
     FRIEND_TEST(threadsafe_messagemanager, test_many_send_recieve);
+    FRIEND_TEST(threadsafe_messagemanager, secure_rekey);
+    FRIEND_TEST(threadsafe_messagemanager, secure_flush_batch);
+    FRIEND_TEST(threadsafe_messagemanager, secure_resume_replay);
 #endif
     ///Array holding all SMMs indexed on thread id
     std::vector<IMessageManager *> perthreadMngr;
@@ -77,7 +80,7 @@ public:
                                             std::map<std::string, aid_t> nameservice_updates,
                                             std::vector<name_service_update_t> outbound_queues,
                                             size_t base_thread,
-                                            lf_buffer_t *global_mem_buf,
+                                            msg_pool_t *global_mem_buf,
                                             bool trusted_root_func_role,
                                             IDynamicEnclaveMeasurement *mrmnt,
                                             bool record_func,
@@ -185,6 +188,12 @@ public:
     void registerTypeCallback(async_cb_t cb, msg_type_t type, void *ctx);
     void endAsync(msg_t *msg);
     void Send(msg_t *msg, async_cb_t cb, void *cb_context);
+    void Send(msg_t *msg, async_cb_t cb, void *cb_context, uint64_t timeout_us);
+    uint64_t openStream(std::string destination, msg_delivery_t delivery);
+    uint64_t openStream(aid_t destination, msg_delivery_t delivery);
+    bool writeStream(uint64_t stream, const uint8_t *buf, size_t size);
+    void closeStream(uint64_t stream);
+    void registerStreamCallback(async_cb_t cb, void *ctx);
     msg_t *allocateMessage(
         std::string destination,
         size_t payload_size,
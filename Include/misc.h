@@ -15,6 +15,21 @@
 #define MAX_DIGGI_MEM_SIZE  1024 * 1024 /*1MB*/
 #define MAX_DIGGI_MEM_ITEMS (1024 * 1024 * 1024) / (MAX_DIGGI_MEM_SIZE)
 
+/*
+    Size classes of the global message object pool.
+    Counts must be a power of 2, as each class is backed by a lockfree queue.
+    Largest class must be MAX_DIGGI_MEM_SIZE.
+*/
+#define DIGGI_MEM_CLASS_COUNT 4
+#define DIGGI_MEM_CLASS_0_SIZE 256
+#define DIGGI_MEM_CLASS_0_ITEMS (1024 * 64)
+#define DIGGI_MEM_CLASS_1_SIZE (1024 * 4)
+#define DIGGI_MEM_CLASS_1_ITEMS (1024 * 8)
+#define DIGGI_MEM_CLASS_2_SIZE (1024 * 64)
+#define DIGGI_MEM_CLASS_2_ITEMS 512
+#define DIGGI_MEM_CLASS_3_SIZE MAX_DIGGI_MEM_SIZE
+#define DIGGI_MEM_CLASS_3_ITEMS 64
+
 //TODO (anders): separate threads into special file.
 
 #define DIGGI_RUNTIME_THREAD_COUNT 1
@@ -37,9 +52,29 @@
 
 /*
 	If all 8 threads nests to max,
-	this is expected pthread state size
+	this is expected pthread state size.
+	Scaled by virtual threads per physical thread, as each virtual thread nests independently.
 */
-#define MAX_VIRTUAL_THREADS MAX_THREADS_NESTED * 8
+#define MAX_VIRTUAL_THREADS_PER_THREAD 64
+#define MAX_VIRTUAL_THREADS MAX_THREADS_NESTED * 8 * MAX_VIRTUAL_THREADS_PER_THREAD
+
+/**
+ * @brief global message object pool, separated into size classes.
+ * Each class is a contiguous slab of equally sized objects, with a lockfree free list holding the unused objects.
+ * Objects are returned to the class whose slab contains the object address.
+ * Allocated in untrusted memory, shared by all instances cohosted on the same untrusted runtime.
+ */
+typedef struct msg_pool_t
+{
+    /// object size of each class, ascending
+    size_t object_size[DIGGI_MEM_CLASS_COUNT];
+    /// object count of each class
+    size_t object_count[DIGGI_MEM_CLASS_COUNT];
+    /// contiguous backing memory of each class
+    uint8_t *slab[DIGGI_MEM_CLASS_COUNT];
+    /// free list of each class
+    lf_buffer_t *free_list[DIGGI_MEM_CLASS_COUNT];
+} msg_pool_t;
 
 static int thread_local __thr_id[[gnu::unused]] = -1;
 static size_t thread_local __pthr_id[[gnu::unused]] = 0;
@@ -82,6 +117,16 @@ void delete_memory_buffer(lf_buffer_t *buf, size_t pool_size);
 
 lf_buffer_t *provision_memory_buffer(size_t threads, size_t pool_size, size_t object_size);
 
+msg_pool_t *provision_message_pool(size_t threads);
+
+void delete_message_pool(msg_pool_t *pool);
+
+void *msg_pool_alloc(msg_pool_t *pool, size_t size, size_t requesting_thread);
+
+void msg_pool_free(msg_pool_t *pool, void *obj, size_t requesting_thread);
+
+size_t msg_pool_object_size(msg_pool_t *pool, void *obj);
+
 size_t roundUp_r(size_t numToRound, size_t multiple);
 
 
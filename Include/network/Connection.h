@@ -19,6 +19,8 @@
 using namespace std;
 
 #define MAX_BUFFERED_LENGTH 128 * 1024
+///interval between polls of a listening socket without pending connections
+#define CONNECTION_ACCEPT_POLL_USEC 100
 
 
 
@@ -11,6 +11,8 @@ class NetworkManager : public INetworkManager {
     private:
         IDiggiAPI *aDiggiAPI;
         ISealingAlgorithm *aSealer;
+        /// response deadline of requests in microseconds, "network-timeout-usec" in func configuration. 0 waits indefinitely
+        uint64_t request_timeout_us;
 
     public:
         NetworkManager(IDiggiAPI *context, ISealingAlgorithm *seal);
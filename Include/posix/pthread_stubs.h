@@ -32,6 +32,14 @@ int		i_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
 int		i_pthread_cond_broadcast(pthread_cond_t *cond);
 int		i_pthread_cond_signal(pthread_cond_t *cond);
 int		i_pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+int		i_pthread_cond_destroy(pthread_cond_t *cond);
+int		i_pthread_rwlock_init(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr);
+int		i_pthread_rwlock_destroy(pthread_rwlock_t *rwlock);
+int		i_pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+int		i_pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock);
+int		i_pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+int		i_pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock);
+int		i_pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
 int     i_pthread_self(void);
 
 #endif
@@ -133,6 +133,14 @@ extern "C" {
 #define pthread_cond_broadcast				i_pthread_cond_broadcast
 #define pthread_cond_signal					i_pthread_cond_signal
 #define pthread_cond_init					i_pthread_cond_init
+#define pthread_cond_destroy				i_pthread_cond_destroy
+#define pthread_rwlock_init					i_pthread_rwlock_init
+#define pthread_rwlock_destroy				i_pthread_rwlock_destroy
+#define pthread_rwlock_rdlock				i_pthread_rwlock_rdlock
+#define pthread_rwlock_tryrdlock			i_pthread_rwlock_tryrdlock
+#define pthread_rwlock_wrlock				i_pthread_rwlock_wrlock
+#define pthread_rwlock_trywrlock			i_pthread_rwlock_trywrlock
+#define pthread_rwlock_unlock				i_pthread_rwlock_unlock
 #define pthread_self						i_pthread_self
 
 #endif
@@ -33,6 +33,7 @@
 #include "ext_com.h"
 #include "messaging/ThreadSafeMessageManager.h"
 #include "messaging/SecureMessageManager.h"
+#include "messaging/MbedtlsCrypto.h"
 #include "messaging/IIASAPI.h"
 #define MAX_PATH FILENAME_MAX
 /*4GB*/
@@ -4,6 +4,7 @@
 #include "posix/syscall_def.h"
 #include "posix/stdio_stubs.h"
 #include "messaging/SecureMessageManager.h"
+#include "messaging/MbedtlsCrypto.h"
 #include <stdarg.h>
 #include <stdio.h>      /* vsnprintf */
 #include "enclave.h"
@@ -26,7 +27,7 @@ void enclave_thread_entry_function();
 void client(aid_t self,
             sgx_enclave_id_t id,
             size_t base_thread,
-            lf_buffer_t *global_memory_buffer,
+            msg_pool_t *global_memory_buffer,
 			lf_buffer_t *input_q,
 			lf_buffer_t *output_q,
 			name_service_update_t * mapdata,
@@ -23,6 +23,12 @@ void ocall_print_string_diggi(const char *name, const char *str, int threadid, u
 int ocall_print_string(const char *str);
 
 void ocall_sleep(uint64_t usec);
+void ocall_doorbell_wait(void *lf, int seq, uint64_t usec);
+void ocall_doorbell_ring(void *lf);
+void ocall_monotonic_usec(uint64_t *usec);
+void ocall_realtime_sec(uint64_t *sec);
+int ocall_session_cache_read(const char *path, uint8_t *buf, size_t size);
+int ocall_session_cache_write(const char *path, uint8_t *buf, size_t size);
 void ocall_sig_assert(void);
 
 void ocall_telemetry_capture(const char* tag);
@@ -54,11 +54,11 @@ public:
 	virtual int execute(const char* tmpl, ...) = 0;
     virtual int executeBlob(const char *query, char *blob, size_t blob_size) = 0;
 	virtual int executemany(std::vector<std::string> statements) = 0;
-	virtual void commit() = 0;
+	virtual int commit() = 0;
 	virtual void freeDBResults() = 0;
 	virtual DBResult fetchone() = 0;
 	virtual std::vector<DBResult> fetchall() = 0;
-	virtual void rollback() = 0;
+	virtual int rollback() = 0;
 
 };
 /**
@@ -81,8 +81,12 @@ class DBClient : public IDBClient {
 	bool transaction_active;
     /// specifying if current series of queries have prepended begin transaction statement.
 	bool appended_begin_statement;
+    /// response deadline per request in microseconds, 0 waits indefinitely
+    uint64_t request_timeout_us;
+    /// requests whose response deadline passed, since last execute invocation
+    size_t timed_out_requests;
     
-	void get_callback_msg(size_t wait_for);
+	bool get_callback_msg(size_t wait_for);
 public:
 /**
  * @brief Construct a new DBClient object
@@ -90,27 +94,31 @@ public:
  * @param mngr 
  * @param threadPool 
  * @param opt 
+ * @param request_timeout_us response deadline per request, requests which time out fail with -1. 0 waits indefinitely, @see DBClient::requestTimeout
  */
-	DBClient(IMessageManager *mngr, IThreadPool *threadPool, msg_delivery_t opt):
+	DBClient(IMessageManager *mngr, IThreadPool *threadPool, msg_delivery_t opt, uint64_t request_timeout_us = 0):
 		mngr(mngr), 
         deliveryopt(opt),
 		connection_info(""), 
 		threadPool(threadPool),
 		transaction_active(false),
-		appended_begin_statement(false) {
+		appended_begin_statement(false),
+		request_timeout_us(request_timeout_us),
+		timed_out_requests(0) {
 	
 	}
 	static void set_callback_msg(void * ptr, int status);
+	static uint64_t requestTimeout(json_node &conf);
 	void beginTransaction();
 	void connect(std::string inf);
 	int execute(const char *statement, ...);
     int executeBlob(const char *query, char *blob, size_t blob_size);
 	int executemany(std::vector<std::string> statements);
-	void commit();
+	int commit();
 	void freeDBResults();
 	DBResult fetchone();
 	std::vector<DBResult> fetchall();
-	void rollback();
+	int rollback();
 	~DBClient() {
 		freeDBResults();
 	}
@@ -60,6 +60,8 @@ class StorageManager : public IStorageManager
     size_t monotonic_time_update;
     /// next virtual inode, monotonically increasing number, used for in memory mode.
     size_t next_virtual_inode;
+    /// response deadline of requests in microseconds, "storage-timeout-usec" in func configuration. 0 waits indefinitely
+    uint64_t request_timeout_us;
 
 public:
     StorageManager(IDiggiAPI *context, ISealingAlgorithm *seal);
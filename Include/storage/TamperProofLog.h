@@ -3,6 +3,8 @@
 #include "runtime/DiggiAPI.h"
 #include "AsyncContext.h"
 #include "messaging/Pack.h"
+///interval between attempts to use the log before storage infrastructure is ready
+#define TAMPERPROOF_LOG_RETRY_USEC 100
 typedef enum LogMode
 {
     READ_LOG,
@@ -35,6 +35,11 @@ void telemetry_init(telemetry_t *sngl);
 void telemetry_start(telemetry_t * tel);
 void telemetry_start();
 void telemetry_write();
+///writers invoked on telemetry_write(), for components dumping their own statistics next to telemetry.log
+#define TELEMETRY_MAX_WRITERS 16
+typedef void (*telemetry_writer_t)(void *ctx);
+void telemetry_register_writer(telemetry_writer_t writer, void *ctx);
+void telemetry_unregister_writer(void *ctx);
 void telemetry_capture_(telemetry_t * tel, const char* tag);
 #else
 #include "enclave_t.h"
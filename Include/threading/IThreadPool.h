@@ -4,6 +4,7 @@
 #include "DiggiAssert.h"
 #include "datatypes.h"
 #include "posix/stdio_stubs.h"
+#include "lockfree_rb_q.h"
 
 #define THREAD_POOL_SIZE 4096 * 2 * 2
 
@@ -13,13 +14,24 @@ class IThreadPool {
 public:
 	IThreadPool() {}
 	virtual void Yield() = 0;
+	virtual void Park(volatile int *wakeup) = 0;
 	virtual int currentThreadId() = 0;
 	virtual size_t currentVThreadId() = 0;
 	virtual void Schedule(async_cb_t cb, void *args, const char *label) = 0;
 	virtual void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label) = 0;
+	virtual void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label) = 0;
+	virtual uint64_t SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label) = 0;
+	virtual void CancelPeriodic(uint64_t timer_id) = 0;
 	virtual size_t physicalThreadCount() = 0;
 	virtual void Stop() = 0;
     virtual bool Alive() = 0;
+	/*
+		block an idle thread on a queue doorbell, implementations may return early for other work on the thread
+	*/
+	virtual void ParkOnQueue(lf_buffer_t *queue, uint64_t max_usec)
+	{
+		lf_park(queue, max_usec);
+	}
 	virtual ~IThreadPool() {};
 };
 
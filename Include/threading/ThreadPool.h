@@ -15,6 +15,8 @@
 #include <unistd.h>
 #include "lockfree_rb_q.h"
 #include "threading/setjmp.h"
+#include "threading/TimerWheel.h"
+#include "AsyncContext.h"
 
 using namespace std;
 
@@ -36,6 +38,98 @@ typedef enum threading_mode_t
 	REGULAR_MODE
 } threading_mode_t;
 
+///virtual threads per physical thread unless configured otherwise, see "virtual-threads" func configuration
+#define DEFAULT_VIRTUAL_THREADS 1
+/*
+    Debug Requires more stack space for symbols
+    howver, release binary enclave must be as small as possible, 
+    so we set it accordingly
+    Overridden by "virtual-thread-stack-size" func configuration.
+*/
+#ifdef RELEASE
+#define DEFAULT_VIRTUAL_THREAD_STACK_SIZE (1 << 16)
+#else
+#define DEFAULT_VIRTUAL_THREAD_STACK_SIZE (1 << 17)
+#endif
+///stack reserved for each enclave thread, must match StackMaxSize in enclave/enclave.config.xml
+#define DIGGI_ENCLAVE_STACK_SIZE 0xf0000
+
+///in enclave mode, clock is read through an ocall, so idle passes of the scheduler loop only poll it at this interval
+#define TIMER_CLOCK_POLL_INTERVAL 64
+///upper bound on how long an idle thread with armed timers blocks before polling its queues again
+#define TIMER_IDLE_PARK_MAX_USEC 1000
+
+///tasks a virtual thread executes per scheduler loop pass unless configured otherwise, see "scheduler-batch" func configuration
+#define DEFAULT_SCHEDULER_BATCH 1
+
+///async_work_t objects preallocated for each physical thread, must be power of 2
+#define WORK_ITEM_CACHE_SIZE 1024
+
+/**
+ * @brief per physical thread scheduling statistics, padded to avoid false sharing between threads.
+ * 
+ */
+typedef struct thread_stat_t{
+	///tasks this thread took from siblings
+	volatile uint64_t steals;
+	///async_work_t allocations served from this threads work item cache
+	volatile uint64_t pooled_allocs;
+	///async_work_t allocations which fell back to the heap
+	volatile uint64_t heap_allocs;
+	uint8_t pad[DCACHE1_LINESIZE - (3 * sizeof(uint64_t))];
+}thread_stat_t;
+
+///distinct labels profiled per physical thread, must be power of 2. Further labels are accounted to a shared overflow entry.
+#define SCHED_PROFILE_LABELS 256
+///file profiles of untrusted instances are appended to on telemetry_write() and when they shut down, next to telemetry.log
+#define SCHED_PROFILE_LOG "scheduler_profile.csv"
+
+/**
+ * @brief per label scheduling profile of a physical thread.
+ * Times are in units of the profiling clock, see ThreadPool::profileClock().
+ */
+typedef struct label_stat_t{
+	///label of profiled callbacks, entry is unused while null
+	const char *volatile label;
+	///callbacks executed
+	volatile uint64_t count;
+	///total time from start to return of callbacks
+	volatile uint64_t run_total;
+	///longest single callback
+	volatile uint64_t run_max;
+	///total time callbacks spent queued, from Schedule()/ScheduleOn() to start
+	volatile uint64_t queue_total;
+	///longest time a single callback spent queued
+	volatile uint64_t queue_max;
+}label_stat_t;
+
+/**
+ * @brief per physical thread profile, open addressed on label pointer.
+ * Only written by the owner thread, so a concurrent dump may observe an entry mid update.
+ */
+typedef struct sched_profile_t{
+	label_stat_t stats[SCHED_PROFILE_LABELS];
+	///callbacks whose label did not fit in stats
+	label_stat_t overflow;
+}sched_profile_t;
+
+/**
+ * @brief per physical thread cache of async_work_t objects.
+ * Items are owned by the thread whose slab they originate from, recorded in async_work_t::thread_id.
+ * The owner allocates and frees from the local stack without synchronization,
+ * items consumed by other threads (ScheduleOn, work stealing) are handed back through the returns queue.
+ */
+typedef struct work_cache_t{
+	///contiguous backing storage for WORK_ITEM_CACHE_SIZE items
+	async_work_t *slab;
+	///free items, only accessed by owner thread
+	async_work_t **stack;
+	///count of items on stack
+	size_t count;
+	///items freed by other threads, consumed by owner
+	lf_buffer_t *returns;
+}work_cache_t;
+
 ///faking STL threads for Constructor of threadpool for enclave instances, not invoked
 #ifdef DIGGI_ENCLAVE
 /*
@@ -74,6 +168,36 @@ class ThreadPool : public IThreadPool
 	volatile size_t stop;
     ///target request FIFO queues used for scheduling execution callbacks onto threadpool
 	std::vector<lf_buffer_t *> target_queue;
+    ///per thread FIFO queues for unpinned callbacks, which idle siblings may steal from. Empty unless work stealing is enabled.
+	std::vector<lf_buffer_t *> steal_queue;
+    ///per thread scheduling statistics
+	std::vector<thread_stat_t> thread_stats;
+    ///per thread async_work_t caches, indexed on physical thread id
+	std::vector<work_cache_t> work_cache;
+    ///per thread timer wheels for delayed and periodic callbacks, indexed on physical thread id
+	std::vector<TimerWheel *> timer_wheels;
+    ///per thread queue the thread is parked on through ParkOnQueue(), nullptr if not parked. Rung when work is scheduled onto the thread.
+	std::vector<lf_buffer_t *> parked_queue;
+    ///next periodic timer sequence number, shared by all threads
+	volatile uint64_t timer_seq;
+    ///maximum tasks drained per scheduler loop pass, see setBatching()
+	volatile size_t batch_size;
+    ///time budget of one scheduler loop pass in microseconds, 0 if unbounded
+	volatile uint64_t batch_budget_us;
+    ///record per label callback statistics, see setProfiling()
+	volatile bool profiling;
+    ///per thread callback profiles, indexed on physical thread id
+	std::vector<sched_profile_t *> profiles;
+    ///allow idle threads to execute callbacks scheduled through Schedule() on a sibling thread
+	bool work_stealing;
+    ///virtual threads per physical thread, each running its own scheduler loop
+	size_t virtual_threads;
+    ///stack size of each virtual thread
+	size_t stack_size;
+    ///wakeup flag each virtual thread is parked on, nullptr if runnable. indexed on array[physical thread][virtual thread]
+	std::vector<std::vector<volatile int *>> parked_on;
+    ///per physical thread stack pools, holding virtual_threads stacks each. Empty for enclave instances, which carve stacks from the physical thread stack.
+	std::vector<char *> coroutine_stacks;
     /// variable holding physical thread count 
 	volatile size_t threads;
     /// array holding STL thread info for each physical thread(allocated through pthreads)
@@ -85,15 +209,52 @@ class ThreadPool : public IThreadPool
     /// variable holding next assignable monotonic physical thread id.
 	unsigned volatile monotonic_thrd_id = 0;
 	unsigned get_thrd_id();
-	ThreadPool(size_t threads, threading_mode_t mode = REGULAR_MODE, string name = "diggi_thread");
+	ThreadPool(size_t threads,
+			   threading_mode_t mode = REGULAR_MODE,
+			   string name = "diggi_thread",
+			   bool work_stealing = false,
+			   size_t virtual_threads = DEFAULT_VIRTUAL_THREADS,
+			   size_t stack_size = DEFAULT_VIRTUAL_THREAD_STACK_SIZE);
 	~ThreadPool();
+	static bool parseVirtualThreads(const std::string &value, size_t *virtual_threads);
 	void Yield();
+	void Park(volatile int *wakeup);
+	int nextCoroutine(int self_id, int cur_id);
 	/*Copy from caller*/
 	void Schedule(async_cb_t cb, void *args, const char *label);
 	void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label);
+	void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label);
+	uint64_t SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label);
+	void CancelPeriodic(uint64_t timer_id);
+	void ParkOnQueue(lf_buffer_t *queue, uint64_t max_usec);
+	void wakeParked(size_t id);
 	int currentThreadId();
 	size_t physicalThreadCount();
 	size_t currentVThreadId();
+	size_t virtualThreadCount();
+	uint64_t stealCount(size_t id);
+	uint64_t pooledWorkAllocations();
+	uint64_t heapWorkAllocations();
+	async_work_t *nextTask(int self_id);
+	async_work_t *allocWork(int self_id);
+	void freeWork(async_work_t *work, int self_id);
+	timer_entry_t *newTimer(uint64_t delay_us, uint64_t period_us, async_cb_t cb, void *args, const char *label);
+	void armTimer(timer_entry_t *entry);
+	void runTimers(int self_id, bool idle);
+	void runTask(async_work_t *task, int self_id);
+	void setBatching(size_t max_tasks, uint64_t budget_us = 0);
+	void setProfiling(bool enabled);
+	bool profilingEnabled();
+	void profileTask(int self_id, const char *label, uint64_t enqueued, uint64_t start, uint64_t end);
+	std::string profileCsv();
+#ifndef DIGGI_ENCLAVE
+	void writeProfile(const char *path);
+	static void writeProfileCb(void *ptr);
+#endif
+	static uint64_t profileClock();
+	static uint64_t monotonicUsec();
+	static void armTimerCb(void *ptr, int status);
+	static void cancelPeriodicCb(void *ptr, int status);
 	static void  alignstack(void * ptr);
 	static void  SchedulerLoop(void *ptr, int status);
 	static void  SchedulerLoopInternal(void *ptr);
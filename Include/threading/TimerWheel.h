@@ -0,0 +1,77 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include "datatypes.h"
+#include "DiggiAssert.h"
+
+///resolution of timer wheel, in microseconds per tick
+#define TIMER_WHEEL_TICK_USEC 10
+///bits used to index slots in one level of the wheel
+#define TIMER_WHEEL_SLOT_BITS 6
+///slots per level
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+///levels in wheel, timers further out than TIMER_WHEEL_SLOTS^TIMER_WHEEL_LEVELS ticks are re-cascaded from the top level
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * @brief timer armed on a timer wheel.
+ * Deadline and period are expressed in ticks of TIMER_WHEEL_TICK_USEC.
+ */
+typedef struct timer_entry_t
+{
+	///callback invoked on expiry
+	async_cb_t cb;
+	///argument passed to callback
+	void *arg;
+	///debug label of callback
+	const char *label;
+	///absolute expiry, in ticks
+	uint64_t deadline;
+	///interval between expiries for periodic timers, 0 for one shot timers
+	uint64_t period;
+	///identity used to cancel periodic timers, 0 for one shot timers
+	uint64_t id;
+	///set when a periodic timer is cancelled, entry is released on next expiry
+	int cancelled;
+	///next entry in slot
+	struct timer_entry_t *next;
+} timer_entry_t;
+
+/**
+ * @brief Hierarchical timing wheel, owned and driven by a single physical thread.
+ * Level 0 holds timers expiring within TIMER_WHEEL_SLOTS ticks, each higher level covers TIMER_WHEEL_SLOTS times the range of the one below.
+ * Timers on higher levels are cascaded to lower levels as the wheel turns, so arming and expiring a timer are both O(1).
+ * Not thread safe.
+ */
+class TimerWheel
+{
+	timer_entry_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	///timers armed with a deadline which has allready passed
+	timer_entry_t *ready;
+	///next tick to process, all ticks before have expired
+	uint64_t current;
+	///count of armed timers
+	size_t count;
+	///live periodic timers, indexed on id
+	std::map<uint64_t, timer_entry_t *> periodic;
+	void place(timer_entry_t *entry);
+	void cascade(size_t level);
+
+public:
+	TimerWheel(uint64_t now_tick);
+	~TimerWheel();
+	void add(timer_entry_t *entry);
+	timer_entry_t *advance(uint64_t now_tick);
+	uint64_t nextExpiry();
+	uint64_t currentTick();
+	size_t pending();
+	void trackPeriodic(timer_entry_t *entry);
+	bool cancelPeriodic(uint64_t id);
+};
+
+#endif
@@ -11,6 +11,8 @@ extern "C" {
 #endif
 
 void reset_affinity();
+void release_thread_affinity();
+bool cores_oversubscribed();
 std::thread new_thread_with_affinity(async_cb_t cb, void* ptr);
 std::thread *new_thread_with_affinity_enc(async_cb_t cb, void* ptr);
 
@@ -124,7 +124,7 @@ void func_start(void *ctx, int status)
 {
     DIGGI_ASSERT(ctx);
     DiggiAPI *a_cont = (DiggiAPI *)ctx;
-    DBClient *cli = new DBClient(a_cont->GetMessageManager(), a_cont->GetThreadPool(), CLEARTEXT);
+    DBClient *cli = new DBClient(a_cont->GetMessageManager(), a_cont->GetThreadPool(), CLEARTEXT, DBClient::requestTimeout(a_cont->GetFuncConfig()));
     cli->connect(a_cont->GetFuncConfig()["load-target-db-func"].value.tostring());
     int sample_count = atoi(a_cont->GetFuncConfig()["train-sample-count"].value.tostring().c_str());
     int test_sample_count = atoi(a_cont->GetFuncConfig()["test-sample-count"].value.tostring().c_str());
@@ -44,7 +44,7 @@ void func_init(void *ctx, int status)
 
 matrix_t *get_matrix(DiggiAPI *api, size_t size, size_t offset, std::string image_table_name, std::string lable_table_name)
 {
-    auto dbcli = new DBClient(api->GetMessageManager(), api->GetThreadPool(), ENCRYPTED);
+    auto dbcli = new DBClient(api->GetMessageManager(), api->GetThreadPool(), ENCRYPTED, DBClient::requestTimeout(api->GetFuncConfig()));
     dbcli->connect(api->GetFuncConfig()["data-source"].value.tostring());
     dbcli->execute("SELECT * FROM %s ORDER BY ID LIMIT %lu OFFSET %lu;", image_table_name.c_str(), size, offset);
     auto images = dbcli->fetchall();
@@ -131,7 +131,7 @@ void func_start(void * ctx, int status)
 	a_cont->GetLogObject()->Log(LRELEASE,"Starting db client func\n");
 	for (size_t i = 0; i < thread_p->physicalThreadCount(); i++) {
 
-		auto dbclient = new DBClient(a_cont->GetMessageManager(), thread_p);
+		auto dbclient = new DBClient(a_cont->GetMessageManager(), thread_p, CLEARTEXT, DBClient::requestTimeout(a_cont->GetFuncConfig()));
         dbclient->connect(a_cont->GetFuncConfig()["connected-to"].value.tostring());
 		auto should_load =  (a_cont->GetFuncConfig()["load"].value == "1") && (i == 0);
 		
@@ -96,7 +96,7 @@ void func_start(void * ctx, int status)
 	a_cont->GetLogObject()->Log(LRELEASE,"Starting TPCC client func\n");
 	for (size_t i = 0; i < thread_p->physicalThreadCount(); i++) {
 
-		auto dbclient = new DBClient(a_cont->GetMessageManager(), thread_p, CLEARTEXT);
+		auto dbclient = new DBClient(a_cont->GetMessageManager(), thread_p, CLEARTEXT, DBClient::requestTimeout(a_cont->GetFuncConfig()));
 		auto should_load =  (a_cont->GetFuncConfig()["tpcc-load"].value == "1") && (i == 0);
 		auto tpcc = new Tpcc(2, 900.0, config, dbclient, should_load);
 		
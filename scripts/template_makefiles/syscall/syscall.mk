@@ -109,4 +109,12 @@ TESTLINKSYSCALLS = 	-Wl,-wrap,lstat\
 	-Wl,-wrap,pthread_cond_wait\
 	-Wl,-wrap,pthread_cond_broadcast\
 	-Wl,-wrap,pthread_cond_signal\
-	-Wl,-wrap,pthread_cond_init
\ No newline at end of file
+	-Wl,-wrap,pthread_cond_init\
+	-Wl,-wrap,pthread_cond_destroy\
+	-Wl,-wrap,pthread_rwlock_init\
+	-Wl,-wrap,pthread_rwlock_destroy\
+	-Wl,-wrap,pthread_rwlock_rdlock\
+	-Wl,-wrap,pthread_rwlock_tryrdlock\
+	-Wl,-wrap,pthread_rwlock_wrlock\
+	-Wl,-wrap,pthread_rwlock_trywrlock\
+	-Wl,-wrap,pthread_rwlock_unlock
\ No newline at end of file
@@ -27,6 +27,11 @@ extern "C" {
  */
 
 #include "lockfree_rb_q.h"
+#ifndef DIGGI_ENCLAVE
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
 
 
 
@@ -63,8 +68,205 @@ lf_buffer_t* lf_new(size_t Q_SIZE, unsigned long prod, unsigned long cons)
 	for(unsigned i = 0; i < n; i++){
 		lfbuffer->thr_p_[i].in_situ = 0;
 	}
+	lfbuffer->spsc_ = 0;
+	lfbuffer->doorbell_ = 0;
+	lfbuffer->parked_ = 0;
+	lfbuffer->doorbell_enabled_ = 0;
+	return lfbuffer;
+}
+/**
+ * @brief Create new single producer single consumer queue.
+ * Accessed through the same functions as queues created by lf_new, requesting_thread is ignored.
+ * The producer owns head_ and a cached copy of tail_ in last_tail_, the consumer owns tail_ and a cached copy of head_ in last_head_.
+ * Each index is published with a release store, no atomic read-modify-write or per thread bookkeeping is required.
+ * At most one thread may produce and one thread may consume at any time.
+ * NB! Q_SIZE must be power of 2
+ * @param Q_SIZE Size of pointer queue.
+ * @return lf_buffer_t* return pointer to buffer.
+ */
+lf_buffer_t* lf_new_spsc(size_t Q_SIZE)
+{
+	auto lfbuffer = lf_new(Q_SIZE, 1, 1);
+	lfbuffer->spsc_ = 1;
 	return lfbuffer;
 }
+/**
+ * @brief enable doorbell wakeups for queue.
+ * Consumers may then block in lf_park while the queue is empty, instead of sleeping for a fixed interval.
+ * Producers pay a memory fence per send, and only signal if a consumer is parked.
+ * Must be enabled before the queue is shared with other threads.
+ * @param lf lock free queue struct
+ */
+void lf_enable_doorbell(lf_buffer_t *lf)
+{
+	lf->doorbell_enabled_ = 1;
+}
+/**
+ * @brief wake parked consumers, invoked by producers after publishing messages.
+ * @param lf lock free queue struct
+ */
+static inline void lf_doorbell_signal(lf_buffer_t *lf)
+{
+	if (!lf->doorbell_enabled_)
+	{
+		return;
+	}
+	// Order publication of message before reading parked_, pairs with lf_park.
+	__sync_synchronize();
+	if (__builtin_expect(lf->parked_ == 0, 1))
+	{
+		return;
+	}
+#ifdef DIGGI_ENCLAVE
+	ocall_doorbell_ring(lf);
+#else
+	lf_doorbell_wake(lf);
+#endif
+}
+/**
+ * @brief check if no published message is availible to any consumer.
+ * Includes slots reserved by consumers through lf_try_recieve.
+ * @param lf lock free queue struct
+ * @return int 1 if empty
+ */
+static inline int lf_empty(lf_buffer_t *lf)
+{
+	if (lf->spsc_)
+	{
+		return lf->tail_ >= lf->head_;
+	}
+	auto min = lf->head_;
+	for (size_t i = 0; i < lf->n_producers_; ++i) {
+		auto tmp_h = lf->thr_p_[i].head;
+
+		asm volatile("" ::: "memory");
+
+		if (tmp_h < min)
+			min = tmp_h;
+	}
+	if (lf->tail_ < min)
+	{
+		return 0;
+	}
+	for (size_t i = 0; i < lf->n_consumers_; ++i) {
+		auto tmp_t = lf->thr_p_[i].tail;
+
+		asm volatile("" ::: "memory");
+
+		if (tmp_t < min)
+			return 0;
+	}
+	return 1;
+}
+/**
+ * @brief block consumer until a message is sent on queue, or timeout expires.
+ * Consumer announces it is parking before rechecking the queue, so a concurrent send is never missed.
+ * May return spuriously, callers must poll the queue afterwards.
+ * Requires lf_enable_doorbell.
+ * @param lf lock free queue struct
+ * @param timeout_usec upper bound on time parked, in microseconds
+ */
+void lf_park(lf_buffer_t *lf, uint64_t timeout_usec)
+{
+	lf_park_unless(lf, nullptr, timeout_usec);
+}
+/**
+ * @brief as lf_park, but also returns if a message is published on another queue.
+ * Producers on the other queue must call lf_ring on lf after sending, as they do not ring it themselves.
+ * @param lf lock free queue struct, with doorbell enabled
+ * @param other queue checked for messages once parking is announced, may be nullptr
+ * @param timeout_usec upper bound on time parked, in microseconds
+ */
+void lf_park_unless(lf_buffer_t *lf, lf_buffer_t *other, uint64_t timeout_usec)
+{
+	DIGGI_ASSERT(lf->doorbell_enabled_);
+	auto seq = __atomic_load_n(&lf->doorbell_, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&lf->parked_, 1, __ATOMIC_SEQ_CST);
+	if (lf_empty(lf) && (other == nullptr || lf_empty(other)))
+	{
+#ifdef DIGGI_ENCLAVE
+		ocall_doorbell_wait(lf, seq, timeout_usec);
+#else
+		lf_doorbell_wait(lf, seq, timeout_usec);
+#endif
+	}
+	__atomic_sub_fetch(&lf->parked_, 1, __ATOMIC_SEQ_CST);
+}
+/**
+ * @brief wake consumers parked on a queue, without sending on it.
+ * Used to wake consumers parked through lf_park_unless when a message is published on the other queue.
+ * @param lf lock free queue struct
+ */
+void lf_ring(lf_buffer_t *lf)
+{
+	lf_doorbell_signal(lf);
+}
+#ifndef DIGGI_ENCLAVE
+/**
+ * @brief futex wait on doorbell, returns immediately if doorbell was rung after seq was read.
+ * Only availible in untrusted memory, enclave consumers reach it through ocall_doorbell_wait.
+ * @param lf lock free queue struct
+ * @param seq doorbell value observed before parking
+ * @param timeout_usec upper bound on wait, in microseconds
+ */
+void lf_doorbell_wait(lf_buffer_t *lf, int seq, uint64_t timeout_usec)
+{
+	struct timespec ts;
+	ts.tv_sec = timeout_usec / 1000000;
+	ts.tv_nsec = (timeout_usec % 1000000) * 1000;
+	syscall(SYS_futex, &lf->doorbell_, FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+}
+/**
+ * @brief ring doorbell and wake all parked consumers.
+ * Only availible in untrusted memory, enclave producers reach it through ocall_doorbell_ring.
+ * @param lf lock free queue struct
+ */
+void lf_doorbell_wake(lf_buffer_t *lf)
+{
+	__atomic_add_fetch(&lf->doorbell_, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &lf->doorbell_, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+/**
+ * @brief wait until n slots are free in a single producer single consumer queue.
+ * @param lf lock free queue struct
+ * @param n number of slots
+ * @param block spin until slots are available
+ * @return int 1 if slots are availible
+ */
+static inline int lf_spsc_reserve(lf_buffer_t *lf, unsigned long n, int block)
+{
+	auto last = lf->head_ + n - 1;
+	while (__builtin_expect(last >= lf->last_tail_ + lf->Q_SIZE, 0))
+	{
+		lf->last_tail_ = __atomic_load_n(&lf->tail_, __ATOMIC_ACQUIRE);
+		if (last < lf->last_tail_ + lf->Q_SIZE)
+			break;
+		if (!block)
+			return 0;
+		__asm volatile ("pause" ::: "memory");
+	}
+	return 1;
+}
+/**
+ * @brief number of messages ready for consumption in a single producer single consumer queue.
+ * @param lf lock free queue struct
+ * @param block spin until at least one message is ready
+ * @return unsigned long ready messages
+ */
+static inline unsigned long lf_spsc_ready(lf_buffer_t *lf, int block)
+{
+	while (__builtin_expect(lf->tail_ >= lf->last_head_, 0))
+	{
+		lf->last_head_ = __atomic_load_n(&lf->head_, __ATOMIC_ACQUIRE);
+		if (lf->tail_ < lf->last_head_)
+			break;
+		if (!block)
+			return 0;
+		__asm volatile ("pause" ::: "memory");
+	}
+	return lf->last_head_ - lf->tail_;
+}
 /**
  * @brief destroy lock free queue
  * @warning ensure no threads are using buffer.
@@ -86,6 +288,14 @@ void lf_destroy(lf_buffer_t *lf){
  */
 void lf_send(lf_buffer_t *lf, void *msg, size_t requesting_thread)
 {
+	if (lf->spsc_)
+	{
+		lf_spsc_reserve(lf, 1, 1);
+		lf->ptr_array_[lf->head_ & lf->Q_MASK] = msg;
+		__atomic_store_n(&lf->head_, lf->head_ + 1, __ATOMIC_RELEASE);
+		lf_doorbell_signal(lf);
+		return;
+	}
 	DIGGI_ASSERT(requesting_thread < lf->n_producers_);
 	lf->thr_p_[requesting_thread].head = lf->head_;
 	lf->thr_p_[requesting_thread].head = __sync_fetch_and_add(&lf->head_, 1);
@@ -112,6 +322,92 @@ void lf_send(lf_buffer_t *lf, void *msg, size_t requesting_thread)
 	lf->ptr_array_[lf->thr_p_[requesting_thread].head & lf->Q_MASK] = msg;
 
 	lf->thr_p_[requesting_thread].head = ULONG_MAX;
+	lf_doorbell_signal(lf);
+}
+/**
+ * @brief send message pointer from thread, without blocking on a full queue.
+ * Unlike lf_send, a slot is only reserved if it is known to be free, so a full queue leaves no reservation behind.
+ * Must ensure that calling thread is able to correctly identify itself, relative to others using the same queue.
+ * @param lf lock free queue struct
+ * @param msg message pointer to send
+ * @param requesting_thread id of requesting thread
+ * @return int 1 if message was enqueued, 0 if queue is full
+ */
+int lf_try_send(lf_buffer_t *lf, void *msg, size_t requesting_thread)
+{
+	if (lf->spsc_)
+	{
+		if (!lf_spsc_reserve(lf, 1, 0))
+		{
+			return 0;
+		}
+		lf->ptr_array_[lf->head_ & lf->Q_MASK] = msg;
+		__atomic_store_n(&lf->head_, lf->head_ + 1, __ATOMIC_RELEASE);
+		lf_doorbell_signal(lf);
+		return 1;
+	}
+	DIGGI_ASSERT(requesting_thread < lf->n_producers_);
+	unsigned long head;
+	while (1)
+	{
+		head = lf->head_;
+		if (__builtin_expect(head >= lf->last_tail_ + lf->Q_SIZE, 0))
+		{
+			auto min = lf->tail_;
+
+			for (size_t i = 0; i < lf->n_consumers_; ++i) {
+				auto tmp_t = lf->thr_p_[i].tail;
+
+				asm volatile("" ::: "memory");
+
+				if (tmp_t < min)
+					min = tmp_t;
+			}
+			lf->last_tail_ = min;
+			if (head >= lf->last_tail_ + lf->Q_SIZE)
+			{
+				lf->thr_p_[requesting_thread].head = ULONG_MAX;
+				return 0;
+			}
+		}
+		/*
+			published before reservation, so consumers do not pass the slot while it is written
+		*/
+		lf->thr_p_[requesting_thread].head = head;
+		if (__sync_bool_compare_and_swap(&lf->head_, head, head + 1))
+		{
+			break;
+		}
+	}
+
+	lf->ptr_array_[head & lf->Q_MASK] = msg;
+
+	lf->thr_p_[requesting_thread].head = ULONG_MAX;
+	lf_doorbell_signal(lf);
+	return 1;
+}
+/**
+ * @brief approximate count of free slots in queue, as seen by producers.
+ * Slots reserved by producers blocked in lf_send are counted as used.
+ * @param lf lock free queue struct
+ * @return unsigned long free slots
+ */
+unsigned long lf_free_slots(lf_buffer_t *lf)
+{
+	auto head = lf->head_;
+	auto tail = lf->tail_;
+	/*
+		consumers may reserve past head while polling an empty queue
+	*/
+	if (tail >= head)
+	{
+		return lf->Q_SIZE;
+	}
+	if (head - tail >= lf->Q_SIZE)
+	{
+		return 0;
+	}
+	return lf->Q_SIZE - (head - tail);
 }
 /**
  * @brief try a recieve operation on queue witout blocking.
@@ -122,6 +418,16 @@ void lf_send(lf_buffer_t *lf, void *msg, size_t requesting_thread)
  */
 void * lf_try_recieve(lf_buffer_t *lf, size_t requesting_thread)
 {
+	if (lf->spsc_)
+	{
+		if (!lf_spsc_ready(lf, 0))
+		{
+			return nullptr;
+		}
+		void *ret = lf->ptr_array_[lf->tail_ & lf->Q_MASK];
+		__atomic_store_n(&lf->tail_, lf->tail_ + 1, __ATOMIC_RELEASE);
+		return ret;
+	}
 	DIGGI_ASSERT(requesting_thread < lf->n_consumers_);	
 	if(!lf->thr_p_[requesting_thread].in_situ){
 		lf->thr_p_[requesting_thread].tail = lf->tail_;
@@ -156,6 +462,152 @@ void * lf_try_recieve(lf_buffer_t *lf, size_t requesting_thread)
 	lf->thr_p_[requesting_thread].in_situ = 0;
 	return ret;
 }
+/**
+ * @brief send a batch of message pointers from thread, reserving all slots with a single atomic operation.
+ * May block on full queue.
+ * Messages are enqueued in array order, consumers observe them in that order.
+ * Must ensure that calling thread is able to correctly identify itself, relative to others using the same queue.
+ * @param lf lock free queue struct
+ * @param msgs array of message pointers to send
+ * @param n number of messages in array, must not exceed queue size. lf is not accessed if n is zero.
+ * @param requesting_thread id of requesting thread
+ */
+void lf_send_batch(lf_buffer_t *lf, void **msgs, size_t n, size_t requesting_thread)
+{
+	if (n == 0)
+	{
+		return;
+	}
+	DIGGI_ASSERT(n <= lf->Q_SIZE);
+	if (lf->spsc_)
+	{
+		lf_spsc_reserve(lf, n, 1);
+		for (size_t i = 0; i < n; i++)
+		{
+			lf->ptr_array_[(lf->head_ + i) & lf->Q_MASK] = msgs[i];
+		}
+		__atomic_store_n(&lf->head_, lf->head_ + n, __ATOMIC_RELEASE);
+		lf_doorbell_signal(lf);
+		return;
+	}
+	DIGGI_ASSERT(requesting_thread < lf->n_producers_);
+	lf->thr_p_[requesting_thread].head = lf->head_;
+	lf->thr_p_[requesting_thread].head = __sync_fetch_and_add(&lf->head_, n);
+	auto last = lf->thr_p_[requesting_thread].head + n - 1;
+
+	while (__builtin_expect(last >= lf->last_tail_ + lf->Q_SIZE, 0))
+	{
+		auto min = lf->tail_;
+
+		for (size_t i = 0; i < lf->n_consumers_; ++i) {
+			auto tmp_t = lf->thr_p_[i].tail;
+
+			asm volatile("" ::: "memory");
+
+			if (tmp_t < min)
+				min = tmp_t;
+		}
+		lf->last_tail_ = min;
+
+		if (last < lf->last_tail_ + lf->Q_SIZE)
+			break;
+		__asm volatile ("pause" ::: "memory");
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		lf->ptr_array_[(lf->thr_p_[requesting_thread].head + i) & lf->Q_MASK] = msgs[i];
+	}
+
+	lf->thr_p_[requesting_thread].head = ULONG_MAX;
+	lf_doorbell_signal(lf);
+}
+/**
+ * @brief try to recieve up to max messages without blocking, reserving all slots with a single atomic operation.
+ * Unlike lf_try_recieve, no reservation is held when the queue is empty.
+ * A reservation left by a previous failed lf_try_recieve on the same thread is completed first.
+ * Must ensure that calling thread is able to correctly identify itself, relative to others using the same queue.
+ * @param lf lock free queue struct
+ * @param out array recieving message pointers
+ * @param max capacity of out array
+ * @param requesting_thread id of requesting thread
+ * @return size_t number of messages written to out
+ */
+size_t lf_try_recieve_batch(lf_buffer_t *lf, void **out, size_t max, size_t requesting_thread)
+{
+	size_t count = 0;
+	if (max == 0)
+	{
+		return 0;
+	}
+	if (lf->spsc_)
+	{
+		count = lf_spsc_ready(lf, 0);
+		if (count > max)
+		{
+			count = max;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = lf->ptr_array_[(lf->tail_ + i) & lf->Q_MASK];
+		}
+		__atomic_store_n(&lf->tail_, lf->tail_ + count, __ATOMIC_RELEASE);
+		return count;
+	}
+	DIGGI_ASSERT(requesting_thread < lf->n_consumers_);
+	if (lf->thr_p_[requesting_thread].in_situ)
+	{
+		auto pending = lf_try_recieve(lf, requesting_thread);
+		if (pending == nullptr)
+		{
+			return 0;
+		}
+		out[count++] = pending;
+	}
+
+	unsigned long start, avail;
+	do
+	{
+		start = lf->tail_;
+		if (start >= lf->last_head_)
+		{
+			auto min = lf->head_;
+
+			// Update the last_head_.
+			for (size_t i = 0; i < lf->n_producers_; ++i) {
+				auto tmp_h = lf->thr_p_[i].head;
+
+				// Force compiler to use tmp_h exactly once.
+				asm volatile("" ::: "memory");
+
+				if (tmp_h < min)
+					min = tmp_h;
+			}
+			lf->last_head_ = min;
+		}
+		auto limit = lf->last_head_;
+		if (start >= limit)
+		{
+			lf->thr_p_[requesting_thread].tail = ULONG_MAX;
+			return count;
+		}
+		avail = limit - start;
+		if (avail > max - count)
+		{
+			avail = max - count;
+		}
+		// Protect the range from producers before it is claimed.
+		lf->thr_p_[requesting_thread].tail = start;
+	} while (!__sync_bool_compare_and_swap(&lf->tail_, start, start + avail));
+
+	for (unsigned long i = 0; i < avail; i++)
+	{
+		out[count++] = lf->ptr_array_[(start + i) & lf->Q_MASK];
+	}
+	// Allow producers rewrite the slots.
+	lf->thr_p_[requesting_thread].tail = ULONG_MAX;
+	return count;
+}
 /**
  * @brief consume message from queue
  * may block if queue is empty
@@ -166,6 +618,13 @@ void * lf_try_recieve(lf_buffer_t *lf, size_t requesting_thread)
  */
 void * lf_recieve(lf_buffer_t *lf, size_t requesting_thread)
 {
+	if (lf->spsc_)
+	{
+		lf_spsc_ready(lf, 1);
+		void *ret = lf->ptr_array_[lf->tail_ & lf->Q_MASK];
+		__atomic_store_n(&lf->tail_, lf->tail_ + 1, __ATOMIC_RELEASE);
+		return ret;
+	}
 	DIGGI_ASSERT(requesting_thread < lf->n_consumers_);	
 	if(!lf->thr_p_[requesting_thread].in_situ){
 		lf->thr_p_[requesting_thread].tail = lf->tail_;
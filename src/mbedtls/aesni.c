@@ -56,6 +56,15 @@ int mbedtls_aesni_has_support( unsigned int what )
     static int done = 0;
     static unsigned int c = 0;
 
+#if defined(DIGGI_ENCLAVE)
+    /*
+     * cpuid faults inside SGX enclaves, and every SGX capable
+     * processor supports AES-NI and PCLMULQDQ.
+     */
+    (void) done;
+    (void) c;
+    return( 1 );
+#endif
     if( ! done )
     {
         asm( "movl  $1, %%eax   \n\t"
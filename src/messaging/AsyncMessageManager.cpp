@@ -22,7 +22,7 @@
  * @param output_q Outbound queue for untrusted runtime /  remote diggi host instances
  * @param outbound_queues Outbound queues for local diggi instances, direct delivery onto input queue.
  * @param global_thread_id global thread id for identifying concurrent producer onto lock-free queues @see lockfree_rb_q.cpp
- * @param global_mem_buf global preprovisioned buffer for allocating outbound message objects onto. requires encryption prior to use.
+ * @param global_mem_buf global preprovisioned size-classed pool for allocating outbound message objects onto. requires encryption prior to use.
  * @param tsafemm thread safe message manager reference, for rescheduling thread specic adressable messages onto correct AMM (one per thread)
  */
 AsyncMessageManager::AsyncMessageManager(
@@ -31,11 +31,19 @@ AsyncMessageManager::AsyncMessageManager(
     lf_buffer_t *output_q,
     std::vector<name_service_update_t> outbound_queues,
     size_t global_thread_id,
-    lf_buffer_t *global_mem_buf,
+    msg_pool_t *global_mem_buf,
     IThreadSafeMM *tsafemm) : monotonic_msg_id(1),
                               linearbackoff(1),
                               nomessage_event_cnt(0),
                               stop(false),
+                              flow_routing(flowRoutingConfigured(dapi)),
+                              coalescing(false),
+                              coalesce_window_us(0),
+                              coalesce_flush_scheduled(false),
+                              backpressure_retry_scheduled(false),
+                              flow_timer_seq(0),
+                              expired_flows_next(0),
+                              expired_flow_floor(0),
                               tsafemm(tsafemm),
                               diggiapi(dapi),
                               input(input_q),
@@ -46,6 +54,10 @@ AsyncMessageManager::AsyncMessageManager(
 {
     monotonic_virtual_msg_id = UINT_MAX;
     DIGGI_ASSERT(global_mem_buf != nullptr);
+    memset(type_handlers, 0, sizeof(type_handlers));
+    memset(expired_flows, 0, sizeof(expired_flows));
+    memset(&late_reply_handler, 0, sizeof(late_reply_handler));
+    configureCoalescing();
     for (auto item : outbound_queues)
     {
         item.physical_address.fields.thread = 0;
@@ -68,10 +80,18 @@ AsyncMessageManager::AsyncMessageManager(
     lf_buffer_t *output_q,
     std::vector<name_service_update_t> outbound_queues,
     size_t global_thread_id,
-    lf_buffer_t *global_mem_buf) : monotonic_msg_id(1),
+    msg_pool_t *global_mem_buf) : monotonic_msg_id(1),
                                    linearbackoff(1),
                                    nomessage_event_cnt(0),
                                    stop(false),
+                                   flow_routing(flowRoutingConfigured(dapi)),
+                                   coalescing(false),
+                                   coalesce_window_us(0),
+                                   coalesce_flush_scheduled(false),
+                                   backpressure_retry_scheduled(false),
+                                   flow_timer_seq(0),
+                                   expired_flows_next(0),
+                                   expired_flow_floor(0),
                                    tsafemm(nullptr),
                                    diggiapi(dapi),
                                    input(input_q),
@@ -81,6 +101,10 @@ AsyncMessageManager::AsyncMessageManager(
 {
     monotonic_virtual_msg_id = UINT_MAX;
     DIGGI_ASSERT(global_mem_buf != nullptr);
+    memset(type_handlers, 0, sizeof(type_handlers));
+    memset(expired_flows, 0, sizeof(expired_flows));
+    memset(&late_reply_handler, 0, sizeof(late_reply_handler));
+    configureCoalescing();
 
     for (auto item : outbound_queues)
     {
@@ -89,6 +113,29 @@ AsyncMessageManager::AsyncMessageManager(
         outbound_map[item.physical_address.raw] = item.destination_queue;
     }
 }
+/**
+ * @brief read message coalescing settings from func configuration.
+ * "message-coalescing" set to "1" enables coalescing of small outbound messages, @see coalesce.
+ * "message-coalescing-window-usec" bounds how long pending messages wait for more messages to the same destination.
+ * If unset, pending messages are flushed once the current callback returns.
+ */
+void AsyncMessageManager::configureCoalescing()
+{
+    memset(coalesce_pending, 0, sizeof(coalesce_pending));
+    if (diggiapi == nullptr)
+    {
+        return;
+    }
+    auto conf = diggiapi->GetFuncConfig();
+    if (conf.contains("message-coalescing"))
+    {
+        coalescing = (conf["message-coalescing"].value == "1");
+    }
+    if (conf.contains("message-coalescing-window-usec"))
+    {
+        coalesce_window_us = (uint64_t)atoi(conf["message-coalescing-window-usec"].value.tostring().c_str());
+    }
+}
 /**
  * @brief start message polling
  * Invokes thread scheduler to start message pump callback.
@@ -97,7 +144,12 @@ void AsyncMessageManager::Start()
 {
     DIGGI_TRACE(diggiapi->GetLogObject(), LDEBUG, "async message manager: starting message pump\n");
 
-    diggiapi->GetThreadPool()->Schedule(AsyncMessageManager::async_message_pump, this, __PRETTY_FUNCTION__);
+    /*
+        Message pump is thread affine, pin it to the polling thread in case work stealing is enabled.
+        Threads not on pool are interpreted as thread 0, as in IThreadPool::Schedule.
+    */
+    auto thrid = diggiapi->GetThreadPool()->currentThreadId();
+    diggiapi->GetThreadPool()->ScheduleOn((thrid < 0) ? 0 : thrid, AsyncMessageManager::async_message_pump, this, __PRETTY_FUNCTION__);
 }
 /**
  * @brief Destroy the Async Message Manager:: Async Message Manager object
@@ -107,8 +159,44 @@ void AsyncMessageManager::Start()
 AsyncMessageManager::~AsyncMessageManager()
 {
 
+    /*
+        Messages still pending coalescing are never sent, return them to the pool
+    */
+    for (size_t i = 0; i < AMM_COALESCE_SLOTS; i++)
+    {
+        if (coalesce_pending[i].first != nullptr)
+        {
+            msg_pool_free(global_mem_buf, coalesce_pending[i].first, global_thread_id);
+        }
+        if (coalesce_pending[i].container != nullptr)
+        {
+            msg_pool_free(global_mem_buf, coalesce_pending[i].container, global_thread_id);
+        }
+    }
+    memset(coalesce_pending, 0, sizeof(coalesce_pending));
+    peer_credits.forEach([&](uint64_t key, peer_credit_t &peer) {
+        while (peer.backlog_head != nullptr)
+        {
+            auto next = (msg_t *)peer.backlog_head->pad[0];
+            msg_pool_free(global_mem_buf, peer.backlog_head, global_thread_id);
+            peer.backlog_head = next;
+        }
+    });
+    peer_credits.clear();
+    pending_types.forEach([&](uint64_t key, pending_type_t &pending) {
+        while (pending.head != nullptr)
+        {
+            auto next = (msg_t *)pending.head->pad[0];
+            msg_pool_free(global_mem_buf, pending.head, global_thread_id);
+            pending.head = next;
+        }
+    });
+    pending_types.clear();
+    memset(type_handlers, 0, sizeof(type_handlers));
     type_handler_map.clear();
     async_handler_map.clear();
+    expired_flow_set.clear();
+    expired_flow_floor = 0;
     outbound_map.clear();
 }
 /**
@@ -160,22 +248,121 @@ lf_buffer_t *AsyncMessageManager::getTargetBuffer(aid_t destination)
     destination.fields.thread = 0;
 
     DIGGI_ASSERT(destination.raw != diggiapi->GetId().raw);
-    auto outbf = outbound_map[destination.raw];
+    auto outbf = outbound_map.find(destination.raw);
 
-    if (outbf)
+    if (outbf != nullptr && *outbf != nullptr)
     {
-        DIGGI_ASSERT(outbf != output);
-        return outbf;
+        DIGGI_ASSERT(*outbf != output);
+        return *outbf;
     }
     return output;
 }
+/**
+ * @brief check if func configuration requests inbound flows to be spread across threads.
+ * Set "message-flow-routing" to "1" on instances which serve requests, such as a multithreaded sql server.
+ * Lanes(the thread field of aid_t) are then decoupled from physical threads for flows initiated by other instances.
+ * Each lane from a remote thread is consistently mapped to one local thread, which owns its ordering and crypto session.
+ * @warning instances using flow routing should not initiate flows towards their clients, as a client lane would then be shared by two local threads.
+ * @param dapi diggi api of instance
+ * @return true if flow routing is enabled
+ */
+bool AsyncMessageManager::flowRoutingConfigured(IDiggiAPI *dapi)
+{
+    if (dapi == nullptr || !dapi->GetFuncConfig().contains("message-flow-routing"))
+    {
+        return false;
+    }
+    return dapi->GetFuncConfig()["message-flow-routing"].value == "1";
+}
+/**
+ * @brief check if a message id belongs to a flow initiated by this instance, @see getMessageId
+ * The thread field of the instance identifier is ignored, as the flow owner thread is given by the lane.
+ * @param id message id
+ * @param self own instance identifier
+ * @return true if flow was initiated locally
+ */
+bool AsyncMessageManager::isLocalFlow(unsigned long id, aid_t self)
+{
+    aid_t owner;
+    owner.raw = self.raw & 0x00000000ffffffff;
+    owner.fields.thread = 0;
+    aid_t flow;
+    flow.raw = (id >> 32);
+    flow.fields.thread = 0;
+    return (id != 0) && (flow.raw == owner.raw);
+}
+/**
+ * @brief consistent mapping of a remote lane onto a local thread.
+ * Fibonacci hash of the source identifier, including its thread field.
+ * @param src source of message
+ * @param threads local physical thread count
+ * @return size_t local thread
+ */
+size_t AsyncMessageManager::flowHashThread(aid_t src, size_t threads)
+{
+    DIGGI_ASSERT(threads > 0);
+    return (size_t)((src.raw * 0x9E3779B97F4A7C15ULL) >> 32) % threads;
+}
+/**
+ * @brief local thread which handles an inbound message.
+ * Continuations of locally initiated flows are pinned to the owning thread, given by the destination lane.
+ * Other messages are addressed to their lane, or hashed onto a thread if flow routing is enabled.
+ * @param msg inbound message
+ * @return size_t physical thread
+ */
+size_t AsyncMessageManager::inboundThread(msg_t *msg)
+{
+    if (!flow_routing || isLocalFlow(msg->id, diggiapi->GetId()))
+    {
+        return (size_t)msg->dest.fields.thread;
+    }
+    return flowHashThread(msg->src, diggiapi->GetThreadPool()->physicalThreadCount());
+}
+/**
+ * @brief lane for an outbound message.
+ * Equals the current thread, unless the message continues a flow initiated remotely, in which case the lane of the flow is kept.
+ * Remote lanes only differ from the current thread if flow routing is enabled.
+ * @param msg outbound message, with destination set
+ * @return uint8_t lane
+ */
+uint8_t AsyncMessageManager::outboundLane(msg_t *msg)
+{
+    if (flow_routing && msg->id != 0 && !isLocalFlow(msg->id, diggiapi->GetId()))
+    {
+        return msg->dest.fields.thread;
+    }
+    return (uint8_t)diggiapi->GetThreadPool()->currentThreadId();
+}
+/**
+ * @brief lookup typed callback, without registering an entry on miss.
+ * Built in types are served from a dense array, application defined types from a hash map.
+ * @param ty message type
+ * @return async_work_t* handler, nullptr if no callback is registered for type
+ */
+async_work_t *AsyncMessageManager::findTypeHandler(msg_type_t ty)
+{
+    async_work_t *handler = nullptr;
+    if ((size_t)ty < AMM_DENSE_TYPE_COUNT)
+    {
+        handler = &type_handlers[ty];
+    }
+    else
+    {
+        handler = type_handler_map.find((uint64_t)ty);
+    }
+    if (handler == nullptr || handler->cb == nullptr)
+    {
+        return nullptr;
+    }
+    return handler;
+}
 /**
  * @brief register a type-based callback.
  * Registers a callback used for all messages recieved of a particular msg_type_t @see msg_type_t
  * all messages of that particular type, who are not assoicated with a message flow ( has a message id)
  * are routed to this particular callback.
  * Only valid for the calling thread. for multithreaded diggi instances, each must individually register an identical typed callback.
- * Reciept of typed messages not pre registered for reciept, cause an assertion failure.
+ * Typed messages recieved before registration are parked, and delivered in order of arrival once the type is registered.
  * may be used  as initial step of multi-step flows.
  * @param cb callback whic is invoked upon reciept of a message 
  * @param ty type associated with the callback
@@ -184,20 +371,42 @@ lf_buffer_t *AsyncMessageManager::getTargetBuffer(aid_t destination)
 void AsyncMessageManager::registerTypeCallback(async_cb_t cb, msg_type_t ty, void *arg)
 {
     DIGGI_ASSERT(cb);
-    type_handler_map[ty].cb = cb;
-    type_handler_map[ty].status = 1;
-    type_handler_map[ty].arg = arg;
+    auto handler = ((size_t)ty < AMM_DENSE_TYPE_COUNT) ? &type_handlers[ty] : &type_handler_map[(uint64_t)ty];
+    handler->cb = cb;
+    handler->status = 1;
+    handler->arg = arg;
+    /*
+        Messages recieved before registration are delivered once the calling context has returned, 
+        on the thread which parked them
+    */
+    auto pending = (pending_types.size() > 0) ? pending_types.find((uint64_t)ty) : nullptr;
+    if (pending != nullptr && !pending->flush_scheduled)
+    {
+        pending->flush_scheduled = true;
+        diggiapi->GetThreadPool()->ScheduleOn(
+            pending->thread,
+            AsyncMessageManager::pending_type_flush_cb,
+            new AsyncContext<AsyncMessageManager *, msg_type_t>(this, ty),
+            __PRETTY_FUNCTION__);
+    }
 }
 /**
  * @brief unregister a typed callback. 
- * will, after invocation, delete typed callabck from type_handler_map.
- * will cause assertions if an inbound message containing said type is recieved after this call is performed.
+ * will, after invocation, delete typed callabck from type_handlers or type_handler_map.
+ * inbound messages containing said type recieved after this call are parked until the type is registered again.
  * 
  * @param ty message type
  */
 void AsyncMessageManager::UnregisterTypeCallback(msg_type_t ty)
 {
-    type_handler_map.erase(ty);
+    if ((size_t)ty < AMM_DENSE_TYPE_COUNT)
+    {
+        memset(&type_handlers[ty], 0, sizeof(async_work_t));
+    }
+    else
+    {
+        type_handler_map.erase((uint64_t)ty);
+    }
 }
 /**
  * @brief allocate a response message object buffer for populating with data.
@@ -219,7 +428,7 @@ msg_t *AsyncMessageManager::allocateMessage(msg_t *msg, size_t payload_size)
     DIGGI_ASSERT(msg->dest.raw != 0);
     DIGGI_ASSERT((payload_size + sizeof(msg_t)) < MAX_DIGGI_MEM_SIZE);
 
-    msg_t *msg_n = (msg_t *)lf_recieve(global_mem_buf, global_thread_id);
+    msg_t *msg_n = (msg_t *)msg_pool_alloc(global_mem_buf, payload_size + sizeof(msg_t), global_thread_id);
 
     msg_n->size = sizeof(msg_t) + payload_size;
     msg_n->src = msg->src;
@@ -250,7 +459,7 @@ msg_t *AsyncMessageManager::allocateMessage(aid_t source, aid_t dest, size_t pay
     DIGGI_ASSERT(dest.raw != 0);
     DIGGI_ASSERT((payload_size + sizeof(msg_t)) < MAX_DIGGI_MEM_SIZE);
 
-    msg_t *msg = (msg_t *)lf_recieve(global_mem_buf, global_thread_id);
+    msg_t *msg = (msg_t *)msg_pool_alloc(global_mem_buf, payload_size + sizeof(msg_t), global_thread_id);
     msg->omit_from_log = 0;
     msg->size = sizeof(msg_t) + payload_size;
     msg->src = source;
@@ -276,27 +485,194 @@ msg_t *AsyncMessageManager::allocateMessage(aid_t source, aid_t dest, size_t pay
  * @param ptr calle managed convenience context pointer
  */
 void AsyncMessageManager::sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr)
+{
+    sendMessageAsync(msg, cb, ptr, 0);
+}
+/**
+ * @brief send message expecting a response, with a deadline for the response.
+ * As sendMessageAsync, but if no message arrives on the flow within timeout_us the flow is removed,
+ * and cb is invoked with status AMM_FLOW_TIMEOUT and a msg_async_response_t holding ptr and no message.
+ * The deadline covers the wait for the next message only, and is disarmed once a message of the flow is delivered.
+ * Sending on the flow again arms a new deadline.
+ * Replies arriving after the deadline are passed to the late reply callback, or dropped, @see registerLateReplyCallback
+ * @param msg message to send
+ * @param cb callback for expected response, or timeout
+ * @param ptr calle managed convenience context pointer
+ * @param timeout_us deadline for the response in microseconds, 0 waits indefinitely
+ */
+void AsyncMessageManager::sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr, uint64_t timeout_us)
 {
     DIGGI_ASSERT(cb);
 
     DIGGI_TRACE(diggiapi->GetLogObject(),
                 LogLevel::LDEBUG,
-                "Sending message expecting response from: %" PRIu64 ", to: %" PRIu64 ", id: %lu size: %lu, type = %d \n",
+                "Sending message expecting response from: %" PRIu64 ", to: %" PRIu64 ", id: %lu size: %lu, type = %d, timeout = %lu \n",
                 msg->src.raw,
                 msg->dest.raw,
                 msg->id,
                 msg->size,
-                msg->type);
-    msg->src.fields.thread = (uint8_t)diggiapi->GetThreadPool()->currentThreadId();
+                msg->type,
+                timeout_us);
+    msg->src.fields.thread = outboundLane(msg);
     if (msg->id == 0)
     {
         msg->id = (msg->omit_from_log) ? getVirtualMessageId(diggiapi->GetId().raw) : getMessageId(diggiapi->GetId().raw);
     }
 
-    async_handler_map[msg->id].cb = cb;
-    async_handler_map[msg->id].arg = ptr;
+    auto &flow = async_handler_map[msg->id];
+    flow.cb = cb;
+    flow.arg = ptr;
+    flow.dest = msg->dest;
+    flow.timer = 0;
+    if (timeout_us > 0)
+    {
+        flow.timer = ++flow_timer_seq;
+        diggiapi->GetThreadPool()->ScheduleAfter(
+            timeout_us,
+            AsyncMessageManager::flow_timeout_cb,
+            new AsyncContext<AsyncMessageManager *, unsigned long, uint64_t>(this, msg->id, flow.timer),
+            __PRETTY_FUNCTION__);
+    }
+
+    flushCoalesced(msg->dest);
+    enqueueOutbound(msg);
+}
+/**
+ * @brief deadline timer of a flow.
+ * A flow whose deadline was disarmed or rearmed since the timer was scheduled is left as is.
+ * @param ctx AsyncContext holding AMM, flow id and timer sequence number
+ * @param status
+ */
+void AsyncMessageManager::flow_timeout_cb(void *ctx, int status)
+{
+    DIGGI_ASSERT(ctx);
+    auto actx = (AsyncContext<AsyncMessageManager *, unsigned long, uint64_t> *)ctx;
+    auto _this = actx->item1;
+    auto id = actx->item2;
+    auto timer = actx->item3;
+    delete actx;
+    auto flow = _this->async_handler_map.find(id);
+    if (flow == nullptr || flow->timer != timer)
+    {
+        return;
+    }
+    DIGGI_TRACE(_this->diggiapi->GetLogObject(), LRELEASE, "Flow timed out, id: %lu, to: %" PRIu64 "\n", id, flow->dest.raw);
+    _this->expireFlow(id, AMM_FLOW_TIMEOUT);
+}
+/**
+ * @brief remove an outstanding flow, and notify its callback without a message.
+ * The flow id is remembered, so a reply arriving later is not mistaken for a new typed message.
+ * @param id flow id
+ * @param status AMM_FLOW_TIMEOUT or AMM_FLOW_CANCELLED
+ */
+void AsyncMessageManager::expireFlow(unsigned long id, int status)
+{
+    auto found = async_handler_map.find(id);
+    DIGGI_ASSERT(found);
+    /*
+        copied, as callback may insert or erase flows, which invalidates entries
+    */
+    auto flow = *found;
+    async_handler_map.erase(id);
+    auto evicted = expired_flows[expired_flows_next];
+    if (evicted != 0)
+    {
+        expired_flow_set.erase(evicted);
+        /*
+            virtual message ids count downwards, @see getVirtualMessageId
+        */
+        if ((evicted & 0x00000000ffffffff) <= (monotonic_msg_id & 0x00000000ffffffff) && evicted > expired_flow_floor)
+        {
+            expired_flow_floor = evicted;
+        }
+    }
+    expired_flows[expired_flows_next] = id;
+    expired_flows_next = (expired_flows_next + 1) % AMM_EXPIRED_FLOW_HISTORY;
+    expired_flow_set[id] = 1;
 
-    lf_send(getTargetBuffer(msg->dest), msg, global_thread_id);
+    msg_async_response_t resp;
+    resp.msg = nullptr;
+    resp.context = flow.arg;
+    flow.cb(&resp, status);
+}
+/**
+ * @brief check if a message without registered callback replies to an expired or cancelled flow.
+ * Recently expired flows are remembered individually. Older ones are recognised as locally initiated flow ids,
+ * of the same instance and thread, at or below the highest id evicted from the history.
+ * Outstanding flows always have a callback, so no reply to a live flow is mistaken for a late reply.
+ * @param id message id
+ * @return true if the message is a late reply
+ */
+bool AsyncMessageManager::isExpiredFlow(unsigned long id)
+{
+    if (expired_flow_set.size() > 0 && expired_flow_set.find(id) != nullptr)
+    {
+        return true;
+    }
+    return (expired_flow_floor != 0) &&
+           ((id >> 32) == (expired_flow_floor >> 32)) &&
+           ((id & 0x00000000ffffffff) <= (expired_flow_floor & 0x00000000ffffffff));
+}
+/**
+ * @brief cancel all outstanding flows towards a destination instance.
+ * Each flow callback is invoked with status AMM_FLOW_CANCELLED and no message, replies arriving later are treated as late replies.
+ * Used to release waiters when a peer is known to be gone.
+ * @param destination destination instance, thread field is ignored
+ * @return size_t count of cancelled flows
+ */
+size_t AsyncMessageManager::cancelFlows(aid_t destination)
+{
+    destination.fields.thread = 0;
+    std::vector<unsigned long> cancelled;
+    async_handler_map.forEach([&](uint64_t id, async_flow_t &flow) {
+        auto dest = flow.dest;
+        dest.fields.thread = 0;
+        if (dest.raw == destination.raw)
+        {
+            cancelled.push_back(id);
+        }
+    });
+    for (auto id : cancelled)
+    {
+        /*
+            a callback may have ended or cancelled later flows in the list
+        */
+        if (async_handler_map.find(id) != nullptr)
+        {
+            expireFlow(id, AMM_FLOW_CANCELLED);
+        }
+    }
+    return cancelled.size();
+}
+/**
+ * @brief cancel all outstanding flows of this thread, @see cancelFlows(aid_t)
+ * @return size_t count of cancelled flows
+ */
+size_t AsyncMessageManager::cancelFlows()
+{
+    std::vector<unsigned long> cancelled;
+    async_handler_map.forEach([&](uint64_t id, async_flow_t &flow) {
+        cancelled.push_back(id);
+    });
+    for (auto id : cancelled)
+    {
+        if (async_handler_map.find(id) != nullptr)
+        {
+            expireFlow(id, AMM_FLOW_CANCELLED);
+        }
+    }
+    return cancelled.size();
+}
+/**
+ * @brief register callback for replies to flows which have timed out or been cancelled.
+ * Layers keeping per peer state, such as message ordering, must still observe late replies. Without a callback they are dropped.
+ * @param cb callback, invoked as a regular flow callback
+ * @param arg context pointer delivered to callback
+ */
+void AsyncMessageManager::registerLateReplyCallback(async_cb_t cb, void *arg)
+{
+    late_reply_handler.cb = cb;
+    late_reply_handler.arg = arg;
 }
 /**
  * @brief deletes stored multistep flow state.
@@ -315,9 +691,8 @@ void AsyncMessageManager::endAsync(msg_t *msg)
                 msg->id,
                 msg->size);
     /*
-        Zero structure to highlight reuse after erase, as map is not freed.
+        erase clears the slot, so stale handlers cannot be observed after reuse.
     */
-    async_handler_map[msg->id] = {0};
     async_handler_map.erase(msg->id);
 }
 
@@ -344,25 +719,369 @@ void AsyncMessageManager::sendMessage(msg_t *msg)
         endAsync(msg);
     }
 
-    msg->src.fields.thread = (uint8_t)diggiapi->GetThreadPool()->currentThreadId();
+    msg->src.fields.thread = outboundLane(msg);
+
+    /*
+        Exit signals are inspected by the untrusted runtime, and are never coalesced
+    */
+    if (coalescing && msg->size <= AMM_COALESCE_MAX_MSG_SIZE && msg->type != DIGGI_SIGNAL_TYPE_EXIT)
+    {
+        coalesce(msg);
+        return;
+    }
+    flushCoalesced(msg->dest);
 
     /*
 		We expect to find a header encapsulating the message object 
 		used for ringbuffer allocation and transmission.
 		We therefore inspect the parrent header to find it.	
 	*/
-    lf_send(getTargetBuffer(msg->dest), msg, global_thread_id);
+    enqueueOutbound(msg);
+}
+/**
+ * @brief send message without a response callback, unless the destination has no credit.
+ * Unlike sendMessage, a message without credit is not parked. Ownership stays with the caller, who may retry later.
+ * Messages are never coalesced.
+ * @param msg message to send
+ * @return true if message was sent, false if sending would block
+ */
+bool AsyncMessageManager::trySendMessage(msg_t *msg)
+{
+    flushCoalesced(msg->dest);
+    auto peer = peerCredit(msg->dest);
+    msg->src.fields.thread = outboundLane(msg);
+    msg->pad[0] = 0;
+    if (peer->backlog > 0 || !lf_try_send(peer->queue, msg, global_thread_id))
+    {
+        peer->stalls++;
+        peer->credits = 0;
+        return false;
+    }
+    peer->sent++;
+    peer->credits = lf_free_slots(peer->queue);
+    if (msg->id != 0)
+    {
+        endAsync(msg);
+    }
+    return true;
+}
+/**
+ * @brief credit accounting entry of a destination, created on first use.
+ * @param destination destination instance, thread field is ignored
+ * @return peer_credit_t* entry, invalidated by the next call
+ */
+peer_credit_t *AsyncMessageManager::peerCredit(aid_t destination)
+{
+    destination.fields.thread = 0;
+    auto peer = peer_credits.find(destination.raw);
+    if (peer == nullptr)
+    {
+        peer = &peer_credits[destination.raw];
+        peer->queue = getTargetBuffer(destination);
+        peer->credits = lf_free_slots(peer->queue);
+    }
+    return peer;
+}
+/**
+ * @brief enqueue message on the destination queue, parking it instead of spinning if the destination has no credit.
+ * Parked messages are sent in order, ahead of later messages to the same destination, by a retry callback on this thread.
+ * The sending callback returns immediately, so the input pump of this thread keeps draining, and two instances flooding each other do not deadlock.
+ * If the backlog of a destination exceeds AMM_BACKPRESSURE_MAX_BACKLOG, the sender yields until it drains, bounding pool usage.
+ * @param msg message to send, ownership is taken
+ */
+void AsyncMessageManager::enqueueOutbound(msg_t *msg)
+{
+    auto peer = peerCredit(msg->dest);
+    msg->pad[0] = 0;
+    if (peer->backlog == 0 && lf_try_send(peer->queue, msg, global_thread_id))
+    {
+        peer->sent++;
+        peer->credits = lf_free_slots(peer->queue);
+        return;
+    }
+    peer->stalls++;
+    peer->credits = 0;
+    if (peer->backlog_tail == nullptr)
+    {
+        peer->backlog_head = msg;
+        aid_t key = msg->dest;
+        key.fields.thread = 0;
+        backlogged_peers.push_back(key.raw);
+    }
+    else
+    {
+        peer->backlog_tail->pad[0] = (size_t)msg;
+    }
+    peer->backlog_tail = msg;
+    peer->backlog++;
+    if (peer->backlog > peer->backlog_peak)
+    {
+        peer->backlog_peak = peer->backlog;
+    }
+    DIGGI_TRACE(diggiapi->GetLogObject(), LDEBUG, "destination %" PRIu64 " has no credit, %lu messages parked\n", msg->dest.raw, peer->backlog);
+
+    if (peer->backlog > AMM_BACKPRESSURE_MAX_BACKLOG)
+    {
+        aid_t key = msg->dest;
+        while (!drainBacklog(peerCredit(key)))
+        {
+            diggiapi->GetThreadPool()->Yield();
+        }
+        return;
+    }
+    if (!backpressure_retry_scheduled)
+    {
+        backpressure_retry_scheduled = true;
+        diggiapi->GetThreadPool()->ScheduleAfter(AMM_BACKPRESSURE_RETRY_USEC, AsyncMessageManager::backpressure_retry_cb, this, __PRETTY_FUNCTION__);
+    }
+}
+/**
+ * @brief send parked messages of a destination, in order, while it has credit.
+ * @param peer destination
+ * @return true if backlog is empty
+ */
+bool AsyncMessageManager::drainBacklog(peer_credit_t *peer)
+{
+    while (peer->backlog_head != nullptr)
+    {
+        auto msg = peer->backlog_head;
+        auto next = (msg_t *)msg->pad[0];
+        msg->pad[0] = 0;
+        if (!lf_try_send(peer->queue, msg, global_thread_id))
+        {
+            msg->pad[0] = (size_t)next;
+            peer->credits = 0;
+            return false;
+        }
+        peer->sent++;
+        peer->backlog--;
+        peer->backlog_head = next;
+        if (next == nullptr)
+        {
+            peer->backlog_tail = nullptr;
+        }
+    }
+    peer->credits = lf_free_slots(peer->queue);
+    return true;
+}
+/**
+ * @brief periodic drain of parked messages, rescheduled until all destinations have drained.
+ * @param ctx AsyncMessageManager
+ * @param status 
+ */
+void AsyncMessageManager::backpressure_retry_cb(void *ctx, int status)
+{
+    DIGGI_ASSERT(ctx);
+    auto _this = (AsyncMessageManager *)ctx;
+    _this->backpressure_retry_scheduled = false;
+    if (_this->stop)
+    {
+        return;
+    }
+    for (size_t i = 0; i < _this->backlogged_peers.size();)
+    {
+        auto peer = _this->peer_credits.find(_this->backlogged_peers[i]);
+        DIGGI_ASSERT(peer);
+        if (_this->drainBacklog(peer))
+        {
+            _this->backlogged_peers[i] = _this->backlogged_peers.back();
+            _this->backlogged_peers.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+    if (!_this->backlogged_peers.empty())
+    {
+        _this->backpressure_retry_scheduled = true;
+        _this->diggiapi->GetThreadPool()->ScheduleAfter(AMM_BACKPRESSURE_RETRY_USEC, AsyncMessageManager::backpressure_retry_cb, ctx, __PRETTY_FUNCTION__);
+    }
+}
+/**
+ * @brief credit currently available towards a destination, as last observed.
+ * @param destination destination instance, thread field is ignored
+ * @return size_t free slots in destination queue, 0 while messages are parked
+ */
+size_t AsyncMessageManager::peerCredits(aid_t destination)
+{
+    auto peer = peerCredit(destination);
+    return (peer->backlog > 0) ? 0 : lf_free_slots(peer->queue);
+}
+/**
+ * @brief per destination credit and stall metrics, in csv format.
+ * One row per destination this thread has sent to.
+ * @return std::string csv with header
+ */
+std::string AsyncMessageManager::creditStatsCsv()
+{
+    std::string csv = "peer,credits,sent,stalls,backlog,backlog_peak\n";
+    peer_credits.forEach([&](uint64_t key, peer_credit_t &peer) {
+        csv += std::to_string(key) + "," +
+               std::to_string(peer.credits) + "," +
+               std::to_string(peer.sent) + "," +
+               std::to_string(peer.stalls) + "," +
+               std::to_string(peer.backlog) + "," +
+               std::to_string(peer.backlog_peak) + "\n";
+    });
+    return csv;
+}
+/**
+ * @brief hold a small outbound message, so it may be sent along with following messages to the same destination lane.
+ * Messages are packed back to back into a single container message of type DIGGI_COALESCED_MESSAGE_TYPE, each 8 byte aligned.
+ * A container costs a single pool object and queue operation, and a single network write for remote destinations.
+ * Pending messages are flushed when the container is full, before any uncoalesced message to the same destination,
+ * and otherwise once the current callback returns, or after the configured window.
+ * @param msg message to coalesce, ownership is taken
+ */
+void AsyncMessageManager::coalesce(msg_t *msg)
+{
+    coalesce_slot_t *slot = nullptr;
+    for (size_t i = 0; i < AMM_COALESCE_SLOTS; i++)
+    {
+        if (coalesce_pending[i].first != nullptr && coalesce_pending[i].dest.raw == msg->dest.raw)
+        {
+            slot = &coalesce_pending[i];
+            break;
+        }
+        if (slot == nullptr && coalesce_pending[i].first == nullptr)
+        {
+            slot = &coalesce_pending[i];
+        }
+    }
+    if (slot == nullptr)
+    {
+        /*
+            More destinations than slots, evict the first slot
+        */
+        slot = &coalesce_pending[0];
+        flushCoalesced(slot);
+    }
+    if (slot->first == nullptr)
+    {
+        slot->dest = msg->dest;
+        slot->first = msg;
+    }
+    else
+    {
+        if (slot->container == nullptr)
+        {
+            slot->container = (msg_t *)msg_pool_alloc(global_mem_buf, AMM_COALESCE_CONTAINER_SIZE, global_thread_id);
+            slot->capacity = msg_pool_object_size(global_mem_buf, slot->container);
+            memset(slot->container, 0, sizeof(msg_t));
+            slot->container->type = DIGGI_COALESCED_MESSAGE_TYPE;
+            slot->container->src = slot->first->src;
+            slot->container->dest = slot->dest;
+            slot->container->delivery = CLEARTEXT;
+            slot->container->omit_from_log = 1;
+            slot->container->size = sizeof(msg_t);
+            memcpy(slot->container->data, slot->first, slot->first->size);
+            slot->container->size += roundUp_r(slot->first->size, 8);
+        }
+        if (slot->container->size + roundUp_r(msg->size, 8) > slot->capacity)
+        {
+            flushCoalesced(slot);
+            slot->dest = msg->dest;
+            slot->first = msg;
+        }
+        else
+        {
+            memcpy(((uint8_t *)slot->container) + slot->container->size, msg, msg->size);
+            slot->container->size += roundUp_r(msg->size, 8);
+            msg_pool_free(global_mem_buf, msg, global_thread_id);
+        }
+    }
+    if (!coalesce_flush_scheduled)
+    {
+        coalesce_flush_scheduled = true;
+        if (coalesce_window_us > 0)
+        {
+            diggiapi->GetThreadPool()->ScheduleAfter(coalesce_window_us, AsyncMessageManager::coalesce_flush_cb, this, __PRETTY_FUNCTION__);
+        }
+        else
+        {
+            diggiapi->GetThreadPool()->ScheduleOn(diggiapi->GetThreadPool()->currentThreadId(), AsyncMessageManager::coalesce_flush_cb, this, __PRETTY_FUNCTION__);
+        }
+    }
+}
+/**
+ * @brief send pending messages of a slot, either the lone first message or the container holding all of them.
+ * Container size includes trailing alignment of the last message.
+ * @param slot slot to flush, emptied on return
+ */
+void AsyncMessageManager::flushCoalesced(coalesce_slot_t *slot)
+{
+    if (slot->first == nullptr)
+    {
+        return;
+    }
+    auto first = slot->first;
+    auto container = slot->container;
+    memset(slot, 0, sizeof(coalesce_slot_t));
+    if (container == nullptr)
+    {
+        enqueueOutbound(first);
+    }
+    else
+    {
+        msg_pool_free(global_mem_buf, first, global_thread_id);
+        DIGGI_ASSERT(container->size <= msg_pool_object_size(global_mem_buf, container));
+        enqueueOutbound(container);
+    }
+}
+/**
+ * @brief send pending coalesced messages to a destination lane, preserving order with a message about to be sent.
+ * @param destination destination, including lane
+ */
+void AsyncMessageManager::flushCoalesced(aid_t destination)
+{
+    if (!coalescing)
+    {
+        return;
+    }
+    for (size_t i = 0; i < AMM_COALESCE_SLOTS; i++)
+    {
+        if (coalesce_pending[i].first != nullptr && coalesce_pending[i].dest.raw == destination.raw)
+        {
+            flushCoalesced(&coalesce_pending[i]);
+        }
+    }
+}
+/**
+ * @brief send all pending coalesced messages
+ */
+void AsyncMessageManager::flushCoalesced()
+{
+    for (size_t i = 0; i < AMM_COALESCE_SLOTS; i++)
+    {
+        flushCoalesced(&coalesce_pending[i]);
+    }
+}
+/**
+ * @brief scheduled flush of pending coalesced messages, on the thread owning the AMM.
+ * @param ctx AsyncMessageManager
+ * @param status 
+ */
+void AsyncMessageManager::coalesce_flush_cb(void *ctx, int status)
+{
+    DIGGI_ASSERT(ctx);
+    auto _this = (AsyncMessageManager *)ctx;
+    _this->coalesce_flush_scheduled = false;
+    _this->flushCoalesced();
 }
 /**
  * @brief polling loop callback for inbound messages.
  * checks inbound message queue for messages and reschedules self onto diggiapi->GetThreadPool() for asynchronous looping.
  * Implements thread reclamation algorithm, with linear backoff. 
  * AMM registers if current instance thread recieves no incomming messages during a given poll.
- * After a given threshold, the thread is reclaimed by the untrusted runtime, which allow other threads to execute in the interim.
- * The thread is reclaimed for linearly increasing intervals. 
+ * After a given threshold, the next poll is delayed on the threadpool timer wheel, for linearly increasing intervals.
+ * Other callbacks on the thread still execute in the interim, and an otherwise idle thread blocks until the next poll, allowing other threads to execute.
  * Once a packet is retrieved, the algorithm resets and gives exclusive threading controll to the instance.
+ * If the input queue has a doorbell enabled, an idle thread instead parks on it and is woken by the next send,
+ * the next timer expiry of the thread, or work scheduled onto the thread, @see ThreadPool::ParkOnQueue
  * Each thread holds its own AMM and may poll the input queue concurrently.
  * Messages recieved for another thread are delivered to the correct thread AMM by invoking a thread switch to the target via the theadpool api. 
+ * Up to AMM_PUMP_BATCH_SIZE messages are dequeued per invocation, reserved with a single atomic operation on the input queue.
  * @param ctx 
  * @param status 
  */
@@ -375,10 +1094,7 @@ void AsyncMessageManager::async_message_pump(void *ctx, int status)
     {
         return;
     }
-    _this->diggiapi->GetThreadPool()->Schedule(AsyncMessageManager::async_message_pump, ctx, __PRETTY_FUNCTION__);
     DIGGI_ASSERT(_this->input);
-    msg_async_response_t resp_ctx;
-    resp_ctx.context = ctx;
     if (_this->stop)
     {
         /*
@@ -392,93 +1108,148 @@ void AsyncMessageManager::async_message_pump(void *ctx, int status)
 
         return;
     }
-    auto item = (msg_t *)lf_try_recieve(_this->input, _this->global_thread_id);
+    void *batch[AMM_PUMP_BATCH_SIZE];
+    auto count = lf_try_recieve_batch(_this->input, batch, AMM_PUMP_BATCH_SIZE, _this->global_thread_id);
 
-    if (item == nullptr)
+    if (count == 0 && _this->nomessage_event_cnt >= DIGGI_IDLE_MESSAGE_THRESHOLD && !_this->input->doorbell_enabled_)
+    {
+        _this->nomessage_event_cnt = 0;
+        if (_this->linearbackoff < PEAK_LINEAR_BACKOFF)
+        {
+            _this->linearbackoff = _this->linearbackoff << 2;
+            DIGGI_TRACE(_this->diggiapi->GetLogObject(), LDEBUG, "waiting for message, poll delay increased, linearbackoff = %lu\n", _this->linearbackoff);
+        }
+        _this->diggiapi->GetThreadPool()->ScheduleAfter(_this->linearbackoff * DIGGI_BASE_IDLE_SLEEP_USEC, AsyncMessageManager::async_message_pump, ctx, __PRETTY_FUNCTION__);
+        return;
+    }
+    auto pool = _this->diggiapi->GetThreadPool();
+    if (count == 0)
     {
         if (_this->nomessage_event_cnt >= DIGGI_IDLE_MESSAGE_THRESHOLD)
         {
+            /*
+                Block until a producer rings the input queue doorbell.
+                Bounded by peak backoff and the next timer of this thread, and cut short by work scheduled onto this thread.
+                Parked before rescheduling, as the pump itself would otherwise count as pending work.
+            */
             _this->nomessage_event_cnt = 0;
-            if (_this->linearbackoff < PEAK_LINEAR_BACKOFF)
-            {
-                _this->linearbackoff = _this->linearbackoff << 2;
-                DIGGI_TRACE(_this->diggiapi->GetLogObject(), LDEBUG, "waiting for message, sleep increased, linearbackoff = %lu\n", _this->linearbackoff);
-            }
-
-#ifdef DIGGI_ENCLAVE
-            ocall_sleep(_this->linearbackoff * DIGGI_BASE_IDLE_SLEEP_USEC);
-#else
-            usleep(_this->linearbackoff * DIGGI_BASE_IDLE_SLEEP_USEC);
-#endif
+            pool->ParkOnQueue(_this->input, PEAK_LINEAR_BACKOFF * DIGGI_BASE_IDLE_SLEEP_USEC);
         }
         else
         {
             _this->nomessage_event_cnt++;
         }
+        pool->ScheduleOn(pool->currentThreadId(), AsyncMessageManager::async_message_pump, ctx, __PRETTY_FUNCTION__);
     }
     else
     {
+        /*
+            Rescheduled before delivery, so polling continues if a handler yields.
+        */
+        pool->ScheduleOn(pool->currentThreadId(), AsyncMessageManager::async_message_pump, ctx, __PRETTY_FUNCTION__);
         _this->nomessage_event_cnt = 0;
         _this->linearbackoff = 1;
-
-        DIGGI_ASSERT(item->size > 0);
-        DIGGI_TRACE(_this->diggiapi->GetLogObject(), LDEBUG, "Message recieved, linear backoff reset to 1\n");
-        auto msg = (msg_t *)item;
-        resp_ctx.msg = msg;
-        DIGGI_TRACE(_this->diggiapi->GetLogObject(), LDEBUG,
-                    "async_message_pump recieved message from: %lu, to: %lu, id:%lu, size: %lu, type = %d\n",
-                    msg->src.raw,
-                    msg->dest.raw,
-                    msg->id,
-                    msg->size,
-                    msg->type);
-
+        DIGGI_TRACE(_this->diggiapi->GetLogObject(), LDEBUG, "%lu messages recieved, linear backoff reset to 1\n", count);
         /*
-			If source thread is same as destination thread 
-			No resheduling  is required
-		*/
-        if ((size_t)msg->dest.fields.thread == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId())
+            Entire batch is dequeued, so all of it is delivered even if a handler requests stop.
+        */
+        for (size_t i = 0; i < count; i++)
         {
-            auto defer_ringbuffer_delete = async_source_cb(COPY(msg_async_response_t, &resp_ctx, sizeof(msg_async_response_t)));
-            if (!defer_ringbuffer_delete)
-            {
-                // memset(item, 0, item->size);
-                lf_send(_this->global_mem_buf, item, _this->global_thread_id);
-            }
+            async_message_deliver(_this, (msg_t *)batch[i]);
+        }
+    }
+}
+/**
+ * @brief deliver a single inbound message recieved by the message pump.
+ * Handled directly if destined for the current thread, otherwise resheduled onto the destination thread.
+ * The response context of a message handled directly lives on the stack of the pump, so delivery does not allocate.
+ * Only a thread change or deferred typed delivery, where the context outlives this call, copies it to the heap.
+ * @param _this AMM of the polling thread
+ * @param msg recieved message
+ */
+void AsyncMessageManager::async_message_deliver(AsyncMessageManager *_this, msg_t *msg)
+{
+    DIGGI_ASSERT(msg);
+    DIGGI_ASSERT(msg->size > 0);
+    if (msg->type == DIGGI_COALESCED_MESSAGE_TYPE)
+    {
+        _this->unpackCoalesced(msg);
+        return;
+    }
+    msg_async_response_t resp_ctx;
+    resp_ctx.context = _this;
+    resp_ctx.msg = msg;
+    DIGGI_TRACE(_this->diggiapi->GetLogObject(), LDEBUG,
+                "async_message_pump recieved message from: %lu, to: %lu, id:%lu, size: %lu, type = %d\n",
+                msg->src.raw,
+                msg->dest.raw,
+                msg->id,
+                msg->size,
+                msg->type);
+
+    /*
+        If source thread is same as destination thread 
+        No resheduling  is required
+    */
+    auto target = _this->inboundThread(msg);
+    if (target == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId())
+    {
+        auto defer_ringbuffer_delete = async_source_cb(&resp_ctx);
+        if (!defer_ringbuffer_delete)
+        {
+            msg_pool_free(_this->global_mem_buf, msg, _this->global_thread_id);
         }
+    }
+    /*
+        Resheduling to expected thread is required
+    */
+    else
+    {
         /*
-			Resheduling to expected thread is required
-		*/
-        else
+            The expected recieving thread must exist.
+            With flow routing, all messages from a remote lane are mapped to a single thread, @see inboundThread
+        */
+        if (!(target < _this->diggiapi->GetThreadPool()->physicalThreadCount()))
         {
-            /*
-				The expected recieving thread must exist.
-				TODO: Implement fair and consistent scheduling of messages to threads.
-					  Given a message mapped to a thread, all messages from that remote thread should be mapped to this particular thread.
-					  Messages should be load balanced across threads such that hot message flows do not excessively ocupy a single core.
-			*/
-            if (!((size_t)(msg->dest.fields.thread) < _this->diggiapi->GetThreadPool()->physicalThreadCount()))
-            {
-                DIGGI_TRACE(_this->diggiapi->GetLogObject(), LRELEASE,
-                            "Physical thread change,src-thread:%d dest-thread %u for message with session count=%lu from: %lu, to: %lu, id:%lu, size: %lu, type = %d\n",
-                            _this->diggiapi->GetThreadPool()->currentThreadId(),
-                            msg->dest.fields.thread,
-                            msg->session_count,
-                            msg->src.raw,
-                            msg->dest.raw,
-                            msg->id,
-                            msg->size,
-                            msg->type);
-                DIGGI_TRACE(_this->diggiapi->GetLogObject(), LRELEASE, "Physical threadcount %lu\n", _this->diggiapi->GetThreadPool()->physicalThreadCount());
-            }
-            DIGGI_ASSERT(_this->tsafemm);
-            DIGGI_ASSERT((size_t)(msg->dest.fields.thread) < _this->diggiapi->GetThreadPool()->physicalThreadCount());
-            _this->diggiapi->GetThreadPool()->ScheduleOn(msg->dest.fields.thread,
-                                                         AsyncMessageManager::async_source_cb_thread_change,
-                                                         COPY(msg_async_response_t, &resp_ctx, sizeof(msg_async_response_t)), __PRETTY_FUNCTION__);
+            DIGGI_TRACE(_this->diggiapi->GetLogObject(), LRELEASE,
+                        "Physical thread change,src-thread:%d dest-thread %u for message with session count=%lu from: %lu, to: %lu, id:%lu, size: %lu, type = %d\n",
+                        _this->diggiapi->GetThreadPool()->currentThreadId(),
+                        (unsigned)target,
+                        msg->session_count,
+                        msg->src.raw,
+                        msg->dest.raw,
+                        msg->id,
+                        msg->size,
+                        msg->type);
+            DIGGI_TRACE(_this->diggiapi->GetLogObject(), LRELEASE, "Physical threadcount %lu\n", _this->diggiapi->GetThreadPool()->physicalThreadCount());
         }
+        DIGGI_ASSERT(_this->tsafemm);
+        DIGGI_ASSERT(target < _this->diggiapi->GetThreadPool()->physicalThreadCount());
+        _this->diggiapi->GetThreadPool()->ScheduleOn(target,
+                                                     AsyncMessageManager::async_source_cb_thread_change,
+                                                     COPY(msg_async_response_t, &resp_ctx, sizeof(msg_async_response_t)), __PRETTY_FUNCTION__);
     }
 }
+/**
+ * @brief deliver messages packed into a coalesced container, in the order they were sent.
+ * Each message is copied into its own pool object, as handlers may retain or reschedule messages individually.
+ * @param container message of type DIGGI_COALESCED_MESSAGE_TYPE, returned to the pool
+ */
+void AsyncMessageManager::unpackCoalesced(msg_t *container)
+{
+    size_t offset = sizeof(msg_t);
+    while (offset < container->size)
+    {
+        auto packed = (msg_t *)(((uint8_t *)container) + offset);
+        DIGGI_ASSERT(packed->size >= sizeof(msg_t));
+        DIGGI_ASSERT(offset + packed->size <= container->size);
+        auto msg = (msg_t *)msg_pool_alloc(global_mem_buf, packed->size, global_thread_id);
+        memcpy(msg, packed, packed->size);
+        offset += roundUp_r(packed->size, 8);
+        async_message_deliver(this, msg);
+    }
+    msg_pool_free(global_mem_buf, container, global_thread_id);
+}
 /**
  * @brief callback invoked on correct AMM thread in response to a message recieved by another thread/AMM
  * Calls regular message handling procedure after modifying context objects to match current AMM.
@@ -491,8 +1262,8 @@ void AsyncMessageManager::async_source_cb_thread_change(void *ptr, int status)
     auto resp = (msg_async_response_t *)ptr;
     auto _this_old_thread = (AsyncMessageManager *)resp->context;
     DIGGI_ASSERT(_this_old_thread);
-    DIGGI_ASSERT(((size_t)resp->msg->src.fields.thread) == (size_t)_this_old_thread->diggiapi->GetThreadPool()->currentThreadId());
-    DIGGI_ASSERT(((size_t)resp->msg->dest.fields.thread) == (size_t)_this_old_thread->diggiapi->GetThreadPool()->currentThreadId());
+    DIGGI_ASSERT(_this_old_thread->inboundThread(resp->msg) == (size_t)_this_old_thread->diggiapi->GetThreadPool()->currentThreadId());
+    DIGGI_ASSERT(_this_old_thread->flow_routing || ((size_t)resp->msg->src.fields.thread) == (size_t)_this_old_thread->diggiapi->GetThreadPool()->currentThreadId());
 
     auto msg = resp->msg;
     DIGGI_ASSERT(msg);
@@ -511,7 +1282,8 @@ void AsyncMessageManager::async_source_cb_thread_change(void *ptr, int status)
                 resp->msg->size,
                 resp->msg->type);
 
-    auto defer_ringbuffer_delete = async_source_cb((msg_async_response_t *)ptr);
+    auto defer_ringbuffer_delete = async_source_cb(resp);
+    free(resp);
 
     /*
 		The new thread accepts responsibillity for old threads ringbuffer message 
@@ -520,7 +1292,7 @@ void AsyncMessageManager::async_source_cb_thread_change(void *ptr, int status)
     if (!defer_ringbuffer_delete)
     {
         // memset(msg, 0, msg->size);
-        lf_send(_this_old_thread->global_mem_buf, msg, _this_old_thread->tsafemm->getAsyncMessageManager()->global_thread_id);
+        msg_pool_free(_this_old_thread->global_mem_buf, msg, _this_old_thread->tsafemm->getAsyncMessageManager()->global_thread_id);
     }
 }
 
@@ -531,9 +1303,10 @@ void AsyncMessageManager::async_source_cb_thread_change(void *ptr, int status)
  * we expect them to have a one-off entry in the async_handler_map.
  * One-off handlers witch are not found, cause an assertion, because messages with one-of ids must have a preceding invocation of a typed handler.
  * Typed callback handlers not yet registered, may be caused by instance intitlization being slow.
- * We therefore retry typed handlers by rescheduling the callback to retry invocation pending a initialization event in the interim.
+ * Such messages are parked per type, and delivered in order once the type is registered @see registerTypeCallback.
+ * resp remains owned by the caller, and may live on its stack.
  * @param resp context, message tuple 
- * @return true  if a deffered typed callback handler, where we must retry, we avoid reclaiming message objects until callback delivery occurs.
+ * @return true  if the message was parked, we avoid reclaiming message objects until callback delivery occurs.
  * @return false 
  */
 bool AsyncMessageManager::async_source_cb(msg_async_response_t *resp)
@@ -542,8 +1315,8 @@ bool AsyncMessageManager::async_source_cb(msg_async_response_t *resp)
     auto _this = (AsyncMessageManager *)resp->context;
     DIGGI_ASSERT(_this);
     auto msg = resp->msg;
-    DIGGI_ASSERT(((size_t)resp->msg->src.fields.thread) == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId());
-    DIGGI_ASSERT(((size_t)resp->msg->dest.fields.thread) == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId());
+    DIGGI_ASSERT(_this->inboundThread(resp->msg) == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId());
+    DIGGI_ASSERT(_this->flow_routing || ((size_t)resp->msg->src.fields.thread) == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId());
     DIGGI_TRACE(_this->diggiapi->GetLogObject(),
                 LogLevel::LDEBUG,
                 "Incomming from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
@@ -555,9 +1328,17 @@ bool AsyncMessageManager::async_source_cb(msg_async_response_t *resp)
 
     if (msg->id != 0)
     {
-        auto handler = _this->async_handler_map[msg->id];
+        /*
+            copied, as callback may insert or erase flows, which invalidates entries
+        */
+        auto found = _this->async_handler_map.find(msg->id);
+        auto handler = (found != nullptr) ? *found : async_flow_t{0};
         if (handler.cb != nullptr)
         {
+            /*
+                the flow deadline covers the wait for this message only
+            */
+            found->timer = 0;
             resp->context = handler.arg;
             DIGGI_TRACE(_this->diggiapi->GetLogObject(),
                         LogLevel::LDEBUG,
@@ -568,15 +1349,32 @@ bool AsyncMessageManager::async_source_cb(msg_async_response_t *resp)
                         msg->type,
                         msg->size);
             handler.cb(resp, 1);
-            free(resp);
+            return false;
+        }
+        /*
+            Reply to a flow which has timed out or been cancelled, its waiter has allready been released
+        */
+        if (_this->isExpiredFlow(msg->id))
+        {
+            DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                        LogLevel::LDEBUG,
+                        "Late reply to expired flow from: %" PRIu64 ", id: %lu\n",
+                        msg->src.raw,
+                        msg->id);
+            if (_this->late_reply_handler.cb != nullptr)
+            {
+                resp->context = _this->late_reply_handler.arg;
+                _this->late_reply_handler.cb(resp, 1);
+            }
             return false;
         }
     }
     /*
-		In the case where the type has not yet been registered by application func
+		In the case where the type has not yet been registered by application func,
+        or earlier messages of the type are still parked awaiting delivery
 	*/
-    auto type_handler = _this->type_handler_map[msg->type];
-    if (type_handler.cb == nullptr)
+    auto found_type = _this->findTypeHandler(msg->type);
+    if (found_type == nullptr || (_this->pending_types.size() > 0 && _this->pending_types.find((uint64_t)msg->type) != nullptr))
     {
         DIGGI_TRACE(_this->diggiapi->GetLogObject(),
                     LogLevel::LDEBUG,
@@ -586,12 +1384,12 @@ bool AsyncMessageManager::async_source_cb(msg_async_response_t *resp)
                     msg->id,
                     msg->type,
                     msg->size);
-
-        _this->diggiapi->GetThreadPool()->Schedule(defered_async_source_cb, resp, __PRETTY_FUNCTION__);
+        _this->parkPendingType(msg);
         return true;
     }
     else
     {
+        auto type_handler = *found_type;
         resp->context = type_handler.arg;
         DIGGI_TRACE(_this->diggiapi->GetLogObject(),
                     LogLevel::LDEBUG,
@@ -605,66 +1403,89 @@ bool AsyncMessageManager::async_source_cb(msg_async_response_t *resp)
         DIGGI_ASSERT(type_handler.cb);
         type_handler.cb(resp, 1);
     }
-    free(resp);
     return false;
 }
 /**
- * @brief Deffered delivery of typed callback message.
- * In the event of successs, message objects are reclaimed.
- * May retry by scheduling itself indefinently.
- * @warning bugs leading to indefinete rescheduling of this function may be hard to catch, recomend some messaging or a retry limit.
- * @param ptr msg_async_response_t containing message and context(this)
- * @param status 
+ * @brief park message of a type without registered handler.
+ * Appended to the per type list, and held without polling until registerTypeCallback is invoked for the type.
+ * @param msg recieved message, reclaimed once delivered
  */
-void AsyncMessageManager::defered_async_source_cb(void *ptr, int status)
+void AsyncMessageManager::parkPendingType(msg_t *msg)
 {
-
-    DIGGI_ASSERT(ptr);
-    auto resp = (msg_async_response_t *)ptr;
-    auto msg = resp->msg;
-    auto _this = (AsyncMessageManager *)resp->context;
-    DIGGI_ASSERT(((size_t)resp->msg->src.fields.thread) == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId());
-    DIGGI_ASSERT(((size_t)resp->msg->dest.fields.thread) == (size_t)_this->diggiapi->GetThreadPool()->currentThreadId());
-    DIGGI_TRACE(_this->diggiapi->GetLogObject(),
-                LogLevel::LDEBUG,
-                "Defered from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
-                msg->src.raw,
-                msg->dest.raw,
-                msg->id,
-                msg->type,
-                msg->size);
-
-    auto type_handler = _this->type_handler_map[resp->msg->type];
-
-    if (type_handler.cb != nullptr)
+    auto &pending = pending_types[(uint64_t)msg->type];
+    if (pending.count == 0)
     {
-        DIGGI_TRACE(_this->diggiapi->GetLogObject(),
-                    LogLevel::LDEBUG, "Successfull defered from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
-                    msg->src.raw,
-                    msg->dest.raw,
-                    msg->id,
-                    msg->type,
-                    msg->size);
-
-        resp->context = type_handler.arg;
-        type_handler.cb(resp, 1);
-        // memset(msg, 0, msg->size);
-        lf_send(_this->global_mem_buf, resp->msg, _this->global_thread_id);
-        free(resp);
+        pending.thread = diggiapi->GetThreadPool()->currentThreadId();
+    }
+    DIGGI_ASSERT(pending.thread == diggiapi->GetThreadPool()->currentThreadId());
+    msg->pad[0] = 0;
+    if (pending.tail == nullptr)
+    {
+        pending.head = msg;
     }
     else
+    {
+        pending.tail->pad[0] = (uint64_t)msg;
+    }
+    pending.tail = msg;
+    pending.count++;
+}
+/**
+ * @brief scheduled delivery of parked messages, once their type is registered.
+ * @param ctx AsyncContext holding AMM and message type
+ * @param status
+ */
+void AsyncMessageManager::pending_type_flush_cb(void *ctx, int status)
+{
+    DIGGI_ASSERT(ctx);
+    auto actx = (AsyncContext<AsyncMessageManager *, msg_type_t> *)ctx;
+    auto _this = actx->item1;
+    auto ty = actx->item2;
+    delete actx;
+    _this->flushPendingType(ty);
+}
+/**
+ * @brief deliver parked messages of a type in order of arrival, and reclaim message objects.
+ * Stops if the type is unregistered by a callback, remaining messages stay parked.
+ * @param ty message type
+ */
+void AsyncMessageManager::flushPendingType(msg_type_t ty)
+{
+    auto pending = pending_types.find((uint64_t)ty);
+    if (pending == nullptr)
+    {
+        return;
+    }
+    DIGGI_ASSERT(pending->thread == diggiapi->GetThreadPool()->currentThreadId());
+    pending->flush_scheduled = false;
+    DIGGI_TRACE(diggiapi->GetLogObject(), LogLevel::LDEBUG, "Delivering %lu parked messages of type: %d\n", pending->count, ty);
+    while (true)
     {
         /*
-			If type has yet not been scheduled, we retry
-		*/
-        DIGGI_TRACE(_this->diggiapi->GetLogObject(),
-                    LogLevel::LDEBUG, "Retrying: type not registered for message from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
-                    msg->src.raw,
-                    msg->dest.raw,
-                    msg->id,
-                    msg->type,
-                    msg->size);
-
-        _this->diggiapi->GetThreadPool()->Schedule(defered_async_source_cb, resp, __PRETTY_FUNCTION__);
+            reacquired each iteration, as callbacks may park or register other types, which invalidates entries
+        */
+        pending = pending_types.find((uint64_t)ty);
+        if (pending == nullptr)
+        {
+            return;
+        }
+        auto found_type = findTypeHandler(ty);
+        if (found_type == nullptr)
+        {
+            return;
+        }
+        auto msg = pending->head;
+        pending->head = (msg_t *)msg->pad[0];
+        pending->count--;
+        if (pending->head == nullptr)
+        {
+            pending_types.erase((uint64_t)ty);
+        }
+        msg_async_response_t resp;
+        resp.msg = msg;
+        resp.context = found_type->arg;
+        auto type_handler = *found_type;
+        type_handler.cb(&resp, 1);
+        msg_pool_free(global_mem_buf, msg, global_thread_id);
     }
 }
@@ -42,16 +42,11 @@ void AttestationClient::dh_key_exchange_report_cb(void *ptr, int status)
     DIGGI_ASSERT(kec->parent_manager->diggiapi->GetThreadPool()->currentThreadId() == resp->msg->src.fields.thread);
     kec->parent_manager->messageService->endAsync(resp->msg);
     DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(), LDEBUG, "DH Key exchange done\n");
-    for (auto ctx_item : kec->outputqueue)
-    {
-        DIGGI_ASSERT(ctx_item);
-        DIGGI_ASSERT(kec->key_exchange_session_done != nullptr);
-        DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(),
-                    LogLevel::LDEBUG,
-                    "AttestationClient::dh_key_exchange_report_cb, retrying queue for dest=%lu, session_count=%lu\n", kec->other_id.raw, kec->session_id_outbound);
-        kec->key_exchange_session_done(ctx_item, 1);
-    }
-    kec->outputqueue.clear();
+    DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "AttestationClient::dh_key_exchange_report_cb, retrying queue of %lu messages for dest=%lu, session_count=%lu\n",
+                kec->outputqueue.size(), kec->other_id.raw, kec->session_id_outbound);
+    SecureMessageManager::flushOutputQueue(kec);
     kec->initial = 0;
 }
 /**
@@ -240,6 +235,8 @@ void AttestationClient::dh_key_exchange_ra_response_msg1_cb(void *ptr, int statu
  * Final callback recieieving symetric keys for attestation group.
  * The attestation group specifies which other attested participants this instance may authentically and securely communicate with.
  * Finally AttestationClient::dh_key_exchange_report_cb is called to send previously prepared messages.
+ * If the session key cache is enabled, the keys of enclave peers are cached and persisted.
+ * Sessions which waited for this attestation with "attest-at-startup" configured are then sent their queued messages.
  * Once the symetric keys are recieved, all participants in the attestation group are concidered trusted.
  * @param ptr 
  * @param status 
@@ -263,7 +260,7 @@ void AttestationClient::dh_key_exchange_ra_response_final_cb(void *ptr, int stat
         key_exchange_context_t_packd *keys = (key_exchange_context_t_packd *)malloc(sizeof(key_exchange_context_t_packd) * count);
 
         size_t decrypt_size;
-        kec->parent_manager->decrypt((secure_message_t *)resp->msg->data, kec, (char *)keys, &decrypt_size);
+        kec->parent_manager->decrypt((secure_message_t *)resp->msg->data, kec, (uint8_t *)keys, &decrypt_size);
         auto attestation_group = keys[0].other_id.fields.att_group;
         for (size_t i = 0; i < count; i++)
         {
@@ -272,6 +269,18 @@ void AttestationClient::dh_key_exchange_ra_response_final_cb(void *ptr, int stat
                         keys[i].other_id.raw);
 
             DIGGI_ASSERT(attestation_group == keys[i].other_id.fields.att_group);
+            if (kec->parent_manager->session_keys && keys[i].other_id.fields.type != LIB)
+            {
+                kec->parent_manager->session_keys->put(keys[i].other_id, &keys[0].g_sp_db.sk_key);
+            }
+            /*
+                Sessions resumed from the session key cache, or being resumed, keep their derived key
+            */
+            auto existing = kec->parent_manager->callback_map.find(keys[i].other_id.raw);
+            if (existing != kec->parent_manager->callback_map.end() && existing->second.resume_state != SESSION_RESUME_NONE)
+            {
+                continue;
+            }
             if (keys[i].other_id.fields.type == LIB)
             {
                 kec->parent_manager->callback_map[keys[i].other_id.raw].g_sp_db = {0};
@@ -288,12 +297,22 @@ void AttestationClient::dh_key_exchange_ra_response_final_cb(void *ptr, int stat
                 (async_cb_t)SecureMessageManager::SendMessageAsyncInternal;
             kec->parent_manager->callback_map[keys[i].other_id.raw].parent_manager = kec->parent_manager;
             kec->parent_manager->callback_map[keys[i].other_id.raw].session_id = 0;
+            SecureMessageManager::resetKeyEpoch(&kec->parent_manager->callback_map[keys[i].other_id.raw]);
             // kec->parent_manager->callback_map[keys[i].other_id.raw].session_id_outbound = 0;
             // kec->parent_manager->callback_map[keys[i].other_id.raw].session_id_inbound = 0;
             kec->parent_manager->callback_map[keys[i].other_id.raw].initial = 0;
             kec->parent_manager->callback_map[keys[i].other_id.raw].attestation_initialized = 1;
         }
+        memset(keys, 0, sizeof(key_exchange_context_t_packd) * count);
         free(keys);
+        if (kec->parent_manager->session_keys)
+        {
+            kec->parent_manager->session_keys->persist();
+        }
+    }
+    if (kec->parent_manager->attest_at_startup)
+    {
+        kec->parent_manager->completeGroupAttestation();
     }
     AttestationClient::dh_key_exchange_report_cb(ptr, status);
 }
\ No newline at end of file
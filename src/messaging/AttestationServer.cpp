@@ -448,6 +448,7 @@ void AttestationServer::dh_key_exchange_ra_msg3(void *ptr, int status)
                         Reset session state between trusted root and participant when new membership is announced
                     */
                     kec->parent_manager->callback_map[msg_n->dest.raw].session_id = 0;
+                    SecureMessageManager::resetKeyEpoch(&kec->parent_manager->callback_map[msg_n->dest.raw]);
                     kec->parent_manager->encrypt(&(kec->parent_manager->callback_map[msg_n->dest.raw]), (uint8_t *)keys, size, (secure_message_t *)msg_n->data);
                     free(keys);
                     DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(),
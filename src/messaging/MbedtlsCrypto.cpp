@@ -0,0 +1,498 @@
+/**
+ * @file MbedtlsCrypto.cpp
+ * @brief implementation of AES-128 GCM message crypto on the vendored mbedtls, with expanded keys cached per thread.
+ * @see MbedtlsCryptoImpl
+ * @version 0.1
+ *
+ */
+#include "messaging/MbedtlsCrypto.h"
+#include "DiggiAssert.h"
+#include "mbedtls/aes.h"
+#include "mbedtls/aesni.h"
+#include "mbedtls/platform_util.h"
+#include <string.h>
+
+#if defined(MBEDTLS_AESNI_C) && defined(MBEDTLS_HAVE_X86_64)
+#define MBEDTLS_CRYPTO_MULTI_BUFFER
+#endif
+
+/// only 96 bit nonces, as used by the secure message manager, take the interleaved path
+#define MBEDTLS_CRYPTO_IV_SIZE 12
+
+/*
+    Crypto implementations are shared by all threads of a func, the cache is per thread to avoid locking.
+    Slots are keyed on the key itself, so instances may share them.
+*/
+static thread_local mbedtls_crypto_key_slot_t key_slots[MBEDTLS_CRYPTO_KEY_SLOTS];
+static thread_local uint64_t key_slot_clock = 0;
+
+/**
+ * @brief key comparison without early exit
+ *
+ * @param a
+ * @param b
+ * @return true if keys are equal
+ */
+static bool key_equal(const sgx_aes_gcm_128bit_key_t *a, const sgx_aes_gcm_128bit_key_t *b)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < sizeof(sgx_aes_gcm_128bit_key_t); i++)
+    {
+        diff |= (*a)[i] ^ (*b)[i];
+    }
+    return diff == 0;
+}
+
+/**
+ * @brief free a cache slot, the key and its expanded schedule are zeroed.
+ *
+ * @param slot
+ */
+static void drop_slot(mbedtls_crypto_key_slot_t *slot)
+{
+    mbedtls_gcm_free(&slot->gcm);
+    mbedtls_platform_zeroize(slot->key, sizeof(slot->key));
+    slot->last_use = 0;
+    slot->used = false;
+}
+
+/**
+ * @brief lookup expanded GCM context of key, expanding it into the least recently used slot on miss.
+ *
+ * @param p_key AES-128 key
+ * @return mbedtls_gcm_context* context, nullptr if key setup failed
+ */
+mbedtls_gcm_context *MbedtlsCryptoImpl::context(const sgx_aes_gcm_128bit_key_t *p_key)
+{
+    DIGGI_ASSERT(p_key);
+    key_slot_clock++;
+    mbedtls_crypto_key_slot_t *victim = &key_slots[0];
+    for (size_t i = 0; i < MBEDTLS_CRYPTO_KEY_SLOTS; i++)
+    {
+        auto slot = &key_slots[i];
+        if (slot->used && key_equal(&slot->key, p_key))
+        {
+            slot->last_use = key_slot_clock;
+            return &slot->gcm;
+        }
+        if (!slot->used || (victim->used && slot->last_use < victim->last_use))
+        {
+            victim = slot;
+        }
+    }
+    if (victim->used)
+    {
+        drop_slot(victim);
+    }
+    mbedtls_gcm_init(&victim->gcm);
+    if (mbedtls_gcm_setkey(&victim->gcm, MBEDTLS_CIPHER_ID_AES, (const unsigned char *)p_key, 128) != 0)
+    {
+        mbedtls_gcm_free(&victim->gcm);
+        return nullptr;
+    }
+    memcpy(victim->key, p_key, sizeof(sgx_aes_gcm_128bit_key_t));
+    victim->last_use = key_slot_clock;
+    victim->used = true;
+    return &victim->gcm;
+}
+
+/**
+ * @brief drop the cached context of a key on the calling thread.
+ * Called by the secure message manager when a session switches key epoch or installs a new key.
+ * @param p_key AES-128 key
+ */
+void MbedtlsCryptoImpl::retireKey(const sgx_aes_gcm_128bit_key_t *p_key)
+{
+    DIGGI_ASSERT(p_key);
+    for (size_t i = 0; i < MBEDTLS_CRYPTO_KEY_SLOTS; i++)
+    {
+        auto slot = &key_slots[i];
+        if (slot->used && key_equal(&slot->key, p_key))
+        {
+            drop_slot(slot);
+        }
+    }
+}
+
+/**
+ * @brief authenticated encryption, p_dst may equal p_src.
+ * @return sgx_status_t
+ */
+sgx_status_t MbedtlsCryptoImpl::encrypt(
+    const sgx_aes_gcm_128bit_key_t *p_key,
+    const uint8_t *p_src,
+    uint32_t src_len,
+    uint8_t *p_dst,
+    const uint8_t *p_iv,
+    uint32_t iv_len,
+    const uint8_t *p_aad,
+    uint32_t aad_len,
+    sgx_aes_gcm_128bit_tag_t *p_out_mac)
+{
+    auto gcm = context(p_key);
+    if (gcm == nullptr)
+    {
+        return SGX_ERROR_UNEXPECTED;
+    }
+    auto ret = mbedtls_gcm_crypt_and_tag(
+        gcm,
+        MBEDTLS_GCM_ENCRYPT,
+        src_len,
+        p_iv,
+        iv_len,
+        p_aad,
+        aad_len,
+        p_src,
+        p_dst,
+        sizeof(sgx_aes_gcm_128bit_tag_t),
+        (unsigned char *)p_out_mac);
+    return (ret == 0) ? SGX_SUCCESS : SGX_ERROR_UNEXPECTED;
+}
+/**
+ * @brief authenticated decryption, p_dst may equal p_src for decryption in place.
+ * @return sgx_status_t SGX_ERROR_MAC_MISMATCH if authentication fails, p_dst is zeroed in that case.
+ */
+sgx_status_t MbedtlsCryptoImpl::decrypt(
+    const sgx_aes_gcm_128bit_key_t *p_key,
+    const uint8_t *p_src,
+    uint32_t src_len,
+    uint8_t *p_dst,
+    const uint8_t *p_iv,
+    uint32_t iv_len,
+    const uint8_t *p_aad,
+    uint32_t aad_len,
+    const sgx_aes_gcm_128bit_tag_t *p_in_mac)
+{
+    auto gcm = context(p_key);
+    if (gcm == nullptr)
+    {
+        return SGX_ERROR_UNEXPECTED;
+    }
+    auto ret = mbedtls_gcm_auth_decrypt(
+        gcm,
+        src_len,
+        p_iv,
+        iv_len,
+        p_aad,
+        aad_len,
+        (const unsigned char *)p_in_mac,
+        sizeof(sgx_aes_gcm_128bit_tag_t),
+        p_src,
+        p_dst);
+    if (ret == MBEDTLS_ERR_GCM_AUTH_FAILED)
+    {
+        return SGX_ERROR_MAC_MISMATCH;
+    }
+    return (ret == 0) ? SGX_SUCCESS : SGX_ERROR_UNEXPECTED;
+}
+/**
+ * @brief encrypt a single batch item with the mbedtls GCM api
+ *
+ * @param gcm expanded GCM context
+ * @param item message to encrypt
+ * @return sgx_status_t
+ */
+static sgx_status_t encrypt_item(mbedtls_gcm_context *gcm, crypto_batch_item_t *item)
+{
+    auto ret = mbedtls_gcm_crypt_and_tag(
+        gcm,
+        MBEDTLS_GCM_ENCRYPT,
+        item->src_len,
+        item->p_iv,
+        item->iv_len,
+        NULL,
+        0,
+        item->p_src,
+        item->p_dst,
+        sizeof(sgx_aes_gcm_128bit_tag_t),
+        (unsigned char *)item->p_out_mac);
+    return (ret == 0) ? SGX_SUCCESS : SGX_ERROR_UNEXPECTED;
+}
+
+#if defined(MBEDTLS_CRYPTO_MULTI_BUFFER)
+
+/**
+ * @brief state of one message in the interleaved batch pipeline
+ *
+ */
+typedef struct mbedtls_crypto_lane_t
+{
+    crypto_batch_item_t *item;
+    ///next counter block, block 1 is J0 which masks the tag
+    uint32_t counter;
+    ///counter blocks of the message, J0 included
+    uint32_t blocks;
+    ///GHASH accumulator
+    unsigned char y[16];
+    ///E(K, J0)
+    unsigned char tag_mask[16];
+} mbedtls_crypto_lane_t;
+
+static void put_uint32_be(unsigned char *b, uint32_t n)
+{
+    b[0] = (unsigned char)(n >> 24);
+    b[1] = (unsigned char)(n >> 16);
+    b[2] = (unsigned char)(n >> 8);
+    b[3] = (unsigned char)(n);
+}
+
+/**
+ * @brief encrypt MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT independent blocks in place with AES-NI.
+ * The rounds of all blocks are interleaved, so consecutive aesenc instructions do not depend on each other and the pipeline stays full.
+ *
+ * @param rk expanded encryption key
+ * @param nr rounds
+ * @param blocks MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT blocks of 16 bytes
+ */
+static void aesni_encrypt_blocks(const uint32_t *rk, int nr, unsigned char *blocks)
+{
+    static_assert(MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT == 8, "aesni_encrypt_blocks is unrolled for 8 blocks");
+    asm volatile("movdqu    (%1), %%xmm8             \n\t" // round key 0
+        "movdqu    0(%2), %%xmm0            \n\t"
+        "movdqu    16(%2), %%xmm1           \n\t"
+        "movdqu    32(%2), %%xmm2           \n\t"
+        "movdqu    48(%2), %%xmm3           \n\t"
+        "movdqu    64(%2), %%xmm4           \n\t"
+        "movdqu    80(%2), %%xmm5           \n\t"
+        "movdqu    96(%2), %%xmm6           \n\t"
+        "movdqu    112(%2), %%xmm7          \n\t"
+        "pxor      %%xmm8, %%xmm0           \n\t"
+        "pxor      %%xmm8, %%xmm1           \n\t"
+        "pxor      %%xmm8, %%xmm2           \n\t"
+        "pxor      %%xmm8, %%xmm3           \n\t"
+        "pxor      %%xmm8, %%xmm4           \n\t"
+        "pxor      %%xmm8, %%xmm5           \n\t"
+        "pxor      %%xmm8, %%xmm6           \n\t"
+        "pxor      %%xmm8, %%xmm7           \n\t"
+        "add       $16, %1                  \n\t"
+        "subl      $1, %0                   \n\t" // normal rounds = nr - 1
+        "1:                                 \n\t"
+        "movdqu    (%1), %%xmm8             \n\t"
+        "aesenc    %%xmm8, %%xmm0           \n\t"
+        "aesenc    %%xmm8, %%xmm1           \n\t"
+        "aesenc    %%xmm8, %%xmm2           \n\t"
+        "aesenc    %%xmm8, %%xmm3           \n\t"
+        "aesenc    %%xmm8, %%xmm4           \n\t"
+        "aesenc    %%xmm8, %%xmm5           \n\t"
+        "aesenc    %%xmm8, %%xmm6           \n\t"
+        "aesenc    %%xmm8, %%xmm7           \n\t"
+        "add       $16, %1                  \n\t"
+        "subl      $1, %0                   \n\t"
+        "jnz       1b                       \n\t"
+        "movdqu    (%1), %%xmm8             \n\t"
+        "aesenclast %%xmm8, %%xmm0          \n\t"
+        "aesenclast %%xmm8, %%xmm1          \n\t"
+        "aesenclast %%xmm8, %%xmm2          \n\t"
+        "aesenclast %%xmm8, %%xmm3          \n\t"
+        "aesenclast %%xmm8, %%xmm4          \n\t"
+        "aesenclast %%xmm8, %%xmm5          \n\t"
+        "aesenclast %%xmm8, %%xmm6          \n\t"
+        "aesenclast %%xmm8, %%xmm7          \n\t"
+        "movdqu    %%xmm0, 0(%2)            \n\t"
+        "movdqu    %%xmm1, 16(%2)           \n\t"
+        "movdqu    %%xmm2, 32(%2)           \n\t"
+        "movdqu    %%xmm3, 48(%2)           \n\t"
+        "movdqu    %%xmm4, 64(%2)           \n\t"
+        "movdqu    %%xmm5, 80(%2)           \n\t"
+        "movdqu    %%xmm6, 96(%2)           \n\t"
+        "movdqu    %%xmm7, 112(%2)          \n\t"
+        : "+r"(nr), "+r"(rk)
+        : "r"(blocks)
+        : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8");
+}
+
+/**
+ * @brief absorb up to one block into the GHASH accumulator, y = (y ^ block) * H with PCLMULQDQ.
+ *
+ * @param y accumulator
+ * @param h hash key, big endian
+ * @param block data, zero padded if shorter than 16 bytes
+ * @param len length of block
+ */
+static void ghash_update(unsigned char y[16], const unsigned char h[16], const unsigned char *block, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        y[i] ^= block[i];
+    }
+    mbedtls_aesni_gcm_mult(y, y, h);
+}
+
+/**
+ * @brief start encrypting the next item with a 96 bit nonce in lane, items with other nonce sizes are encrypted directly.
+ *
+ * @param gcm expanded GCM context
+ * @param lane idle lane
+ * @param items batch
+ * @param count count of items
+ * @param next index of next item, advanced past consumed items
+ * @return sgx_status_t
+ */
+static sgx_status_t start_lane(mbedtls_gcm_context *gcm, mbedtls_crypto_lane_t *lane, crypto_batch_item_t *items, size_t count, size_t *next)
+{
+    lane->item = nullptr;
+    while (*next < count)
+    {
+        auto item = &items[(*next)++];
+        if (item->iv_len != MBEDTLS_CRYPTO_IV_SIZE)
+        {
+            auto sts = encrypt_item(gcm, item);
+            if (sts != SGX_SUCCESS)
+            {
+                return sts;
+            }
+            continue;
+        }
+        lane->item = item;
+        lane->counter = 1;
+        lane->blocks = (uint32_t)(1 + ((uint64_t)item->src_len + 15) / 16);
+        memset(lane->y, 0, sizeof(lane->y));
+        break;
+    }
+    return SGX_SUCCESS;
+}
+
+/**
+ * @brief multi buffer GCM encryption of a batch.
+ * Counter blocks of up to MBEDTLS_CRYPTO_BATCH_LANES messages are encrypted together, MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT at a time,
+ * so small messages share the AES-NI pipeline instead of each paying its latency.
+ * GHASH is computed per message on PCLMULQDQ. A lane takes the next message as soon as its current one is done.
+ * Produces the same ciphertext and tag as mbedtls_gcm_crypt_and_tag without additional data.
+ * @param gcm expanded GCM context, provides the AES key schedule and hash key
+ * @param items messages to encrypt
+ * @param count count of items
+ * @return sgx_status_t
+ */
+static sgx_status_t encrypt_interleaved(mbedtls_gcm_context *gcm, crypto_batch_item_t *items, size_t count)
+{
+    auto aes = (const mbedtls_aes_context *)gcm->cipher_ctx.cipher_ctx;
+    unsigned char h[16];
+    put_uint32_be(h, (uint32_t)(gcm->HH[8] >> 32));
+    put_uint32_be(h + 4, (uint32_t)gcm->HH[8]);
+    put_uint32_be(h + 8, (uint32_t)(gcm->HL[8] >> 32));
+    put_uint32_be(h + 12, (uint32_t)gcm->HL[8]);
+
+    mbedtls_crypto_lane_t lanes[MBEDTLS_CRYPTO_BATCH_LANES];
+    unsigned char blocks[MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT][16];
+    mbedtls_crypto_lane_t *owner[MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT];
+    uint32_t counters[MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT];
+    size_t next = 0;
+    sgx_status_t sts = SGX_SUCCESS;
+    for (size_t l = 0; l < MBEDTLS_CRYPTO_BATCH_LANES && sts == SGX_SUCCESS; l++)
+    {
+        sts = start_lane(gcm, &lanes[l], items, count, &next);
+    }
+    while (sts == SGX_SUCCESS)
+    {
+        /*
+            hand out counter blocks round robin, so a single large message fills the pipeline on its own
+        */
+        size_t in_flight = 0;
+        bool issued = true;
+        while (issued && in_flight < MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT)
+        {
+            issued = false;
+            for (size_t l = 0; l < MBEDTLS_CRYPTO_BATCH_LANES && in_flight < MBEDTLS_CRYPTO_BLOCKS_IN_FLIGHT; l++)
+            {
+                auto lane = &lanes[l];
+                if (lane->item == nullptr || lane->counter > lane->blocks)
+                {
+                    continue;
+                }
+                memcpy(blocks[in_flight], lane->item->p_iv, MBEDTLS_CRYPTO_IV_SIZE);
+                put_uint32_be(blocks[in_flight] + MBEDTLS_CRYPTO_IV_SIZE, lane->counter);
+                counters[in_flight] = lane->counter++;
+                owner[in_flight++] = lane;
+                issued = true;
+            }
+        }
+        if (in_flight == 0)
+        {
+            break;
+        }
+        aesni_encrypt_blocks(aes->rk, aes->nr, blocks[0]);
+
+        for (size_t i = 0; i < in_flight; i++)
+        {
+            auto lane = owner[i];
+            if (counters[i] == 1)
+            {
+                memcpy(lane->tag_mask, blocks[i], sizeof(lane->tag_mask));
+                continue;
+            }
+            auto item = lane->item;
+            uint32_t offset = (counters[i] - 2) * 16;
+            uint32_t len = (item->src_len - offset < 16) ? item->src_len - offset : 16;
+            for (uint32_t j = 0; j < len; j++)
+            {
+                item->p_dst[offset + j] = item->p_src[offset + j] ^ blocks[i][j];
+            }
+            ghash_update(lane->y, h, item->p_dst + offset, len);
+        }
+
+        for (size_t l = 0; l < MBEDTLS_CRYPTO_BATCH_LANES && sts == SGX_SUCCESS; l++)
+        {
+            auto lane = &lanes[l];
+            if (lane->item == nullptr || lane->counter <= lane->blocks)
+            {
+                continue;
+            }
+            /*
+                length block, no additional data
+            */
+            unsigned char len_block[16];
+            memset(len_block, 0, sizeof(len_block));
+            uint64_t bits = (uint64_t)lane->item->src_len * 8;
+            put_uint32_be(len_block + 8, (uint32_t)(bits >> 32));
+            put_uint32_be(len_block + 12, (uint32_t)bits);
+            ghash_update(lane->y, h, len_block, sizeof(len_block));
+            for (size_t j = 0; j < sizeof(sgx_aes_gcm_128bit_tag_t); j++)
+            {
+                (*lane->item->p_out_mac)[j] = lane->y[j] ^ lane->tag_mask[j];
+            }
+            sts = start_lane(gcm, lane, items, count, &next);
+        }
+    }
+    mbedtls_platform_zeroize(lanes, sizeof(lanes));
+    mbedtls_platform_zeroize(blocks, sizeof(blocks));
+    return sts;
+}
+
+#endif
+
+/**
+ * @brief encrypt a batch of messages under one key, expanded once for the whole batch.
+ * With AES-NI and PCLMULQDQ available the messages are encrypted interleaved, otherwise one at a time.
+ * Stops at the first failing message.
+ * @param p_key AES-128 key
+ * @param items messages to encrypt
+ * @param count count of items
+ * @return sgx_status_t
+ */
+sgx_status_t MbedtlsCryptoImpl::encryptBatch(
+    const sgx_aes_gcm_128bit_key_t *p_key,
+    crypto_batch_item_t *items,
+    size_t count)
+{
+    DIGGI_ASSERT(items || count == 0);
+    auto gcm = context(p_key);
+    if (gcm == nullptr)
+    {
+        return SGX_ERROR_UNEXPECTED;
+    }
+#if defined(MBEDTLS_CRYPTO_MULTI_BUFFER)
+    if (mbedtls_aesni_has_support(MBEDTLS_AESNI_AES) && mbedtls_aesni_has_support(MBEDTLS_AESNI_CLMUL))
+    {
+        return encrypt_interleaved(gcm, items, count);
+    }
+#endif
+    for (size_t i = 0; i < count; i++)
+    {
+        auto sts = encrypt_item(gcm, &items[i]);
+        if (sts != SGX_SUCCESS)
+        {
+            return sts;
+        }
+    }
+    return SGX_SUCCESS;
+}
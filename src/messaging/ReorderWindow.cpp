@@ -0,0 +1,107 @@
+/**
+ * @file ReorderWindow.cpp
+ * @brief implementation of ReorderWindow, the per session reordering buffer of SecureMessageManager.
+ * @see ReorderWindow
+ * @version 0.1
+ *
+ */
+#include "messaging/ReorderWindow.h"
+#include <string.h>
+
+/**
+ * @brief Construct a new empty Reorder Window object
+ */
+ReorderWindow::ReorderWindow() : held(0)
+{
+    memset(ring, 0, sizeof(ring));
+}
+/**
+ * @brief hold an early message.
+ * A slot of the ring is given by the session count, and is unique as long as the message is less than the window ahead of expected.
+ * @param expected next session count to be delivered
+ * @param slot message and callback, slot->msg->session_count must be ahead of expected
+ * @return true if held in the ring, false if held in overflow
+ */
+bool ReorderWindow::store(uint64_t expected, const reorder_slot_t *slot)
+{
+    DIGGI_ASSERT(slot);
+    DIGGI_ASSERT(slot->msg);
+    auto session_count = slot->msg->session_count;
+    DIGGI_ASSERT(session_count > expected);
+    held++;
+    if (session_count - expected < REORDER_WINDOW_SIZE)
+    {
+        auto entry = &ring[session_count & (REORDER_WINDOW_SIZE - 1)];
+        DIGGI_ASSERT(entry->msg == nullptr);
+        *entry = *slot;
+        return true;
+    }
+    DIGGI_ASSERT(overflow.find(session_count) == overflow.end());
+    overflow[session_count] = *slot;
+    return false;
+}
+/**
+ * @brief remove held message with a given session count, if present.
+ * @param session_count session count, normally the next expected
+ * @param slot output message and callback
+ * @return true if found
+ */
+bool ReorderWindow::take(uint64_t session_count, reorder_slot_t *slot)
+{
+    DIGGI_ASSERT(slot);
+    if (held == 0)
+    {
+        return false;
+    }
+    auto entry = &ring[session_count & (REORDER_WINDOW_SIZE - 1)];
+    if (entry->msg != nullptr && entry->msg->session_count == session_count)
+    {
+        *slot = *entry;
+        entry->msg = nullptr;
+        held--;
+        return true;
+    }
+    if (overflow.empty())
+    {
+        return false;
+    }
+    auto it = overflow.find(session_count);
+    if (it == overflow.end())
+    {
+        return false;
+    }
+    *slot = it->second;
+    overflow.erase(it);
+    held--;
+    return true;
+}
+/**
+ * @brief remove any held message, used to release all messages of a session.
+ * @param slot output message and callback
+ * @return true if a message was held
+ */
+bool ReorderWindow::takeAny(reorder_slot_t *slot)
+{
+    DIGGI_ASSERT(slot);
+    if (held == 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < REORDER_WINDOW_SIZE; i++)
+    {
+        if (ring[i].msg != nullptr)
+        {
+            return take(ring[i].msg->session_count, slot);
+        }
+    }
+    DIGGI_ASSERT(!overflow.empty());
+    return take(overflow.begin()->first, slot);
+}
+/**
+ * @brief count of held messages
+ * @return size_t
+ */
+size_t ReorderWindow::size()
+{
+    return held;
+}
@@ -10,6 +10,11 @@
  * 
  */
 #include "messaging/SecureMessageManager.h"
+#include "mbedtls/md.h"
+#include "mbedtls/hkdf.h"
+
+/// HKDF info of key epochs, followed by the new epoch
+static const char rekey_info[] = "diggi session rekey";
 
 /**
  * @brief Construct a new Secure Message Manager:: Secure Message Manager object
@@ -24,6 +29,10 @@
  * @param dynMR reference to dynamic enclave measurement object, which updates enclave measurement based on message state incomming to enclave.
  * @param crypto implementation api for cryptographic primitives used to encrypt and decrypt messages, only supports AES-256 GCM mode per now.
  * @param trusted_root_func_role if enabled, this SMM is used to attest other diggi instances, is itself concidered fully trustworthy.
+ * If "session-key-cache" is set to "1" in func configuration, keys of attested peers are sealed to a file per thread and restored here,
+ * so sessions towards them are resumed without a new attestation. "session-key-cache-ttl-sec" sets how long keys may be reused.
+ * If "attest-at-startup" is set to "1", sessions towards all enclave peers are established once the thread starts, @see SecureMessageManager::connectAll
+ * "rekey-threshold" sets how many nonces are used per key before sessions switch to a new key, @see SecureMessageManager::rekey
  */
 SecureMessageManager::SecureMessageManager(
     IDiggiAPI *dapi,
@@ -43,8 +52,15 @@ SecureMessageManager::SecureMessageManager(
       crypto(crypto),
       record_func(record_func),
       started_attest(false),
-      trusted_root_func(trusted_root_func_role)
+      trusted_root_func(trusted_root_func_role),
+      flow_routing(AsyncMessageManager::flowRoutingConfigured(dapi)),
+      late_reply_ctx(nullptr),
+      streams(nullptr),
+      session_keys(nullptr),
+      attest_at_startup(false),
+      rekey_threshold(SMM_REKEY_THRESHOLD)
 {
+    memset(&reorder_stats, 0, sizeof(reorder_stat_t));
     self = diggiapi->GetId();
     self.fields.thread = this_thread;
     DIGGI_ASSERT(crypto);
@@ -72,7 +88,45 @@ SecureMessageManager::SecureMessageManager(
             nullptr,
             nullptr);
     }
+    auto &conf = dapi->GetFuncConfig();
+    if (conf.contains("session-key-cache") && conf["session-key-cache"].value == "1" && iasapi->attestable() && !trusted_root_func)
+    {
+        auto ttl_sec = SESSION_KEY_CACHE_DEFAULT_TTL_SEC;
+        if (conf.contains("session-key-cache-ttl-sec"))
+        {
+            ttl_sec = (uint64_t)atoi(conf["session-key-cache-ttl-sec"].value.tostring().c_str());
+        }
+#ifdef DIGGI_ENCLAVE
+        auto sealer = new SGXSeal(MEASURED, true);
+#else
+        auto sealer = new NoSeal(true);
+#endif
+        session_keys = new SessionKeyCache(std::to_string(self.raw) + ".sessionkeys", ttl_sec, sealer);
+        auto restored = session_keys->load();
+        DIGGI_TRACE(diggiapi->GetLogObject(), LDEBUG, "Secure message manager, restored %lu cached session keys\n", restored);
+    }
+    if (conf.contains("rekey-threshold"))
+    {
+        rekey_threshold = (uint32_t)strtoul(conf["rekey-threshold"].value.tostring().c_str(), nullptr, 10);
+        DIGGI_ASSERT(rekey_threshold > 0 && rekey_threshold < UINT32_MAX);
+    }
     messageService->registerTypeCallback(SessionRequestHandler, SESSION_REQUEST, this);
+    messageService->registerTypeCallback(SessionResumeHandler, DIGGI_SESSION_RESUME_TYPE, this);
+    late_reply_ctx = new secure_message_context_t(nullptr, LateReplyHandler, this, this, true);
+    messageService->registerLateReplyCallback(RecieveMessageHandlerAsync, late_reply_ctx);
+    streams = new StreamChannelManager(this, dapi->GetThreadPool(), dapi->GetLogObject());
+    if (conf.contains("attest-at-startup") && conf["attest-at-startup"].value == "1")
+    {
+        if (iasapi->attestable() && !trusted_root_func)
+        {
+            attest_at_startup = true;
+            dapi->GetThreadPool()->ScheduleOn(this_thread, ConnectAllHandler, this, __PRETTY_FUNCTION__);
+        }
+        else
+        {
+            DIGGI_TRACE(diggiapi->GetLogObject(), LDEBUG, "Secure message manager, attest-at-startup ignored, func is not attested\n");
+        }
+    }
 }
 /**
  * @brief Destroy the Secure Message Manager:: Secure Message Manager object
@@ -82,12 +136,110 @@ SecureMessageManager::SecureMessageManager(
 SecureMessageManager::~SecureMessageManager()
 {
     messageService->UnregisterTypeCallback(SESSION_REQUEST);
+    messageService->UnregisterTypeCallback(DIGGI_SESSION_RESUME_TYPE);
+    messageService->registerLateReplyCallback(nullptr, nullptr);
+    delete late_reply_ctx;
+    delete streams;
+    delete session_keys;
+    DIGGI_TRACE(diggiapi->GetLogObject(),
+                LDEBUG,
+                "Secure message manager, reordering: in order %lu, reordered %lu, overflowed %lu, max depth %lu, pooled copies %lu, heap copies %lu\n",
+                reorder_stats.in_order,
+                reorder_stats.reordered,
+                reorder_stats.overflowed,
+                reorder_stats.max_depth,
+                reorder_stats.pooled_copies,
+                reorder_stats.heap_copies);
+    for (auto &kec : callback_map)
+    {
+        releaseHeld(&kec.second);
+    }
     callback_map.clear();
+    for (auto copy : reorder_copies)
+    {
+        free(copy);
+    }
+}
+/**
+ * @brief derive the key of a key epoch, HKDF-SHA256 over the key of the preceding epoch.
+ * Keys are chained, so keys of earlier epochs are not recoverable from the current.
+ * @param current key of the preceding epoch
+ * @param epoch epoch of the derived key
+ * @param next output key
+ */
+void SecureMessageManager::deriveEpochKey(const sgx_ec_key_128bit_t *current, uint32_t epoch, sgx_ec_key_128bit_t *next)
+{
+    uint8_t info[sizeof(rekey_info) + sizeof(uint32_t)];
+    memcpy(info, rekey_info, sizeof(rekey_info));
+    memcpy(info + sizeof(rekey_info), &epoch, sizeof(uint32_t));
+    auto ret = mbedtls_hkdf(
+        mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+        NULL,
+        0,
+        (const unsigned char *)current,
+        sizeof(sgx_ec_key_128bit_t),
+        info,
+        sizeof(info),
+        (unsigned char *)next,
+        sizeof(sgx_ec_key_128bit_t));
+    DIGGI_ASSERT(ret == 0);
+}
+/**
+ * @brief switch a session to the key of the next epoch.
+ * The sender switches once the nonce passes the rekey threshold, and the recipient follows on the first authenticated message marked with the new epoch.
+ * The current key is kept for messages sent before the switch, and the nonce restarts from 0.
+ * @param kec crypto/integrity context of session
+ * @param next key of the next epoch, @see SecureMessageManager::deriveEpochKey
+ */
+void SecureMessageManager::rekey(key_exchange_context_t *kec, const sgx_ec_key_128bit_t *next)
+{
+    if (kec->key_epoch > 0)
+    {
+        retireKey(kec, &kec->prev_key);
+    }
+    memcpy(kec->prev_key, kec->g_sp_db.sk_key, sizeof(sgx_ec_key_128bit_t));
+    memcpy(kec->g_sp_db.sk_key, next, sizeof(sgx_ec_key_128bit_t));
+    kec->prev_session_id = kec->session_id;
+    kec->session_id = 0;
+    kec->key_epoch++;
+    DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "rekeyed session with: %" PRIu64 ", epoch %u\n",
+                kec->other_id.raw,
+                kec->key_epoch);
+}
+/**
+ * @brief restart key epochs, once a new key is installed for a session by attestation or resumption.
+ * @param kec crypto/integrity context of session
+ */
+void SecureMessageManager::resetKeyEpoch(key_exchange_context_t *kec)
+{
+    if (kec->key_epoch > 0)
+    {
+        retireKey(kec, &kec->prev_key);
+    }
+    kec->key_epoch = 0;
+    kec->prev_session_id = 0;
+    memset(kec->prev_key, 0, sizeof(sgx_ec_key_128bit_t));
+}
+/**
+ * @brief drop a key no longer used by a session from the caches of the crypto implementation.
+ * Sessions are owned by the thread of their manager, so the key is only cached by that thread.
+ * @param kec crypto/integrity context of session
+ * @param key retired key
+ */
+void SecureMessageManager::retireKey(key_exchange_context_t *kec, const sgx_ec_key_128bit_t *key)
+{
+    if (kec->parent_manager != nullptr)
+    {
+        kec->parent_manager->crypto->retireKey(key);
+    }
 }
 /**
  * @brief internal method for encrypting a message
  * encrypts AES-128 GCM with nonse for replay prenvention.
  * Invokes crypto api for encrypt, may in theory be replaced in the future.
+ * @see SecureMessageManager::prepareEncrypt
  * @param kec crypto/integrity context for target recipient of message
  * @param inp_buff plaintext to encrypt
  * @param inp_buff_len plaintext length
@@ -98,10 +250,43 @@ void SecureMessageManager::encrypt(
     uint8_t *inp_buff,
     size_t inp_buff_len,
     secure_message_t *req_message)
+{
+    crypto_batch_item_t item;
+    prepareEncrypt(kec, inp_buff, inp_buff_len, req_message, &item);
+    auto sts = kec->parent_manager->crypto->encrypt(&kec->g_sp_db.sk_key, item.p_src, item.src_len,
+                                                    item.p_dst,
+                                                    item.p_iv,
+                                                    item.iv_len, NULL, 0,
+                                                    item.p_out_mac);
+    DIGGI_ASSERT(sts == SGX_SUCCESS);
+}
+/**
+ * @brief assign the next nonce of a session to a message, without encrypting it.
+ * Once the nonce passes the rekey threshold, the session switches to a new key instead of running out of nonces.
+ * The key epoch is carried in the IV, following the nonce, so the recipient knows which key to use.
+ * The message must be encrypted under the current key of the session before the nonce passes the rekey threshold again.
+ * @param kec crypto/integrity context for target recipient of message
+ * @param inp_buff plaintext to encrypt
+ * @param inp_buff_len plaintext length
+ * @param req_message target encrypted message structure.
+ * @param item output, encryption of the message for ICryptoImplementation
+ */
+void SecureMessageManager::prepareEncrypt(
+    key_exchange_context_t *kec,
+    uint8_t *inp_buff,
+    size_t inp_buff_len,
+    secure_message_t *req_message,
+    crypto_batch_item_t *item)
 {
     memset(req_message, 0, inp_buff_len);
 
-    //Check if the nonce for the session has not exceeded 2^32-2 if so end session and start a new session
+    if (kec->session_id >= kec->parent_manager->rekey_threshold)
+    {
+        sgx_ec_key_128bit_t next;
+        deriveEpochKey(&kec->g_sp_db.sk_key, kec->key_epoch + 1, &next);
+        rekey(kec, &next);
+        memset(next, 0, sizeof(sgx_ec_key_128bit_t));
+    }
     DIGGI_ASSERT(kec->session_id < UINT32_MAX);
     const uint32_t data2encrypt_length = (uint32_t)inp_buff_len;
     //Set the payload size to data to encrypt length
@@ -112,17 +297,18 @@ void SecureMessageManager::encrypt(
     kec->session_id++;
 
     memcpy(req_message->message_aes_gcm_data.reserved, &kec->session_id, sizeof(kec->session_id));
+    memcpy(req_message->message_aes_gcm_data.reserved + SMM_IV_EPOCH_OFFSET, &kec->key_epoch, sizeof(kec->key_epoch));
 
     //Set the session ID of the message to the current session id
     req_message->session_id = kec->session_id;
 
     //Prepare the request message with the encrypted payload
-    auto sts = kec->parent_manager->crypto->encrypt(&kec->g_sp_db.sk_key, inp_buff, data2encrypt_length,
-                                                    reinterpret_cast<uint8_t *>(&(req_message->message_aes_gcm_data.payload)),
-                                                    reinterpret_cast<uint8_t *>(&(req_message->message_aes_gcm_data.reserved)),
-                                                    sizeof(req_message->message_aes_gcm_data.reserved), NULL, 0,
-                                                    &(req_message->message_aes_gcm_data.payload_tag));
-    DIGGI_ASSERT(sts == SGX_SUCCESS);
+    item->p_src = inp_buff;
+    item->src_len = data2encrypt_length;
+    item->p_dst = reinterpret_cast<uint8_t *>(&(req_message->message_aes_gcm_data.payload));
+    item->p_iv = reinterpret_cast<uint8_t *>(&(req_message->message_aes_gcm_data.reserved));
+    item->iv_len = sizeof(req_message->message_aes_gcm_data.reserved);
+    item->p_out_mac = &(req_message->message_aes_gcm_data.payload_tag);
     DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(),
                 LogLevel::LDEBUG,
                 "encrypting req_message->session_id= %lu, kec->session_id = %lu\n",
@@ -131,52 +317,79 @@ void SecureMessageManager::encrypt(
 }
 /**
  * @brief internal method to decrypt message inbound to instance
- * copies data into memory, checks and updates nonce, decrypts into memory buffer allocated in trusted memory.
- * @param resp_message encrypted message to decrypt.
+ * checks and updates nonce, decrypts into out_buff, which must be in trusted memory.
+ * Messages marked with the next key epoch switch the session to the new key, messages of the previous epoch are decrypted with the previous key.
+ * out_buff may be the ciphertext itself, for decryption in place.
+ * @param resp_message encrypted message to decrypt, in trusted memory.
  * @param kec crypto/integrity context for source of message
- * @param out_buff unencrypted target buffer for message
+ * @param out_buff unencrypted target buffer for message, at least payload_size bytes
  * @param out_buff_len length of unencrypted buffer.
  */
 void SecureMessageManager::decrypt(secure_message_t *resp_message,
                                    key_exchange_context_t *kec,
-                                   char *out_buff,
+                                   uint8_t *out_buff,
                                    size_t *out_buff_len)
 {
 
     //Code to process the response message from the Destination Enclave
     size_t decrypted_data_length = resp_message->message_aes_gcm_data.payload_size;
-    uint8_t *decrypted_data = (uint8_t *)malloc(decrypted_data_length);
-    DIGGI_ASSERT(decrypted_data);
-    memset(decrypted_data, 0, decrypted_data_length);
+
+    uint32_t epoch;
+    memcpy(&epoch, resp_message->message_aes_gcm_data.reserved + SMM_IV_EPOCH_OFFSET, sizeof(uint32_t));
+    const sgx_ec_key_128bit_t *key = &kec->g_sp_db.sk_key;
+    auto nonce = &kec->session_id;
+    sgx_ec_key_128bit_t next;
+    auto advance = (epoch == kec->key_epoch + 1);
+    if (advance)
+    {
+        /*
+            The epoch is read from the IV before the tag is checked,
+            so the session only switches once the message is authenticated under the derived key.
+        */
+        deriveEpochKey(&kec->g_sp_db.sk_key, epoch, &next);
+        key = &next;
+    }
+    else if (kec->key_epoch > 0 && epoch == kec->key_epoch - 1)
+    {
+        key = &kec->prev_key;
+        nonce = &kec->prev_session_id;
+    }
+    else
+    {
+        DIGGI_ASSERT(epoch == kec->key_epoch);
+    }
 
     //Decrypt the response message payload
 
     auto status = kec->parent_manager->crypto->decrypt(
-        &kec->g_sp_db.sk_key,
+        key,
         resp_message->message_aes_gcm_data.payload,
-        decrypted_data_length, decrypted_data,
+        decrypted_data_length, out_buff,
         reinterpret_cast<uint8_t *>(&(resp_message->message_aes_gcm_data.reserved)),
         sizeof(resp_message->message_aes_gcm_data.reserved), NULL, 0,
         &(resp_message->message_aes_gcm_data.payload_tag));
     DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(), "decryption returned status:%lx\n", status);
 
     DIGGI_ASSERT(status == SGX_SUCCESS);
+    if (advance)
+    {
+        rekey(kec, &next);
+        memset(next, 0, sizeof(sgx_ec_key_128bit_t));
+    }
 
     DIGGI_TRACE(kec->parent_manager->diggiapi->GetLogObject(),
                 LogLevel::LDEBUG,
-                "decrypting resp_message->session_id= %lu, kec->session_id = %lu\n",
+                "decrypting resp_message->session_id= %lu, kec->session_id = %lu, epoch = %u\n",
                 resp_message->session_id,
-                kec->session_id);
+                *nonce,
+                epoch);
 
     // Verify if the nonce obtained in the response is equal to the session nonce + 1
     // (Prevents replay attacks)
-    DIGGI_ASSERT(resp_message->session_id == (kec->session_id) + 1);
-    kec->session_id++;
+    DIGGI_ASSERT(resp_message->session_id == (*nonce) + 1);
+    (*nonce)++;
     //Update the value of the session nonce in the source enclave
     *out_buff_len = decrypted_data_length;
-
-    memcpy(out_buff, decrypted_data, decrypted_data_length);
-    free(decrypted_data);
 }
 /**
  * @brief Allocate message destined for address specified by human readable name.
@@ -293,22 +506,43 @@ void SecureMessageManager::endAsync(msg_t *msg)
  * @see AsyncMessageManager::Send
  * @warning if sent as non-encrypted message, callback message will recide in untrusted memory, do not modify response directly.
  * Message encrypted before sent through AMM send operation.
- * If uninitialized channel, attestaion and key exchange occurs before message is sent.
+ * If uninitialized channel, attestaion and key exchange occurs before message is sent, or the session is resumed from the session key cache.
  * @param msg message to send
  * @param cb completion callback invoked on the recipt of a response, given that the message was allocate with a message id.
  * @param ptr Convenience context object  delived to callback along with message response.
  */
 void SecureMessageManager::Send(msg_t *msg, async_cb_t cb, void *ptr)
+{
+    Send(msg, cb, ptr, 0);
+}
+/**
+ * @brief send a message with a deadline for its response.
+ * As Send, but if no response arrives within timeout_us, cb is invoked with status AMM_FLOW_TIMEOUT and no message.
+ * The deadline is armed once the message is handed to the AMM, so time spent on attestation and key exchange is not counted.
+ * @see AsyncMessageManager::sendMessageAsync
+ * @param msg message to send
+ * @param cb completion callback, invoked on response or timeout
+ * @param ptr Convenience context object delived to callback
+ * @param timeout_us response deadline in microseconds, 0 waits indefinitely
+ */
+void SecureMessageManager::Send(msg_t *msg, async_cb_t cb, void *ptr, uint64_t timeout_us)
 {
     DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
     /*
 			Initially we  attempt to send to same thread on recieving end
 			If not then rework is required in callbackmap to account for correct thread.
 			which is not currently implemented.
+			With flow routing, responses to remotely initiated flows keep the lane of the remote thread instead,
+			as the session in callback_map is keyed on that lane.
 		*/
-    msg->dest.fields.thread = diggiapi->GetThreadPool()->currentThreadId();
-    msg->src.fields.thread = diggiapi->GetThreadPool()->currentThreadId();
-    auto ctx = new secure_message_context_t(msg, cb, ptr, this, false);
+    uint8_t lane = (uint8_t)diggiapi->GetThreadPool()->currentThreadId();
+    if (flow_routing && msg->id != 0 && !AsyncMessageManager::isLocalFlow(msg->id, self))
+    {
+        lane = msg->dest.fields.thread;
+    }
+    msg->dest.fields.thread = lane;
+    msg->src.fields.thread = lane;
+    auto ctx = new secure_message_context_t(msg, cb, ptr, this, false, timeout_us);
 
     if (callback_map.find(msg->dest.raw) == callback_map.end())
     {
@@ -326,14 +560,20 @@ void SecureMessageManager::Send(msg_t *msg, async_cb_t cb, void *ptr)
         callback_map[msg->dest.raw].session_id_inbound = 0;
         callback_map[msg->dest.raw].initial = 1;
         callback_map[msg->dest.raw].attestation_initialized = 0;
-        dh_key_exchange_initiator(&callback_map[msg->dest.raw]);
+        if (!resumeSession(&callback_map[msg->dest.raw]) && !joinGroupAttestation(&callback_map[msg->dest.raw]))
+        {
+            dh_key_exchange_initiator(&callback_map[msg->dest.raw]);
+        }
     }
     else
     {
         ///if instance attempts to send messages before key exchange and attestation is completed, the message is stored for deffered delivery.
         if (callback_map[msg->dest.raw].initial)
         {
-            DIGGI_ASSERT(callback_map[msg->dest.raw].outputqueue.size() > 0);
+            /*
+                sessions set up by connectAll are pending without queued messages
+            */
+            DIGGI_ASSERT(callback_map[msg->dest.raw].outputqueue.size() > 0 || attest_at_startup);
             callback_map[msg->dest.raw].outputqueue.push_back(ctx);
         }
         else
@@ -344,6 +584,65 @@ void SecureMessageManager::Send(msg_t *msg, async_cb_t cb, void *ptr)
     }
 }
 
+/**
+ * @brief open a streaming channel towards an instance addressed by human readable name.
+ * @see StreamChannelManager::openStream
+ * @param destination HRN of reciever
+ * @param delivery encryption of chunks (ENCRYPTED | CLEARTEXT)
+ * @return uint64_t stream id, only valid on this thread
+ */
+uint64_t SecureMessageManager::openStream(std::string destination, msg_delivery_t delivery)
+{
+    DIGGI_ASSERT(name_servicemap.find(destination) != name_servicemap.end());
+    return openStream(name_servicemap[destination], delivery);
+}
+/**
+ * @brief open a streaming channel towards an instance.
+ * Chunks are encrypted as they are written, pending attestation they are queued as any other message.
+ * @see StreamChannelManager::openStream
+ * @param destination reciever id
+ * @param delivery encryption of chunks (ENCRYPTED | CLEARTEXT)
+ * @return uint64_t stream id, only valid on this thread
+ */
+uint64_t SecureMessageManager::openStream(aid_t destination, msg_delivery_t delivery)
+{
+    DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
+    return streams->openStream(destination, delivery);
+}
+/**
+ * @brief append data to stream, may yield while the stream window is full.
+ * @see StreamChannelManager::writeStream
+ * @param stream stream id
+ * @param buf data
+ * @param size size of data
+ * @return true if all data was sent
+ */
+bool SecureMessageManager::writeStream(uint64_t stream, const uint8_t *buf, size_t size)
+{
+    DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
+    return streams->writeStream(stream, buf, size);
+}
+/**
+ * @brief close stream
+ * @see StreamChannelManager::closeStream
+ * @param stream stream id
+ */
+void SecureMessageManager::closeStream(uint64_t stream)
+{
+    DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
+    streams->closeStream(stream);
+}
+/**
+ * @brief accept streams on this thread, cb recieves a stream_chunk_t per chunk.
+ * @see StreamChannelManager::registerStreamCallback
+ * @param cb chunk callback
+ * @param ctx context pointer delivered with chunks
+ */
+void SecureMessageManager::registerStreamCallback(async_cb_t cb, void *ctx)
+{
+    DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
+    streams->registerStreamCallback(cb, ctx);
+}
 /**
  * @brief invoked directly from send operation or as a deffered message delivery following a completed attestation process.
  * 
@@ -353,7 +652,16 @@ void SecureMessageManager::Send(msg_t *msg, async_cb_t cb, void *ptr)
 void SecureMessageManager::SendMessageAsyncInternal(void *context, int status)
 {
     auto ctx = (secure_message_context_t *)context;
-    auto cb = ctx->item2;
+    dispatchSend(ctx, prepareSend(ctx, nullptr));
+}
+/**
+ * @brief allocate the outbound message of a send, encrypted if requested.
+ * @param ctx context object capturing message send information
+ * @param item if not null, encryption is deferred to the caller and described in item, @see SecureMessageManager::prepareEncrypt
+ * @return msg_t* message to send, the message of ctx itself if cleartext
+ */
+msg_t *SecureMessageManager::prepareSend(secure_message_context_t *ctx, crypto_batch_item_t *item)
+{
     auto _this = ctx->item4;
     DIGGI_ASSERT(_this->this_thread == _this->diggiapi->GetThreadPool()->currentThreadId());
 
@@ -386,15 +694,40 @@ void SecureMessageManager::SendMessageAsyncInternal(void *context, int status)
         send = _this->messageService->allocateMessage(ctx->item1, payload_size);
         send->delivery = ENCRYPTED;
         auto secure_message = (secure_message_t *)send->data;
-        encrypt(
-            &(_this->callback_map[send->dest.raw]),
-            ctx->item1->data,
-            payload_size - sizeof(secure_message_t), /*only data is encrypted, not headers*/
-            secure_message);
-        free(ctx->item1);
+        if (item == nullptr)
+        {
+            encrypt(
+                &(_this->callback_map[send->dest.raw]),
+                ctx->item1->data,
+                payload_size - sizeof(secure_message_t), /*only data is encrypted, not headers*/
+                secure_message);
+        }
+        else
+        {
+            prepareEncrypt(
+                &(_this->callback_map[send->dest.raw]),
+                ctx->item1->data,
+                payload_size - sizeof(secure_message_t),
+                secure_message,
+                item);
+        }
     }
-
+    return send;
+}
+/**
+ * @brief send a message prepared by SecureMessageManager::prepareSend, its payload encrypted if requested.
+ * @param ctx context object capturing message send information
+ * @param send message to send
+ */
+void SecureMessageManager::dispatchSend(secure_message_context_t *ctx, msg_t *send)
+{
+    auto cb = ctx->item2;
+    auto _this = ctx->item4;
     DIGGI_ASSERT(send);
+    if (send != ctx->item1)
+    {
+        free(ctx->item1);
+    }
     send->session_count = _this->callback_map[send->dest.raw].session_id_outbound;
     DIGGI_TRACE(_this->diggiapi->GetLogObject(),
                 LogLevel::LDEBUG,
@@ -415,23 +748,72 @@ void SecureMessageManager::SendMessageAsyncInternal(void *context, int status)
     }
     (cb == nullptr)
         ? _this->messageService->sendMessage(send)
-        : _this->messageService->sendMessageAsync(send, RecieveMessageHandlerAsync, ctx);
+        : _this->messageService->sendMessageAsync(send, RecieveMessageHandlerAsync, ctx, ctx->item6);
 
     if (cb == nullptr)
     {
         delete ctx;
     }
 }
+/**
+ * @brief send messages queued while a session was established, in order.
+ * Encrypted messages are encrypted in batches through ICryptoImplementation::encryptBatch, so the key is set up once per batch.
+ * A batch ends after SMM_ENCRYPT_BATCH_SIZE messages, at cleartext messages, and before the session switches key epoch.
+ * @param kec keyed context
+ */
+void SecureMessageManager::flushOutputQueue(key_exchange_context_t *kec)
+{
+    auto queued = kec->outputqueue;
+    kec->outputqueue.clear();
+    secure_message_context_t *batch[SMM_ENCRYPT_BATCH_SIZE];
+    msg_t *sends[SMM_ENCRYPT_BATCH_SIZE];
+    crypto_batch_item_t items[SMM_ENCRYPT_BATCH_SIZE];
+    size_t count = 0;
+    auto flush = [&]() {
+        if (count == 0)
+        {
+            return;
+        }
+        auto sts = kec->parent_manager->crypto->encryptBatch(&kec->g_sp_db.sk_key, items, count);
+        DIGGI_ASSERT(sts == SGX_SUCCESS);
+        for (size_t i = 0; i < count; i++)
+        {
+            dispatchSend(batch[i], sends[i]);
+        }
+        count = 0;
+    };
+    for (auto ctx_item : queued)
+    {
+        DIGGI_ASSERT(ctx_item);
+        DIGGI_ASSERT(kec->key_exchange_session_done == (async_cb_t)SecureMessageManager::SendMessageAsyncInternal);
+        if (ctx_item->item1->delivery != ENCRYPTED)
+        {
+            flush();
+            SendMessageAsyncInternal(ctx_item, 1);
+            continue;
+        }
+        if (count == SMM_ENCRYPT_BATCH_SIZE || kec->session_id >= kec->parent_manager->rekey_threshold)
+        {
+            flush();
+        }
+        batch[count] = ctx_item;
+        sends[count] = prepareSend(ctx_item, &items[count]);
+        count++;
+    }
+    flush();
+}
 /**
  * @brief Callback handler for all messages inbound. 
  * Registered as intermediate recipient for all callbacks(both typed and one-off as part of a flow)
  * correct callback context is captured through the secure_message_context_t object, created for all message send operations, or type registrations.
  * This callback handles and preserves correct ordering of messages according to the sender. Senders mark messages with a series counter, indicating the ordering.
  * If the AMM or untrusted runtime deffers scheduling of a message onto the recipient queue, a reordering may occur.
- * Messages which do not match the currently expected, are copied and stored until the correct is recieved.
+ * Messages which do not match the currently expected, are copied and held in the ReorderWindow of the session until the correct is recieved.
  * The callback must copy messages because AMM purges message objects following the callback invocation.
  * We preserve the delete-after-invoke convention for copied messages aswell on behalf of callbacks invoked here.
  * The fast path is still invoked in the event of no rescheduling, without major algoritmic operations or copy operations.
+ * Held messages are copied into pooled buffers, and their contexts live on the stack, so reordering does not allocate in steady state.
+ * @see SecureMessageManager::reorderStats
  * 
  * @param info msg_async_response_t containing message and secure_message_context_t
  * @param status unused parameter, error handling, future work.
@@ -442,7 +824,20 @@ void SecureMessageManager::RecieveMessageHandlerAsync(void *info, int status)
     auto resp = (msg_async_response_t *)info;
     auto ctx_base = (secure_message_context_t *)resp->context;
     DIGGI_ASSERT(ctx_base);
-    auto ctx = new secure_message_context_t(ctx_base->item1, ctx_base->item2, ctx_base->item3, ctx_base->item4, ctx_base->item5);
+    /*
+        Flow timed out or cancelled by the AMM, no message takes part in ordering.
+        The send context is released, a late reply passes through late_reply_ctx instead.
+    */
+    if (resp->msg == nullptr)
+    {
+        DIGGI_ASSERT(ctx_base->item5 != true);
+        resp->context = ctx_base->item3;
+        ctx_base->item2(resp, status);
+        delete ctx_base;
+        return;
+    }
+    secure_message_context_t ctx_local(ctx_base->item1, ctx_base->item2, ctx_base->item3, ctx_base->item4, ctx_base->item5);
+    auto ctx = &ctx_local;
     if (ctx_base->item5 != true)
     {
         delete ctx_base;
@@ -467,140 +862,138 @@ void SecureMessageManager::RecieveMessageHandlerAsync(void *info, int status)
     DIGGI_ASSERT(ctx->item1->type != SESSION_REQUEST);
     key_exchange_context_t &source_slot = _this->callback_map.find(ctx->item1->src.raw)->second;
 
-    DIGGI_ASSERT(source_slot.inputqueue.find(ctx->item1->session_count) == source_slot.inputqueue.end());
-
-    auto lowerbound = source_slot.session_id_inbound;
-    auto upperbound = ctx->item1->session_count;
-    DIGGI_ASSERT(lowerbound <= upperbound);
-    for (
-        uint64_t i = lowerbound;
-        i <= upperbound;
-        i++)
+    auto expected = source_slot.session_id_inbound;
+    DIGGI_ASSERT(expected <= ctx->item1->session_count);
+    if (ctx->item1->session_count != expected)
     {
         /*
-				We set response for each iteration of loop as we are reusing 
-				the asyncmessagemanagers response struct.
-			*/
-
-        /*
-				If we reached current message
-			*/
-        if ((i == ctx->item1->session_count) &&
-            (i == source_slot.session_id_inbound))
+            Early messages are copied, as the AMM purges message objects following the callback invocation.
+            Typed messages share their context, so only the callback and its context pointer are held.
+        */
+        DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                    LogLevel::LDEBUG,
+                    "Storing out of bounds message with expecting %lu, session_count %lu,  from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
+                    expected,
+                    ctx->item1->session_count,
+                    ctx->item1->src.raw,
+                    ctx->item1->dest.raw,
+                    ctx->item1->id,
+                    ctx->item1->type,
+                    ctx->item1->size);
+        DIGGI_ASSERT(ctx->item2);
+        reorder_slot_t held;
+        held.msg = _this->copyEarlyMessage(ctx->item1);
+        held.cb = ctx->item2;
+        held.context = ctx->item3;
+        held.typed = ctx->item5;
+        if (!source_slot.inputqueue.store(expected, &held))
         {
-
-            DIGGI_ASSERT(source_slot.inputqueue.find(i) == source_slot.inputqueue.end());
-            DIGGI_TRACE(_this->diggiapi->GetLogObject(),
-                        LogLevel::LDEBUG,
-                        "deliver current message from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
-                        ctx->item1->src.raw,
-                        ctx->item1->dest.raw,
-                        ctx->item1->id,
-                        ctx->item1->type,
-                        ctx->item1->size);
-            resp->context = ctx;
-            resp->msg = ctx->item1;
-            RecieveMessageHandlerInternal(resp, status);
-
-            /*
-					In the event where messages following the most
-					current is held up, we deliver them aswell.
-				*/
-
-            while (source_slot.inputqueue.find(i + 1) != source_slot.inputqueue.end())
-            {
-                auto context = source_slot.inputqueue[i + 1];
-                DIGGI_ASSERT(context);
-                DIGGI_ASSERT(context->item1 != nullptr);
-                DIGGI_ASSERT(context->item1->size > 0);
-                DIGGI_ASSERT(context->item4);
-                DIGGI_ASSERT(context->item2);
-                resp->context = context;
-                resp->msg = context->item1;
-                DIGGI_TRACE(_this->diggiapi->GetLogObject(),
-                            LogLevel::LDEBUG,
-                            "deliver future messages from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
-                            context->item1->src.raw,
-                            context->item1->dest.raw,
-                            context->item1->id,
-                            context->item1->type,
-                            context->item1->size);
-                source_slot.inputqueue.erase(i + 1);
-                RecieveMessageHandlerInternal(resp, status);
-                free(context->item1);
-                delete context;
-                i++;
-            }
-
-            delete ctx;
-            break;
+            _this->reorder_stats.overflowed++;
         }
-        /*
-			else if in map, deliver it
-			*/
-        else if (source_slot.inputqueue.find(i) != source_slot.inputqueue.end() &&
-                 (i == source_slot.session_id_inbound))
+        _this->reorder_stats.reordered++;
+        _this->reorder_stats.depth++;
+        if (_this->reorder_stats.depth > _this->reorder_stats.max_depth)
         {
-
-            auto ctx_new = source_slot.inputqueue[i];
-            DIGGI_ASSERT(ctx_new);
-            DIGGI_ASSERT(ctx_new->item1 != nullptr);
-            DIGGI_ASSERT(ctx_new->item1->size > 0);
-            DIGGI_ASSERT(ctx_new->item4);
-            DIGGI_ASSERT(ctx_new->item2);
-            DIGGI_ASSERT(i == ctx_new->item1->session_count);
-            source_slot.inputqueue.erase(i);
-            resp->context = ctx_new;
-            resp->msg = ctx_new->item1;
-            DIGGI_TRACE(_this->diggiapi->GetLogObject(),
-                        LogLevel::LDEBUG,
-                        "deliver past message from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
-                        ctx_new->item1->src.raw,
-                        ctx_new->item1->dest.raw,
-                        ctx_new->item1->id,
-                        ctx_new->item1->type,
-                        ctx_new->item1->size);
-            RecieveMessageHandlerInternal(resp, status);
-            free(ctx_new->item1);
-            ctx_new->item1 = nullptr;
-            /*
-					delete regardless of wether this is a typed,
-					as deffered typed message delivery will copy the message context instead of reuse
-				*/
-            delete ctx_new;
+            _this->reorder_stats.max_depth = _this->reorder_stats.depth;
         }
-        else
-        {
-            /*
-					If not stored in the map,
-					we return without serving a message to the upwards layer
+        return;
+    }
 
-					If typed message, we copy the context used aswell, since all typed originally share context,
-					further reuse would cause inconsistent global message context.
-				*/
-            DIGGI_TRACE(_this->diggiapi->GetLogObject(),
-                        LogLevel::LDEBUG,
-                        "Storing out of bounds message with expecting %lu, session_count %lu,  from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
-                        source_slot.session_id_inbound,
-                        ctx->item1->session_count,
-                        ctx->item1->src.raw,
-                        ctx->item1->dest.raw,
-                        ctx->item1->id,
-                        ctx->item1->type,
-                        ctx->item1->size);
-            DIGGI_ASSERT(source_slot.inputqueue.find(ctx->item1->session_count) == source_slot.inputqueue.end());
-            DIGGI_ASSERT(ctx->item1 != nullptr);
-            DIGGI_ASSERT(ctx->item4);
-            DIGGI_ASSERT(ctx->item2);
-            auto cpymsg = COPY(msg_t, ctx->item1, ctx->item1->size);
-
-            source_slot.inputqueue[ctx->item1->session_count] = ctx;
-            ctx->item1 = cpymsg;
-
-            break;
-        }
+    DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "deliver current message from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
+                ctx->item1->src.raw,
+                ctx->item1->dest.raw,
+                ctx->item1->id,
+                ctx->item1->type,
+                ctx->item1->size);
+    _this->reorder_stats.in_order++;
+    resp->context = ctx;
+    resp->msg = ctx->item1;
+    RecieveMessageHandlerInternal(resp, status);
+
+    /*
+        In the event where messages following the most
+        current is held up, we deliver them aswell.
+    */
+    reorder_slot_t held;
+    while (source_slot.inputqueue.take(source_slot.session_id_inbound, &held))
+    {
+        _this->reorder_stats.depth--;
+        DIGGI_ASSERT(held.msg->size > 0);
+        DIGGI_ASSERT(held.cb);
+        secure_message_context_t ctx_held(held.msg, held.cb, held.context, _this, held.typed);
+        resp->context = &ctx_held;
+        resp->msg = held.msg;
+        DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                    LogLevel::LDEBUG,
+                    "deliver future messages from: %" PRIu64 ", to: %" PRIu64 ", id: %lu, type: %d , size: %lu \n",
+                    held.msg->src.raw,
+                    held.msg->dest.raw,
+                    held.msg->id,
+                    held.msg->type,
+                    held.msg->size);
+        RecieveMessageHandlerInternal(resp, status);
+        _this->releaseEarlyMessage(held.msg);
     }
 }
+/**
+ * @brief copy an early message into trusted memory, pooled if it is small.
+ * @param msg message recieved by the AMM
+ * @return msg_t* copy, released with releaseEarlyMessage
+ */
+msg_t *SecureMessageManager::copyEarlyMessage(msg_t *msg)
+{
+    msg_t *copy = nullptr;
+    if (msg->size <= REORDER_COPY_SIZE && reorder_copies.size() > 0)
+    {
+        copy = reorder_copies.back();
+        reorder_copies.pop_back();
+        reorder_stats.pooled_copies++;
+    }
+    else
+    {
+        copy = (msg_t *)malloc((msg->size <= REORDER_COPY_SIZE) ? REORDER_COPY_SIZE : msg->size);
+        reorder_stats.heap_copies++;
+    }
+    DIGGI_ASSERT(copy);
+    memcpy(copy, msg, msg->size);
+    return copy;
+}
+/**
+ * @brief release copy of an early message once delivered, pool sized copies are retained for reuse.
+ * @param copy message copy from copyEarlyMessage
+ */
+void SecureMessageManager::releaseEarlyMessage(msg_t *copy)
+{
+    if (copy->size <= REORDER_COPY_SIZE && reorder_copies.size() < REORDER_COPY_POOL_MAX)
+    {
+        reorder_copies.push_back(copy);
+        return;
+    }
+    free(copy);
+}
+/**
+ * @brief release all early messages held in a session, without delivering them.
+ * @param kec session context
+ */
+void SecureMessageManager::releaseHeld(key_exchange_context_t *kec)
+{
+    reorder_slot_t held;
+    while (kec->inputqueue.takeAny(&held))
+    {
+        reorder_stats.depth--;
+        releaseEarlyMessage(held.msg);
+    }
+}
+/**
+ * @brief reordering statistics of this thread, only consistent when read by the owner thread.
+ * @return reorder_stat_t
+ */
+reorder_stat_t SecureMessageManager::reorderStats()
+{
+    return reorder_stats;
+}
 /**
  * @brief invoked on a correctly ordered message, either typed or one-off callback as part of flow.
  * Increments lowerbound ordering count, and calls decrypt operations.
@@ -634,13 +1027,26 @@ void SecureMessageManager::RecieveMessageHandlerInternal(void *info, int status)
     DIGGI_TRACE(_this->diggiapi->GetLogObject(), "Delivering session_count: %lu, next_id_inbound:%lu\n", ctx->item1->session_count, _this->callback_map[ctx->item1->src.raw].session_id_inbound);
 
     _this->decryptAndDeliver(secmsg, ctx, ctx->item5);
-#ifndef RELEASE
     DIGGI_TRACE(_this->diggiapi->GetLogObject(), "Messages left on input queue from: %" PRIu64 " count:%lu \n", ctx->item1->src.raw, _this->callback_map[ctx->item1->src.raw].inputqueue.size());
-    for (auto itm : _this->callback_map[ctx->item1->src.raw].inputqueue)
-    {
-        DIGGI_TRACE(_this->diggiapi->GetLogObject(), "Left session items: %lu\n", itm.second->item1->session_count);
-    }
-#endif
+}
+/**
+ * @brief final recipient of replies to flows which have timed out or been cancelled.
+ * The reply has been ordered and counted as any other message, its original callback has allready been notified of the timeout.
+ * @param info msg_async_response_t containing message and SecureMessageManager
+ * @param status unused
+ */
+void SecureMessageManager::LateReplyHandler(void *info, int status)
+{
+    auto resp = (msg_async_response_t *)info;
+    DIGGI_ASSERT(resp);
+    DIGGI_ASSERT(resp->msg);
+    auto _this = (SecureMessageManager *)resp->context;
+    DIGGI_ASSERT(_this);
+    DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "Dropping late reply from: %" PRIu64 ", id: %lu\n",
+                resp->msg->src.raw,
+                resp->msg->id);
 }
 /**
  * @brief Registers type callback, funnels all types into RecieveMessageHandlerAsync for order-presered processing.
@@ -658,18 +1064,10 @@ void SecureMessageManager::registerTypeCallback(async_cb_t cb, msg_type_t type,
     DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
     if (iasapi->attestable()  && !this->started_attest)
     {
-        this->started_attest = true;
         DIGGI_TRACE(diggiapi->GetLogObject(),
                     LogLevel::LDEBUG,
                     "Attesting server from registerTypeCallback\n");
-        callback_map[self.raw].self_id = self;
-        callback_map[self.raw].parent_manager = this;
-        callback_map[self.raw].session_id = 0;
-        callback_map[self.raw].session_id_outbound = 0;
-        callback_map[self.raw].session_id_inbound = 0;
-        callback_map[self.raw].initial = 1;
-        callback_map[self.raw].attestation_initialized = 0;
-        dh_key_exchange_initiator(&callback_map[self.raw]);
+        startGroupAttestation();
     }
     else
     {
@@ -683,7 +1081,7 @@ void SecureMessageManager::registerTypeCallback(async_cb_t cb, msg_type_t type,
 
 /**
  * @brief internal method to decrypt message and invoke the correct corresponding callback
- * Copies message into trusted memory before decryption. if cleartext, delivered directly.
+ * Copies message into trusted memory once, and decrypts it in place. if cleartext, delivered directly.
  * @param ctxmsg msg_async_response_t (context,message)
  * @param ctx secure message to decrypt
  * @param typed non used parameter
@@ -698,28 +1096,32 @@ void SecureMessageManager::decryptAndDeliver(msg_async_response_t *ctxmsg, secur
     auto encrypted = (ctxmsg->msg->delivery == ENCRYPTED);
 
     size_t decrypt_msg_size = 0;
+    uint8_t *trusted_copy = nullptr;
     if (encrypted)
     {
         /*
             We must copy message from buffer into encalve
-            as the decryption api will not work on untrusted memory directly
-            
-            TODO: evaulate security risk of decrypting directly from unsecure memory to avoid an extra copy operation.
-                and implement custom crypto.
+            as untrusted memory may be modified by the host while it is authenticated and decrypted.
+            The ciphertext is decrypted in place, and the header moved in front of the plaintext,
+            so the payload is never copied again.
         */
-
-        auto recv = COPY(msg_t, ctxmsg->msg, ctxmsg->msg->size);
+        auto size = ctxmsg->msg->size;
+        DIGGI_ASSERT(size >= sizeof(msg_t) + SMM_CIPHERTEXT_OFFSET);
+        trusted_copy = (uint8_t *)malloc(size + SMM_DECRYPT_ALIGN_SHIFT);
+        DIGGI_ASSERT(trusted_copy);
+        auto recv = (msg_t *)(trusted_copy + SMM_DECRYPT_ALIGN_SHIFT);
+        memcpy(recv, ctxmsg->msg, size);
 
         auto secure_message = (secure_message_t *)recv->data;
+        DIGGI_ASSERT(secure_message->message_aes_gcm_data.payload_size <= size - sizeof(msg_t) - SMM_CIPHERTEXT_OFFSET);
+        auto plaintext = secure_message->message_aes_gcm_data.payload;
 
-        decrypt(secure_message, &callback_map[recv->src.raw], sgx_recieve_buffer, &decrypt_msg_size);
-
-        // DIGGI_ASSERT(decrypt_msg_size > 0);
-        DIGGI_ASSERT(decrypt_msg_size <= SGX_RECIEVEBUFSIZE);
+        decrypt(secure_message, &callback_map[recv->src.raw], plaintext, &decrypt_msg_size);
 
-        memcpy(recv->data, sgx_recieve_buffer, decrypt_msg_size);
-        recv->size = decrypt_msg_size + sizeof(msg_t);
-        ctxmsg->msg = recv;
+        auto delivered = (msg_t *)(plaintext - sizeof(msg_t));
+        memmove(delivered, recv, sizeof(msg_t));
+        delivered->size = decrypt_msg_size + sizeof(msg_t);
+        ctxmsg->msg = delivered;
     }
 
     ctxmsg->context = ctx->item3;
@@ -744,7 +1146,7 @@ void SecureMessageManager::decryptAndDeliver(msg_async_response_t *ctxmsg, secur
     ctx->item2(ctxmsg, 1);
     if (encrypted)
     {
-        free(ctxmsg->msg);
+        free(trusted_copy);
     }
 }
 /**
@@ -767,6 +1169,7 @@ void SecureMessageManager::SessionRequestHandler(void *ptr, int status)
     auto msg = secmsg->msg;
 
     _this->callback_map[msg->src.raw].self_id = _this->self;
+    _this->callback_map[msg->src.raw].self_id.fields.thread = msg->src.fields.thread;
     _this->callback_map[msg->src.raw].other_id = msg->src;
     _this->callback_map[msg->src.raw].initial = _this->iasapi->attestable();
     _this->callback_map[msg->src.raw].attestation_initialized = 0;
@@ -829,6 +1232,502 @@ void SecureMessageManager::dh_key_exchange_initiator(
 #endif
     messageService->sendMessageAsync(msg, iasapi->get_client_initiator_attestation_flow(), kec);
 }
+/**
+ * @brief attest this thread to the trusted root on behalf of the instance itself, rather than a single peer.
+ * The trusted root responds with keys for every member of the attestation group, @see AttestationClient::dh_key_exchange_ra_response_final_cb
+ * Invoked by registertypedcallback for servers, and by connectAll.
+ */
+void SecureMessageManager::startGroupAttestation()
+{
+    DIGGI_ASSERT(!started_attest);
+    started_attest = true;
+    callback_map[self.raw].self_id = self;
+    callback_map[self.raw].parent_manager = this;
+    callback_map[self.raw].session_id = 0;
+    callback_map[self.raw].session_id_outbound = 0;
+    callback_map[self.raw].session_id_inbound = 0;
+    callback_map[self.raw].initial = 1;
+    callback_map[self.raw].attestation_initialized = 0;
+    dh_key_exchange_initiator(&callback_map[self.raw]);
+}
+/**
+ * @brief let a session wait for the attestation of this thread which is in progress, instead of attesting it separately.
+ * Only enclave peers join, as keys are only handed out for the attestation group.
+ * @param kec context of target, with queued messages
+ * @return true if joined, false if "attest-at-startup" is not configured or no attestation is in progress, and the caller must attest.
+ */
+bool SecureMessageManager::joinGroupAttestation(key_exchange_context_t *kec)
+{
+    if (!attest_at_startup || kec->other_id.fields.type != ENCLAVE)
+    {
+        return false;
+    }
+    auto own = callback_map.find(self.raw);
+    if (own == callback_map.end() || own->second.initial == 0)
+    {
+        return false;
+    }
+    kec->group_pending = 1;
+    return true;
+}
+/**
+ * @brief send messages of sessions which waited for the group attestation, once its keys are installed.
+ * Sessions towards peers outside the attestation group are still without keys,
+ * these attest on their own if messages are queued, and are otherwise forgotten until the next send.
+ */
+void SecureMessageManager::completeGroupAttestation()
+{
+    DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
+    std::vector<key_exchange_context_t *> keyed;
+    std::vector<key_exchange_context_t *> unkeyed;
+    for (auto it = callback_map.begin(); it != callback_map.end();)
+    {
+        auto kec = &it->second;
+        if (!kec->group_pending)
+        {
+            it++;
+            continue;
+        }
+        kec->group_pending = 0;
+        if (kec->resume_state != SESSION_RESUME_NONE)
+        {
+            /*
+                resumed on request of the peer meanwhile
+            */
+            it++;
+            continue;
+        }
+        if (kec->initial == 0)
+        {
+            keyed.push_back(kec);
+        }
+        else if (kec->outputqueue.size() > 0)
+        {
+            unkeyed.push_back(kec);
+        }
+        else
+        {
+            it = callback_map.erase(it);
+            continue;
+        }
+        it++;
+    }
+    DIGGI_TRACE(diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "group attestation done, %lu sessions keyed, %lu sessions outside attestation group\n",
+                keyed.size(),
+                unkeyed.size());
+    for (auto kec : keyed)
+    {
+        flushOutputQueue(kec);
+    }
+    for (auto kec : unkeyed)
+    {
+        dh_key_exchange_initiator(kec);
+    }
+}
+/**
+ * @brief establish sessions towards all enclave peers in the name service map at once, before application traffic starts.
+ * Sessions are resumed from the session key cache where possible, the remaining wait for a single attestation of this thread,
+ * as the trusted root hands out keys for the whole attestation group in one response.
+ * Messages sent in the meantime are queued, and sent once the session is established.
+ */
+void SecureMessageManager::connectAll()
+{
+    DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
+    aid_t root_id;
+    root_id.raw = 0;
+    auto root = name_servicemap.find("trusted_root_func");
+    if (root != name_servicemap.end())
+    {
+        root_id = root->second;
+        root_id.fields.thread = this_thread;
+    }
+    size_t resumed = 0;
+    size_t joined = 0;
+    for (auto &entry : name_servicemap)
+    {
+        auto peer = entry.second;
+        peer.fields.thread = this_thread;
+        if (peer.fields.type != ENCLAVE || peer.raw == self.raw || peer.raw == root_id.raw)
+        {
+            continue;
+        }
+        if (callback_map.find(peer.raw) != callback_map.end())
+        {
+            continue;
+        }
+        auto kec = &callback_map[peer.raw];
+        kec->self_id = self;
+        kec->other_id = peer;
+        kec->key_exchange_session_done = (async_cb_t)SecureMessageManager::SendMessageAsyncInternal;
+        kec->parent_manager = this;
+        kec->session_id = 0;
+        kec->session_id_outbound = 0;
+        kec->session_id_inbound = 0;
+        kec->initial = 1;
+        kec->attestation_initialized = 0;
+        if (resumeSession(kec))
+        {
+            resumed++;
+        }
+        else
+        {
+            kec->group_pending = 1;
+            joined++;
+        }
+    }
+    DIGGI_TRACE(diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "attest-at-startup: resuming %lu sessions, %lu sessions wait for group attestation\n",
+                resumed,
+                joined);
+    if (joined > 0 && !started_attest)
+    {
+        startGroupAttestation();
+    }
+    else if (joined > 0 && callback_map[self.raw].initial == 0)
+    {
+        /*
+            attestation of this thread already done, peers left without keys are outside the attestation group
+        */
+        completeGroupAttestation();
+    }
+}
+/**
+ * @brief scheduled on the thread of the SMM by the constructor if "attest-at-startup" is configured.
+ * @param ptr SecureMessageManager
+ * @param status unused
+ */
+void SecureMessageManager::ConnectAllHandler(void *ptr, int status)
+{
+    DIGGI_ASSERT(ptr);
+    auto _this = (SecureMessageManager *)ptr;
+    _this->connectAll();
+}
+/**
+ * @brief attempt to resume a session from the session key cache instead of attesting, called by send for peers without a session.
+ * Sends a resume request carrying a fresh nonce, authenticated with the cached key.
+ * Messages stay queued until the peer answers with a challenge, @see SecureMessageManager::SessionResumeResponseHandler
+ * @param kec context of target, with queued messages
+ * @return true if a request was sent, false if no valid key is cached and the caller must attest.
+ */
+bool SecureMessageManager::resumeSession(key_exchange_context_t *kec)
+{
+    DIGGI_ASSERT(this_thread == diggiapi->GetThreadPool()->currentThreadId());
+    sgx_ec_key_128bit_t base;
+    if (session_keys == nullptr || !session_keys->get(kec->other_id, &base))
+    {
+        return false;
+    }
+    auto src = self;
+    src.fields.thread = kec->other_id.fields.thread;
+    auto msg = messageService->allocateMessage(src, kec->other_id, sizeof(session_resume_t), CALLBACK);
+    msg->session_count = 0;
+    msg->type = DIGGI_SESSION_RESUME_TYPE;
+    msg->delivery = CLEARTEXT;
+
+    session_resume_t request;
+    memset(&request, 0, sizeof(session_resume_t));
+    request.status = SESSION_RESUME_REQUEST;
+    sgx_read_rand(request.nonce_initiator, SESSION_RESUME_NONCE_SIZE);
+    SessionKeyCache::resumeMac(&base, msg->src, msg->dest, &request, request.mac);
+    memset(base, 0, sizeof(sgx_ec_key_128bit_t));
+    memcpy(msg->data, &request, sizeof(session_resume_t));
+
+    memcpy(kec->resume_nonce, request.nonce_initiator, SESSION_RESUME_NONCE_SIZE);
+    kec->resume_state = SESSION_RESUME_PENDING;
+    DIGGI_TRACE(diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "resuming session from: %" PRIu64 ", to: %" PRIu64 "\n",
+                msg->src.raw,
+                msg->dest.raw);
+    messageService->sendMessageAsync(msg, SessionResumeResponseHandler, kec);
+    return true;
+}
+/**
+ * @brief responder side of session resumption, answers a resume request with a challenge.
+ * The request carries no freshness of its own, so it changes no session state: a recorded request replayed by the host only yields a challenge.
+ * The session is resumed once the initiator answers the challenge, @see SecureMessageManager::acceptConfirm
+ * If both peers request resumption at the same time, the request of the peer with the higher identity wins.
+ * @param initiator identity of peer requesting resumption
+ * @param responder own identity
+ * @param request resume request, copied into trusted memory
+ * @param answer response to populate, nonces and mac are set on challenge.
+ * @return uint32_t session_resume_status_t of response
+ */
+uint32_t SecureMessageManager::acceptResume(aid_t initiator, aid_t responder, const session_resume_t *request, session_resume_t *answer)
+{
+    sgx_ec_key_128bit_t base;
+    if (request->status != SESSION_RESUME_REQUEST || session_keys == nullptr || !session_keys->get(initiator, &base))
+    {
+        return SESSION_RESUME_NACK;
+    }
+    if (!SessionKeyCache::verifyResumeMac(&base, initiator, responder, request))
+    {
+        memset(base, 0, sizeof(sgx_ec_key_128bit_t));
+        return SESSION_RESUME_NACK;
+    }
+    auto existing = callback_map.find(initiator.raw);
+    if (existing != callback_map.end() && existing->second.resume_state == SESSION_RESUME_PENDING && responder.raw > initiator.raw)
+    {
+        memset(base, 0, sizeof(sgx_ec_key_128bit_t));
+        return SESSION_RESUME_BUSY;
+    }
+    auto kec = &callback_map[initiator.raw];
+    /*
+        An unanswered challenge is repeated rather than replaced, so a replayed request can not invalidate the challenge of a genuine one.
+    */
+    if (!kec->resume_challenged)
+    {
+        sgx_read_rand(kec->resume_challenge, SESSION_RESUME_NONCE_SIZE);
+        kec->resume_challenged = 1;
+    }
+    answer->status = SESSION_RESUME_CHALLENGE;
+    memcpy(answer->nonce_initiator, request->nonce_initiator, SESSION_RESUME_NONCE_SIZE);
+    memcpy(answer->nonce_responder, kec->resume_challenge, SESSION_RESUME_NONCE_SIZE);
+    SessionKeyCache::resumeMac(&base, initiator, responder, answer, answer->mac);
+    memset(base, 0, sizeof(sgx_ec_key_128bit_t));
+    return SESSION_RESUME_CHALLENGE;
+}
+/**
+ * @brief responder side of session resumption, installs the derived key once the initiator answers the challenge.
+ * The confirmation proves the initiator holds the derived key of the current challenge, which is consumed,
+ * so a replayed confirmation does not reset an established session.
+ * @param initiator identity of peer requesting resumption
+ * @param responder own identity
+ * @param confirm confirmation, copied into trusted memory
+ * @return true if the session was resumed
+ */
+bool SecureMessageManager::acceptConfirm(aid_t initiator, aid_t responder, const session_resume_t *confirm)
+{
+    auto existing = callback_map.find(initiator.raw);
+    if (confirm->status != SESSION_RESUME_CONFIRM ||
+        existing == callback_map.end() ||
+        !existing->second.resume_challenged ||
+        memcmp(confirm->nonce_responder, existing->second.resume_challenge, SESSION_RESUME_NONCE_SIZE) != 0)
+    {
+        return false;
+    }
+    auto kec = &existing->second;
+    sgx_ec_key_128bit_t base;
+    if (session_keys == nullptr || !session_keys->get(initiator, &base))
+    {
+        return false;
+    }
+    sgx_ec_key_128bit_t derived;
+    SessionKeyCache::deriveResumeKey(&base, initiator, responder, confirm, &derived);
+    memset(base, 0, sizeof(sgx_ec_key_128bit_t));
+    if (!SessionKeyCache::verifyResumeMac(&derived, initiator, responder, confirm))
+    {
+        memset(derived, 0, sizeof(sgx_ec_key_128bit_t));
+        return false;
+    }
+    kec->resume_challenged = 0;
+    memset(kec->resume_challenge, 0, SESSION_RESUME_NONCE_SIZE);
+
+    if (kec->parent_manager == nullptr)
+    {
+        kec->self_id = self;
+        kec->self_id.fields.thread = initiator.fields.thread;
+        kec->other_id = initiator;
+        kec->key_exchange_session_done = (async_cb_t)SecureMessageManager::SendMessageAsyncInternal;
+        kec->parent_manager = this;
+    }
+    /*
+        Messages of the previous session of a restarted peer are never delivered
+    */
+    releaseHeld(kec);
+    if (kec->attestation_initialized)
+    {
+        retireKey(kec, &kec->g_sp_db.sk_key);
+    }
+    memcpy(kec->g_sp_db.sk_key, derived, sizeof(sgx_ec_key_128bit_t));
+    memset(derived, 0, sizeof(sgx_ec_key_128bit_t));
+    resetKeyEpoch(kec);
+    kec->session_id = 0;
+    kec->session_id_inbound = 0;
+    kec->session_id_outbound = 0;
+    kec->attestation_initialized = 1;
+    memcpy(kec->resume_nonce, confirm->nonce_initiator, SESSION_RESUME_NONCE_SIZE);
+    /*
+        the initiator installed the derived key before confirming, so queued messages may be sent
+    */
+    completeResume(kec);
+    return true;
+}
+/**
+ * @brief send messages queued while a session was resumed.
+ * @param kec resumed context
+ */
+void SecureMessageManager::completeResume(key_exchange_context_t *kec)
+{
+    DIGGI_ASSERT(kec->key_exchange_session_done != nullptr);
+    kec->resume_state = SESSION_RESUME_DONE;
+    kec->initial = 0;
+    flushOutputQueue(kec);
+}
+/**
+ * @brief typed handler for resume requests and confirmations from peers.
+ * Requests are always answered, confirmations are not.
+ * @see SecureMessageManager::acceptResume
+ * @see SecureMessageManager::acceptConfirm
+ * @param ptr msg_async_response_t with SecureMessageManager as context
+ * @param status unused
+ */
+void SecureMessageManager::SessionResumeHandler(void *ptr, int status)
+{
+    auto secmsg = (msg_async_response_t *)ptr;
+    DIGGI_ASSERT(secmsg);
+    DIGGI_ASSERT(secmsg->msg);
+    auto _this = (SecureMessageManager *)secmsg->context;
+    DIGGI_ASSERT(_this);
+    DIGGI_ASSERT(_this->this_thread == _this->diggiapi->GetThreadPool()->currentThreadId());
+    auto msg = secmsg->msg;
+
+    /*
+        copied into trusted memory, as the host may modify the message while it is verified
+    */
+    session_resume_t request;
+    memset(&request, 0, sizeof(session_resume_t));
+    request.status = SESSION_RESUME_NACK;
+    if (msg->size == sizeof(msg_t) + sizeof(session_resume_t))
+    {
+        memcpy(&request, msg->data, sizeof(session_resume_t));
+    }
+    if (request.status == SESSION_RESUME_CONFIRM)
+    {
+        auto resumed = _this->acceptConfirm(msg->src, msg->dest, &request);
+        DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                    LogLevel::LDEBUG,
+                    "resume confirmation from: %" PRIu64 ", to: %" PRIu64 ", %s\n",
+                    msg->src.raw,
+                    msg->dest.raw,
+                    resumed ? "resumed" : "rejected");
+        return;
+    }
+
+    session_resume_t answer;
+    memset(&answer, 0, sizeof(session_resume_t));
+    answer.status = _this->acceptResume(msg->src, msg->dest, &request, &answer);
+    DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "resume request from: %" PRIu64 ", to: %" PRIu64 ", answered with status %u\n",
+                msg->src.raw,
+                msg->dest.raw,
+                answer.status);
+
+    auto msg_n = _this->messageService->allocateMessage(msg, sizeof(session_resume_t));
+    msg_n->session_count = 0;
+    msg_n->delivery = CLEARTEXT;
+    msg_n->src = msg->dest;
+    msg_n->dest = msg->src;
+    memcpy(msg_n->data, &answer, sizeof(session_resume_t));
+    _this->messageService->sendMessage(msg_n);
+}
+/**
+ * @brief initiator side of session resumption, handles the answer to a resume request.
+ * A challenge authenticated with the cached key is answered with a confirmation under the derived key,
+ * after which the derived key is installed and queued messages are sent.
+ * If the peer rejects the cached key, it is removed from the cache and the session is attested instead.
+ * @param ptr msg_async_response_t with key_exchange_context_t of peer as context
+ * @param status unused
+ */
+void SecureMessageManager::SessionResumeResponseHandler(void *ptr, int status)
+{
+    auto resp = (msg_async_response_t *)ptr;
+    DIGGI_ASSERT(resp);
+    DIGGI_ASSERT(resp->msg);
+    auto kec = (key_exchange_context_t *)resp->context;
+    DIGGI_ASSERT(kec);
+    auto _this = kec->parent_manager;
+    DIGGI_ASSERT(_this->this_thread == _this->diggiapi->GetThreadPool()->currentThreadId());
+    _this->messageService->endAsync(resp->msg);
+    /*
+        Superseded by a resume request of the peer
+    */
+    if (kec->resume_state != SESSION_RESUME_PENDING)
+    {
+        return;
+    }
+    session_resume_t answer;
+    memset(&answer, 0, sizeof(session_resume_t));
+    if (resp->msg->size == sizeof(msg_t) + sizeof(session_resume_t))
+    {
+        memcpy(&answer, resp->msg->data, sizeof(session_resume_t));
+    }
+    else
+    {
+        answer.status = SESSION_RESUME_NACK;
+    }
+    auto initiator = resp->msg->dest;
+    auto responder = resp->msg->src;
+    if (answer.status == SESSION_RESUME_BUSY)
+    {
+        kec->resume_state = SESSION_RESUME_YIELDED;
+        return;
+    }
+    sgx_ec_key_128bit_t base;
+    if (answer.status == SESSION_RESUME_CHALLENGE &&
+        memcmp(answer.nonce_initiator, kec->resume_nonce, SESSION_RESUME_NONCE_SIZE) == 0 &&
+        _this->session_keys->get(kec->other_id, &base))
+    {
+        if (SessionKeyCache::verifyResumeMac(&base, initiator, responder, &answer))
+        {
+            session_resume_t confirm;
+            memset(&confirm, 0, sizeof(session_resume_t));
+            confirm.status = SESSION_RESUME_CONFIRM;
+            memcpy(confirm.nonce_initiator, answer.nonce_initiator, SESSION_RESUME_NONCE_SIZE);
+            memcpy(confirm.nonce_responder, answer.nonce_responder, SESSION_RESUME_NONCE_SIZE);
+            sgx_ec_key_128bit_t derived;
+            SessionKeyCache::deriveResumeKey(&base, initiator, responder, &confirm, &derived);
+            memset(base, 0, sizeof(sgx_ec_key_128bit_t));
+            SessionKeyCache::resumeMac(&derived, initiator, responder, &confirm, confirm.mac);
+
+            /*
+                sent ahead of the queued messages, so the peer installs the derived key before they arrive
+            */
+            auto msg = _this->messageService->allocateMessage(initiator, responder, sizeof(session_resume_t), REGULAR);
+            msg->session_count = 0;
+            msg->type = DIGGI_SESSION_RESUME_TYPE;
+            msg->delivery = CLEARTEXT;
+            memcpy(msg->data, &confirm, sizeof(session_resume_t));
+            _this->messageService->sendMessage(msg);
+
+            DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                        LogLevel::LDEBUG,
+                        "resumed session from: %" PRIu64 ", to: %" PRIu64 "\n",
+                        initiator.raw,
+                        responder.raw);
+            if (kec->attestation_initialized)
+            {
+                retireKey(kec, &kec->g_sp_db.sk_key);
+            }
+            memcpy(kec->g_sp_db.sk_key, derived, sizeof(sgx_ec_key_128bit_t));
+            memset(derived, 0, sizeof(sgx_ec_key_128bit_t));
+            memcpy(kec->resume_nonce, answer.nonce_responder, SESSION_RESUME_NONCE_SIZE);
+            resetKeyEpoch(kec);
+            kec->session_id = 0;
+            kec->session_id_inbound = 0;
+            kec->session_id_outbound = 0;
+            kec->attestation_initialized = 1;
+            _this->completeResume(kec);
+            return;
+        }
+        memset(base, 0, sizeof(sgx_ec_key_128bit_t));
+    }
+    DIGGI_TRACE(_this->diggiapi->GetLogObject(),
+                LogLevel::LDEBUG,
+                "resume rejected by: %" PRIu64 ", attesting\n",
+                responder.raw);
+    _this->session_keys->erase(kec->other_id);
+    _this->session_keys->persist();
+    kec->resume_state = SESSION_RESUME_NONE;
+    if (!_this->joinGroupAttestation(kec))
+    {
+        _this->dh_key_exchange_initiator(kec);
+    }
+}
 /**
  * @brief api call for retrieving aid->human readable name map for instances.
  * returns all possible instance targets allowed for this instance.
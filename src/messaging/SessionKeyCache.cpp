@@ -0,0 +1,399 @@
+/**
+ * @file SessionKeyCache.cpp
+ * @brief implementation of the sealed session key cache, and the key derivation and authentication of session resumption.
+ * @see SessionKeyCache
+ * @version 0.1
+ *
+ */
+#include "messaging/SessionKeyCache.h"
+#include "DiggiAssert.h"
+#include "mbedtls/md.h"
+#include "mbedtls/hkdf.h"
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#ifndef DIGGI_ENCLAVE
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#endif
+
+/// context string of derived session keys
+static const char resume_key_info[] = "diggi session resume";
+
+/**
+ * @brief read cache file, through an ocall in enclave mode.
+ * @return int bytes read, -1 if the file does not exist
+ */
+static int read_cache_file(const char *path, uint8_t *buf, size_t size)
+{
+#ifdef DIGGI_ENCLAVE
+    int ret = -1;
+    ocall_session_cache_read(&ret, path, buf, size);
+    return ret;
+#else
+    return session_cache_file_read(path, buf, size);
+#endif
+}
+/**
+ * @brief replace cache file, through an ocall in enclave mode.
+ * @return int 0 on success
+ */
+static int write_cache_file(const char *path, uint8_t *buf, size_t size)
+{
+#ifdef DIGGI_ENCLAVE
+    int ret = -1;
+    ocall_session_cache_write(&ret, path, buf, size);
+    return ret;
+#else
+    return session_cache_file_write(path, buf, size);
+#endif
+}
+#ifndef DIGGI_ENCLAVE
+/**
+ * @brief read sealed session key cache.
+ * Only availible in untrusted memory, enclaves reach it through ocall_session_cache_read.
+ * @see SessionKeyCache::load
+ * @param path cache file
+ * @param buf target buffer
+ * @param size size of buffer
+ * @return int bytes read, -1 if the file does not exist
+ */
+int session_cache_file_read(const char *path, uint8_t *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < size)
+    {
+        auto ret = read(fd, buf + done, size - done);
+        if (ret <= 0)
+        {
+            break;
+        }
+        done += (size_t)ret;
+    }
+    close(fd);
+    return (int)done;
+}
+/**
+ * @brief replace sealed session key cache.
+ * Written to a temporary file which is renamed over the cache, so a crash never leaves a partial cache.
+ * Only availible in untrusted memory, enclaves reach it through ocall_session_cache_write.
+ * @see SessionKeyCache::persist
+ * @param path cache file
+ * @param buf sealed cache
+ * @param size size of sealed cache
+ * @return int 0 on success, -1 on failure
+ */
+int session_cache_file_write(const char *path, uint8_t *buf, size_t size)
+{
+    auto tmp = std::string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < size)
+    {
+        auto ret = write(fd, buf + done, size - done);
+        if (ret <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        done += (size_t)ret;
+    }
+    fsync(fd);
+    close(fd);
+    return rename(tmp.c_str(), path);
+}
+#endif
+
+/**
+ * @brief Construct a new Session Key Cache object, empty until loaded.
+ *
+ * @param path file the cache is persisted to
+ * @param ttl_sec lifetime of entries added by put
+ * @param sealer sealing algorithm of persisted cache, owned by the cache
+ */
+SessionKeyCache::SessionKeyCache(std::string path, uint64_t ttl_sec, ISealingAlgorithm *sealer)
+    : path(path),
+      ttl_sec(ttl_sec),
+      sealer(sealer),
+      clock_floor(0)
+{
+    DIGGI_ASSERT(sealer);
+}
+/**
+ * @brief Destroy the Session Key Cache object, keys are cleared from memory.
+ */
+SessionKeyCache::~SessionKeyCache()
+{
+    for (auto &entry : entries)
+    {
+        memset(entry.second.key, 0, sizeof(sgx_ec_key_128bit_t));
+    }
+    delete sealer;
+}
+/**
+ * @brief read wall clock, through an ocall in enclave mode.
+ * The host controls this clock, @see SessionKeyCache::current
+ * @return uint64_t seconds since epoch
+ */
+uint64_t SessionKeyCache::now()
+{
+    uint64_t sec = 0;
+#ifdef DIGGI_ENCLAVE
+    ocall_realtime_sec(&sec);
+#else
+    sec = (uint64_t)time(NULL);
+#endif
+    return sec;
+}
+/**
+ * @brief clock used for expiry, never earlier than any reading observed before, including those of earlier runs sealed in the cache file.
+ * Bounds the host clock, so rolling it back does not revive expired entries.
+ * @return uint64_t seconds since epoch
+ */
+uint64_t SessionKeyCache::current()
+{
+    auto sec = now();
+    if (sec < clock_floor)
+    {
+        sec = clock_floor;
+    }
+    clock_floor = sec;
+    return sec;
+}
+/**
+ * @brief restore cache from file, replacing entries in memory. Expired entries are dropped.
+ * A missing or truncated file yields an empty cache.
+ * @warning a file which fails to unseal is treated as tampering, and asserts as sealed storage does.
+ * @return size_t count of restored entries
+ */
+size_t SessionKeyCache::load()
+{
+    entries.clear();
+    auto ciphertext_size = sealer->getciphertextsize(SPACE_PER_BLOCK);
+    auto file_size = sizeof(uint32_t) + ciphertext_size;
+    auto file = (uint8_t *)malloc(file_size);
+    DIGGI_ASSERT(file);
+    auto read = read_cache_file(path.c_str(), file, file_size);
+    if (read < 0 || (size_t)read != file_size)
+    {
+        free(file);
+        return 0;
+    }
+    uint32_t crc = 0;
+    memcpy(&crc, file, sizeof(uint32_t));
+    auto plaintext = (uint8_t *)malloc(SPACE_PER_BLOCK);
+    DIGGI_ASSERT(plaintext);
+    sealer->decrypt(file + sizeof(uint32_t), ciphertext_size, plaintext, SPACE_PER_BLOCK, crc);
+    free(file);
+
+    auto header = (session_key_cache_header_t *)plaintext;
+    if (header->magic == SESSION_KEY_CACHE_MAGIC && header->count <= SESSION_KEY_CACHE_MAX_ENTRIES)
+    {
+        auto stored = (session_key_cache_entry_t *)(plaintext + sizeof(session_key_cache_header_t));
+        if (header->clock > clock_floor)
+        {
+            clock_floor = header->clock;
+        }
+        auto sec = current();
+        for (uint32_t i = 0; i < header->count; i++)
+        {
+            if (stored[i].expires > sec)
+            {
+                entries[stored[i].other_id.raw] = stored[i];
+            }
+        }
+    }
+    memset(plaintext, 0, SPACE_PER_BLOCK);
+    free(plaintext);
+    return entries.size();
+}
+/**
+ * @brief seal cache and replace file.
+ * @return true if the file was written
+ */
+bool SessionKeyCache::persist()
+{
+    auto plaintext = (uint8_t *)calloc(1, SPACE_PER_BLOCK);
+    DIGGI_ASSERT(plaintext);
+    auto header = (session_key_cache_header_t *)plaintext;
+    auto stored = (session_key_cache_entry_t *)(plaintext + sizeof(session_key_cache_header_t));
+    header->magic = SESSION_KEY_CACHE_MAGIC;
+    header->count = 0;
+    header->clock = current();
+    for (auto &entry : entries)
+    {
+        DIGGI_ASSERT(header->count < SESSION_KEY_CACHE_MAX_ENTRIES);
+        stored[header->count++] = entry.second;
+    }
+    auto ciphertext_size = sealer->getciphertextsize(SPACE_PER_BLOCK);
+    uint32_t crc = 0;
+    auto sealed = sealer->encrypt(plaintext, SPACE_PER_BLOCK, ciphertext_size, &crc);
+    memset(plaintext, 0, SPACE_PER_BLOCK);
+    free(plaintext);
+
+    auto file_size = sizeof(uint32_t) + ciphertext_size;
+    auto file = (uint8_t *)malloc(file_size);
+    DIGGI_ASSERT(file);
+    memcpy(file, &crc, sizeof(uint32_t));
+    memcpy(file + sizeof(uint32_t), sealed, ciphertext_size);
+    free(sealed);
+    auto ret = write_cache_file(path.c_str(), file, file_size);
+    free(file);
+    return ret == 0;
+}
+/**
+ * @brief add or replace key of peer, expiring ttl_sec from now.
+ * If the cache is full, the entry closest to expiry is evicted.
+ * @param other peer identity
+ * @param key attested key
+ */
+void SessionKeyCache::put(aid_t other, const sgx_ec_key_128bit_t *key)
+{
+    DIGGI_ASSERT(key);
+    if (entries.find(other.raw) == entries.end() && entries.size() >= SESSION_KEY_CACHE_MAX_ENTRIES)
+    {
+        auto victim = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); it++)
+        {
+            if (it->second.expires < victim->second.expires)
+            {
+                victim = it;
+            }
+        }
+        entries.erase(victim);
+    }
+    auto &entry = entries[other.raw];
+    entry.other_id = other;
+    memcpy(entry.key, key, sizeof(sgx_ec_key_128bit_t));
+    entry.expires = current() + ttl_sec;
+}
+/**
+ * @brief lookup unexpired key of peer, expired entries are removed.
+ * @param other peer identity
+ * @param key output key
+ * @return true if a valid key was found
+ */
+bool SessionKeyCache::get(aid_t other, sgx_ec_key_128bit_t *key)
+{
+    DIGGI_ASSERT(key);
+    auto it = entries.find(other.raw);
+    if (it == entries.end())
+    {
+        return false;
+    }
+    if (it->second.expires <= current())
+    {
+        entries.erase(it);
+        return false;
+    }
+    memcpy(key, it->second.key, sizeof(sgx_ec_key_128bit_t));
+    return true;
+}
+/**
+ * @brief remove key of peer, for instance when the peer rejects it.
+ * @param other peer identity
+ */
+void SessionKeyCache::erase(aid_t other)
+{
+    entries.erase(other.raw);
+}
+/**
+ * @brief count of entries in memory, including entries which expired since loaded.
+ * @return size_t
+ */
+size_t SessionKeyCache::size()
+{
+    return entries.size();
+}
+/**
+ * @brief derive key of a resumed session, HKDF-SHA256 over the cached key, salted with the nonces of both peers.
+ * Fresh nonces give a fresh key, so message nonces may restart from 0 without reusing a GCM IV.
+ * @param base cached key shared by both peers
+ * @param initiator identity of peer requesting resumption
+ * @param responder identity of peer accepting resumption
+ * @param resume resume message carrying both nonces
+ * @param derived output key
+ */
+void SessionKeyCache::deriveResumeKey(
+    const sgx_ec_key_128bit_t *base,
+    aid_t initiator,
+    aid_t responder,
+    const session_resume_t *resume,
+    sgx_ec_key_128bit_t *derived)
+{
+    uint8_t salt[SESSION_RESUME_NONCE_SIZE * 2];
+    memcpy(salt, resume->nonce_initiator, SESSION_RESUME_NONCE_SIZE);
+    memcpy(salt + SESSION_RESUME_NONCE_SIZE, resume->nonce_responder, SESSION_RESUME_NONCE_SIZE);
+    uint8_t info[sizeof(resume_key_info) + (2 * sizeof(aid_t))];
+    memcpy(info, resume_key_info, sizeof(resume_key_info));
+    memcpy(info + sizeof(resume_key_info), &initiator, sizeof(aid_t));
+    memcpy(info + sizeof(resume_key_info) + sizeof(aid_t), &responder, sizeof(aid_t));
+    auto ret = mbedtls_hkdf(
+        mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+        salt,
+        sizeof(salt),
+        (const unsigned char *)base,
+        sizeof(sgx_ec_key_128bit_t),
+        info,
+        sizeof(info),
+        (unsigned char *)derived,
+        sizeof(sgx_ec_key_128bit_t));
+    DIGGI_ASSERT(ret == 0);
+}
+/**
+ * @brief HMAC-SHA256 over a resume message and the identities of both peers, excluding the mac field itself.
+ * @param key cached key for requests, derived key for acknowledgements
+ * @param initiator identity of peer requesting resumption
+ * @param responder identity of peer accepting resumption
+ * @param resume resume message
+ * @param mac output of SESSION_RESUME_MAC_SIZE bytes
+ */
+void SessionKeyCache::resumeMac(
+    const sgx_ec_key_128bit_t *key,
+    aid_t initiator,
+    aid_t responder,
+    const session_resume_t *resume,
+    uint8_t *mac)
+{
+    uint8_t input[(2 * sizeof(aid_t)) + offsetof(session_resume_t, mac)];
+    memcpy(input, &initiator, sizeof(aid_t));
+    memcpy(input + sizeof(aid_t), &responder, sizeof(aid_t));
+    memcpy(input + (2 * sizeof(aid_t)), resume, offsetof(session_resume_t, mac));
+    auto ret = mbedtls_md_hmac(
+        mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+        (const unsigned char *)key,
+        sizeof(sgx_ec_key_128bit_t),
+        input,
+        sizeof(input),
+        mac);
+    DIGGI_ASSERT(ret == 0);
+}
+/**
+ * @brief verify mac of resume message, without early exit.
+ * @return true if authentic
+ */
+bool SessionKeyCache::verifyResumeMac(
+    const sgx_ec_key_128bit_t *key,
+    aid_t initiator,
+    aid_t responder,
+    const session_resume_t *resume)
+{
+    uint8_t expected[SESSION_RESUME_MAC_SIZE];
+    resumeMac(key, initiator, responder, resume, expected);
+    uint8_t diff = 0;
+    for (size_t i = 0; i < SESSION_RESUME_MAC_SIZE; i++)
+    {
+        diff |= expected[i] ^ resume->mac[i];
+    }
+    return diff == 0;
+}
@@ -0,0 +1,287 @@
+/**
+ * @file StreamChannel.cpp
+ * @brief implementation of streaming channels, for payloads exceeding the MAX_DIGGI_MEM_SIZE limit of a single message.
+ * Streams are opened, written and closed by the sender, and surface as an ordered series of chunk callbacks on the reciever.
+ * Flow control is a fixed window of chunks per stream, replenished by cumulative acknowledgements from the reciever.
+ * @see StreamChannelManager
+ * @version 0.1
+ *
+ */
+#include "messaging/StreamChannel.h"
+
+/*
+    A full chunk, with its headers, must fit the pool class it is sized for, also after encryption
+*/
+COMPILE_TIME_ASSERT(STREAM_CHUNK_PAYLOAD + sizeof(stream_header_t) + sizeof(secure_message_t) + sizeof(msg_t) <= DIGGI_MEM_CLASS_2_SIZE);
+
+/**
+ * @brief Construct a new Stream Channel Manager object
+ * The stream message type is registered with the message manager once a stream is opened, or a stream callback registered.
+ * @param mngr per thread message manager, used to send and recieve chunks
+ * @param threadpool threadpool, yielded to while a writer waits for the window to open
+ * @param log log object
+ */
+StreamChannelManager::StreamChannelManager(IMessageManager *mngr, IThreadPool *threadpool, ILog *log)
+    : mngr(mngr),
+      threadpool(threadpool),
+      log(log),
+      stream_counter(0),
+      registered(false),
+      chunk_cb(nullptr),
+      chunk_ctx(nullptr)
+{
+    DIGGI_ASSERT(mngr);
+    DIGGI_ASSERT(threadpool);
+}
+/**
+ * @brief Destroy the Stream Channel Manager object
+ * Open streams are abandoned, recievers are not notified.
+ */
+StreamChannelManager::~StreamChannelManager()
+{
+    outbound.clear();
+    inbound.clear();
+}
+/**
+ * @brief register handler for stream messages, both chunks and acknowledgements arrive through the same type.
+ *
+ */
+void StreamChannelManager::registerHandler()
+{
+    if (registered)
+    {
+        return;
+    }
+    registered = true;
+    mngr->registerTypeCallback(StreamChannelManager::stream_message_cb, DIGGI_STREAM_MESSAGE_TYPE, this);
+}
+/**
+ * @brief send a stream message without payload
+ *
+ * @param destination reciever
+ * @param delivery encryption of message
+ * @param op operation
+ * @param stream stream id
+ * @param seq sequence number or acknowledged count
+ */
+void StreamChannelManager::sendControl(aid_t destination, msg_delivery_t delivery, stream_op_t op, uint64_t stream, uint64_t seq)
+{
+    auto msg = mngr->allocateMessage(destination, sizeof(stream_header_t), REGULAR, delivery);
+    msg->type = DIGGI_STREAM_MESSAGE_TYPE;
+    auto header = (stream_header_t *)msg->data;
+    header->op = op;
+    header->pad = 0;
+    header->stream = stream;
+    header->seq = seq;
+    mngr->Send(msg, nullptr, nullptr);
+}
+/**
+ * @brief open a stream towards destination instance.
+ *
+ * @param destination reciever, which must have registered a stream callback
+ * @param delivery encryption of chunks, as for allocateMessage
+ * @return uint64_t stream id, used for writeStream and closeStream
+ */
+uint64_t StreamChannelManager::openStream(aid_t destination, msg_delivery_t delivery)
+{
+    registerHandler();
+    auto stream = ++stream_counter;
+    auto &out = outbound[stream];
+    out.destination = destination;
+    out.delivery = delivery;
+    out.next_seq = 0;
+    out.acked = 0;
+    DIGGI_TRACE(log, LDEBUG, "Opening stream %lu to: %" PRIu64 "\n", stream, destination.raw);
+    sendControl(destination, delivery, STREAM_OPEN, stream, 0);
+    return stream;
+}
+/**
+ * @brief append data to stream.
+ * Data is copied into chunks which are sent immediately, so the caller may reuse buf on return.
+ * If STREAM_WINDOW_CHUNKS chunks are unacknowledged, the caller yields until the reciever acknowledges more.
+ * @param stream stream id
+ * @param buf data
+ * @param size size of data in bytes
+ * @return true if all data was sent, false if the threadpool stopped while waiting for the window
+ */
+bool StreamChannelManager::writeStream(uint64_t stream, const uint8_t *buf, size_t size)
+{
+    DIGGI_ASSERT(buf || size == 0);
+    while (size > 0)
+    {
+        auto it = outbound.find(stream);
+        DIGGI_ASSERT(it != outbound.end());
+        while (it->second.next_seq - it->second.acked >= STREAM_WINDOW_CHUNKS)
+        {
+            if (!threadpool->Alive())
+            {
+                return false;
+            }
+            threadpool->Yield();
+            it = outbound.find(stream);
+            DIGGI_ASSERT(it != outbound.end());
+        }
+        auto &out = it->second;
+        auto chunk = (size < STREAM_CHUNK_PAYLOAD) ? size : STREAM_CHUNK_PAYLOAD;
+        auto msg = mngr->allocateMessage(out.destination, sizeof(stream_header_t) + chunk, REGULAR, out.delivery);
+        msg->type = DIGGI_STREAM_MESSAGE_TYPE;
+        auto header = (stream_header_t *)msg->data;
+        header->op = STREAM_DATA;
+        header->pad = 0;
+        header->stream = stream;
+        header->seq = out.next_seq++;
+        memcpy(msg->data + sizeof(stream_header_t), buf, chunk);
+        mngr->Send(msg, nullptr, nullptr);
+        buf += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+/**
+ * @brief close stream, the reciever is notified once all chunks are delivered.
+ * Does not wait for outstanding chunks to be acknowledged.
+ * @param stream stream id
+ */
+void StreamChannelManager::closeStream(uint64_t stream)
+{
+    auto it = outbound.find(stream);
+    DIGGI_ASSERT(it != outbound.end());
+    DIGGI_TRACE(log, LDEBUG, "Closing stream %lu after %lu chunks\n", stream, it->second.next_seq);
+    sendControl(it->second.destination, it->second.delivery, STREAM_CLOSE, stream, it->second.next_seq);
+    outbound.erase(it);
+}
+/**
+ * @brief accept streams on this thread.
+ * cb is invoked with a stream_chunk_t for each chunk in the order written, and a final chunk with last set once the stream is closed.
+ * @param cb chunk callback
+ * @param ctx context pointer delivered in stream_chunk_t::context
+ */
+void StreamChannelManager::registerStreamCallback(async_cb_t cb, void *ctx)
+{
+    chunk_cb = cb;
+    chunk_ctx = ctx;
+    registerHandler();
+}
+/**
+ * @brief count of chunks sent on stream, not yet acknowledged by the reciever
+ *
+ * @param stream stream id
+ * @return size_t chunks in flight, 0 if stream is not open
+ */
+size_t StreamChannelManager::inFlight(uint64_t stream)
+{
+    auto it = outbound.find(stream);
+    if (it == outbound.end())
+    {
+        return 0;
+    }
+    return it->second.next_seq - it->second.acked;
+}
+/**
+ * @brief typed callback for DIGGI_STREAM_MESSAGE_TYPE, dispatches on operation
+ *
+ * @param ptr msg_async_response_t holding message and StreamChannelManager
+ * @param status
+ */
+void StreamChannelManager::stream_message_cb(void *ptr, int status)
+{
+    DIGGI_ASSERT(ptr);
+    auto resp = (msg_async_response_t *)ptr;
+    auto _this = (StreamChannelManager *)resp->context;
+    DIGGI_ASSERT(_this);
+    auto msg = resp->msg;
+    DIGGI_ASSERT(msg);
+    DIGGI_ASSERT(msg->size >= sizeof(msg_t) + sizeof(stream_header_t));
+    auto header = (stream_header_t *)msg->data;
+    if (header->op == STREAM_ACK)
+    {
+        _this->handleAck(msg, header);
+    }
+    else
+    {
+        _this->handleChunk(msg, header);
+    }
+}
+/**
+ * @brief deliver open, data or close message of an inbound stream.
+ * Chunks are acknowledged every STREAM_ACK_INTERVAL chunks, after the callback has consumed them.
+ * @param msg recieved message
+ * @param header stream header of message
+ */
+void StreamChannelManager::handleChunk(msg_t *msg, stream_header_t *header)
+{
+    auto key = std::make_pair((uint64_t)msg->src.raw, header->stream);
+    if (header->op == STREAM_OPEN)
+    {
+        DIGGI_ASSERT(inbound.find(key) == inbound.end());
+        auto &in = inbound[key];
+        in.next_seq = 0;
+        in.offset = 0;
+        in.unacked = 0;
+        return;
+    }
+    auto it = inbound.find(key);
+    DIGGI_ASSERT(it != inbound.end());
+    auto &in = it->second;
+    /*
+        message managers preserve ordering per peer, so chunks never arrive out of order
+    */
+    DIGGI_ASSERT(header->seq == in.next_seq);
+
+    stream_chunk_t chunk;
+    chunk.stream = header->stream;
+    chunk.source = msg->src;
+    chunk.offset = in.offset;
+    chunk.context = chunk_ctx;
+    if (header->op == STREAM_CLOSE)
+    {
+        chunk.data = nullptr;
+        chunk.size = 0;
+        chunk.last = true;
+        inbound.erase(it);
+        if (chunk_cb != nullptr)
+        {
+            chunk_cb(&chunk, 1);
+        }
+        return;
+    }
+    DIGGI_ASSERT(header->op == STREAM_DATA);
+    chunk.data = msg->data + sizeof(stream_header_t);
+    chunk.size = msg->size - sizeof(msg_t) - sizeof(stream_header_t);
+    chunk.last = false;
+    in.next_seq++;
+    in.offset += chunk.size;
+    in.unacked++;
+    auto ack = (in.unacked >= STREAM_ACK_INTERVAL);
+    auto acked_seq = in.next_seq;
+    if (ack)
+    {
+        in.unacked = 0;
+    }
+    if (chunk_cb != nullptr)
+    {
+        chunk_cb(&chunk, 1);
+    }
+    if (ack)
+    {
+        sendControl(msg->src, msg->delivery, STREAM_ACK, header->stream, acked_seq);
+    }
+}
+/**
+ * @brief cumulative acknowledgement from reciever, opens the window of the stream.
+ * Acknowledgements for streams allready closed are ignored.
+ * @param msg recieved message
+ * @param header stream header of message
+ */
+void StreamChannelManager::handleAck(msg_t *msg, stream_header_t *header)
+{
+    auto it = outbound.find(header->stream);
+    if (it == outbound.end())
+    {
+        return;
+    }
+    if (header->seq > it->second.acked)
+    {
+        it->second.acked = header->seq;
+    }
+}
@@ -76,6 +76,72 @@ void ThreadSafeMessageManager::Send(msg_t *msg, async_cb_t cb, void *cb_context)
     ptmngr->Send(msg, cb, cb_context);
 }
 
+/// per-thread, threadsafe version @see SecureMessageManager::Send
+void ThreadSafeMessageManager::Send(msg_t *msg, async_cb_t cb, void *cb_context, uint64_t timeout_us)
+{
+    auto thrid = threadpool->currentThreadId();
+    DIGGI_ASSERT(thrid >= 0);
+    DIGGI_ASSERT(perthreadMngr.size() > (size_t)thrid);
+    auto ptmngr = perthreadMngr[thrid];
+    DIGGI_ASSERT(ptmngr);
+    ptmngr->Send(msg, cb, cb_context, timeout_us);
+}
+
+/// per-thread, threadsafe version @see SecureMessageManager::openStream
+uint64_t ThreadSafeMessageManager::openStream(std::string destination, msg_delivery_t delivery)
+{
+    auto thrid = threadpool->currentThreadId();
+    DIGGI_ASSERT(thrid >= 0);
+    DIGGI_ASSERT(perthreadMngr.size() > (size_t)thrid);
+    auto ptmngr = perthreadMngr[thrid];
+    DIGGI_ASSERT(ptmngr);
+    return ptmngr->openStream(destination, delivery);
+}
+
+/// per-thread, threadsafe version @see SecureMessageManager::openStream
+uint64_t ThreadSafeMessageManager::openStream(aid_t destination, msg_delivery_t delivery)
+{
+    auto thrid = threadpool->currentThreadId();
+    DIGGI_ASSERT(thrid >= 0);
+    DIGGI_ASSERT(perthreadMngr.size() > (size_t)thrid);
+    auto ptmngr = perthreadMngr[thrid];
+    DIGGI_ASSERT(ptmngr);
+    return ptmngr->openStream(destination, delivery);
+}
+
+/// per-thread, threadsafe version @see SecureMessageManager::writeStream
+bool ThreadSafeMessageManager::writeStream(uint64_t stream, const uint8_t *buf, size_t size)
+{
+    auto thrid = threadpool->currentThreadId();
+    DIGGI_ASSERT(thrid >= 0);
+    DIGGI_ASSERT(perthreadMngr.size() > (size_t)thrid);
+    auto ptmngr = perthreadMngr[thrid];
+    DIGGI_ASSERT(ptmngr);
+    return ptmngr->writeStream(stream, buf, size);
+}
+
+/// per-thread, threadsafe version @see SecureMessageManager::closeStream
+void ThreadSafeMessageManager::closeStream(uint64_t stream)
+{
+    auto thrid = threadpool->currentThreadId();
+    DIGGI_ASSERT(thrid >= 0);
+    DIGGI_ASSERT(perthreadMngr.size() > (size_t)thrid);
+    auto ptmngr = perthreadMngr[thrid];
+    DIGGI_ASSERT(ptmngr);
+    ptmngr->closeStream(stream);
+}
+
+/// per-thread, threadsafe version @see SecureMessageManager::registerStreamCallback
+void ThreadSafeMessageManager::registerStreamCallback(async_cb_t cb, void *ctx)
+{
+    auto thrid = threadpool->currentThreadId();
+    DIGGI_ASSERT(thrid >= 0);
+    DIGGI_ASSERT(perthreadMngr.size() > (size_t)thrid);
+    auto ptmngr = perthreadMngr[thrid];
+    DIGGI_ASSERT(ptmngr);
+    ptmngr->registerStreamCallback(cb, ctx);
+}
+
 /// per-thread, threadsafe version @see SecureMessageManager::allocateMessage
 msg_t *ThreadSafeMessageManager::allocateMessage(
     std::string destination,
@@ -160,6 +160,139 @@ void delete_memory_buffer(lf_buffer_t *buf, size_t pool_size)
     }
 }
 
+/**
+ * @brief allocate the global message object pool usable by all diggi instances.
+ * Replaces a single pool of MAX_DIGGI_MEM_SIZE objects with size classes, so small messages do not pin a full slot.
+ * Each class is one contiguous slab, its objects are pushed onto a lockfree free list.
+ * As in provision_memory_buffer, all consumers are also producers.
+ * Consumed by AsyncMessageManager and the untrusted runtime.
+ * @see AsyncMessageManager::AsyncMessageManager
+ * @param threads expected producers and consumers
+ * @return msg_pool_t* new pool
+ */
+msg_pool_t *provision_message_pool(size_t threads)
+{
+    const size_t sizes[DIGGI_MEM_CLASS_COUNT] = {
+        DIGGI_MEM_CLASS_0_SIZE,
+        DIGGI_MEM_CLASS_1_SIZE,
+        DIGGI_MEM_CLASS_2_SIZE,
+        DIGGI_MEM_CLASS_3_SIZE};
+    const size_t counts[DIGGI_MEM_CLASS_COUNT] = {
+        DIGGI_MEM_CLASS_0_ITEMS,
+        DIGGI_MEM_CLASS_1_ITEMS,
+        DIGGI_MEM_CLASS_2_ITEMS,
+        DIGGI_MEM_CLASS_3_ITEMS};
+
+    auto pool = (msg_pool_t *)calloc(1, sizeof(msg_pool_t));
+    DIGGI_ASSERT(pool);
+    for (size_t cls = 0; cls < DIGGI_MEM_CLASS_COUNT; cls++)
+    {
+        DIGGI_ASSERT(cls == 0 || sizes[cls] > sizes[cls - 1]);
+        pool->object_size[cls] = sizes[cls];
+        pool->object_count[cls] = counts[cls];
+        pool->slab[cls] = (uint8_t *)memalign(PAGE_SIZE, sizes[cls] * counts[cls]);
+        DIGGI_ASSERT(pool->slab[cls]);
+        pool->free_list[cls] = lf_new(counts[cls], threads, threads);
+        for (size_t count = 0; count < counts[cls]; count++)
+        {
+            lf_send(pool->free_list[cls], pool->slab[cls] + (count * sizes[cls]), 0);
+        }
+    }
+    DIGGI_ASSERT(pool->object_size[DIGGI_MEM_CLASS_COUNT - 1] == MAX_DIGGI_MEM_SIZE);
+    return pool;
+}
+/**
+ * @brief delete global message object pool.
+ * @warning ensure no threads are producing or consuming from pool.
+ * @param pool pool to delete
+ */
+void delete_message_pool(msg_pool_t *pool)
+{
+    DIGGI_ASSERT(pool);
+    for (size_t cls = 0; cls < DIGGI_MEM_CLASS_COUNT; cls++)
+    {
+        lf_destroy(pool->free_list[cls]);
+        free(pool->slab[cls]);
+    }
+    free(pool);
+}
+/**
+ * @brief retrieve the class of a pool object, based on which slab holds the address.
+ * @param pool message pool
+ * @param obj object previously allocated from pool
+ * @return size_t class index
+ */
+static size_t msg_pool_class_of(msg_pool_t *pool, void *obj)
+{
+    auto ptr = (uint8_t *)obj;
+    for (size_t cls = 0; cls < DIGGI_MEM_CLASS_COUNT; cls++)
+    {
+        auto start = pool->slab[cls];
+        auto end = start + (pool->object_size[cls] * pool->object_count[cls]);
+        if (ptr >= start && ptr < end)
+        {
+            DIGGI_ASSERT(((size_t)(ptr - start) % pool->object_size[cls]) == 0);
+            return cls;
+        }
+    }
+    /*
+        object does not originate from this pool
+    */
+    DIGGI_ASSERT(false);
+    return DIGGI_MEM_CLASS_COUNT;
+}
+/**
+ * @brief allocate a message object of at least size bytes.
+ * Picks the smallest class which fits, if that class is depleted larger classes are attempted before blocking.
+ * May block if all fitting classes are empty.
+ * @param pool message pool
+ * @param size required object size, including message header
+ * @param requesting_thread id of requesting thread, @see lf_recieve
+ * @return void* pool object
+ */
+void *msg_pool_alloc(msg_pool_t *pool, size_t size, size_t requesting_thread)
+{
+    DIGGI_ASSERT(pool);
+    DIGGI_ASSERT(size <= MAX_DIGGI_MEM_SIZE);
+    size_t fit = 0;
+    while (pool->object_size[fit] < size)
+    {
+        fit++;
+    }
+    for (size_t cls = fit; cls < DIGGI_MEM_CLASS_COUNT; cls++)
+    {
+        auto obj = lf_try_recieve(pool->free_list[cls], requesting_thread);
+        if (obj != nullptr)
+        {
+            return obj;
+        }
+    }
+    return lf_recieve(pool->free_list[fit], requesting_thread);
+}
+/**
+ * @brief return a message object to the class it was allocated from.
+ * @param pool message pool
+ * @param obj object to return
+ * @param requesting_thread id of requesting thread, @see lf_send
+ */
+void msg_pool_free(msg_pool_t *pool, void *obj, size_t requesting_thread)
+{
+    DIGGI_ASSERT(pool);
+    DIGGI_ASSERT(obj);
+    lf_send(pool->free_list[msg_pool_class_of(pool, obj)], obj, requesting_thread);
+}
+/**
+ * @brief usable size of a pool object, which may exceed the size requested at allocation.
+ * @param pool message pool
+ * @param obj pool object
+ * @return size_t object capacity in bytes
+ */
+size_t msg_pool_object_size(msg_pool_t *pool, void *obj)
+{
+    DIGGI_ASSERT(pool);
+    return pool->object_size[msg_pool_class_of(pool, obj)];
+}
+
 /**
  * @brief round up an unsigned number to a multiple of a given number
  * 
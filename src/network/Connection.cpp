@@ -86,6 +86,7 @@ void Connection::InitializeServer(const char *serverip, const char *serverport)
  * @brief Internal loop used for periodic asynchronous listen socket poll.
  * Agnostic to underlying socket implementation, however, requires non blocking operation.
  * Attempts to accept incomming connection, and invokes callback server_loop_cb to create new request connection object.
+ * If no connection is pending, the next poll is delayed by CONNECTION_ACCEPT_POLL_USEC instead of occupying the thread.
  * @param ptr this connection object
  * @param status unused parameter, error handling, future work
  */
@@ -117,7 +118,7 @@ void Connection::ServerLoop(void *ptr, int status)
     if (ret == DIGGI_NETWORK_WOULD_BLOCK || (ret == -74))
     { /*Fix for unit tests*/
         delete  client_fd;
-        _this->tpool->Schedule(Connection::ServerLoop, _this, __PRETTY_FUNCTION__);
+        _this->tpool->ScheduleAfter(CONNECTION_ACCEPT_POLL_USEC, Connection::ServerLoop, _this, __PRETTY_FUNCTION__);
         return;
     }
     else if (ret != 0)
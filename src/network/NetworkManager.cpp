@@ -10,10 +10,24 @@
  */
 #include "network/NetworkManager.h"
 
+/**
+ * @brief Construct a new Network Manager object
+ * If "network-timeout-usec" is set in func configuration, requests without a response within the deadline complete with no message,
+ * which the POSIX stubs report as ETIMEDOUT.
+ * Accept, recv and select block on remote peers by design and are exempt from the deadline, as is rand which has no error return.
+ * @param context Diggi API reference
+ * @param seal sealing algorithm
+ */
 NetworkManager::NetworkManager(IDiggiAPI *context, ISealingAlgorithm *seal)
     : aDiggiAPI(context),
-      aSealer(seal)
+      aSealer(seal),
+      request_timeout_us(0)
 {
+    auto &conf = aDiggiAPI->GetFuncConfig();
+    if (conf.contains("network-timeout-usec"))
+    {
+        request_timeout_us = strtoull(conf["network-timeout-usec"].value.tostring().c_str(), nullptr, 10);
+    }
 }
 
 NetworkManager::~NetworkManager()
@@ -38,7 +52,7 @@ void NetworkManager::AsyncSocket(int domain, int type, int protocol,
 	Pack::pack<int>(&currentPtr, type);
 	Pack::pack<int>(&currentPtr, protocol);
 
-    mngr->Send(msg, callback, context);
+    mngr->Send(msg, callback, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncBind(int sockfd, const struct sockaddr *addr,
@@ -57,7 +71,7 @@ void NetworkManager::AsyncBind(int sockfd, const struct sockaddr *addr,
 	Pack::pack<unsigned int>(&currentPtr, addrlen);
 	Pack::packBuffer(&currentPtr, (uint8_t*)addr, addrlen);
 
-    mngr->Send(msg, callback, context);
+    mngr->Send(msg, callback, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncGetsockname(int sockfd, const struct sockaddr *addr, socklen_t *addrlen, async_cb_t callback, void *context)
@@ -73,7 +87,7 @@ void NetworkManager::AsyncGetsockname(int sockfd, const struct sockaddr *addr, s
 	auto *currentPtr = msg->data;
 	Pack::pack<int>(&currentPtr, sockfd);
 	Pack::pack<unsigned int>(&currentPtr, (unsigned int) *addrlen);
-    mngr->Send(msg, callback, context);
+    mngr->Send(msg, callback, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncGetsockopt(int sockfd, int level, int optname, socklen_t *optlen, async_cb_t cb, void *context)
@@ -92,7 +106,7 @@ void NetworkManager::AsyncGetsockopt(int sockfd, int level, int optname, socklen
 	Pack::pack<int>(&currentPtr, optname);
 	Pack::pack<unsigned int>(&currentPtr, *optlen);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncSetsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen, async_cb_t cb, void *context)
@@ -113,7 +127,7 @@ void NetworkManager::AsyncSetsockopt(int sockfd, int level, int optname, const v
 	Pack::pack<unsigned int>(&currentPtr, optlen);
 	Pack::packBuffer(&currentPtr, (uint8_t*) optval, (unsigned int)optlen);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncConnect(int sockfd, const struct sockaddr *addr, socklen_t addrlen, async_cb_t cb, void *context)
@@ -126,7 +140,7 @@ void NetworkManager::AsyncConnect(int sockfd, const struct sockaddr *addr, sockl
     auto msg = mngr->allocateMessage("network_server_func", request_size, CALLBACK, CLEARTEXT);
     msg->type = NET_CONNECT_MSG_TYPE;
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncFcntl(int sockfd, int cmd, int flag, async_cb_t cb, void *context)
@@ -145,7 +159,7 @@ void NetworkManager::AsyncFcntl(int sockfd, int cmd, int flag, async_cb_t cb, vo
 	Pack::pack<int>(&currentPtr, cmd);
 	Pack::pack<int>(&currentPtr, flag);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncListen(int sockfd, int backlog, async_cb_t cb, void *context)
@@ -162,7 +176,7 @@ void NetworkManager::AsyncListen(int sockfd, int backlog, async_cb_t cb, void *c
     Pack::pack<int>(&currentPtr, sockfd);
     Pack::pack<int>(&currentPtr, backlog);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncSelect(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout, async_cb_t cb, void *context)
@@ -220,7 +234,7 @@ void NetworkManager::AsyncSend(int sockfd, const void *buf, size_t length, int f
 	Pack::packBuffer(&currentPtr, (uint8_t*)buf, length);
 	Pack::pack<int>(&currentPtr, flags);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncAccept(int sockfd, const struct sockaddr *addr, socklen_t *addrlen, async_cb_t cb, void *context)
@@ -254,7 +268,7 @@ void NetworkManager::AsyncClose(int sockfd, async_cb_t cb, void *context)
 	uint8_t *currentPtr = msg->data;
 	Pack::pack<int>(&currentPtr, sockfd);
 
-	mngr->Send(msg, cb, context);
+	mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void NetworkManager::AsyncRand(async_cb_t cb, void *context){
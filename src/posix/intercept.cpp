@@ -1088,6 +1088,87 @@ int __wrap_pthread_cond_init(pthread_cond_t * cond,
 	}
 }
 
+int __wrap_pthread_cond_destroy(pthread_cond_t * cond) {
+    debug_printf("pthread_cond_destroy");
+	if (syscall_interposition) {
+		return i_pthread_cond_destroy(cond);
+	}
+	else {
+		return __real_pthread_cond_destroy(cond);
+	}
+}
+
+int __wrap_pthread_rwlock_init(pthread_rwlock_t * rwlock,
+	const pthread_rwlockattr_t * attr) {
+    debug_printf("pthread_rwlock_init");
+	if (syscall_interposition) {
+		return i_pthread_rwlock_init(rwlock, attr);
+	}
+	else {
+		return __real_pthread_rwlock_init(rwlock, attr);
+	}
+}
+
+int __wrap_pthread_rwlock_destroy(pthread_rwlock_t * rwlock) {
+    debug_printf("pthread_rwlock_destroy");
+	if (syscall_interposition) {
+		return i_pthread_rwlock_destroy(rwlock);
+	}
+	else {
+		return __real_pthread_rwlock_destroy(rwlock);
+	}
+}
+
+int __wrap_pthread_rwlock_rdlock(pthread_rwlock_t * rwlock) {
+    debug_printf("pthread_rwlock_rdlock");
+	if (syscall_interposition) {
+		return i_pthread_rwlock_rdlock(rwlock);
+	}
+	else {
+		return __real_pthread_rwlock_rdlock(rwlock);
+	}
+}
+
+int __wrap_pthread_rwlock_tryrdlock(pthread_rwlock_t * rwlock) {
+    debug_printf("pthread_rwlock_tryrdlock");
+	if (syscall_interposition) {
+		return i_pthread_rwlock_tryrdlock(rwlock);
+	}
+	else {
+		return __real_pthread_rwlock_tryrdlock(rwlock);
+	}
+}
+
+int __wrap_pthread_rwlock_wrlock(pthread_rwlock_t * rwlock) {
+    debug_printf("pthread_rwlock_wrlock");
+	if (syscall_interposition) {
+		return i_pthread_rwlock_wrlock(rwlock);
+	}
+	else {
+		return __real_pthread_rwlock_wrlock(rwlock);
+	}
+}
+
+int __wrap_pthread_rwlock_trywrlock(pthread_rwlock_t * rwlock) {
+    debug_printf("pthread_rwlock_trywrlock");
+	if (syscall_interposition) {
+		return i_pthread_rwlock_trywrlock(rwlock);
+	}
+	else {
+		return __real_pthread_rwlock_trywrlock(rwlock);
+	}
+}
+
+int __wrap_pthread_rwlock_unlock(pthread_rwlock_t * rwlock) {
+    debug_printf("pthread_rwlock_unlock");
+	if (syscall_interposition) {
+		return i_pthread_rwlock_unlock(rwlock);
+	}
+	else {
+		return __real_pthread_rwlock_unlock(rwlock);
+	}
+}
+
 #endif
 
 #ifdef __cplusplus
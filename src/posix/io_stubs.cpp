@@ -36,6 +36,11 @@ extern "C"
  * 
  */
     static bool encrypted = true;
+    /**
+ * @brief set in place of a response, for requests whose response deadline passed.
+ * @see StorageManager::StorageManager
+ */
+    static msg_t iostub_timed_out;
 
     void iostub_setcontext(void *ctx, int enc)
     {
@@ -54,9 +59,10 @@ extern "C"
  * Copies message result from asynchronous Storage Manager operation.
  * and sets double pointer input as msg_async_response_t to the resulting copied message.
  * Nofree postfix in function name is redundant as the stub calle should handle freeing the copied object.
+ * If the request timed out, the double pointer is set to iostub_timed_out instead.
  * 
  * @param ptr 
- * @param status 
+ * @param status AMM_FLOW_TIMEOUT if no response arrived
  */
     void iostub_setresponse(void *ptr, int status)
     {
@@ -70,6 +76,12 @@ extern "C"
 		Not a real message from the async message manager
 	*/
         msg_t **mr = (msg_t **)rsp->context;
+        if (rsp->msg == nullptr)
+        {
+            DIGGI_TRACE(acontext->GetLogObject(), LRELEASE, "Storage request timed out, status=%d\n", status);
+            *mr = &iostub_timed_out;
+            return;
+        }
         *mr = COPY(msg_t, rsp->msg, rsp->msg->size);
         auto mm = acontext->GetMessageManager();
         mm->endAsync(rsp->msg);
@@ -82,8 +94,9 @@ extern "C"
  * Resulting in the successfull return to calling POSIX stub.
  * 
  * Message is copied and allocated in iostub_setresponse but double pointer is allocated on stack in blocking POSIX call stub.
+ * Waits at most the response deadline of the StorageManager, "storage-timeout-usec" in func configuration.
  * @param ptr double pointer for which to wait for assignment.
- * @return msg_t* 
+ * @return msg_t* response, or nullptr with errno set to ETIMEDOUT if the request timed out
  */
     msg_t *iostub_wait_for_response(msg_t **ptr)
     {
@@ -95,6 +108,13 @@ extern "C"
             acontext->GetThreadPool()->Yield();
             // DIGGI_TRACE(acontext->GetLogObject(), LDEBUG, "Returning from Yield\n");
         }
+        if (*ptr == &iostub_timed_out)
+        {
+            *ptr = nullptr;
+            set_errno(ETIMEDOUT);
+            errno = ETIMEDOUT;
+            return nullptr;
+        }
         return *ptr;
     }
     /**
@@ -122,7 +142,10 @@ extern "C"
     {
 
         auto response = iostub_wait_for_response(mptr);
-        DIGGI_ASSERT(response != nullptr);
+        if (response == nullptr)
+        {
+            return -1;
+        }
 
         auto ptr = response->data;
         DIGGI_ASSERT(response->size == sizeof(msg_t) + sizeof(int));
@@ -484,6 +507,10 @@ extern "C"
         retmsg = nullptr;
         acontext->GetStorageManager()->async_open(path, oflags, mode, iostub_setresponse, put, encrypted, false);
         auto response = iostub_wait_for_response(put);
+        if (response == nullptr)
+        {
+            return -1;
+        }
         auto ptr = response->data;
         int fd = Pack::unpack<int>(&ptr);
         iostub_freeresponse(put);
@@ -527,7 +554,10 @@ extern "C"
         retmsg = nullptr;
         acontext->GetStorageManager()->async_read(fildes, nullptr, nbyte, iostub_setresponse, put, encrypted, false);
         auto response = iostub_wait_for_response(put);
-        DIGGI_ASSERT(response != nullptr);
+        if (response == nullptr)
+        {
+            return -1;
+        }
         auto dtptr = response->data;
         size_t read = 0;
         memcpy(&read, dtptr, sizeof(size_t));
@@ -592,7 +622,10 @@ extern "C"
         retmsg = nullptr;
         acontext->GetStorageManager()->async_write(fd, buf, count, iostub_setresponse, put, encrypted, false);
         auto response = iostub_wait_for_response(put);
-        DIGGI_ASSERT(response != nullptr);
+        if (response == nullptr)
+        {
+            return -1;
+        }
         DIGGI_ASSERT(response->size == sizeof(msg_t) + sizeof(ssize_t));
         iostub_freeresponse(put);
         return count;
@@ -685,7 +718,10 @@ WARNING
         global_context->GetStorageManager()->async_fopen(filename, mode, iostub_setresponse, put);
 
         auto response = iostub_wait_for_response(put);
-        DIGGI_ASSERT(response != nullptr);
+        if (response == nullptr)
+        {
+            return nullptr;
+        }
 
         uint8_t *ptr = response->data;
         DIGGI_ASSERT(response->size == sizeof(msg_t) + sizeof(int));
@@ -721,7 +757,14 @@ WARNING
         global_context->GetStorageManager()->async_fclose(stream, iostub_setresponse, put);
 
         auto response = iostub_wait_for_response(put);
-        DIGGI_ASSERT(response != nullptr);
+        if (response == nullptr)
+        {
+            /*
+                stream is invalid after fclose, even if it fails
+            */
+            free(stream);
+            return EOF;
+        }
 
         uint8_t *ptr = response->data;
         DIGGI_ASSERT(response->size == sizeof(msg_t) + sizeof(int));
@@ -820,7 +863,10 @@ WARNING
         global_context->GetStorageManager()->async_fread(size, count, stream, iostub_setresponse, put);
 
         auto response = iostub_wait_for_response(put);
-        DIGGI_ASSERT(response != nullptr);
+        if (response == nullptr)
+        {
+            return 0;
+        }
 
         uint8_t *ptr = response->data;
         size_t actual_count = Pack::unpack<size_t>(&ptr);
@@ -860,7 +906,10 @@ WARNING
         global_context->GetStorageManager()->async_ftell(stream, iostub_setresponse, put);
 
         auto response = iostub_wait_for_response(put);
-        DIGGI_ASSERT(response != nullptr);
+        if (response == nullptr)
+        {
+            return -1;
+        }
 
         uint8_t *ptr = response->data;
         DIGGI_ASSERT(response->size == sizeof(msg_t) + sizeof(long));
@@ -15,6 +15,10 @@
 #include "misc.h"
 
 static int stop = 0;
+/*
+	set in place of a response, for requests whose response deadline passed.
+*/
+static msg_t netstubs_timed_out;
 
 void netstubs_teardown() {
 	DIGGI_ASSERT(!stop);
@@ -31,12 +35,17 @@ void netstubs_free_response(msg_t **incoming_msg) {
 void netstubs_setresponse(void *ptr, int status) { // why can't parameter 1 be a msg_async_response_t* ?
 	auto rsp = (msg_async_response_t*)ptr;
 	DIGGI_ASSERT(ptr);
-	DIGGI_ASSERT(status); // status isn't really used, just magic number 1 for now.
+	DIGGI_ASSERT(status); // status isn't really used, just magic number 1 for now, AMM_FLOW_TIMEOUT if the request timed out.
 	IDiggiAPI* global_context = GET_DIGGI_GLOBAL_CONTEXT();
 
 	global_context->GetLogObject()->Log(LDEBUG, "Setting response from call\n");
 
 	msg_t **mr = (msg_t **)rsp->context;
+	if (rsp->msg == nullptr) {
+		global_context->GetLogObject()->Log(LRELEASE, "Network request timed out, status=%d\n", status);
+		*mr = &netstubs_timed_out;
+		return;
+	}
 	*mr = COPY(msg_t, rsp->msg, rsp->msg->size);
 	global_context->GetMessageManager()->endAsync(rsp->msg);
 
@@ -51,6 +60,12 @@ msg_t* netstubs_wait_for_response(msg_t **ptr) {
 		DIGGI_ASSERT(tp != nullptr);
 		tp->Yield();
 	}
+	if (*ptr == &netstubs_timed_out) { // deadline of NetworkManager, "network-timeout-usec" in func configuration
+		*ptr = nullptr;
+		set_errno(ETIMEDOUT);
+		errno = ETIMEDOUT;
+		return nullptr;
+	}
 	return *ptr;
 }
 
@@ -58,6 +73,9 @@ msg_t* netstubs_wait_for_response(msg_t **ptr) {
 int netstubs_extract_retval(msg_t **mptr) {   // at this point mptr is still nullptr
 
 	auto response = netstubs_wait_for_response(mptr);
+	if (response == nullptr) {
+		return -1;
+	}
 	auto ptr = response->data;
 	DIGGI_ASSERT(response->size == sizeof(msg_t) + sizeof(int));
 	int retval = Pack::unpack<int>(&ptr);
@@ -88,7 +106,9 @@ int i_getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *op
 	global_context->GetNetworkManager()->AsyncGetsockopt(sockfd, level, optname, optlen, 
 												netstubs_setresponse, 
 												put);
-    netstubs_wait_for_response(put);                                                
+    if (netstubs_wait_for_response(put) == nullptr) {
+		return -1;
+	}
     
     // fetch stuff from put and place in pointers given from caller
 	auto *ptr = retmsg->data;	
@@ -147,7 +167,9 @@ ssize_t	i_send(int sockfd, const void *buf, size_t len, int flags) {
 	msg_t **put = &retmsg;
 
 	global_context->GetNetworkManager()->AsyncSend(sockfd, buf, len, flags, netstubs_setresponse, put);
-	netstubs_wait_for_response(put);
+	if (netstubs_wait_for_response(put) == nullptr) {
+		return -1;
+	}
 	
 	// fetch retval from put 
 	auto *ptr = retmsg->data;	
@@ -179,7 +201,9 @@ int	i_getsockname(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
 	msg_t **put = &retmsg;
 
 	global_context->GetNetworkManager()->AsyncGetsockname(sockfd, addr, addrlen, netstubs_setresponse, put);
-	netstubs_wait_for_response(put);
+	if (netstubs_wait_for_response(put) == nullptr) {
+		return -1;
+	}
 
 	// fetch stuff from put and place in pointers given from caller
 	auto *ptr = retmsg->data;	
@@ -57,6 +57,127 @@ typedef struct pthread_pack_data_t {
 /// next asignable thread, index into static array
 static volatile size_t curr_head_thread = 1;
 
+/**
+ * @brief virtual thread blocked on a mutex, condition variable or rwlock.
+ * Allocated on the stack of the waiting virtual thread, which is parked until woken is set.
+ * Wakers must not touch the waiter after setting woken.
+ */
+typedef struct vthread_waiter_t {
+    ///set by waker, see IThreadPool::Park
+	volatile int woken;
+    ///virtual thread id + 1 of waiter, used to hand over lock ownership
+	int id;
+    ///waiting for exclusive access to rwlock
+	int writer;
+    ///next waiter in FIFO order
+	struct vthread_waiter_t *next;
+}vthread_waiter_t;
+
+/**
+ * @brief internal layout of pthread_cond_t
+ * 
+ */
+typedef struct vthread_cond_t {
+    ///spinlock protecting wait queue, only held while manipulating queue
+	volatile int lock;
+    ///first waiter
+	vthread_waiter_t *head;
+    ///last waiter
+	vthread_waiter_t *tail;
+}vthread_cond_t;
+COMPILE_TIME_ASSERT(sizeof(vthread_cond_t) <= sizeof(pthread_cond_t));
+
+/**
+ * @brief internal layout of pthread_rwlock_t
+ * 
+ */
+typedef struct vthread_rwlock_t {
+    ///spinlock protecting lock state and wait queue
+	volatile int lock;
+    ///count of read locks held
+	unsigned int readers;
+    ///virtual thread id + 1 of writer holding lock, 0 if none
+	int writer;
+    ///first waiter
+	vthread_waiter_t *head;
+    ///last waiter
+	vthread_waiter_t *tail;
+}vthread_rwlock_t;
+COMPILE_TIME_ASSERT(sizeof(vthread_rwlock_t) <= sizeof(pthread_rwlock_t));
+
+/**
+ * @brief acquire spinlock guarding a wait queue.
+ * Never held across Yield(), so spinning is bounded by a few instructions of the holder.
+ * @param lock 
+ */
+static void waitqueue_lock(volatile int *lock)
+{
+	while (__sync_lock_test_and_set(lock, 1))
+	{
+		__asm volatile("pause" ::
+						   : "memory");
+	}
+}
+/**
+ * @brief release spinlock guarding a wait queue
+ * 
+ * @param lock 
+ */
+static void waitqueue_unlock(volatile int *lock)
+{
+	__sync_lock_release(lock);
+}
+/**
+ * @brief append waiter to wait queue, queue lock must be held
+ * 
+ * @param head 
+ * @param tail 
+ * @param waiter 
+ */
+static void waitqueue_push(vthread_waiter_t **head, vthread_waiter_t **tail, vthread_waiter_t *waiter)
+{
+	waiter->next = nullptr;
+	if (*tail == nullptr)
+	{
+		*head = waiter;
+	}
+	else
+	{
+		(*tail)->next = waiter;
+	}
+	*tail = waiter;
+}
+/**
+ * @brief remove first waiter from wait queue, queue lock must be held
+ * 
+ * @param head 
+ * @param tail 
+ * @return vthread_waiter_t* first waiter, nullptr if queue is empty
+ */
+static vthread_waiter_t *waitqueue_pop(vthread_waiter_t **head, vthread_waiter_t **tail)
+{
+	auto waiter = *head;
+	if (waiter != nullptr)
+	{
+		*head = waiter->next;
+		if (*head == nullptr)
+		{
+			*tail = nullptr;
+		}
+	}
+	return waiter;
+}
+/**
+ * @brief wake parked waiter, waiter is invalid after return.
+ * 
+ * @param waiter 
+ */
+static void waitqueue_wake(vthread_waiter_t *waiter)
+{
+	__sync_synchronize();
+	waiter->woken = 1;
+}
+
 /**
  * @brief set thread pool api 
  * initializes join array.
@@ -133,7 +254,7 @@ int  i_pthread_mutexattr_destroy(pthread_mutexattr_t *)
 }
 
 /**
- * @brief initialize a mutex and clear the ownership and locking info 
+ * @brief initialize a mutex and clear the ownership, locking info and wait queue
  * 
  * @param mutext 
  * @param attr 
@@ -142,19 +263,20 @@ int  i_pthread_mutexattr_destroy(pthread_mutexattr_t *)
 int i_pthread_mutex_init (pthread_mutex_t *mutext, const pthread_mutexattr_t *attr)
 {
 	DIGGI_ASSERT(t_pool_obj->currentVThreadId() < MAX_VIRTUAL_THREADS);
-	mutext->__data.__lock = 0;
 	/*
 		We use thread id + 1 to specify ownership of lock, used for recursive lock support.
-		As default value may be 0 if mutex is staticaly initialized before syscall interposition occurs
+		As default value may be 0 if mutex is staticaly initialized before syscall interposition occurs.
+		The wait queue lives in __nusers and __list, so those must start cleared aswell.
 	*/
-	mutext->__data.__owner = 0;
+	memset(&mutext->__data, 0, sizeof(mutext->__data));
 
 	return 0;
 }
 /**
  * @brief lock mutex,
  * blocks virtual thread until success.
- * Internally yield to other virtual threads while waiting.
+ * Contended lockers are queued in FIFO order and parked until the unlocking virtual thread hands them ownership.
+ * The wait queue is kept in the __list field, guarded by a spinlock in the __nusers field, both unused otherwise.
  * Sets current thread as owner of mutex.
  * Mutex locks may be recursively invoked(nested).
  * sets ownership of lock to current thread upon success.
@@ -166,10 +288,28 @@ int i_pthread_mutex_lock (pthread_mutex_t *mutex)
 	DIGGI_ASSERT(t_pool_obj->currentVThreadId() < MAX_VIRTUAL_THREADS);
 	//printf("attempting lock mutex %p, mutex on thread %lu\n", mutex, t_pool_obj->currentVThreadId());
 
-	if (mutex->__data.__lock != ((int)t_pool_obj->currentVThreadId() + 1)) {
-		while (__sync_val_compare_and_swap(&mutex->__data.__lock, 0, ((int)t_pool_obj->currentVThreadId() + 1)) != 0) {
-			t_pool_obj->Yield();
-		} 
+	int self = (int)t_pool_obj->currentVThreadId() + 1;
+	if (mutex->__data.__lock != self) {
+		if (__sync_val_compare_and_swap(&mutex->__data.__lock, 0, self) != 0) {
+			auto qlock = (volatile int *)&mutex->__data.__nusers;
+			waitqueue_lock(qlock);
+			/*
+				retry under queue lock, unlock inspects the queue under the same lock so the wakeup cannot be lost
+			*/
+			if (__sync_val_compare_and_swap(&mutex->__data.__lock, 0, self) != 0) {
+				vthread_waiter_t waiter = {0, self, 0, nullptr};
+				waitqueue_push((vthread_waiter_t **)&mutex->__data.__list.__prev, (vthread_waiter_t **)&mutex->__data.__list.__next, &waiter);
+				waitqueue_unlock(qlock);
+				t_pool_obj->Park(&waiter.woken);
+				/*
+					ownership handed over by unlock
+				*/
+				DIGGI_ASSERT(mutex->__data.__lock == self);
+			}
+			else {
+				waitqueue_unlock(qlock);
+			}
+		}
 	}
 	else {
 		DIGGI_ASSERT(mutex->__data.__count > 0);
@@ -184,7 +324,7 @@ int i_pthread_mutex_lock (pthread_mutex_t *mutex)
  * @brief unlock mutex
  * Must be invoked by same virtual thread which locked the mutex in the first place.
  * if nested locks, the lock will only release once last unlock is called.
- * last unlock will unset ownership
+ * last unlock will unset ownership, and hand the mutex directly to the first queued locker, if any.
  * @param mutex 
  * @return int 
  */
@@ -203,8 +343,19 @@ int i_pthread_mutex_unlock (pthread_mutex_t *mutex)
 	DIGGI_ASSERT(mutex->__data.__owner != 0);
 	DIGGI_ASSERT(mutex->__data.__lock != 0);
 	mutex->__data.__owner = 0;
+	auto qlock = (volatile int *)&mutex->__data.__nusers;
+	waitqueue_lock(qlock);
+	auto waiter = waitqueue_pop((vthread_waiter_t **)&mutex->__data.__list.__prev, (vthread_waiter_t **)&mutex->__data.__list.__next);
 	__sync_synchronize();
-	mutex->__data.__lock = 0;
+	if (waiter != nullptr) {
+		mutex->__data.__lock = waiter->id;
+		waitqueue_unlock(qlock);
+		waitqueue_wake(waiter);
+	}
+	else {
+		mutex->__data.__lock = 0;
+		waitqueue_unlock(qlock);
+	}
 	//printf("unlocked mutex %p, mutex on thread %lu\n", mutex, t_pool_obj->currentVThreadId());
 	return 0;
 }
@@ -341,51 +492,275 @@ int i_pthread_join (pthread_t thread, void **value_ptr)
     return 0;
 }
 /**
- * @brief not implemented, will throw assertion failure
- * 
+ * @brief wait on condition variable.
+ * Atomically with respect to signalers, queues the virtual thread on the condition and releases the mutex.
+ * The virtual thread is parked until signaled, and reacquires the mutex before returning.
+ * Recursively held mutexes are released completely, and relocked to the same depth.
  * @param cond 
- * @param mutex 
+ * @param mutex mutex held by caller
  * @return int 
  */
 int i_pthread_cond_wait (pthread_cond_t *cond, pthread_mutex_t *mutex)
 {
-	DIGGI_ASSERT(false);
+	DIGGI_ASSERT(t_pool_obj->currentVThreadId() < MAX_VIRTUAL_THREADS);
+	int self = (int)t_pool_obj->currentVThreadId() + 1;
+	DIGGI_ASSERT(mutex->__data.__lock == self);
+	auto cnd = (vthread_cond_t *)cond;
+	vthread_waiter_t waiter = {0, self, 0, nullptr};
+	/*
+		queued before mutex is released, so a signal issued after the caller observed the predicate is not lost
+	*/
+	waitqueue_lock(&cnd->lock);
+	waitqueue_push(&cnd->head, &cnd->tail, &waiter);
+	waitqueue_unlock(&cnd->lock);
+	auto depth = mutex->__data.__count;
+	mutex->__data.__count = 1;
+	i_pthread_mutex_unlock(mutex);
+	t_pool_obj->Park(&waiter.woken);
+	i_pthread_mutex_lock(mutex);
+	mutex->__data.__count = depth;
     return 0;
 }
 /**
- * @brief  not implemented, will throw assertion failure
+ * @brief wake all virtual threads waiting on condition variable
  * 
  * @param cond 
  * @return int 
  */
 int i_pthread_cond_broadcast (pthread_cond_t *cond)
 {
-	DIGGI_ASSERT(false);
+	auto cnd = (vthread_cond_t *)cond;
+	waitqueue_lock(&cnd->lock);
+	auto waiter = cnd->head;
+	cnd->head = nullptr;
+	cnd->tail = nullptr;
+	waitqueue_unlock(&cnd->lock);
+	while (waiter != nullptr) {
+		auto next = waiter->next;
+		waitqueue_wake(waiter);
+		waiter = next;
+	}
     return 0;
 }
 /**
- * @brief  not implemented, will throw assertion failure
+ * @brief wake the longest waiting virtual thread on condition variable, if any
  * 
  * @param cond 
  * @return int 
  */
 int i_pthread_cond_signal (pthread_cond_t *cond)
 {
-	DIGGI_ASSERT(false);
+	auto cnd = (vthread_cond_t *)cond;
+	waitqueue_lock(&cnd->lock);
+	auto waiter = waitqueue_pop(&cnd->head, &cnd->tail);
+	waitqueue_unlock(&cnd->lock);
+	if (waiter != nullptr) {
+		waitqueue_wake(waiter);
+	}
     return 0;
 }
 /**
- * @brief  not implemented, will throw assertion failure
- * 
+ * @brief initialize condition variable with an empty wait queue.
+ * Statically initialized condition variables (PTHREAD_COND_INITIALIZER) are also valid.
  * @param cond 
- * @param attr 
+ * @param attr not used
  * @return int 
  */
 int i_pthread_cond_init (pthread_cond_t *cond, const pthread_condattr_t *attr)
 {
-	DIGGI_ASSERT(false);
+	memset(cond, 0, sizeof(pthread_cond_t));
     return 0;
 }
+/**
+ * @brief destroy condition variable, no virtual threads may be waiting on it.
+ * 
+ * @param cond 
+ * @return int 
+ */
+int i_pthread_cond_destroy (pthread_cond_t *cond)
+{
+	auto cnd = (vthread_cond_t *)cond;
+	if (cnd->head != nullptr) {
+		return EBUSY;
+	}
+    return 0;
+}
+/**
+ * @brief initialize rwlock, unlocked with an empty wait queue.
+ * Statically initialized rwlocks (PTHREAD_RWLOCK_INITIALIZER) are also valid.
+ * @param rwlock 
+ * @param attr not used, readers are always preferred as in the glibc default
+ * @return int 
+ */
+int i_pthread_rwlock_init (pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr)
+{
+	memset(rwlock, 0, sizeof(pthread_rwlock_t));
+	return 0;
+}
+/**
+ * @brief destroy rwlock, must not be held
+ * 
+ * @param rwlock 
+ * @return int 
+ */
+int i_pthread_rwlock_destroy (pthread_rwlock_t *rwlock)
+{
+	auto rw = (vthread_rwlock_t *)rwlock;
+	if (rw->readers > 0 || rw->writer != 0 || rw->head != nullptr) {
+		return EBUSY;
+	}
+	return 0;
+}
+/**
+ * @brief acquire rwlock for reading.
+ * Succeeds unless a writer holds the lock, so read locks may be taken recursively.
+ * Otherwise the virtual thread is queued and parked until the writer releases it.
+ * @param rwlock 
+ * @return int EDEADLK if caller holds the write lock
+ */
+int i_pthread_rwlock_rdlock (pthread_rwlock_t *rwlock)
+{
+	DIGGI_ASSERT(t_pool_obj->currentVThreadId() < MAX_VIRTUAL_THREADS);
+	int self = (int)t_pool_obj->currentVThreadId() + 1;
+	auto rw = (vthread_rwlock_t *)rwlock;
+	waitqueue_lock(&rw->lock);
+	if (rw->writer == 0) {
+		rw->readers++;
+		waitqueue_unlock(&rw->lock);
+		return 0;
+	}
+	if (rw->writer == self) {
+		waitqueue_unlock(&rw->lock);
+		return EDEADLK;
+	}
+	vthread_waiter_t waiter = {0, self, 0, nullptr};
+	waitqueue_push(&rw->head, &rw->tail, &waiter);
+	waitqueue_unlock(&rw->lock);
+	/*
+		read lock granted by waker
+	*/
+	t_pool_obj->Park(&waiter.woken);
+	return 0;
+}
+/**
+ * @brief attempt to acquire rwlock for reading without blocking
+ * 
+ * @param rwlock 
+ * @return int EBUSY if a writer holds the lock
+ */
+int i_pthread_rwlock_tryrdlock (pthread_rwlock_t *rwlock)
+{
+	auto rw = (vthread_rwlock_t *)rwlock;
+	int retval = EBUSY;
+	waitqueue_lock(&rw->lock);
+	if (rw->writer == 0) {
+		rw->readers++;
+		retval = 0;
+	}
+	waitqueue_unlock(&rw->lock);
+	return retval;
+}
+/**
+ * @brief acquire rwlock for writing.
+ * If held, the virtual thread is queued and parked until ownership is handed to it.
+ * @param rwlock 
+ * @return int EDEADLK if caller holds the write lock
+ */
+int i_pthread_rwlock_wrlock (pthread_rwlock_t *rwlock)
+{
+	DIGGI_ASSERT(t_pool_obj->currentVThreadId() < MAX_VIRTUAL_THREADS);
+	int self = (int)t_pool_obj->currentVThreadId() + 1;
+	auto rw = (vthread_rwlock_t *)rwlock;
+	waitqueue_lock(&rw->lock);
+	if (rw->writer == 0 && rw->readers == 0) {
+		rw->writer = self;
+		waitqueue_unlock(&rw->lock);
+		return 0;
+	}
+	if (rw->writer == self) {
+		waitqueue_unlock(&rw->lock);
+		return EDEADLK;
+	}
+	vthread_waiter_t waiter = {0, self, 1, nullptr};
+	waitqueue_push(&rw->head, &rw->tail, &waiter);
+	waitqueue_unlock(&rw->lock);
+	t_pool_obj->Park(&waiter.woken);
+	DIGGI_ASSERT(rw->writer == self);
+	return 0;
+}
+/**
+ * @brief attempt to acquire rwlock for writing without blocking
+ * 
+ * @param rwlock 
+ * @return int EBUSY if held
+ */
+int i_pthread_rwlock_trywrlock (pthread_rwlock_t *rwlock)
+{
+	int self = (int)t_pool_obj->currentVThreadId() + 1;
+	auto rw = (vthread_rwlock_t *)rwlock;
+	int retval = EBUSY;
+	waitqueue_lock(&rw->lock);
+	if (rw->writer == 0 && rw->readers == 0) {
+		rw->writer = self;
+		retval = 0;
+	}
+	waitqueue_unlock(&rw->lock);
+	return retval;
+}
+/**
+ * @brief release read or write lock held by caller.
+ * Once the lock is free, it is handed to the first queued writer, or, if the first waiter is a reader, to all queued readers.
+ * @param rwlock 
+ * @return int 
+ */
+int i_pthread_rwlock_unlock (pthread_rwlock_t *rwlock)
+{
+	auto rw = (vthread_rwlock_t *)rwlock;
+	waitqueue_lock(&rw->lock);
+	if (rw->writer != 0) {
+		DIGGI_ASSERT(rw->writer == (int)t_pool_obj->currentVThreadId() + 1);
+		rw->writer = 0;
+	}
+	else {
+		DIGGI_ASSERT(rw->readers > 0);
+		rw->readers--;
+	}
+	vthread_waiter_t *woken = nullptr;
+	if (rw->readers == 0 && rw->head != nullptr) {
+		if (rw->head->writer) {
+			woken = waitqueue_pop(&rw->head, &rw->tail);
+			rw->writer = woken->id;
+			woken->next = nullptr;
+		}
+		else {
+			/*
+				grant all queued readers, writers keep their order
+			*/
+			vthread_waiter_t *writers = nullptr;
+			vthread_waiter_t *writers_tail = nullptr;
+			vthread_waiter_t *waiter = nullptr;
+			while ((waiter = waitqueue_pop(&rw->head, &rw->tail)) != nullptr) {
+				if (waiter->writer) {
+					waitqueue_push(&writers, &writers_tail, waiter);
+				}
+				else {
+					rw->readers++;
+					waiter->next = woken;
+					woken = waiter;
+				}
+			}
+			rw->head = writers;
+			rw->tail = writers_tail;
+		}
+	}
+	waitqueue_unlock(&rw->lock);
+	while (woken != nullptr) {
+		auto next = woken->next;
+		waitqueue_wake(woken);
+		woken = next;
+	}
+	return 0;
+}
 /**
  * @brief return own pthread id, virtual thread id.
  * 
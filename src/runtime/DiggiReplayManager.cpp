@@ -77,7 +77,7 @@ void DiggiReplayManager::replayEnqueue(void *ptr, int status)
         auto resp1 = new msg_async_response_t();
         resp1->context = _this;
         resp1->msg = COPY(msg_t, msg, msg->size);
-        _this->threadpool->Schedule(DiggiReplayManager::typehandlerDeffered, resp1, __PRETTY_FUNCTION__);
+        _this->threadpool->ScheduleOn(_this->threadpool->currentThreadId(), DiggiReplayManager::typehandlerDeffered, resp1, __PRETTY_FUNCTION__);
         return;
     }
 
@@ -112,7 +112,7 @@ void DiggiReplayManager::replayEnqueue(void *ptr, int status)
         auto resp1 = new msg_async_response_t();
         resp1->context = _this;
         resp1->msg = COPY(msg_t, resp->msg, resp->msg->size);
-        _this->threadpool->Schedule(DiggiReplayManager::typehandlerDeffered, resp1, __PRETTY_FUNCTION__);
+        _this->threadpool->ScheduleOn(_this->threadpool->currentThreadId(), DiggiReplayManager::typehandlerDeffered, resp1, __PRETTY_FUNCTION__);
         return;
     }
     else
@@ -154,7 +154,7 @@ void DiggiReplayManager::typehandlerDeffered(void *ptr, int status)
                 _this->next_in_line);
     if (_this->next_in_line != msg->session_count)
     {
-        _this->threadpool->Schedule(DiggiReplayManager::typehandlerDeffered, resp, __PRETTY_FUNCTION__);
+        _this->threadpool->ScheduleOn(_this->threadpool->currentThreadId(), DiggiReplayManager::typehandlerDeffered, resp, __PRETTY_FUNCTION__);
         return;
     }
     if (msg->id != 0)
@@ -188,7 +188,7 @@ void DiggiReplayManager::typehandlerDeffered(void *ptr, int status)
     auto type_handler = _this->type_handler_map[msg->type];
     if (type_handler.cb == nullptr)
     {
-        _this->threadpool->Schedule(DiggiReplayManager::typehandlerDeffered, resp, __PRETTY_FUNCTION__);
+        _this->threadpool->ScheduleOn(_this->threadpool->currentThreadId(), DiggiReplayManager::typehandlerDeffered, resp, __PRETTY_FUNCTION__);
         return;
     }
     else
@@ -40,8 +40,8 @@ static std::map<uint8_t, networkinfo *> *network_map = nullptr;
 ///context object used to store outbound message buffer, accounting to ensure local buffer is released after send.
 typedef AsyncContext<lf_buffer_t *, msg_t *> proc_outbound_ctx_t;
 
-/// reference to global memory buffer pool, used by all diggi instances hosted by this runtime to allocate message objects prior to send.
-static lf_buffer_t *global_memory_buffer = nullptr;
+/// reference to global size-classed memory pool, used by all diggi instances hosted by this runtime to allocate message objects prior to send.
+static msg_pool_t *global_memory_buffer = nullptr;
 
 /// Untrusted runtime accounting map for keping information about each diggi instance. indexec by aid.
 static std::map<uint64_t, func_management_context_t> func_map;
@@ -90,6 +90,10 @@ void initialize_enclave(sgx_enclave_id_t *id, const char *enclave_filename)
 
 ///bolean value used to shut down message loop in the event of gracefull exit.
 static volatile bool stop_message_loop = false;
+/// maximum messages drained from a single instance output queue per message scheduler invocation.
+#define MESSAGE_SCHEDULER_BATCH_SIZE 32
+///delay before retrying delivery of a network message which could not be delivered
+#define RUNTIME_RECIEVE_RETRY_USEC 100
 
 /**
  * @brief message scheduler loop for internal messages.
@@ -98,6 +102,7 @@ static volatile bool stop_message_loop = false;
  * 
  * Each invocation of the below callback checs the outbound queues for messages and in the event of a remote message,
  * forwards handling to networking callback.
+ * Each output queue is drained in batches of up to MESSAGE_SCHEDULER_BATCH_SIZE messages.
  * 
  * Before done, the function schedules a new invokation of itself onto the threadpool.
  * @param msg 
@@ -112,6 +117,8 @@ void message_sheduler_loop(void *msg, int status)
         return;
     }
     DIGGI_ASSERT(proc_ctx);
+    void *batch[MESSAGE_SCHEDULER_BATCH_SIZE];
+    void *forward[MESSAGE_SCHEDULER_BATCH_SIZE];
     for (
         std::map<uint64_t, func_management_context_t>::const_iterator it = func_map.begin();
         it != func_map.end();
@@ -119,19 +126,35 @@ void message_sheduler_loop(void *msg, int status)
     {
 
         DIGGI_ASSERT(it->second.output_queue);
-        auto item = (msg_t *)lf_try_recieve(it->second.output_queue, 0);
+        auto count = lf_try_recieve_batch(it->second.output_queue, batch, MESSAGE_SCHEDULER_BATCH_SIZE, 0);
 
-        if (item != nullptr)
+        /*
+            Consecutive local messages to the same instance are forwarded with a single batch send
+        */
+        lf_buffer_t *forward_queue = nullptr;
+        size_t forward_count = 0;
+        bool exited = false;
+        for (size_t i = 0; i < count; i++)
         {
             //telemetry_capture("Message in func func scheduler");
 
-            auto msg = (msg_t *)item;
+            auto item = (msg_t *)batch[i];
+            auto msg = item;
             DIGGI_ASSERT(msg);
             if (msg->type == DIGGI_SIGNAL_TYPE_EXIT)
             {
+                lf_send_batch(forward_queue, forward, forward_count, 0);
+                forward_count = 0;
+                /*
+                    Messages following the exit signal have no recipient, return them to the pool
+                */
+                for (size_t j = i + 1; j < count; j++)
+                {
+                    msg_pool_free(global_memory_buffer, batch[j], 0);
+                }
                 telemetry_write();
                 DIGGI_TRACE(proc_ctx->GetLogObject(), LRELEASE, "%s is sending Signal: Stop to the diggi runtime\n", it->second.name.c_str());
-                free(item);
+                msg_pool_free(global_memory_buffer, item, 0);
                 func_management_context_t itm = it->second;
                 func_map.erase(it->first);
                 if (runtime_global_exit_when_done)
@@ -142,9 +165,7 @@ void message_sheduler_loop(void *msg, int status)
                 {
                     shutdown_func(itm);
                 }
-                /*
-                    must break and reenumerate map
-                */
+                exited = true;
                 break;
             }
             else if (msg->dest.fields.proc != proc_ctx->GetId().fields.proc)
@@ -177,7 +198,13 @@ void message_sheduler_loop(void *msg, int status)
                             msg->size,
                             msg->type);
 
-                lf_send(destination_queue, msg, 0);
+                if (destination_queue != forward_queue)
+                {
+                    lf_send_batch(forward_queue, forward, forward_count, 0);
+                    forward_queue = destination_queue;
+                    forward_count = 0;
+                }
+                forward[forward_count++] = msg;
 
                 //telemetry_capture("Message forwarded to destination queue");
 
@@ -185,8 +212,15 @@ void message_sheduler_loop(void *msg, int status)
                             "Successful message forwarding in message scheduler\n");
             }
         }
+        if (exited)
+        {
+            /*
+                must break and reenumerate map
+            */
+            break;
+        }
+        lf_send_batch(forward_queue, forward, forward_count, 0);
     }
-
     proc_ctx->GetThreadPool()->Schedule(message_sheduler_loop, proc_ctx, __PRETTY_FUNCTION__);
 }
 
@@ -212,6 +246,26 @@ void message_scheduler_start()
     DIGGI_TRACE(proc_ctx->GetLogObject(), LDEBUG, "Starting Message Scheduler\n");
     proc_ctx->GetThreadPool()->Schedule(message_sheduler_loop, proc_ctx, __PRETTY_FUNCTION__);
 }
+/**
+ * @brief create inbound or outbound queue for an instance.
+ * A single producer single consumer queue is used if only one thread may produce and only one may consume.
+ * @param producers count of threads producing onto queue
+ * @param consumers count of threads consuming from queue
+ * @param max_thread_id upper bound of thread ids used to access a multi producer multi consumer queue
+ * @param doorbell enable doorbell wakeup for idle consumers, @see lf_park
+ * @return lf_buffer_t* new queue
+ */
+static lf_buffer_t *new_func_queue(size_t producers, size_t consumers, size_t max_thread_id, bool doorbell)
+{
+    auto queue = (producers == 1 && consumers == 1)
+                     ? lf_new_spsc(RING_BUFFER_SIZE)
+                     : lf_new(RING_BUFFER_SIZE, max_thread_id, max_thread_id);
+    if (doorbell)
+    {
+        lf_enable_doorbell(queue);
+    }
+    return queue;
+}
 /**
  * @brief initalizes enclave instances according to specifications in configuration.json. 
  * each thread enters enclave through special ecall.
@@ -262,8 +316,12 @@ std::vector<name_service_update_t> initialize_enclave_funcs(
             func_map[cli.raw].enclave_thread.push_back(
                 new_thread_with_affinity_enc(enclave_thread_entry, new uint64_t(id)));
         }
-        func_map[cli.raw].input_queue = lf_new(RING_BUFFER_SIZE, (max_threads * threads) + 1, (max_threads * threads) + 1);
-        func_map[cli.raw].output_queue = lf_new(RING_BUFFER_SIZE, (max_threads * threads) + 1, (max_threads * threads) + 1);
+        /*
+            Inbound queue is produced onto by the threads of other local instances and the runtime thread, idle instance threads park on its doorbell.
+            Outbound queue is only consumed by the runtime message scheduler.
+        */
+        func_map[cli.raw].input_queue = new_func_queue(((max_threads - 1) * threads) + DIGGI_RUNTIME_THREAD_COUNT, threads, (max_threads * threads) + 1, true);
+        func_map[cli.raw].output_queue = new_func_queue(threads, DIGGI_RUNTIME_THREAD_COUNT, (max_threads * threads) + 1, false);
         func_map[cli.raw].configuration = enclave_funclist[i];
         name_service_update_t upd;
         memcpy(upd.name, enclave_name.c_str(), enclave_name.size());
@@ -344,13 +402,46 @@ std::vector<name_service_update_t> initialize_library_funcs(
 
         auto threads = atoi(conf["threads"].value.tostring().c_str());
         DIGGI_ASSERT(threads > 0);
-        auto pool_singleton = new ThreadPool(threads, REGULAR_MODE, funclist[i].key.tostring());
+        bool work_stealing = false;
+        if (conf.contains("work-stealing"))
+        {
+            work_stealing = (conf["work-stealing"].value == "1") ? true : false;
+        }
+        size_t virtual_threads = DEFAULT_VIRTUAL_THREADS;
+        if (conf.contains("virtual-threads") && !ThreadPool::parseVirtualThreads(conf["virtual-threads"].value.tostring(), &virtual_threads))
+        {
+            DIGGI_TRACE(proc_ctx->GetLogObject(), LRELEASE,
+                        "Invalid virtual-threads: %s for %s, must be between 1 and %d, using default: %d\n",
+                        conf["virtual-threads"].value.tostring().c_str(),
+                        funclist[i].key.tostring().c_str(),
+                        MAX_VIRTUAL_THREADS_PER_THREAD,
+                        DEFAULT_VIRTUAL_THREADS);
+        }
+        size_t stack_size = DEFAULT_VIRTUAL_THREAD_STACK_SIZE;
+        if (conf.contains("virtual-thread-stack-size"))
+        {
+            stack_size = (size_t)atoi(conf["virtual-thread-stack-size"].value.tostring().c_str());
+        }
+        auto pool_singleton = new ThreadPool(threads, REGULAR_MODE, funclist[i].key.tostring(), work_stealing, virtual_threads, stack_size);
+        if (conf.contains("scheduler-batch"))
+        {
+            uint64_t budget_us = 0;
+            if (conf.contains("scheduler-batch-budget-usec"))
+            {
+                budget_us = (uint64_t)atoi(conf["scheduler-batch-budget-usec"].value.tostring().c_str());
+            }
+            pool_singleton->setBatching((size_t)atoi(conf["scheduler-batch"].value.tostring().c_str()), budget_us);
+        }
+        if (conf.contains("scheduler-profiling"))
+        {
+            pool_singleton->setProfiling(conf["scheduler-profiling"].value == "1");
+        }
         /*
             TODO: funcs now expect that all other funcs have the same ammount of threads.
                 may not be the case in the future. 
         */
-        func_map[d.raw].input_queue = lf_new(RING_BUFFER_SIZE, (max_threads * threads) + 1, (max_threads * threads) + 1);
-        func_map[d.raw].output_queue = lf_new(RING_BUFFER_SIZE, (max_threads * threads) + 1, (max_threads * threads) + 1);
+        func_map[d.raw].input_queue = new_func_queue(((max_threads - 1) * threads) + DIGGI_RUNTIME_THREAD_COUNT, threads, (max_threads * threads) + 1, true);
+        func_map[d.raw].output_queue = new_func_queue(threads, DIGGI_RUNTIME_THREAD_COUNT, (max_threads * threads) + 1, false);
         upd.destination_queue = func_map[d.raw].input_queue;
         map_arr.push_back(upd);
         auto a_logger = new StdLogger(pool_singleton);
@@ -433,7 +524,7 @@ void start_funcs(std::vector<name_service_update_t> map)
                        ? (func_map.begin()->second.enclave_thread.size())
                        : atoi(func_map.begin()->second.acontext->GetFuncConfig()["threads"].value.tostring().c_str());
 
-    global_memory_buffer = provision_memory_buffer((func_map.size() * threads) + 1, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    global_memory_buffer = provision_message_pool((func_map.size() * threads) + 1);
 
     DIGGI_TRACE(proc_ctx->GetLogObject(), LRELEASE, "done making memory, for %d threads\n", threads);
     telemetry_init();
@@ -474,6 +565,12 @@ void start_funcs(std::vector<name_service_update_t> map)
                 dynamic_measurement = (func.acontext->GetFuncConfig()["dynamic-measurement"].value == "1") ? true : false;
             }
 
+            bool mbedtls_crypto = false;
+            if (func.acontext->GetFuncConfig().contains("mbedtls-crypto"))
+            {
+                mbedtls_crypto = (func.acontext->GetFuncConfig()["mbedtls-crypto"].value == "1") ? true : false;
+            }
+
             if (skip_attestation)
             {
                 DIGGI_ASSERT(!trusted_root);
@@ -497,7 +594,9 @@ void start_funcs(std::vector<name_service_update_t> map)
                 trusted_root,
                 dynamicmeasurement,
                 record_func,
-                new SGXCryptoImpl());
+                (mbedtls_crypto)
+                    ? static_cast<ICryptoImplementation *>(new MbedtlsCryptoImpl())
+                    : static_cast<ICryptoImplementation *>(new SGXCryptoImpl()));
 
             DIGGI_TRACE(proc_ctx->GetLogObject(), LDEBUG, "Initializing func with id:  %" PRIu64 "\n", func.id.raw);
 
@@ -698,6 +797,10 @@ void shutdown_func(func_management_context_t ctx)
         delete gmm;
 
         auto tp = (ThreadPool *)func->GetThreadPool();
+        if (tp->profilingEnabled())
+        {
+            tp->writeProfile(SCHED_PROFILE_LOG);
+        }
         delete tp;
         delete lg;
         delete func;
@@ -718,6 +821,7 @@ void shutdown_func(func_management_context_t ctx)
         for (auto th : ctx.enclave_thread)
         {
             th->join();
+            release_thread_affinity();
             delete th;
         }
         sgx_destroy_enclave(ctx.enc_id);
@@ -734,7 +838,7 @@ void shutdown_func(func_management_context_t ctx)
         DIGGI_TRACE(proc_ctx->GetLogObject(), LRELEASE, "Last func exited, shutting down runtime\n");
         stop_message_loop = true;
         proc_ctx->GetThreadPool()->Stop();
-        lf_destroy(global_memory_buffer);
+        delete_message_pool(global_memory_buffer);
         global_memory_buffer = nullptr;
         telemetry_write();
         // runtime_stop(nullptr, 1);
@@ -766,7 +870,8 @@ void shutdown_funcs()
     telemetry_write();
     if (global_memory_buffer)
     {
-        lf_destroy(global_memory_buffer);
+        delete_message_pool(global_memory_buffer);
+        global_memory_buffer = nullptr;
     }
     /*Deletes all all ringbuffers*/
 }
@@ -844,14 +949,14 @@ void runtime_recieve(void *ptr, int status)
 	*/
     if (func_map[dest.raw].input_queue == nullptr)
     {
-        proc_ctx->GetThreadPool()->Schedule(runtime_recieve, ptr, __PRETTY_FUNCTION__);
+        proc_ctx->GetThreadPool()->ScheduleAfter(RUNTIME_RECIEVE_RETRY_USEC, runtime_recieve, ptr, __PRETTY_FUNCTION__);
         return;
     }
     /*Nested message for forwarding*/
     DIGGI_ASSERT(global_memory_buffer != nullptr);
     DIGGI_ASSERT(messagebuff->size() < MAX_DIGGI_MEM_SIZE);
 
-    msg_t *rb_msg = (msg_t *)lf_recieve(global_memory_buffer, 0);
+    msg_t *rb_msg = (msg_t *)msg_pool_alloc(global_memory_buffer, messagebuff->size(), 0);
 
     DIGGI_TRACE(proc_ctx->GetLogObject(), LDEBUG, "Message in func func recieve to %d\n", dest.raw);
 
@@ -866,7 +971,7 @@ void runtime_recieve(void *ptr, int status)
 		(Can be fixed by defering all messages to that input queue)
 		*/
 
-        proc_ctx->GetThreadPool()->Schedule(runtime_recieve, ptr, __PRETTY_FUNCTION__);
+        proc_ctx->GetThreadPool()->ScheduleAfter(RUNTIME_RECIEVE_RETRY_USEC, runtime_recieve, ptr, __PRETTY_FUNCTION__);
     }
     else
     {
@@ -1019,7 +1124,7 @@ void tcp_outgoing_cb(void *ptr, int status)
     auto ctx = (proc_outbound_ctx_t *)ptr;
     DIGGI_ASSERT(global_memory_buffer != nullptr);
 
-    lf_send(global_memory_buffer, ctx->item2, 0);
+    msg_pool_free(global_memory_buffer, ctx->item2, 0);
     delete ctx;
 }
 
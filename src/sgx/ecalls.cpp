@@ -51,7 +51,7 @@ void ecall_enclave_entry_client(
 	const char* func_name,
 	size_t expected_threads)
 {
-	client(self, id, base_thread_id, (lf_buffer_t*)global_memory_buffer, (lf_buffer_t*)input_q, (lf_buffer_t*)output_q,  (name_service_update_t*)mapdata, count, func_name, expected_threads);
+	client(self, id, base_thread_id, (msg_pool_t*)global_memory_buffer, (lf_buffer_t*)input_q, (lf_buffer_t*)output_q,  (name_service_update_t*)mapdata, count, func_name, expected_threads);
 }
 /**
  * @brief wrapper for client_stop() in enclave.cpp
@@ -93,7 +93,7 @@ void start_init(void *ptr, int status)
 void client(aid_t self,
             sgx_enclave_id_t id,
             size_t base_thread_id,
-            lf_buffer_t *global_memory_buffer,
+            msg_pool_t *global_memory_buffer,
             lf_buffer_t *input_q,
             lf_buffer_t *output_q,
             name_service_update_t *mapdata,
@@ -107,12 +107,42 @@ void client(aid_t self,
     DIGGI_ASSERT(input_q);
     DIGGI_ASSERT(output_q);
 
+    zcstring convert(static_attested_diggi_configuration);
+    json_node conf(convert);
+
+    bool work_stealing = false;
+    if (conf.contains("work-stealing"))
+    {
+        work_stealing = (conf["work-stealing"].value == "1") ? true : false;
+    }
+    size_t virtual_threads = DEFAULT_VIRTUAL_THREADS;
+    /*
+        logged once the logger exists, which needs the threadpool
+    */
+    bool invalid_virtual_threads = conf.contains("virtual-threads") &&
+                                   !ThreadPool::parseVirtualThreads(conf["virtual-threads"].value.tostring(), &virtual_threads);
+    size_t stack_size = DEFAULT_VIRTUAL_THREAD_STACK_SIZE;
+    if (conf.contains("virtual-thread-stack-size"))
+    {
+        stack_size = (size_t)atoi(conf["virtual-thread-stack-size"].value.tostring().c_str());
+    }
     /*wait for threads to be initialized*/
-    threadpool = new ThreadPool(expected_threads, ENCLAVE_MODE, std::string(func_name));
+    threadpool = new ThreadPool(expected_threads, ENCLAVE_MODE, std::string(func_name), work_stealing, virtual_threads, stack_size);
+    if (conf.contains("scheduler-batch"))
+    {
+        uint64_t budget_us = 0;
+        if (conf.contains("scheduler-batch-budget-usec"))
+        {
+            budget_us = (uint64_t)atoi(conf["scheduler-batch-budget-usec"].value.tostring().c_str());
+        }
+        threadpool->setBatching((size_t)atoi(conf["scheduler-batch"].value.tostring().c_str()), budget_us);
+    }
+    if (conf.contains("scheduler-profiling"))
+    {
+        threadpool->setProfiling(conf["scheduler-profiling"].value == "1");
+    }
     while (threadcount_initialized < expected_threads)
         ;
-    zcstring convert(static_attested_diggi_configuration);
-    json_node conf(convert);
 
     inbound_queue = input_q;
     outbound_queue = output_q;
@@ -144,6 +174,13 @@ void client(aid_t self,
     acontext->SetEnclaveId(id);
 
     log_r->Log("This enclaves address=%" PRIu64 "\n", self.raw);
+    if (invalid_virtual_threads)
+    {
+        log_r->Log(LRELEASE, "Invalid virtual-threads: %s, must be between 1 and %d, using default: %d\n",
+                   conf["virtual-threads"].value.tostring().c_str(),
+                   MAX_VIRTUAL_THREADS_PER_THREAD,
+                   DEFAULT_VIRTUAL_THREADS);
+    }
 
     bool skip_attestation = false;
     if (conf.contains("skip-attestation"))
@@ -163,6 +200,12 @@ void client(aid_t self,
         dynamic_measurement = (conf["dynamic-measurement"].value == "1") ? true : false;
     }
 
+    bool mbedtls_crypto = false;
+    if (conf.contains("mbedtls-crypto"))
+    {
+        mbedtls_crypto = (conf["mbedtls-crypto"].value == "1") ? true : false;
+    }
+
     if (skip_attestation)
     {
         log_r->Log(LRELEASE, "Skipping attestation\n");
@@ -204,7 +247,9 @@ void client(aid_t self,
         trusted_root,
         dynamicmeasurement,
         record_func,
-        new SGXCryptoImpl());
+        (mbedtls_crypto)
+            ? static_cast<ICryptoImplementation *>(new MbedtlsCryptoImpl())
+            : static_cast<ICryptoImplementation *>(new SGXCryptoImpl()));
 
     acontext->SetMessageManager(tmm);
     acontext->SetSignalHandler(new DiggiSignalHandler(tmm));
@@ -254,6 +299,20 @@ void client_stop()
 	*/
 
     acontext->GetThreadPool()->Stop();
+    if (threadpool->profilingEnabled())
+    {
+        /*
+            no file api availible in enclave, profile is logged instead
+        */
+        auto csv = threadpool->profileCsv();
+        size_t pos = 0;
+        while (pos < csv.size())
+        {
+            auto end = csv.find('\n', pos);
+            acontext->GetLogObject()->Log("%s\n", csv.substr(pos, end - pos).c_str());
+            pos = end + 1;
+        }
+    }
     auto mngr = acontext->GetMessageManager();
     /*
         No cleanup or free operations, as other threads migth still touch objects on way out and cause a SIGILL.
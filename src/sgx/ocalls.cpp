@@ -12,6 +12,7 @@
 
 #include "sgx/ocalls.h"
 #include "messaging/Util.h"
+#include "messaging/SessionKeyCache.h"
 
 /**
  * @brief print string facility for logging infrastructure, called by StdLogger
@@ -63,6 +64,74 @@ void ocall_sleep(uint64_t usec)
 {
     usleep(usec);
 }
+/**
+ * Block enclave thread on the doorbell of a queue in untrusted memory, until a producer rings it or the timeout expires.
+ *
+ * @see lf_park
+ * @param lf queue to wait on
+ * @param seq doorbell value observed by the enclave before parking
+ * @param usec upper bound on wait in microseconds
+ */
+void ocall_doorbell_wait(void *lf, int seq, uint64_t usec)
+{
+    lf_doorbell_wait((lf_buffer_t *)lf, seq, usec);
+}
+/**
+ * Wake consumers parked on the doorbell of a queue in untrusted memory, on behalf of an enclave producer.
+ *
+ * @see lf_park
+ * @param lf queue to ring
+ */
+void ocall_doorbell_ring(void *lf)
+{
+    lf_doorbell_wake((lf_buffer_t *)lf);
+}
+/**
+ * Read monotonic clock on behalf of enclave threadpools, used to expire timers.
+ *
+ * @see ThreadPool::runTimers
+ * @param usec microseconds since an arbitrary fixed point
+ */
+void ocall_monotonic_usec(uint64_t *usec)
+{
+    struct timespec ts;
+    get_time_(&ts);
+    *usec = ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+}
+/**
+ * Read wall clock on behalf of enclaves, used to expire cached session keys across restarts.
+ *
+ * @see SessionKeyCache::now
+ * @param sec seconds since epoch
+ */
+void ocall_realtime_sec(uint64_t *sec)
+{
+    *sec = (uint64_t)time(NULL);
+}
+/**
+ * @brief read sealed session key cache of an enclave.
+ * @see session_cache_file_read
+ * @param path cache file
+ * @param buf target buffer
+ * @param size size of buffer
+ * @return int bytes read, -1 if the file does not exist
+ */
+int ocall_session_cache_read(const char *path, uint8_t *buf, size_t size)
+{
+    return session_cache_file_read(path, buf, size);
+}
+/**
+ * @brief replace sealed session key cache of an enclave.
+ * @see session_cache_file_write
+ * @param path cache file
+ * @param buf sealed cache
+ * @param size size of sealed cache
+ * @return int 0 on success, -1 on failure
+ */
+int ocall_session_cache_write(const char *path, uint8_t *buf, size_t size)
+{
+    return session_cache_file_write(path, buf, size);
+}
 
 /**
  * @brief for experimental measurements of intervals in runtime internals, tags identify point of sampling.
@@ -84,9 +84,10 @@ std::string DBResult::getString(size_t col)
 /**
  * To translate database client sql api into a synchronous blocking one, this method, invoked on succesfull completion of a request.
  * pushes response onto incomming request queue.
+ * A request whose response deadline passed is counted instead, without a response.
  * 
  * @param ptr incomming database operation response in form of a msg_async_response_t(context field is DBClient)
- * @param status status flag (unused) future work
+ * @param status status flag, AMM_FLOW_TIMEOUT or AMM_FLOW_CANCELLED if no response arrived
  */
 void DBClient::set_callback_msg(void *ptr, int status)
 {
@@ -94,29 +95,49 @@ void DBClient::set_callback_msg(void *ptr, int status)
     auto rsp = (msg_async_response_t *)ptr;
     auto _this = (DBClient *)rsp->context;
     DIGGI_ASSERT(_this);
-    DIGGI_ASSERT(rsp->msg);
+    if (rsp->msg == nullptr)
+    {
+        _this->timed_out_requests++;
+        return;
+    }
     auto msg_cpy = COPY(msg_t, rsp->msg, rsp->msg->size);
     _this->free_msgs.push_back(msg_cpy);
     _this->incomming_msgs.push_back(msg_cpy);
 }
+/**
+ * Response deadline for database clients of a func, read from "db-timeout-usec" in func configuration.
+ * 
+ * @param conf func configuration
+ * @return uint64_t deadline in microseconds, 0 if not configured
+ */
+uint64_t DBClient::requestTimeout(json_node &conf)
+{
+    if (conf.contains("db-timeout-usec"))
+    {
+        return strtoull(conf["db-timeout-usec"].value.tostring().c_str(), nullptr, 10);
+    }
+    return 0;
+}
 /**
  * After a number of Database client query operation are marhaled and sent, 
  * this method may be invoked to wait for a given number of responses.
  * 
  * @param wait_for count of response objects to wait for.
+ * @return true if all responses arrived, false if a request timed out or the threadpool stopped
  */
-void DBClient::get_callback_msg(size_t wait_for)
+bool DBClient::get_callback_msg(size_t wait_for)
 {
     DIGGI_ASSERT(wait_for);
-    size_t count = this->incomming_msgs.size();
-    while (this->incomming_msgs.size() < count + wait_for)
+    size_t count = this->incomming_msgs.size() + this->timed_out_requests;
+    while (this->incomming_msgs.size() + this->timed_out_requests < count + wait_for)
     {
         if (!this->threadPool->Alive())
         {
-            return;
+            return false;
         }
         this->threadPool->Yield();
     }
+    return this->timed_out_requests == 0;
 }
 /**
  * Connect to a given diggi instance by specifying the human readable address for the target relational DB.
@@ -150,6 +171,7 @@ void DBClient::beginTransaction()
 int DBClient::executeBlob(const char *query, char *blob, size_t blob_size)
 {
     incomming_msgs.clear();
+    timed_out_requests = 0;
     DIGGI_ASSERT(mngr);
     std::string transactionstmnt = "";
     if (this->transaction_active)
@@ -169,15 +191,15 @@ int DBClient::executeBlob(const char *query, char *blob, size_t blob_size)
     Pack::packBuffer(&preparedquery, (uint8_t *)blob, blob_size);
 
     preparedmsg->type = SQL_QUERY_MESSAGE_BLOB_TYPE;
-    this->mngr->Send(preparedmsg, set_callback_msg, this);
-    get_callback_msg(1);
+    this->mngr->Send(preparedmsg, set_callback_msg, this, request_timeout_us);
 
-    return 0;
+    return get_callback_msg(1) ? 0 : -1;
 }
 
 int DBClient::execute(const char *templ, ...)
 {
     incomming_msgs.clear();
+    timed_out_requests = 0;
     DIGGI_ASSERT(sizeof(templ) > 0);
     DIGGI_ASSERT(mngr);
     std::string transactionstmnt = "";
@@ -218,10 +240,9 @@ int DBClient::execute(const char *templ, ...)
     DIGGI_ASSERT(chars <= expectechars);
     //printf("clientsend:%s\n", preparedquery);
     preparedmsg->type = SQL_QUERY_MESSAGE_TYPE;
-    this->mngr->Send(preparedmsg, set_callback_msg, this);
-    get_callback_msg(1);
+    this->mngr->Send(preparedmsg, set_callback_msg, this, request_timeout_us);
 
-    return 0;
+    return get_callback_msg(1) ? 0 : -1;
 }
 /**
  * Execute a list of queries as a single transactions and await their response
@@ -237,6 +258,7 @@ int DBClient::executemany(std::vector<std::string> statements)
         return -1;
     }
     incomming_msgs.clear();
+    timed_out_requests = 0;
     DIGGI_ASSERT(statements.size());
     DIGGI_ASSERT(mngr);
     DIGGI_ASSERT(connection_info.size());
@@ -252,35 +274,41 @@ int DBClient::executemany(std::vector<std::string> statements)
         preparedmsg->type = SQL_QUERY_MESSAGE_TYPE;
         preparedmsg->size = statement.size() + 1 + sizeof(msg_t);
         preparedmsg->data[statement.size() - 1] = '\0';
-        this->mngr->Send(preparedmsg, set_callback_msg, this);
+        this->mngr->Send(preparedmsg, set_callback_msg, this, request_timeout_us);
         /*
 			TODO:bundle multiple executions together.
 			We must wait for callback to achieve synchrony
 		*/
         if (batches % BATCH_SIZE == 0)
         {
-            get_callback_msg(BATCH_SIZE);
+            auto completed = get_callback_msg(BATCH_SIZE);
             incomming_msgs.clear();
             batches = 0;
+            if (!completed)
+            {
+                return -1;
+            }
         }
     }
-    if (batches)
+    if (batches && !get_callback_msg(batches))
     {
-        get_callback_msg(batches);
+        return -1;
     }
     return 0;
 }
 /**
  * Commit transactions and free incomming results cache. 
+ * @return int 0 on success, -1 if the commit request timed out
  */
-void DBClient::commit()
+int DBClient::commit()
 {
     if (!this->transaction_active)
     {
         DIGGI_ASSERT(!this->appended_begin_statement);
-        return;
+        return 0;
     }
     this->freeDBResults();
+    timed_out_requests = 0;
     this->transaction_active = false;
     this->appended_begin_statement = false;
     std::string statement = "COMMIT;";
@@ -293,10 +321,8 @@ void DBClient::commit()
 
     preparedmsg->type = SQL_QUERY_MESSAGE_TYPE;
     preparedmsg->size = statement.size() + sizeof(msg_t);
-    this->mngr->Send(preparedmsg, set_callback_msg, this);
-    get_callback_msg(1);
-
-    return;
+    this->mngr->Send(preparedmsg, set_callback_msg, this, request_timeout_us);
+    return get_callback_msg(1) ? 0 : -1;
 }
 /**
  * Free all incomming query responses cached by api.
@@ -363,8 +389,9 @@ std::vector<DBResult> DBClient::fetchall()
 /**
  * request an explicit rollback for transaction.
  * Frees all cached results.
+ * @return int 0 on success, -1 if the rollback request timed out
  */
-void DBClient::rollback()
+int DBClient::rollback()
 {
     this->transaction_active = false;
     this->appended_begin_statement = false;
@@ -373,6 +400,7 @@ void DBClient::rollback()
     DIGGI_ASSERT(mngr);
 
     this->freeDBResults();
+    timed_out_requests = 0;
     DIGGI_ASSERT(connection_info.size());
 
     auto preparedmsg = this->mngr->allocateMessage(connection_info, statement.size(), CALLBACK, deliveryopt);
@@ -380,8 +408,6 @@ void DBClient::rollback()
 
     preparedmsg->type = SQL_QUERY_MESSAGE_TYPE;
 
-    this->mngr->Send(preparedmsg, set_callback_msg, this);
-    get_callback_msg(1);
-
-    return;
+    this->mngr->Send(preparedmsg, set_callback_msg, this, request_timeout_us);
+    return get_callback_msg(1) ? 0 : -1;
 }
@@ -27,6 +27,8 @@
 
 /**
  * Creates an asynchronous Storage Object Manager. Situated inside enclave memory.
+ * If "storage-timeout-usec" is set in func configuration, requests without a response within the deadline complete with no message,
+ * which the POSIX stubs report as ETIMEDOUT.
  * @param context Diggi API reference
  * @param seal Algorithm type reference for determining which algorithm to use for block encryption of storage.
  */
@@ -34,9 +36,15 @@ StorageManager::StorageManager(IDiggiAPI *context, ISealingAlgorithm *seal)
     : func_context(context),
       sealer(seal),
       monotonic_time_update(1566911621),
-      next_virtual_inode(100000)
+      next_virtual_inode(100000),
+      request_timeout_us(0)
 
 {
+    auto &conf = func_context->GetFuncConfig();
+    if (conf.contains("storage-timeout-usec"))
+    {
+        request_timeout_us = strtoull(conf["storage-timeout-usec"].value.tostring().c_str(), nullptr, 10);
+    }
 }
 void StorageManager::GetCRCReplayVector(crc_vector_t **vectors)
 {
@@ -181,7 +189,7 @@ void StorageManager::async_fopen(const char *filename, const char *mode, async_c
 
         string filename_str(filename);
 
-        mngr->Send(msg, async_fopen_cb, new fopen_ctx_t(cb, context, this, filename));
+        mngr->Send(msg, async_fopen_cb, new fopen_ctx_t(cb, context, this, filename), request_timeout_us);
     }
 }
 
@@ -189,6 +197,17 @@ void StorageManager::async_fopen_cb(void *ptr, int status)
 {
     DIGGI_ASSERT(ptr);
     auto resp = (msg_async_response_t *)ptr;
+    if (resp->msg == nullptr)
+    {
+        /*
+            request timed out, no file was associated
+        */
+        auto ctx = (fopen_ctx_t *)resp->context;
+        resp->context = ctx->item2;
+        ctx->item1(resp, status);
+        delete ctx;
+        return;
+    }
     auto async_id = resp->msg->id;
     DIGGI_ASSERT(resp);
     auto ctx = (fopen_ctx_t *)resp->context;
@@ -229,7 +248,7 @@ void StorageManager::async_fseek(FILE *f, off_t offset, int whence, async_cb_t c
     Pack::pack<off_t>(&ptr, offset);
     Pack::pack<int>(&ptr, whence);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 void StorageManager::async_ftell(FILE *f, async_cb_t cb, void *context)
@@ -245,7 +264,7 @@ void StorageManager::async_ftell(FILE *f, async_cb_t cb, void *context)
     uint8_t *ptr = msg->data;
     Pack::pack<short>(&ptr, f->_fileno);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 typedef struct AsyncContext<async_cb_t, void *, StorageManager *, short> fread_ctx_t;
@@ -269,13 +288,21 @@ void StorageManager::async_fread(size_t size, size_t count, FILE *f, async_cb_t
     // towards the file checksum
     auto cb_context = new fread_ctx_t(cb, context, this, f->_fileno);
 
-    mngr->Send(msg, async_fread_cb, cb_context);
+    mngr->Send(msg, async_fread_cb, cb_context, request_timeout_us);
 }
 
 void StorageManager::async_fread_cb(void *ptr, int status)
 {
     DIGGI_ASSERT(ptr);
     auto resp = (msg_async_response_t *)ptr;
+    if (resp->msg == nullptr)
+    {
+        auto ctx = (fread_ctx_t *)resp->context;
+        resp->context = ctx->item2;
+        ctx->item1(resp, status);
+        delete ctx;
+        return;
+    }
     auto async_id = resp->msg->id;
     DIGGI_ASSERT(resp);
     auto ctx = (fread_ctx_t *)resp->context;
@@ -349,7 +376,7 @@ void StorageManager::async_fclose(FILE *f, async_cb_t cb, void *context)
     uint8_t *ptr = msg->data;
     Pack::pack<short>(&ptr, f->_fileno);
 
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 /**
@@ -575,13 +602,23 @@ void StorageManager::async_open(const char *path, int oflags, mode_t mode, async
     Pack::pack<int>(&ptr, (int)encrypted);
     memcpy(ptr, path_n, path_length + 1);
     auto ctx = new open_ctx_t(this, cb, context, std::string(path_n), mode);
-    mngr->Send(msg, StorageManager::async_open_cb, ctx);
+    mngr->Send(msg, StorageManager::async_open_cb, ctx, request_timeout_us);
 }
 void StorageManager::async_open_cb(void *ptr, int status)
 {
     DIGGI_ASSERT(ptr);
     auto resp = (msg_async_response_t *)ptr;
     auto ctx = (open_ctx_t *)resp->context;
+    if (resp->msg == nullptr)
+    {
+        /*
+            request timed out, the descriptor is unknown and not tracked
+        */
+        resp->context = ctx->item3;
+        ctx->item2(resp, status);
+        delete ctx;
+        return;
+    }
     auto _this = ctx->item1;
     auto ptrm = resp->msg->data;
     int fd = Pack::unpack<int>(&ptrm);
@@ -628,6 +665,18 @@ void StorageManager::async_read_internal_cb(void *ptr, int status)
 {
     DIGGI_ASSERT(ptr);
     auto resp = (msg_async_response_t *)ptr;
+    if (resp->msg == nullptr)
+    {
+        /*
+            request timed out, file position is unchanged.
+            A read preceding a write forwards the timeout to async_write_internal_cb
+        */
+        auto ctx = (read_ctx_t *)resp->context;
+        resp->context = ctx->item2;
+        ctx->item1(resp, status);
+        delete ctx;
+        return;
+    }
     auto async_id = resp->msg->id;
     DIGGI_ASSERT(resp);
     auto ctx = (read_ctx_t *)resp->context;
@@ -880,7 +929,7 @@ void StorageManager::async_read_internal(int fd, read_type_t type, void *buf, si
     Pack::pack<size_t>(&ptr, phys_pos);
     Pack::pack<int>(&ptr, encrypted);
 
-    mngr->Send(msg, async_read_internal_cb, new read_ctx_t(cb, context, this, type, nbyte, encrypted, fd));
+    mngr->Send(msg, async_read_internal_cb, new read_ctx_t(cb, context, this, type, nbyte, encrypted, fd), request_timeout_us);
 }
 /**
  * Asynchronous read request. The correct function for req requesting a read.
@@ -928,6 +977,17 @@ void StorageManager::async_write_internal_cb(void *ptr, int status)
     DIGGI_ASSERT(resp);
     auto context = (write_ctx_t *)resp->context;
     DIGGI_ASSERT(context);
+    if (resp->msg == nullptr)
+    {
+        /*
+            preceding read timed out, nothing is written
+        */
+        context->item4->pending_write_map[context->item6]--;
+        resp->context = context->item2;
+        context->item1(resp, status);
+        delete context;
+        return;
+    }
     auto count = context->item5;
     DIGGI_ASSERT(count > 0);
     auto _this = context->item4;
@@ -1025,7 +1085,7 @@ void StorageManager::async_write_internal_cb(void *ptr, int status)
     }
     _this->lseekstatemap[fd] += count;
     _this->pending_write_map[fd]--;
-    mngr->Send(msg, cb, ctx);
+    mngr->Send(msg, cb, ctx, _this->request_timeout_us);
     free(resp->msg);
     resp->msg = nullptr;
     delete context;
@@ -1081,7 +1141,7 @@ void StorageManager::async_write(int fd, const void *buf, size_t count, async_cb
         Pack::pack<int>(&ptrresp, (int)encrypted);
         Pack::pack<size_t>(&ptrresp, (size_t)lseekstatemap[fd]);
         Pack::packBuffer(&ptrresp, (uint8_t *)buf, count);
-        mngr->Send(msg, cb, context);
+        mngr->Send(msg, cb, context, request_timeout_us);
         if (((size_t)lseekstatemap[fd] + count) > ((size_t)size_of_file[fd]))
         {
             size_of_file[fd] = lseekstatemap[fd] + count;
@@ -1116,7 +1176,7 @@ void StorageManager::async_unlink(const char *pathname, async_cb_t cb, void *con
     /*Marshall*/
     auto ptr = msg->data;
     Pack::packBuffer(&ptr, (uint8_t *)path_n, path_length + 1);
-    mngr->Send(msg, cb, context);
+    mngr->Send(msg, cb, context, request_timeout_us);
 }
 
 /**
@@ -164,7 +164,7 @@ void TamperProofLog::initLog(LogMode mode, std::string log_identifier, async_cb_
     ///do not try logging before storage infra is set up
     if (!ctx->item1->api->GetStorageManager() || !ctx->item1->api->GetMessageManager())
     {
-        api->GetThreadPool()->Schedule(TamperProofLog::retryInit, ctx, __PRETTY_FUNCTION__);
+        api->GetThreadPool()->ScheduleAfter(TAMPERPROOF_LOG_RETRY_USEC, TamperProofLog::retryInit, ctx, __PRETTY_FUNCTION__);
         return;
     }
     retryInit(ctx, 1);
@@ -178,7 +178,7 @@ void TamperProofLog::retryInit(void *ptr, int status)
     ///do not try logging before storage infra is set up
     if (!ctx->item1->api->GetStorageManager() || !ctx->item1->api->GetMessageManager())
     {
-        ctx->item1->api->GetThreadPool()->Schedule(TamperProofLog::retryInit, ctx, __PRETTY_FUNCTION__);
+        ctx->item1->api->GetThreadPool()->ScheduleAfter(TAMPERPROOF_LOG_RETRY_USEC, TamperProofLog::retryInit, ctx, __PRETTY_FUNCTION__);
         return;
     }
 
@@ -221,7 +221,7 @@ void TamperProofLog::appendLogEntry(msg_t *msg)
     ctx->item2->session_count = next_id++;
     if (file_descriptor == 0)
     {
-        api->GetThreadPool()->Schedule(TamperProofLog::retryAppendLogEntry, ctx, __PRETTY_FUNCTION__);
+        api->GetThreadPool()->ScheduleAfter(TAMPERPROOF_LOG_RETRY_USEC, TamperProofLog::retryAppendLogEntry, ctx, __PRETTY_FUNCTION__);
         return;
     }
     retryAppendLogEntry(ctx, 1);
@@ -232,7 +232,7 @@ void TamperProofLog::retryAppendLogEntry(void *ptr, int status)
     auto ctx = (log_append_entry_ctx *)ptr;
     if (ctx->item1->file_descriptor == 0)
     {
-        ctx->item1->api->GetThreadPool()->Schedule(TamperProofLog::retryAppendLogEntry, ctx, __PRETTY_FUNCTION__);
+        ctx->item1->api->GetThreadPool()->ScheduleAfter(TAMPERPROOF_LOG_RETRY_USEC, TamperProofLog::retryAppendLogEntry, ctx, __PRETTY_FUNCTION__);
         return;
     }
     DIGGI_TRACE(ctx->item1->api->GetLogObject(),
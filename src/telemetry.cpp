@@ -9,6 +9,7 @@
  * 
  */
 #include "telemetry.h"
+#include <mutex>
 
 
 #if !defined(DIGGI_ENCLAVE)
@@ -91,11 +92,69 @@ void telemetry_start()
 	telemetry_start(telemetrysingleton);
 }
 
+static std::mutex telemetry_writer_lock;
+static telemetry_writer_t telemetry_writers[TELEMETRY_MAX_WRITERS] = {};
+static void *telemetry_writer_ctx[TELEMETRY_MAX_WRITERS] = {};
 /**
- * @brief write telemetry data to disk.
+ * @brief register a writer invoked each time telemetry data is written to disk.
+ * Registering the same context again replaces its writer.
+ * @param writer callback writing statistics of ctx
+ * @param ctx context delivered to writer, identifies the registration
+ */
+void telemetry_register_writer(telemetry_writer_t writer, void *ctx)
+{
+	DIGGI_ASSERT(writer);
+	DIGGI_ASSERT(ctx);
+	std::lock_guard<std::mutex> guard(telemetry_writer_lock);
+	int free_slot = -1;
+	for (int i = 0; i < TELEMETRY_MAX_WRITERS; i++)
+	{
+		if (telemetry_writer_ctx[i] == ctx)
+		{
+			telemetry_writers[i] = writer;
+			return;
+		}
+		if (free_slot < 0 && telemetry_writer_ctx[i] == nullptr)
+		{
+			free_slot = i;
+		}
+	}
+	DIGGI_ASSERT(free_slot >= 0);
+	telemetry_writers[free_slot] = writer;
+	telemetry_writer_ctx[free_slot] = ctx;
+}
+/**
+ * @brief remove the writer registered for ctx, if any.
  * 
+ * @param ctx context the writer was registered with
+ */
+void telemetry_unregister_writer(void *ctx)
+{
+	std::lock_guard<std::mutex> guard(telemetry_writer_lock);
+	for (int i = 0; i < TELEMETRY_MAX_WRITERS; i++)
+	{
+		if (telemetry_writer_ctx[i] == ctx)
+		{
+			telemetry_writers[i] = nullptr;
+			telemetry_writer_ctx[i] = nullptr;
+		}
+	}
+}
+/**
+ * @brief write telemetry data to disk.
+ * Registered writers are invoked first, see telemetry_register_writer().
  */
 void telemetry_write() {
+	{
+		std::lock_guard<std::mutex> guard(telemetry_writer_lock);
+		for (int i = 0; i < TELEMETRY_MAX_WRITERS; i++)
+		{
+			if (telemetry_writers[i] != nullptr)
+			{
+				telemetry_writers[i](telemetry_writer_ctx[i]);
+			}
+		}
+	}
 
 	observation_t *head = telemetrysingleton->next;
 	FILE * pFile = fopen("telemetry.log", "a+");
@@ -3,8 +3,8 @@
  * @author your name (you@domain.com)
  * @brief implementation of diggi threadpool.
  * include all threading facilites used for virtual non-preemptive threading and asynchronous scheduling.
- * For each physical thread allocated to a particular threadpool, a statically defined number of virtual threads are allocated, defined by MAX_COROUTINES.
- * each virtual thread is allocated a separate stack of STACKSIZE. each virtual thread is subject to cooperative sheduling, invoked in round robin through Yield()
+ * For each physical thread allocated to a particular threadpool, a configurable number of virtual threads are allocated, defaulting to DEFAULT_VIRTUAL_THREADS.
+ * each virtual thread is allocated a separate stack of configurable size from a pool reserved at creation. each virtual thread is subject to cooperative sheduling, invoked in round robin through Yield()
  * One physical thread cannot be hosted by multiple threadpools.
  * @version 0.1
  * @date 2020-02-04
@@ -13,6 +13,7 @@
  * 
  */
 #include "threading/ThreadPool.h"
+#include "telemetry.h"
 
 /// thread local argument when switching to virtual thread.
 static thread_local void *coarg;
@@ -20,6 +21,12 @@ static thread_local void *coarg;
 static thread_local int coroutine_id = -1;
 /// thread local next virtual thread in round robin scheduler.
 static thread_local int next_coroutine_id = 0;
+/// thread local count of virtual threads blocked in Yield(), including nested yields.
+static thread_local int yielding_coroutines = 0;
+#ifdef DIGGI_ENCLAVE
+/// thread local count of busy scheduler loop passes since timers were last polled, only used in enclave mode.
+static thread_local size_t timer_clock_polls = 0;
+#endif
 
 ///GCC compiler options to supress problems caused by stack manipulation.
 #pragma GCC diagnostic push
@@ -40,48 +47,49 @@ void *coto(jmp_buf_d here, jmp_buf_d there, void *arg)
 		return (coarg);
 	longjmp_d(there, 1);
 }
-///pop gcc warning supression
-#pragma GCC diagnostic pop
-///Simpler to adhere to regular linux x86, we use downwards stack
-#define STACKDIR - // set to + for upwards and - for downwards
-
-
-/*
-    Debug Requires more stack space for symbols
-    howver, release binary enclave must be as small as possible, 
-    so we set it accordingly
-*/
-
-#ifdef RELEASE
-#define STACKSIZE (1 << 16)
-#else
-#define STACKSIZE (1 << 17)
-
-#endif
-/// top of stack
-static thread_local char *tos;
+/// thread local entry point of virtual thread started by cogo
+static thread_local void (*cofun)(void *);
+/// thread local execution context resumed once a virtual thread entry point returns
+static thread_local __jmp_buf_tag_d *coreturn;
+/**
+ * @brief first frame on a fresh virtual thread stack.
+ * There is no caller frame to return to on the new stack, so the context which created the virtual thread is resumed instead.
+ */
+static void costart()
+{
+	cofun(coarg);
+	longjmp_d(coreturn, 1);
+}
 /**
  * @brief initialize and start a new virtual thread
- * 
+ * Switches stack pointer to stack_top and invokes fun on the new stack.
  * @param here this execution context
  * @param fun callback executing new virtual thread
  * @param arg arguments provided to new virtual thread.
+ * @param stack_top highest address of new virtual thread stack, 16 byte aligned
  * @return void* not used (or: dont worry about it)
  */
-void *cogo(jmp_buf_d here, void (*fun)(void *), void *arg)
+void *cogo(jmp_buf_d here, void (*fun)(void *), void *arg, char *stack_top)
 {
-	if (tos == NULL)
-		tos = (char *)&arg;
-	tos += STACKDIR STACKSIZE;
-	char n[STACKDIR(tos - (char *)&arg)];
-	coarg = n; // ensure optimizer keeps n
+	DIGGI_ASSERT(((size_t)stack_top & 0xf) == 0);
 	if (setjmp_d(here))
 		return (coarg);
-	fun(arg);
-	return nullptr;
+	cofun = fun;
+	coarg = arg;
+	coreturn = here;
+	/*
+		null return address terminates stack unwinding at costart
+	*/
+	__asm__ volatile("movq %0, %%rsp\n\t"
+					 "pushq $0\n\t"
+					 "jmpq *%1\n\t"
+					 :
+					 : "r"(stack_top), "r"(costart)
+					 : "memory");
+	__builtin_unreachable();
 }
-///virtual threads per physicaln threa
-#define MAX_COROUTINES 2
+///pop gcc warning supression
+#pragma GCC diagnostic pop
 /**
  * @brief assing a thread id to a physical thread.
  * monotonically increasing
@@ -97,6 +105,28 @@ unsigned ThreadPool::get_thrd_id()
 
 	return local_id;
 }
+/**
+ * @brief parse "virtual-threads" func configuration.
+ * Accepts decimal values from 1 to MAX_VIRTUAL_THREADS_PER_THREAD, the bound enforced by the constructor.
+ * @param value configured value
+ * @param virtual_threads set to parsed value, left unchanged if invalid
+ * @return true if value is valid
+ */
+bool ThreadPool::parseVirtualThreads(const std::string &value, size_t *virtual_threads)
+{
+	DIGGI_ASSERT(virtual_threads);
+	if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+	{
+		return false;
+	}
+	auto parsed = strtoul(value.c_str(), nullptr, 10);
+	if (parsed == 0 || parsed > MAX_VIRTUAL_THREADS_PER_THREAD)
+	{
+		return false;
+	}
+	*virtual_threads = (size_t)parsed;
+	return true;
+}
 /**
  * @brief Construct a new Thread Pool:: Thread Pool object
  * creates a new thread pool for a predefined number of physical threads.
@@ -114,20 +144,83 @@ unsigned ThreadPool::get_thrd_id()
  * @see lockfree_rb_q.cpp
  * @param threads thread count of expected threads executing in this threadpool
  * @param mode ENCLAVE_MODE or REGULAR_MODE
+ * If work_stealing is enabled, callbacks scheduled through Schedule() are placed on a separate per thread queue, 
+ * which idle sibling threads may consume from. Callbacks scheduled through ScheduleOn() are never stolen.
+ * Each physical thread is also allocated a timer wheel for callbacks scheduled through ScheduleAfter() and SchedulePeriodic().
+ * Per label profiling of callbacks is disabled until setProfiling() is invoked, and each scheduler pass executes a single task until setBatching() is invoked.
  * @param name set pthread name for all physical threads in pool, used for simplified debugging
+ * @param work_stealing allow idle threads to execute unpinned callbacks queued on sibling threads
+ * Each physical thread hosts virtual_threads virtual threads, which may block in Yield() independently of each other.
+ * Their stacks are reserved up front, as one pool per physical thread.
+ * Enclave instances carve them from the physical thread stack instead, as the SGX SDK validates the stack pointer against it when handling exceptions,
+ * so virtual_threads + 1 stacks must fit in DIGGI_ENCLAVE_STACK_SIZE.
+ * @param virtual_threads virtual threads per physical thread
+ * @param stack_size stack size of each virtual thread, rounded up to page size
  */
 ThreadPool::ThreadPool(size_t threads,
 					   threading_mode_t mode,
-					   string name) : quit(0),
-									  stop(1),
-									  threads(threads),
-									  name(name),
-									  mode(mode)
+					   string name,
+					   bool work_stealing,
+					   size_t virtual_threads,
+					   size_t stack_size) : quit(0),
+											 stop(1),
+											 thread_stats(threads),
+											 work_cache(threads),
+											 timer_seq(0),
+											 batch_size(DEFAULT_SCHEDULER_BATCH),
+											 batch_budget_us(0),
+											 profiling(false),
+											 work_stealing(work_stealing),
+											 virtual_threads(virtual_threads),
+											 stack_size(roundUp_r(stack_size, PAGE_SIZE)),
+											 threads(threads),
+											 name(name),
+											 mode(mode)
 {
+	DIGGI_ASSERT(virtual_threads > 0 && virtual_threads <= MAX_VIRTUAL_THREADS_PER_THREAD);
+	DIGGI_ASSERT(this->stack_size > 0);
+#ifdef DIGGI_ENCLAVE
+	DIGGI_ASSERT((virtual_threads + 1) * this->stack_size <= DIGGI_ENCLAVE_STACK_SIZE);
+#endif
 	for (unsigned i = 0; i < threads; i++)
 	{
-		coroutine_bufs.push_back(std::vector<jmp_buf_internal_t>(MAX_COROUTINES));
+		/*
+			one execution context for the base context of the physical thread, and one per virtual thread
+		*/
+		coroutine_bufs.push_back(std::vector<jmp_buf_internal_t>(virtual_threads + 1));
+		parked_on.push_back(std::vector<volatile int *>(virtual_threads + 1, nullptr));
+#ifndef DIGGI_ENCLAVE
+		auto stacks = (char *)memalign(PAGE_SIZE, virtual_threads * this->stack_size);
+		DIGGI_ASSERT(stacks);
+		coroutine_stacks.push_back(stacks);
+#endif
 		target_queue.push_back(lf_new(THREAD_POOL_SIZE, threads + 1, threads + 1));
+#ifndef DIGGI_ENCLAVE
+		/*
+			idle threads with armed timers park on their queue until the next expiry,
+			not availible for queues in enclave memory.
+		*/
+		lf_enable_doorbell(target_queue[i]);
+#endif
+		timer_wheels.push_back(new TimerWheel(monotonicUsec() / TIMER_WHEEL_TICK_USEC));
+		parked_queue.push_back(nullptr);
+		if (work_stealing)
+		{
+			steal_queue.push_back(lf_new(THREAD_POOL_SIZE, threads + 1, threads + 1));
+		}
+		memset(&thread_stats[i], 0, sizeof(thread_stat_t));
+		profiles.push_back((sched_profile_t *)memalign(DCACHE1_LINESIZE, sizeof(sched_profile_t)));
+		DIGGI_ASSERT(profiles[i]);
+		memset(profiles[i], 0, sizeof(sched_profile_t));
+		work_cache[i].slab = (async_work_t *)memalign(DCACHE1_LINESIZE, sizeof(async_work_t) * WORK_ITEM_CACHE_SIZE);
+		work_cache[i].stack = (async_work_t **)malloc(sizeof(async_work_t *) * WORK_ITEM_CACHE_SIZE);
+		work_cache[i].returns = lf_new(WORK_ITEM_CACHE_SIZE, threads + 1, threads + 1);
+		for (unsigned j = 0; j < WORK_ITEM_CACHE_SIZE; j++)
+		{
+			work_cache[i].slab[j].thread_id = i;
+			work_cache[i].stack[j] = &work_cache[i].slab[j];
+		}
+		work_cache[i].count = WORK_ITEM_CACHE_SIZE;
 #ifndef DIGGI_ENCLAVE
 		if (mode != ENCLAVE_MODE)
 		{
@@ -190,6 +283,7 @@ void ThreadPool::Stop()
 		for (size_t i = 0; i < workers.size(); ++i)
 		{
 			workers[i].join();
+			release_thread_affinity();
 		}
 	}
 }
@@ -209,14 +303,46 @@ ThreadPool::~ThreadPool()
 	{
 		lf_destroy(lf);
 	}
+	for (auto lf : steal_queue)
+	{
+		lf_destroy(lf);
+	}
+
+	for (auto cache : work_cache)
+	{
+		lf_destroy(cache.returns);
+		free(cache.stack);
+		free(cache.slab);
+	}
+	for (auto wheel : timer_wheels)
+	{
+		delete wheel;
+	}
+	for (auto stacks : coroutine_stacks)
+	{
+		free(stacks);
+	}
+#ifndef DIGGI_ENCLAVE
+	telemetry_unregister_writer(this);
+#endif
+	for (auto profile : profiles)
+	{
+		free(profile);
+	}
 
 	target_queue.clear();
+	steal_queue.clear();
+	work_cache.clear();
+	timer_wheels.clear();
+	coroutine_stacks.clear();
+	profiles.clear();
 
 	if (mode != ENCLAVE_MODE)
 	{
 		workers.clear();
 	}
 	coroutine_bufs.clear();
+	parked_on.clear();
 }
 
 /**
@@ -224,6 +350,7 @@ ThreadPool::~ThreadPool()
  * will execute after all preceding pending callbacks are done (FIFO)
  * May be invoked by thread not on pool. In this case the "self"-thread is interpreted as physical thread id 0.
  * Will not schedule callback if threadpool stop is invoked in the interim.
+ * If work stealing is enabled, the callback may execute on another physical thread, use ScheduleOn() for thread affine callbacks.
  * @param cb callback to invoke
  * @param args arguments passed to callback
  * @param label optional string function label for debuggability(can be null)
@@ -240,13 +367,14 @@ void ThreadPool::Schedule(async_cb_t cb, void *args, const char *label)
 	}
 	//DIGGI_ASSERT(args);
 	DIGGI_ASSERT(cb);
-	auto workitem = (async_work_t *)malloc(sizeof(async_work_t));
+	auto id = currentThreadId();
+	auto workitem = allocWork(id);
 	workitem->label = label;
 	workitem->cb = cb;
 	workitem->arg = args;
 	workitem->status = 1;
+	workitem->enqueue_tsc = (profiling) ? profileClock() : 0;
 
-	auto id = currentThreadId();
 	if (id < 0)
 	{
 		/*
@@ -254,7 +382,8 @@ void ThreadPool::Schedule(async_cb_t cb, void *args, const char *label)
 		*/
 		id = 0;
 	}
-	lf_send(target_queue[id], workitem, id);
+	lf_send((work_stealing) ? steal_queue[id] : target_queue[id], workitem, id);
+	wakeParked(id);
 }
 /**
  * @brief Schedule callback on thread with id
@@ -282,12 +411,13 @@ void ThreadPool::ScheduleOn(size_t id, async_cb_t cb, void *args, const char *la
 	DIGGI_ASSERT(id < threads);
 	//DIGGI_ASSERT(args);
 	DIGGI_ASSERT(cb);
-	auto workitem = (async_work_t *)malloc(sizeof(async_work_t));
+	auto self_id = currentThreadId();
+	auto workitem = allocWork(self_id);
 	workitem->label = label;
 	workitem->cb = cb;
 	workitem->arg = args;
 	workitem->status = 1;
-	auto self_id = currentThreadId();
+	workitem->enqueue_tsc = (profiling) ? profileClock() : 0;
 	if (self_id < 0)
 	{
 		/*
@@ -296,7 +426,542 @@ void ThreadPool::ScheduleOn(size_t id, async_cb_t cb, void *args, const char *la
 		self_id = 0;
 	}
 	lf_send(target_queue[id], workitem, self_id);
+	wakeParked(id);
+}
+/**
+ * @brief ring the queue a thread is parked on through ParkOnQueue(), after work is scheduled onto it.
+ * Pairs with the announcement in ParkOnQueue(), so either the parked thread observes the work or is woken.
+ * @param id identity of target thread
+ */
+void ThreadPool::wakeParked(size_t id)
+{
+	__sync_synchronize();
+	auto queue = __atomic_load_n(&parked_queue[id], __ATOMIC_SEQ_CST);
+	if (queue != nullptr)
+	{
+		lf_ring(queue);
+	}
+}
+/**
+ * @brief block the calling idle thread on the doorbell of a queue, such as the input queue of a message manager.
+ * The wait ends no later than the next timer expiry of the thread, and is cut short by work scheduled onto the thread through ScheduleOn() or Schedule().
+ * Does not block if work stealing is enabled, as work may appear on sibling queues.
+ * @param queue queue with doorbell enabled
+ * @param max_usec upper bound on time parked, in microseconds
+ */
+void ThreadPool::ParkOnQueue(lf_buffer_t *queue, uint64_t max_usec)
+{
+	auto self_id = currentThreadId();
+	if (self_id < 0)
+	{
+		lf_park(queue, max_usec);
+		return;
+	}
+	if (work_stealing)
+	{
+		return;
+	}
+	auto wait = max_usec;
+	auto wheel = timer_wheels[self_id];
+	if (wheel->pending() > 0)
+	{
+		auto now = monotonicUsec() / TIMER_WHEEL_TICK_USEC;
+		auto next = wheel->nextExpiry();
+		if (next <= now)
+		{
+			return;
+		}
+		if ((next - now) * TIMER_WHEEL_TICK_USEC < wait)
+		{
+			wait = (next - now) * TIMER_WHEEL_TICK_USEC;
+		}
+	}
+	__atomic_store_n(&parked_queue[self_id], queue, __ATOMIC_SEQ_CST);
+	lf_park_unless(queue, target_queue[self_id], wait);
+	__atomic_store_n(&parked_queue[self_id], (lf_buffer_t *)nullptr, __ATOMIC_SEQ_CST);
+}
+/**
+ * @brief Schedule callback on current thread after a delay.
+ * Callback is armed on the timer wheel of the calling physical thread, and executes on that thread no earlier than delay_us from now.
+ * Delays are rounded up to TIMER_WHEEL_TICK_USEC, and expiry is observed between tasks, so long running tasks postpone it.
+ * May be invoked by thread not on pool, in which case the timer is armed on physical thread id 0.
+ * Will not schedule callback if threadpool stop is invoked in the interim.
+ * @param delay_us minimum delay in microseconds
+ * @param cb callback to invoke
+ * @param args arguments passed to callback
+ * @param label optional string function label for debuggability(can be null)
+ */
+void ThreadPool::ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label)
+{
+	if (stop)
+	{
+		return;
+	}
+	if (quit)
+	{
+		return;
+	}
+	DIGGI_ASSERT(cb);
+	armTimer(newTimer(delay_us, 0, cb, args, label));
+}
+/**
+ * @brief Schedule callback to execute repeatedly on current thread, every period_us.
+ * Expiries are spaced relative to the previous deadline, so the period does not drift with callback duration.
+ * If a thread falls more than a period behind, missed expiries are skipped rather than replayed.
+ * Otherwise same semantics as ScheduleAfter().
+ * @param period_us interval in microseconds, must be nonzero
+ * @param cb callback to invoke
+ * @param args arguments passed to callback
+ * @param label optional string function label for debuggability(can be null)
+ * @return uint64_t timer id used to cancel timer through CancelPeriodic(), 0 if threadpool is stopping
+ */
+uint64_t ThreadPool::SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label)
+{
+	if (stop)
+	{
+		return 0;
+	}
+	if (quit)
+	{
+		return 0;
+	}
+	DIGGI_ASSERT(cb);
+	DIGGI_ASSERT(period_us > 0);
+	auto self_id = currentThreadId();
+	if (self_id < 0)
+	{
+		self_id = 0;
+	}
+	auto entry = newTimer(period_us, period_us, cb, args, label);
+	/*
+		id encodes owner thread, so cancellation can be routed to it
+	*/
+	entry->id = (__sync_add_and_fetch(&timer_seq, 1) * threads) + self_id;
+	armTimer(entry);
+	return entry->id;
+}
+/**
+ * @brief cancel periodic timer.
+ * Synchronous if invoked on the thread owning the timer, including from the timer callback itself.
+ * Otherwise the cancellation is scheduled onto the owner thread, and the callback may execute once more in the interim.
+ * @param timer_id id returned by SchedulePeriodic()
+ */
+void ThreadPool::CancelPeriodic(uint64_t timer_id)
+{
+	if (timer_id == 0)
+	{
+		return;
+	}
+	auto owner = timer_id % threads;
+	if ((size_t)currentThreadId() == owner)
+	{
+		timer_wheels[owner]->cancelPeriodic(timer_id);
+		return;
+	}
+	ScheduleOn(owner, ThreadPool::cancelPeriodicCb, new AsyncContext<ThreadPool *, uint64_t>(this, timer_id), __PRETTY_FUNCTION__);
+}
+/**
+ * @brief cancel periodic timer on owner thread, on behalf of another thread.
+ *
+ * @param ptr AsyncContext holding threadpool and timer id
+ * @param status unused
+ */
+void ThreadPool::cancelPeriodicCb(void *ptr, int status)
+{
+	DIGGI_ASSERT(ptr);
+	auto ctx = (AsyncContext<ThreadPool *, uint64_t> *)ptr;
+	ctx->item1->timer_wheels[ctx->item1->currentThreadId()]->cancelPeriodic(ctx->item2);
+	delete ctx;
+}
+/**
+ * @brief allocate timer with an absolute deadline relative to now.
+ *
+ * @param delay_us delay until first expiry
+ * @param period_us interval between expiries, 0 for one shot timers
+ * @param cb callback
+ * @param args callback argument
+ * @param label callback label
+ * @return timer_entry_t* new timer
+ */
+timer_entry_t *ThreadPool::newTimer(uint64_t delay_us, uint64_t period_us, async_cb_t cb, void *args, const char *label)
+{
+	auto entry = (timer_entry_t *)calloc(1, sizeof(timer_entry_t));
+	DIGGI_ASSERT(entry);
+	entry->cb = cb;
+	entry->arg = args;
+	entry->label = label;
+	/*
+		round up, timers never expire early
+	*/
+	entry->deadline = (monotonicUsec() + delay_us + TIMER_WHEEL_TICK_USEC - 1) / TIMER_WHEEL_TICK_USEC;
+	if (period_us > 0)
+	{
+		entry->period = (period_us + TIMER_WHEEL_TICK_USEC - 1) / TIMER_WHEEL_TICK_USEC;
+	}
+	return entry;
+}
+/**
+ * @brief add timer to the wheel of the current thread.
+ * Timer wheels are only accessed by their owner, so threads not on pool hand the timer to physical thread id 0.
+ * @param entry timer
+ */
+void ThreadPool::armTimer(timer_entry_t *entry)
+{
+	auto self_id = currentThreadId();
+	if (self_id < 0)
+	{
+		ScheduleOn(0, ThreadPool::armTimerCb, new AsyncContext<ThreadPool *, timer_entry_t *>(this, entry), __PRETTY_FUNCTION__);
+		return;
+	}
+	auto wheel = timer_wheels[self_id];
+	wheel->add(entry);
+	if (entry->period > 0)
+	{
+		wheel->trackPeriodic(entry);
+	}
+}
+/**
+ * @brief arm timer on behalf of thread not on pool.
+ *
+ * @param ptr AsyncContext holding threadpool and timer
+ * @param status unused
+ */
+void ThreadPool::armTimerCb(void *ptr, int status)
+{
+	DIGGI_ASSERT(ptr);
+	auto ctx = (AsyncContext<ThreadPool *, timer_entry_t *> *)ptr;
+	ctx->item1->armTimer(ctx->item2);
+	delete ctx;
+}
+/**
+ * @brief read monotonic clock.
+ * Enclave instances read it through an ocall.
+ * @return uint64_t microseconds since an arbitrary fixed point
+ */
+uint64_t ThreadPool::monotonicUsec()
+{
+	uint64_t usec = 0;
+#ifdef DIGGI_ENCLAVE
+	ocall_monotonic_usec(&usec);
+#else
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+	{
+		DIGGI_ASSERT(false);
+	}
+	usec = ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+#endif
+	return usec;
+}
+/**
+ * @brief invoke expired timers of a physical thread, called by scheduler loop between tasks.
+ * Free if no timers are armed. In enclave mode, busy passes only poll the clock every TIMER_CLOCK_POLL_INTERVAL passes, as it requires an ocall.
+ * If the pass was idle and no timer has expired, the thread blocks until the next expiry, bounded by TIMER_IDLE_PARK_MAX_USEC.
+ * Outside enclaves, the thread parks on its queue and is woken by the next ScheduleOn(), inside it sleeps through an ocall.
+ * Idle threads do not block if work stealing is enabled, as work may appear on sibling queues.
+ * @param self_id physical thread id of caller
+ * @param idle true if scheduler loop found no task during this pass
+ */
+void ThreadPool::runTimers(int self_id, bool idle)
+{
+	auto wheel = timer_wheels[self_id];
+	if (wheel->pending() == 0)
+	{
+		return;
+	}
+#ifdef DIGGI_ENCLAVE
+	if (!idle && (++timer_clock_polls % TIMER_CLOCK_POLL_INTERVAL) != 0)
+	{
+		return;
+	}
+#endif
+	auto now = monotonicUsec() / TIMER_WHEEL_TICK_USEC;
+	auto expired = wheel->advance(now);
+	if (expired == nullptr)
+	{
+		if (!idle || work_stealing)
+		{
+			return;
+		}
+		auto next = wheel->nextExpiry();
+		if (next <= now)
+		{
+			return;
+		}
+		auto wait = (next - now) * TIMER_WHEEL_TICK_USEC;
+		if (wait > TIMER_IDLE_PARK_MAX_USEC)
+		{
+			wait = TIMER_IDLE_PARK_MAX_USEC;
+		}
+#ifdef DIGGI_ENCLAVE
+		ocall_sleep(wait);
+#else
+		lf_park(target_queue[self_id], wait);
+#endif
+		return;
+	}
+	while (expired != nullptr)
+	{
+		auto entry = expired;
+		expired = entry->next;
+		entry->next = nullptr;
+		if (entry->cancelled)
+		{
+			free(entry);
+			continue;
+		}
+		DIGGI_ASSERT(entry->label != nullptr);
+		if (profiling)
+		{
+			/*
+				timers are not queued, lateness is not accounted as queueing delay
+			*/
+			auto start = profileClock();
+			entry->cb(entry->arg, 1);
+			profileTask(self_id, entry->label, 0, start, profileClock());
+		}
+		else
+		{
+			entry->cb(entry->arg, 1);
+		}
+		/*
+			callback may have cancelled its own timer
+		*/
+		if (entry->period == 0 || entry->cancelled)
+		{
+			free(entry);
+			continue;
+		}
+		entry->deadline += entry->period;
+		if (entry->deadline <= now)
+		{
+			entry->deadline = now + entry->period;
+		}
+		wheel->add(entry);
+	}
+}
+/**
+ * @brief execute callback of a task and release its work item.
+ * If profiling, the callback is timed and accounted to its label on the executing thread.
+ * Run time is measured from start to return, and includes time the callback spent yielded to other virtual threads.
+ * @param task task to execute
+ * @param self_id physical thread id of caller
+ */
+void ThreadPool::runTask(async_work_t *task, int self_id)
+{
+	DIGGI_ASSERT(task->label != nullptr);
+	DIGGI_ASSERT(task->cb != nullptr);
+	if (!profiling)
+	{
+		task->cb(task->arg, task->status);
+		freeWork(task, self_id);
+		return;
+	}
+	auto label = task->label;
+	auto enqueued = task->enqueue_tsc;
+	auto start = profileClock();
+	task->cb(task->arg, task->status);
+	profileTask(self_id, label, enqueued, start, profileClock());
+	freeWork(task, self_id);
+}
+/**
+ * @brief configure how many tasks a virtual thread drains per scheduler loop pass.
+ * Each pass ends with a timer check and a switch to the next virtual thread, so draining several tasks amortizes that cost.
+ * Larger batches delay timers and sibling virtual threads by up to max_tasks callbacks, budget_us bounds that delay.
+ * The budget is checked between tasks, and is ignored inside enclaves as the clock requires an ocall.
+ * Configured through the "scheduler-batch" and "scheduler-batch-budget-usec" func configurations.
+ * @param max_tasks maximum tasks per pass, at least 1
+ * @param budget_us maximum duration of a pass in microseconds, 0 for no bound
+ */
+void ThreadPool::setBatching(size_t max_tasks, uint64_t budget_us)
+{
+	DIGGI_ASSERT(max_tasks > 0);
+	batch_size = max_tasks;
+	batch_budget_us = budget_us;
+	__sync_synchronize();
+}
+/**
+ * @brief enable or disable per label profiling of callbacks.
+ * While enabled, each physical thread records invocation count, run time and queueing delay of the callbacks it executes, keyed on the label they were scheduled with.
+ * Callbacks scheduled before profiling was enabled are not accounted queueing delay.
+ * Enabled through the "scheduler-profiling" func configuration.
+ * Outside enclaves, profiles are appended to SCHED_PROFILE_LOG on each telemetry_write() while enabled.
+ * @param enabled
+ */
+void ThreadPool::setProfiling(bool enabled)
+{
+	profiling = enabled;
+	__sync_synchronize();
+#ifndef DIGGI_ENCLAVE
+	if (enabled)
+	{
+		telemetry_register_writer(ThreadPool::writeProfileCb, this);
+	}
+	else
+	{
+		telemetry_unregister_writer(this);
+	}
+#endif
+}
+/**
+ * @brief check if per label profiling is enabled
+ * 
+ * @return true if enabled
+ */
+bool ThreadPool::profilingEnabled()
+{
+	return profiling;
+}
+/**
+ * @brief read profiling clock.
+ * Outside enclaves the timestamp counter is used, and all profile times are in cycles.
+ * rdtsc is not permitted inside SGX1 enclaves, so enclave instances fall back to monotonicUsec(), which requires an ocall.
+ * @return uint64_t current time, in cycles or microseconds
+ */
+uint64_t ThreadPool::profileClock()
+{
+#ifdef DIGGI_ENCLAVE
+	return monotonicUsec();
+#else
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc"
+						 : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+/**
+ * @brief account one callback execution to the profile of a physical thread.
+ * Labels are identified by pointer, as they are usually string literals (__PRETTY_FUNCTION__).
+ * @param self_id physical thread id of caller, profiles are only written by their owner
+ * @param label label of callback
+ * @param enqueued clock reading when callback was scheduled, 0 if unknown
+ * @param start clock reading when callback started
+ * @param end clock reading when callback returned
+ */
+void ThreadPool::profileTask(int self_id, const char *label, uint64_t enqueued, uint64_t start, uint64_t end)
+{
+	DIGGI_ASSERT(self_id >= 0 && (size_t)self_id < threads);
+	auto profile = profiles[self_id];
+	label_stat_t *stat = &profile->overflow;
+	auto idx = ((size_t)label >> 3) & (SCHED_PROFILE_LABELS - 1);
+	for (size_t probe = 0; probe < SCHED_PROFILE_LABELS; probe++)
+	{
+		auto candidate = &profile->stats[(idx + probe) & (SCHED_PROFILE_LABELS - 1)];
+		if (candidate->label == label)
+		{
+			stat = candidate;
+			break;
+		}
+		if (candidate->label == nullptr)
+		{
+			candidate->label = label;
+			stat = candidate;
+			break;
+		}
+	}
+	auto run = (end > start) ? end - start : 0;
+	stat->count++;
+	stat->run_total += run;
+	if (run > stat->run_max)
+	{
+		stat->run_max = run;
+	}
+	/*
+		timestamp counters of different cores may be slightly skewed, discard negative delays
+	*/
+	if (enqueued != 0 && start > enqueued)
+	{
+		auto queued = start - enqueued;
+		stat->queue_total += queued;
+		if (queued > stat->queue_max)
+		{
+			stat->queue_max = queued;
+		}
+	}
+}
+/**
+ * @brief dump profiles of all physical threads as CSV, one row per thread and label.
+ * Columns: thread,label,count,run_total,run_max,queue_total,queue_max,clock
+ * clock is the unit of all times, "cycles" outside enclaves and "usec" inside, see profileClock().
+ * Labels are quoted, as __PRETTY_FUNCTION__ labels contain commas.
+ * May be invoked while the pool is running, in which case rows are not a consistent snapshot.
+ * @return std::string CSV including header, no rows if profiling was never enabled
+ */
+std::string ThreadPool::profileCsv()
+{
+#ifdef DIGGI_ENCLAVE
+	const char *unit = "usec";
+#else
+	const char *unit = "cycles";
+#endif
+	std::string csv = "thread,label,count,run_total,run_max,queue_total,queue_max,clock\n";
+	char row[128];
+	auto append = [&](size_t thread, const char *label, label_stat_t *stat) {
+		if (stat->count == 0)
+		{
+			return;
+		}
+		snprintf(row, sizeof(row), "%lu,\"", thread);
+		csv += row;
+		for (auto c = label; *c != '\0'; c++)
+		{
+			if (*c == '"')
+			{
+				csv += '"';
+			}
+			csv += *c;
+		}
+		snprintf(row, sizeof(row), "\",%lu,%lu,%lu,%lu,%lu,%s\n",
+				 stat->count,
+				 stat->run_total,
+				 stat->run_max,
+				 stat->queue_total,
+				 stat->queue_max,
+				 unit);
+		csv += row;
+	};
+	for (size_t i = 0; i < threads; i++)
+	{
+		for (size_t j = 0; j < SCHED_PROFILE_LABELS; j++)
+		{
+			auto stat = &profiles[i]->stats[j];
+			if (stat->label != nullptr)
+			{
+				append(i, stat->label, stat);
+			}
+		}
+		append(i, "overflow", &profiles[i]->overflow);
+	}
+	return csv;
 }
+#ifndef DIGGI_ENCLAVE
+/**
+ * @brief append profiles of all physical threads to a file, formatted as profileCsv().
+ * Untrusted instances are dumped to SCHED_PROFILE_LOG on telemetry_write() and when they shut down.
+ * @param path file to append to
+ */
+void ThreadPool::writeProfile(const char *path)
+{
+	DIGGI_ASSERT(path);
+	auto csv = profileCsv();
+	FILE *pFile = fopen(path, "a+");
+	DIGGI_ASSERT(pFile);
+	fputs(csv.c_str(), pFile);
+	fflush(pFile);
+	fclose(pFile);
+}
+/**
+ * @brief telemetry writer, dumps profiles so they are available without shutting down the instance.
+ * @see telemetry_register_writer
+ * @param ptr ThreadPool
+ */
+void ThreadPool::writeProfileCb(void *ptr)
+{
+	DIGGI_ASSERT(ptr);
+	auto _this = (ThreadPool *)ptr;
+	_this->writeProfile(SCHED_PROFILE_LOG);
+}
+#endif
 /**
  * @brief get current physical thread id.
  * 
@@ -313,14 +978,153 @@ int ThreadPool::currentThreadId()
 	return thr_id();
 }
 /**
- * @brief get current virtual thread id
+ * @brief get count of tasks a physical thread has stolen from its siblings.
  * 
+ * @param id physical thread id
+ * @return uint64_t stolen tasks
+ */
+uint64_t ThreadPool::stealCount(size_t id)
+{
+	DIGGI_ASSERT(id < threads);
+	return thread_stats[id].steals;
+}
+/**
+ * @brief total async_work_t allocations served from work item caches, across all physical threads.
+ * Allocations by threads not on pool are not counted.
+ * @return uint64_t pooled allocations
+ */
+uint64_t ThreadPool::pooledWorkAllocations()
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < threads; i++)
+	{
+		total += thread_stats[i].pooled_allocs;
+	}
+	return total;
+}
+/**
+ * @brief total async_work_t allocations which fell back to the heap, across all physical threads.
+ * Allocations by threads not on pool are not counted.
+ * @return uint64_t heap allocations
+ */
+uint64_t ThreadPool::heapWorkAllocations()
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < threads; i++)
+	{
+		total += thread_stats[i].heap_allocs;
+	}
+	return total;
+}
+/**
+ * @brief allocate work item for scheduling a callback.
+ * Served from the callers work item cache, refilled from items other threads have handed back.
+ * Falls back to heap allocation if the cache is exhausted or the caller is not on pool, such items are marked with thread_id -1.
+ * @param self_id physical thread id of caller, negative if not on pool
+ * @return async_work_t* work item
+ */
+async_work_t *ThreadPool::allocWork(int self_id)
+{
+	if (self_id >= 0)
+	{
+		auto cache = &work_cache[self_id];
+		if (cache->count == 0)
+		{
+			cache->count = lf_try_recieve_batch(cache->returns, (void **)cache->stack, WORK_ITEM_CACHE_SIZE, self_id);
+		}
+		if (cache->count > 0)
+		{
+			thread_stats[self_id].pooled_allocs++;
+			return cache->stack[--cache->count];
+		}
+		thread_stats[self_id].heap_allocs++;
+	}
+	auto workitem = (async_work_t *)malloc(sizeof(async_work_t));
+	workitem->thread_id = -1;
+	return workitem;
+}
+/**
+ * @brief release work item after its callback is executed.
+ * Items owned by the caller are pushed on its local stack, items owned by other threads are sent back to the owners returns queue.
+ * The returns queue holds every item of a cache, so handing back never blocks.
+ * @param work work item to release
+ * @param self_id physical thread id of caller
+ */
+void ThreadPool::freeWork(async_work_t *work, int self_id)
+{
+	if (work->thread_id < 0)
+	{
+		free(work);
+	}
+	else if (work->thread_id == self_id)
+	{
+		auto cache = &work_cache[self_id];
+		DIGGI_ASSERT(cache->count < WORK_ITEM_CACHE_SIZE);
+		cache->stack[cache->count++] = work;
+	}
+	else
+	{
+		DIGGI_ASSERT((size_t)work->thread_id < threads);
+		lf_send(work_cache[work->thread_id].returns, work, self_id);
+	}
+}
+/**
+ * @brief retrieve next task for physical thread.
+ * Pinned callbacks are served first, then unpinned callbacks queued on this thread.
+ * If both are empty and work stealing is enabled, siblings are probed in round robin order, starting with the next thread.
+ * Stealing claims only published slots (lf_try_recieve_batch), so no reservation is left on a siblings queue.
+ * @param self_id physical thread id of caller
+ * @return async_work_t* task or nullptr
+ */
+async_work_t *ThreadPool::nextTask(int self_id)
+{
+	auto task = (async_work_t *)lf_try_recieve(target_queue[self_id], self_id);
+	if (task != nullptr || !work_stealing)
+	{
+		return task;
+	}
+	void *item = nullptr;
+	if (lf_try_recieve_batch(steal_queue[self_id], &item, 1, self_id))
+	{
+		return (async_work_t *)item;
+	}
+	for (size_t i = 1; i < threads; i++)
+	{
+		auto victim = steal_queue[(self_id + i) % threads];
+		/*
+			Cheap emptiness check, avoids writing to idle siblings queue state
+		*/
+		if (victim->tail_ >= victim->head_)
+		{
+			continue;
+		}
+		if (lf_try_recieve_batch(victim, &item, 1, self_id))
+		{
+			thread_stats[self_id].steals++;
+			return (async_work_t *)item;
+		}
+	}
+	return nullptr;
+}
+/**
+ * @brief get current virtual thread id
+ * Virtual thread k (from 0) on physical thread t is identified as t + (k * physicalThreadCount()),
+ * callbacks nested through Yield() are offset by physicalThreadCount() * virtualThreadCount() per level.
  * @return size_t 
  */
 size_t ThreadPool::currentVThreadId()
 {
 	return __pthr_id;
 }
+/**
+ * @brief get count of virtual threads per physical thread
+ * 
+ * @return size_t 
+ */
+size_t ThreadPool::virtualThreadCount()
+{
+	return virtual_threads;
+}
 
 /**
  * @brief Method for cooperative yielding of physical thread, allowing other virtual threads to execute.
@@ -339,7 +1143,7 @@ void ThreadPool::Yield()
     // DIGGI_ASSERT (currentVThreadId() <= physicalThreadCount() * MAX_THREADS_NESTED);
 
     #ifdef TEST_DEBUG
-        if (currentVThreadId() >= physicalThreadCount() * MAX_THREADS_NESTED)
+        if (currentVThreadId() >= physicalThreadCount() * virtual_threads * MAX_THREADS_NESTED)
         {
             #ifdef DIGGI_ENCLAVE
                 __asm volatile("pause" ::
@@ -351,47 +1155,98 @@ void ThreadPool::Yield()
         }
     #endif
     volatile int self_id = currentThreadId();
-
-	async_work_t *volatile task = (async_work_t *)lf_try_recieve(target_queue[self_id], self_id);
+    /*
+        Callbacks executed here are nested on the stack of the yielding virtual thread, which cannot resume before they return.
+        Only nest if every virtual thread is blocked in Yield(), otherwise leave new work to the virtual threads still in their scheduler loop.
+    */
+	yielding_coroutines++;
+	async_work_t *volatile task = (yielding_coroutines >= (int)virtual_threads) ? nextTask(self_id) : nullptr;
     if (task != nullptr)
     {
-        DIGGI_ASSERT(task->label != nullptr);
-        DIGGI_ASSERT(task->cb != nullptr);
         // printf("schedule task=%p, pointer to loc=%p\n",task, &task);
-        __pthr_id += physicalThreadCount();
+        __pthr_id += physicalThreadCount() * virtual_threads;
 
-        task->cb(task->arg, task->status);
-        __pthr_id -= physicalThreadCount();
+        runTask(task, self_id);
+        __pthr_id -= physicalThreadCount() * virtual_threads;
 
         // printf("end schedule task=%p, pointer to loc=%p\n",task, &task);
-
-        free(task);
         /*workitem is responsible for deallocating argument resources*/
     }
 	volatile int self_vthread = currentVThreadId();
-	__pthr_id += physicalThreadCount();
+	__pthr_id += physicalThreadCount() * virtual_threads;
 	DIGGI_ASSERT(coroutine_id > 0);
 	volatile int cur_id = coroutine_id;
-	if(next_coroutine_id < MAX_COROUTINES - 1){
-			coroutine_id = 0;
-	}
-	else if (coroutine_id + 1 == MAX_COROUTINES)
-	{
-		coroutine_id = 1;
-	}
-	else
-	{
-		coroutine_id = (cur_id + 1) % (MAX_COROUTINES);
-	}
+	coroutine_id = nextCoroutine(self_id, cur_id);
 	#ifdef DIGGI_ENCLAVE
 	// printf("yield to coroutine=%d from current=%d ,physicalthread = %d\n", coroutine_id, cur_id, self_id);
 	#endif
-	coto(coroutine_bufs[self_id][cur_id].inner, coroutine_bufs[self_id][coroutine_id].inner, nullptr);
+	if (coroutine_id != cur_id)
+	{
+		coto(coroutine_bufs[self_id][cur_id].inner, coroutine_bufs[self_id][coroutine_id].inner, nullptr);
+	}
 	DIGGI_ASSERT(coroutine_id > 0);
 	#ifdef DIGGI_ENCLAVE
 	// printf("back from yield to coroutine=%d from current=%d ,physicalthread = %d\n", coroutine_id, cur_id, self_id);
 	#endif	
 	__pthr_id = self_vthread;
+	yielding_coroutines--;
+}
+/**
+ * @brief block current virtual thread until *wakeup is set, typically by another virtual thread releasing a lock or signaling a condition.
+ * The virtual thread is skipped by the round robin scheduler while parked, so waiters do not cost context switches.
+ * As in Yield(), once every virtual thread of the physical thread is blocked, new callbacks execute nested on the stack of the parked virtual thread.
+ * Threads not on pool spin instead.
+ * @param wakeup flag set to nonzero by waker, must remain valid until Park() returns
+ */
+void ThreadPool::Park(volatile int *wakeup)
+{
+	DIGGI_ASSERT(wakeup);
+	auto self_id = currentThreadId();
+	if (self_id < 0 || coroutine_id <= 0)
+	{
+		while (!*wakeup)
+		{
+			__asm volatile("pause" ::
+							   : "memory");
+		}
+		return;
+	}
+	while (!*wakeup)
+	{
+		/*
+			restored on every pass, as callbacks nested in Yield() may park this virtual thread on their own flag
+		*/
+		parked_on[self_id][coroutine_id] = wakeup;
+		Yield();
+	}
+	parked_on[self_id][coroutine_id] = nullptr;
+	__sync_synchronize();
+}
+/**
+ * @brief select next virtual thread to execute in round robin order.
+ * Virtual threads not yet started are started first, through the base context (0).
+ * Parked virtual threads are skipped until their wakeup flag is set, or the pool is stopping.
+ * @param self_id physical thread id of caller
+ * @param cur_id current virtual thread
+ * @return int next virtual thread, cur_id if all other virtual threads are parked
+ */
+int ThreadPool::nextCoroutine(int self_id, int cur_id)
+{
+	if (next_coroutine_id < (int)virtual_threads)
+	{
+		return 0;
+	}
+	int candidate = cur_id;
+	for (size_t i = 0; i < virtual_threads; i++)
+	{
+		candidate = (candidate == (int)virtual_threads) ? 1 : candidate + 1;
+		auto wakeup = parked_on[self_id][candidate];
+		if (wakeup == nullptr || *wakeup || stop)
+		{
+			return candidate;
+		}
+	}
+	return cur_id;
 }
 /**
  * @brief Initialize thread, used to capture threads into threadpool. 
@@ -446,17 +1301,26 @@ void ThreadPool::SchedulerLoop(void *ptr, int status)
 	__pthr_id = pool->currentThreadId();
 	volatile int self_id = pool->currentThreadId();
 	DIGGI_ASSERT(coroutine_id == -1);
-    ///begin virtual thread loops
-	while (++count < MAX_COROUTINES)
+#ifdef DIGGI_ENCLAVE
+	/*
+		carve stacks below this frame, leaving one stack of headroom for the base context
+	*/
+	char *volatile stacks = (char *)(((size_t)__builtin_frame_address(0) - ((pool->virtual_threads + 1) * pool->stack_size)) & ~(size_t)0xf);
+#else
+	char *volatile stacks = pool->coroutine_stacks[self_id];
+#endif
+    ///begin virtual thread loops, virtual thread k runs on the k-th stack from the top of the pool
+	while (++count <= (int)pool->virtual_threads)
 	{
 		coroutine_id = 0;
-		cogo(pool->coroutine_bufs[self_id][0].inner, ThreadPool::alignstack, ptr);
+		cogo(pool->coroutine_bufs[self_id][0].inner, ThreadPool::alignstack, ptr, stacks + ((pool->virtual_threads - count + 1) * pool->stack_size));
 		if(!pool->stop){
 			DIGGI_ASSERT(coroutine_id == 0);
 		}
 	}
 	coroutine_id = -1;
 	next_coroutine_id = 0;
+	yielding_coroutines = 0;
 	__sync_fetch_and_add(&pool->quit, 1);
 }
 /**
@@ -473,6 +1337,8 @@ void ThreadPool::alignstack(void * ptr){
 }
 /**
  * @brief internal loop executed by each physical thread.
+ * Each pass drains up to batch_size tasks, bounded by batch_budget_us, then checks timers and switches to the next virtual thread.
+ * Outside enclaves, the physical thread only yields its core between passes if cores are oversubscribed.
  * Virtual threads returning to this loop are done executing.
  * @param ptr this (ThreadPool pointer)
  */
@@ -490,43 +1356,62 @@ void ThreadPool::SchedulerLoopInternal(void *ptr)
 	while (!pool->stop)
 	{
 		DIGGI_ASSERT(coroutine_id > 0);
-		async_work_t *volatile task = (async_work_t *)lf_try_recieve(pool->target_queue[self_id], self_id);
-		if (task != nullptr)
+		/*
+			virtual thread identity, restored on every pass as other virtual threads may have changed it
+		*/
+		__pthr_id = self_id + ((coroutine_id - 1) * pool->threads);
+		async_work_t *volatile task = pool->nextTask(self_id);
+		volatile size_t drained = 0;
+		volatile uint64_t deadline = 0;
+		while (task != nullptr)
 		{
-			DIGGI_ASSERT(task->label != nullptr);
-			DIGGI_ASSERT(task->cb != nullptr);
 			// printf("schedule task=%p, pointer to loc=%p\n",task, &task);
-			task->cb(task->arg, task->status);
+			pool->runTask(task, self_id);
 			// printf("end schedule task=%p, pointer to loc=%p\n",task, &task);
-
-			free(task);
 			/*workitem is responsiblqe for deallocating argument resources*/
+			if (++drained >= pool->batch_size || pool->stop)
+			{
+				break;
+			}
+#ifndef DIGGI_ENCLAVE
+			if (pool->batch_budget_us > 0)
+			{
+				auto now = monotonicUsec();
+				if (deadline == 0)
+				{
+					deadline = now + pool->batch_budget_us;
+				}
+				else if (now >= deadline)
+				{
+					break;
+				}
+			}
+#endif
+			__pthr_id = self_id + ((coroutine_id - 1) * pool->threads);
+			task = pool->nextTask(self_id);
 		}
+		pool->runTimers(self_id, drained == 0);
         /*
             allow other untrusted threads to run
             important, in case we are overprovisioning threads.
         */
         #ifndef DIGGI_ENCLAVE
-            pthread_yield();
+            if (cores_oversubscribed())
+            {
+                pthread_yield();
+            }
         #endif
 
 		volatile int cur_id = coroutine_id;
-		if(next_coroutine_id < MAX_COROUTINES - 1){
-			coroutine_id = 0;
-		}
-		else if (coroutine_id + 1 == MAX_COROUTINES)
-		{
-			coroutine_id = 1;
-		}
-		else
-		{
-			coroutine_id = (cur_id + 1) % (MAX_COROUTINES);
-		}
+		coroutine_id = pool->nextCoroutine(self_id, cur_id);
 		DIGGI_ASSERT(coroutine_id >= 0);
 #ifdef		DIGGI_ENCLAVE
 		// printf("going to target=%d cur=%d,physicalthread = %d\n", coroutine_id, cur_id, self_id);
 		#endif
-		coto(pool->coroutine_bufs[self_id][cur_id].inner, pool->coroutine_bufs[self_id][coroutine_id].inner, nullptr);
+		if (coroutine_id != cur_id)
+		{
+			coto(pool->coroutine_bufs[self_id][cur_id].inner, pool->coroutine_bufs[self_id][coroutine_id].inner, nullptr);
+		}
 	#ifdef DIGGI_ENCLAVE
 		// printf("back from target=%d cur=%d,physicalthread = %d\n", coroutine_id, cur_id, self_id);
 #endif
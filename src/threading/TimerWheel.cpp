@@ -0,0 +1,247 @@
+/**
+ * @file TimerWheel.cpp
+ * @brief implementation of hierarchical timing wheel used by the threadpool to schedule delayed and periodic callbacks.
+ * Each physical thread owns one wheel, which is advanced from its scheduler loop.
+ * Timers are hashed into slots on their absolute deadline, and migrate towards level 0 as the wheel turns.
+ * @see ThreadPool::ScheduleAfter
+ * @version 0.1
+ *
+ */
+#include "threading/TimerWheel.h"
+
+/**
+ * @brief Construct a new Timer Wheel object
+ *
+ * @param now_tick current time, in ticks. Timers armed before now_tick expire on first advance.
+ */
+TimerWheel::TimerWheel(uint64_t now_tick) : ready(nullptr), current(now_tick), count(0)
+{
+	memset(slots, 0, sizeof(slots));
+}
+/**
+ * @brief Destroy the Timer Wheel object
+ * Releases all armed timers without invoking them.
+ */
+TimerWheel::~TimerWheel()
+{
+	for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		for (size_t idx = 0; idx < TIMER_WHEEL_SLOTS; idx++)
+		{
+			auto entry = slots[level][idx];
+			while (entry != nullptr)
+			{
+				auto next = entry->next;
+				free(entry);
+				entry = next;
+			}
+		}
+	}
+	while (ready != nullptr)
+	{
+		auto next = ready->next;
+		free(ready);
+		ready = next;
+	}
+	periodic.clear();
+}
+/**
+ * @brief hash timer into slot, based on distance to its deadline.
+ * Timers beyond the range of the top level are parked in the furthest top level slot, and placed again once it is cascaded.
+ * @param entry timer
+ */
+void TimerWheel::place(timer_entry_t *entry)
+{
+	if (entry->deadline < current)
+	{
+		entry->next = ready;
+		ready = entry;
+		return;
+	}
+	auto deadline = entry->deadline;
+	auto delta = deadline - current;
+	size_t level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+	{
+		level++;
+	}
+	if (delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)))
+	{
+		deadline = current + (1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1;
+	}
+	auto idx = (deadline >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+	entry->next = slots[level][idx];
+	slots[level][idx] = entry;
+}
+/**
+ * @brief move all timers in the current slot of a level to lower levels.
+ *
+ * @param level level to cascade, must be greater than 0
+ */
+void TimerWheel::cascade(size_t level)
+{
+	DIGGI_ASSERT(level > 0 && level < TIMER_WHEEL_LEVELS);
+	auto idx = (current >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+	auto entry = slots[level][idx];
+	slots[level][idx] = nullptr;
+	while (entry != nullptr)
+	{
+		auto next = entry->next;
+		place(entry);
+		entry = next;
+	}
+}
+/**
+ * @brief arm timer.
+ * Timers with a deadline before the current tick expire on the next advance.
+ * Wheel takes ownership of entry until it expires.
+ * @param entry timer, deadline must be set
+ */
+void TimerWheel::add(timer_entry_t *entry)
+{
+	DIGGI_ASSERT(entry);
+	DIGGI_ASSERT(entry->cb);
+	place(entry);
+	count++;
+}
+/**
+ * @brief turn wheel up to and including now_tick, collecting all timers which have expired.
+ * Timers expire in deadline order, timers sharing a tick expire in no particular order.
+ * Runs of empty level 0 slots are skipped, and the wheel jumps straight to now_tick if no timers are armed.
+ * Ownership of expired timers is returned to caller.
+ * @param now_tick current time, in ticks
+ * @return timer_entry_t* list of expired timers, linked through next
+ */
+timer_entry_t *TimerWheel::advance(uint64_t now_tick)
+{
+	timer_entry_t *head = nullptr;
+	timer_entry_t *tail = nullptr;
+	auto expire = [&](timer_entry_t *entry) {
+		while (entry != nullptr)
+		{
+			auto next = entry->next;
+			entry->next = nullptr;
+			if (tail == nullptr)
+			{
+				head = entry;
+			}
+			else
+			{
+				tail->next = entry;
+			}
+			tail = entry;
+			count--;
+			entry = next;
+		}
+	};
+	expire(ready);
+	ready = nullptr;
+	while (current <= now_tick)
+	{
+		if (count == 0)
+		{
+			current = now_tick + 1;
+			break;
+		}
+		auto idx = current & TIMER_WHEEL_SLOT_MASK;
+		if (idx == 0)
+		{
+			for (size_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+			{
+				cascade(level);
+				if (((current >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK) != 0)
+				{
+					break;
+				}
+			}
+		}
+		else if (slots[0][idx] == nullptr)
+		{
+			/*
+				skip to next armed slot or cascade point, whichever comes first
+			*/
+			while (idx < TIMER_WHEEL_SLOTS && slots[0][idx] == nullptr && current <= now_tick)
+			{
+				idx++;
+				current++;
+			}
+			continue;
+		}
+		auto entry = slots[0][idx];
+		slots[0][idx] = nullptr;
+		expire(entry);
+		current++;
+	}
+	return head;
+}
+/**
+ * @brief lower bound on the tick at which the next timer expires.
+ * Exact for timers on level 0, otherwise the next cascade point is returned.
+ * @return uint64_t tick, UINT64_MAX if no timers are armed
+ */
+uint64_t TimerWheel::nextExpiry()
+{
+	if (count == 0)
+	{
+		return UINT64_MAX;
+	}
+	if (ready != nullptr)
+	{
+		return current;
+	}
+	for (uint64_t tick = current; tick < current + TIMER_WHEEL_SLOTS; tick++)
+	{
+		auto idx = tick & TIMER_WHEEL_SLOT_MASK;
+		if ((idx == 0 && tick != current) || slots[0][idx] != nullptr)
+		{
+			return tick;
+		}
+	}
+	return current + TIMER_WHEEL_SLOTS;
+}
+/**
+ * @brief next tick to be processed by advance
+ *
+ * @return uint64_t
+ */
+uint64_t TimerWheel::currentTick()
+{
+	return current;
+}
+/**
+ * @brief count of armed timers, excluding timers returned by advance.
+ *
+ * @return size_t
+ */
+size_t TimerWheel::pending()
+{
+	return count;
+}
+/**
+ * @brief register periodic timer so it may be cancelled through its id.
+ * Registration lasts until the timer is cancelled.
+ * @param entry periodic timer with a nonzero id
+ */
+void TimerWheel::trackPeriodic(timer_entry_t *entry)
+{
+	DIGGI_ASSERT(entry->id != 0);
+	DIGGI_ASSERT(entry->period != 0);
+	periodic[entry->id] = entry;
+}
+/**
+ * @brief flag periodic timer as cancelled.
+ * Entry is released by its owner on the next expiry, instead of invoking the callback.
+ * @param id timer id
+ * @return true if timer was live
+ */
+bool TimerWheel::cancelPeriodic(uint64_t id)
+{
+	auto it = periodic.find(id);
+	if (it == periodic.end())
+	{
+		return false;
+	}
+	it->second->cancelled = 1;
+	periodic.erase(it);
+	return true;
+}
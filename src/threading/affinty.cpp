@@ -23,10 +23,37 @@ extern "C"
     static volatile size_t next_core = 0;
     /// next enclave core to assing
     static size_t next_enclave_core = 1;
+    /// live threads allocated through new_thread_with_affinity() and new_thread_with_affinity_enc()
+    static volatile size_t allocated_threads = 0;
+    /// cached core count
+    static size_t available_cores = 0;
     void reset_affinity()
     {
         next_core = 0;
         next_enclave_core = 1;
+        allocated_threads = 0;
+    }
+    /**
+     * @brief account for a thread allocated through this module exiting, after it is joined.
+     * 
+     */
+    void release_thread_affinity()
+    {
+        DIGGI_ASSERT(allocated_threads > 0);
+        __sync_fetch_and_sub(&allocated_threads, 1);
+    }
+    /**
+     * @brief check if more threads are allocated than there are cores, counting core 0 dedicated to the untrusted runtime.
+     * If so, spinning scheduler loops should relinquish their core to other threads between tasks.
+     * @return true if cores are oversubscribed
+     */
+    bool cores_oversubscribed()
+    {
+        if (available_cores == 0)
+        {
+            available_cores = std::thread::hardware_concurrency();
+        }
+        return (allocated_threads + 1) > available_cores;
     }
 
     /**
@@ -40,6 +67,7 @@ extern "C"
     {
 
         auto thrd = std::thread(cb, ptr, 1);
+        __sync_fetch_and_add(&allocated_threads, 1);
 
 #ifndef TEST_DEBUG /*test code does not need affinitization*/
         size_t num_cpus = std::thread::hardware_concurrency();
@@ -89,6 +117,7 @@ extern "C"
         // DIGGI_ASSERT(local_id <= num_cpus);
 
         auto thrd = new std::thread(cb, ptr, 1);
+        __sync_fetch_and_add(&allocated_threads, 1);
         cpu_set_t cpuset;
         CPU_ZERO(&cpuset);
         printf("setting secure thread to core%lu\n", local_id % num_cpus);
@@ -26,6 +26,41 @@ class MockLog : public ILog
 };
 static MockLog loginstance;
 
+/*
+    Heap allocation counter, used to verify that inbound delivery does not allocate.
+    Forwards to the glibc allocator, counting only while enabled.
+*/
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+static volatile bool count_allocations = false;
+static volatile size_t allocation_count = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    if (count_allocations)
+    {
+        allocation_count++;
+    }
+    return __libc_malloc(size);
+}
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+    if (count_allocations)
+    {
+        allocation_count++;
+    }
+    return __libc_calloc(nmemb, size);
+}
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (count_allocations)
+    {
+        allocation_count++;
+    }
+    return __libc_realloc(ptr, size);
+}
+
 class MockThreadPool : public IThreadPool
 {
     int rounds;
@@ -39,6 +74,14 @@ public:
     void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label)
     {
     }
+    void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label)
+    {
+    }
+    uint64_t SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label)
+    {
+        return 0;
+    }
+    void CancelPeriodic(uint64_t timer_id) {}
     size_t physicalThreadCount()
     {
         return 1;
@@ -51,6 +94,8 @@ public:
 
     void Yield() {}
 
+    void Park(volatile int *wakeup) {}
+
     void InitializeThread() {}
 
     // Inherited via IThreadPool
@@ -87,7 +132,7 @@ TEST(asyncmessagemanager, simple_source_sink_test)
     aid_t src;
     src.raw = 0;
     src.fields.lib = 2;
-    auto globuff = provision_memory_buffer(1, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(1);
     auto dapi = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, src, nullptr);
     auto amm = new AsyncMessageManager(dapi, input, output, std::vector<name_service_update_t>(), 0, globuff);
     auto str = new std::string("heyman");
@@ -98,7 +143,7 @@ TEST(asyncmessagemanager, simple_source_sink_test)
 
     amm->registerTypeCallback(test_recv_handler, REGULAR_MESSAGE, nullptr);
     amm->Start();
-    auto itm = lf_recieve(globuff, 0);
+    auto itm = msg_pool_alloc(globuff, str->size() + sizeof(msg_t), 0);
     auto msg = (msg_t *)itm;
     msg->type = REGULAR_MESSAGE;
     msg->id = 0;
@@ -124,13 +169,13 @@ TEST(asyncmessagemanager, simple_source_sink_test)
     EXPECT_TRUE(itm2 != nullptr);
     auto last_sent = (msg_t *)itm2;
     EXPECT_TRUE(last_sent->size == msg2->size);
-    lf_send(globuff, itm2, 0);
+    msg_pool_free(globuff, itm2, 0);
 
     EXPECT_TRUE(memcmp(last_sent->data, msg2->data, msg2->size - sizeof(msg_t)) == 0);
 
     lf_destroy(input);
     lf_destroy(output);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
     delete amm;
     delete mktp;
     delete str;
@@ -164,7 +209,7 @@ TEST(asyncmessagemanager, simple_continuation_source_sink)
     aid_t src;
     src.raw = 0;
     src.fields.lib = 2;
-    auto globuff = provision_memory_buffer(1, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(1);
     auto dapi = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, src, nullptr);
 
     auto amm = new AsyncMessageManager(dapi, input, output, std::vector<name_service_update_t>(), 0, globuff);
@@ -175,7 +220,7 @@ TEST(asyncmessagemanager, simple_continuation_source_sink)
     dest.fields.lib = 0;
 
     auto str = new std::string("heyman");
-    auto itm = lf_recieve(globuff, 0);
+    auto itm = msg_pool_alloc(globuff, str->size() + sizeof(msg_t), 0);
     auto msg = (msg_t *)itm;
     msg->type = REGULAR_MESSAGE;
     msg->id = 1234;
@@ -190,9 +235,9 @@ TEST(asyncmessagemanager, simple_continuation_source_sink)
     EXPECT_TRUE(msg->size == last_sent->size);
     EXPECT_TRUE(memcmp(last_sent->data, msg->data, msg->size - sizeof(msg_t)) == 0);
     EXPECT_TRUE(!sink_called);
-    auto itm3 = lf_recieve(globuff, 0);
+    auto itm3 = msg_pool_alloc(globuff, last_sent->size, 0);
     memcpy(itm3, last_sent, last_sent->size);
-    lf_send(globuff, last_sent, 0);
+    msg_pool_free(globuff, last_sent, 0);
 
     auto lastmsg = (msg_t *)itm3;
 
@@ -205,9 +250,689 @@ TEST(asyncmessagemanager, simple_continuation_source_sink)
     EXPECT_TRUE(sink_called);
     lf_destroy(input);
     lf_destroy(output);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
 
     delete amm;
     delete mktp;
     delete str;
-}
\ No newline at end of file
+}
+
+TEST(asyncmessagemanager, message_pool_size_classes)
+{
+    auto globuff = provision_message_pool(1);
+
+    auto small = msg_pool_alloc(globuff, sizeof(msg_t) + 16, 0);
+    auto medium = msg_pool_alloc(globuff, DIGGI_MEM_CLASS_0_SIZE + 1, 0);
+    auto large = msg_pool_alloc(globuff, MAX_DIGGI_MEM_SIZE, 0);
+
+    EXPECT_TRUE(msg_pool_object_size(globuff, small) == DIGGI_MEM_CLASS_0_SIZE);
+    EXPECT_TRUE(msg_pool_object_size(globuff, medium) == DIGGI_MEM_CLASS_1_SIZE);
+    EXPECT_TRUE(msg_pool_object_size(globuff, large) == MAX_DIGGI_MEM_SIZE);
+
+    msg_pool_free(globuff, small, 0);
+    msg_pool_free(globuff, medium, 0);
+    msg_pool_free(globuff, large, 0);
+
+    /*
+        Depleted class falls back to the next larger class
+    */
+    std::vector<void *> taken;
+    for (unsigned i = 0; i < DIGGI_MEM_CLASS_0_ITEMS; i++)
+    {
+        taken.push_back(msg_pool_alloc(globuff, DIGGI_MEM_CLASS_0_SIZE, 0));
+        EXPECT_TRUE(msg_pool_object_size(globuff, taken.back()) == DIGGI_MEM_CLASS_0_SIZE);
+    }
+    auto spill = msg_pool_alloc(globuff, DIGGI_MEM_CLASS_0_SIZE, 0);
+    EXPECT_TRUE(msg_pool_object_size(globuff, spill) == DIGGI_MEM_CLASS_1_SIZE);
+    msg_pool_free(globuff, spill, 0);
+    for (auto obj : taken)
+    {
+        msg_pool_free(globuff, obj, 0);
+    }
+    delete_message_pool(globuff);
+}
+
+TEST(asyncmessagemanager, flat_hash_map_churn)
+{
+    FlatHashMap<uint64_t> map;
+    std::map<uint64_t, uint64_t> reference;
+
+    EXPECT_TRUE(map.find(42) == nullptr);
+    EXPECT_TRUE(map.erase(42) == 0);
+    EXPECT_TRUE(map.size() == 0);
+
+    /*
+        Interleave inserts and erases of sequential flow ids, as seen by async_handler_map, forcing growth and backward shifts
+    */
+    for (uint64_t id = 1; id < 20000; id++)
+    {
+        map[id] = id * 3;
+        reference[id] = id * 3;
+        if (id % 3 == 0)
+        {
+            EXPECT_TRUE(map.erase(id - 2) == 1);
+            reference.erase(id - 2);
+        }
+    }
+    EXPECT_TRUE(map.size() == reference.size());
+    for (uint64_t id = 1; id < 20000; id++)
+    {
+        auto found = map.find(id);
+        auto it = reference.find(id);
+        if (it == reference.end())
+        {
+            EXPECT_TRUE(found == nullptr);
+        }
+        else
+        {
+            ASSERT_TRUE(found != nullptr);
+            EXPECT_TRUE(*found == it->second);
+        }
+    }
+    /*
+        operator[] inserts a value initialized entry on miss
+    */
+    EXPECT_TRUE(map[UINT64_MAX] == 0);
+    EXPECT_TRUE(map.size() == reference.size() + 1);
+    map.clear();
+    EXPECT_TRUE(map.size() == 0);
+    EXPECT_TRUE(map.find(2) == nullptr);
+}
+
+static size_t alloc_free_recv_count = 0;
+
+void alloc_free_recv_handler(void *ptr, int status)
+{
+    auto resp = (msg_async_response_t *)ptr;
+    EXPECT_TRUE(resp->msg->type == REGULAR_MESSAGE);
+    alloc_free_recv_count++;
+}
+
+TEST(asyncmessagemanager, inbound_delivery_allocation_free)
+{
+    auto mktp = new MockThreadPool(0);
+    auto input = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto output = lf_new(RING_BUFFER_SIZE, 1, 1);
+    aid_t src;
+    src.raw = 0;
+    src.fields.lib = 2;
+    auto globuff = provision_message_pool(1);
+    auto dapi = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, src, nullptr);
+    auto amm = new AsyncMessageManager(dapi, input, output, std::vector<name_service_update_t>(), 0, globuff);
+    amm->registerTypeCallback(alloc_free_recv_handler, REGULAR_MESSAGE, nullptr);
+    amm->Start();
+
+    aid_t dest;
+    dest.raw = 0;
+    dest.fields.lib = 1;
+    const size_t rounds = 100;
+    alloc_free_recv_count = 0;
+    /*
+        Warm up, so lazily initialized state is not counted
+    */
+    for (size_t i = 0; i < rounds + 1; i++)
+    {
+        auto msg = (msg_t *)msg_pool_alloc(globuff, sizeof(msg_t) + 8, 0);
+        msg->type = REGULAR_MESSAGE;
+        msg->id = 0;
+        msg->src = src;
+        msg->dest = dest;
+        msg->size = sizeof(msg_t) + 8;
+        lf_send(input, msg, 0);
+        if (i == 0)
+        {
+            AsyncMessageManager::async_message_pump(amm, 1);
+            allocation_count = 0;
+            count_allocations = true;
+        }
+    }
+    for (size_t i = 0; i < rounds / AMM_PUMP_BATCH_SIZE + 1; i++)
+    {
+        AsyncMessageManager::async_message_pump(amm, 1);
+    }
+    count_allocations = false;
+    EXPECT_TRUE(alloc_free_recv_count == rounds + 1);
+    EXPECT_TRUE(allocation_count == 0);
+
+    lf_destroy(input);
+    lf_destroy(output);
+    delete_message_pool(globuff);
+    delete amm;
+    delete dapi;
+    delete mktp;
+}
+
+class MockMultiThreadPool : public MockThreadPool
+{
+public:
+    MockMultiThreadPool() : MockThreadPool(0) {}
+    size_t physicalThreadCount()
+    {
+        return 4;
+    }
+};
+
+TEST(asyncmessagemanager, flow_hash_routing)
+{
+    auto mktp = new MockMultiThreadPool();
+    auto input = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto output = lf_new(RING_BUFFER_SIZE, 1, 1);
+    aid_t self;
+    self.raw = 0;
+    self.fields.lib = 2;
+    auto globuff = provision_message_pool(1);
+    auto dapi = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, self, nullptr);
+    auto amm = new AsyncMessageManager(dapi, input, output, std::vector<name_service_update_t>(), 0, globuff);
+    EXPECT_FALSE(amm->flow_routing);
+
+    /*
+        Remote lanes map consistently, and are spread over all local threads
+    */
+    size_t hits[4] = {0};
+    for (uint8_t lib = 1; lib < 17; lib++)
+    {
+        for (uint8_t thread = 0; thread < 4; thread++)
+        {
+            aid_t src;
+            src.raw = 0;
+            src.fields.lib = lib;
+            src.fields.thread = thread;
+            auto target = AsyncMessageManager::flowHashThread(src, 4);
+            EXPECT_TRUE(target < 4);
+            EXPECT_TRUE(target == AsyncMessageManager::flowHashThread(src, 4));
+            hits[target]++;
+        }
+    }
+    for (size_t i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(hits[i] > 0);
+    }
+
+    aid_t client;
+    client.raw = 0;
+    client.fields.lib = 1;
+    client.fields.thread = 3;
+    msg_t msg;
+    memset(&msg, 0, sizeof(msg_t));
+    msg.src = client;
+    msg.dest = self;
+    msg.dest.fields.thread = 3;
+
+    /*
+        Without flow routing, messages are delivered to their lane
+    */
+    EXPECT_TRUE(amm->inboundThread(&msg) == 3);
+
+    amm->flow_routing = true;
+    auto local_id = amm->getMessageId(self.raw);
+    EXPECT_TRUE(AsyncMessageManager::isLocalFlow(local_id, self));
+    aid_t client_flow_owner = client;
+    client_flow_owner.fields.thread = 0;
+    auto remote_id = (client_flow_owner.raw << 32) | 7;
+    EXPECT_FALSE(AsyncMessageManager::isLocalFlow(remote_id, self));
+    EXPECT_FALSE(AsyncMessageManager::isLocalFlow(0, self));
+
+    /*
+        Typed and remotely initiated flows are hashed on their source lane
+    */
+    msg.id = 0;
+    EXPECT_TRUE(amm->inboundThread(&msg) == AsyncMessageManager::flowHashThread(client, 4));
+    msg.id = remote_id;
+    EXPECT_TRUE(amm->inboundThread(&msg) == AsyncMessageManager::flowHashThread(client, 4));
+
+    /*
+        Continuations of local flows are pinned to the owning thread
+    */
+    msg.id = local_id;
+    msg.dest.fields.thread = 2;
+    EXPECT_TRUE(amm->inboundThread(&msg) == 2);
+
+    /*
+        Responses to remote flows keep the remote lane, local flows use the current thread
+    */
+    msg_t resp;
+    memset(&resp, 0, sizeof(msg_t));
+    resp.src = self;
+    resp.dest = client;
+    resp.id = remote_id;
+    EXPECT_TRUE(amm->outboundLane(&resp) == 3);
+    resp.id = local_id;
+    EXPECT_TRUE(amm->outboundLane(&resp) == 0);
+
+    lf_destroy(input);
+    lf_destroy(output);
+    delete_message_pool(globuff);
+    delete amm;
+    delete dapi;
+    delete mktp;
+}
+
+static std::vector<uint64_t> coalesced_recv;
+
+void coalesced_recv_handler(void *ptr, int status)
+{
+    auto resp = (msg_async_response_t *)ptr;
+    EXPECT_TRUE(resp->msg->type == REGULAR_MESSAGE);
+    coalesced_recv.push_back(*(uint64_t *)resp->msg->data);
+}
+
+TEST(asyncmessagemanager, coalesced_small_messages)
+{
+    auto mktp = new MockThreadPool(0);
+    auto link = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto unused_input = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto unused_output = lf_new(RING_BUFFER_SIZE, 1, 1);
+    aid_t src;
+    src.raw = 0;
+    src.fields.lib = 2;
+    aid_t dest;
+    dest.raw = 0;
+    dest.fields.lib = 1;
+    auto globuff = provision_message_pool(1);
+    auto sender_api = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, src, nullptr);
+    auto reciever_api = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, dest, nullptr);
+    auto sender = new AsyncMessageManager(sender_api, unused_input, link, std::vector<name_service_update_t>(), 0, globuff);
+    auto reciever = new AsyncMessageManager(reciever_api, link, unused_output, std::vector<name_service_update_t>(), 0, globuff);
+    sender->coalescing = true;
+    reciever->registerTypeCallback(coalesced_recv_handler, REGULAR_MESSAGE, nullptr);
+    reciever->Start();
+
+    auto send = [&](uint64_t seq, size_t payload) {
+        auto msg = sender->allocateMessage(src, dest, payload, REGULAR);
+        msg->type = REGULAR_MESSAGE;
+        msg->delivery = CLEARTEXT;
+        memcpy(msg->data, &seq, sizeof(uint64_t));
+        sender->sendMessage(msg);
+    };
+    /*
+        Small messages are held until flushed, then sent packed into containers.
+        More messages than fit a single container are sent, so a full container is flushed early.
+    */
+    const uint64_t small_count = 40;
+    for (uint64_t i = 0; i < small_count; i++)
+    {
+        send(i, 16 + (i % 5));
+    }
+    auto early = (msg_t *)lf_try_recieve(link, 0);
+    ASSERT_TRUE(early != nullptr);
+    EXPECT_TRUE(early->type == DIGGI_COALESCED_MESSAGE_TYPE);
+    EXPECT_TRUE(early->size <= AMM_COALESCE_CONTAINER_SIZE);
+    EXPECT_TRUE(lf_try_recieve(link, 0) == nullptr);
+    AsyncMessageManager::coalesce_flush_cb(sender, 1);
+    auto rest = (msg_t *)lf_try_recieve(link, 0);
+    ASSERT_TRUE(rest != nullptr);
+    EXPECT_TRUE(rest->type == DIGGI_COALESCED_MESSAGE_TYPE);
+    EXPECT_TRUE(lf_try_recieve(link, 0) == nullptr);
+    lf_send(link, early, 0);
+    lf_send(link, rest, 0);
+
+    /*
+        Large messages flush pending messages first, preserving order.
+        A lone pending message is sent without a container.
+    */
+    send(small_count, 16);
+    send(small_count + 1, DIGGI_MEM_CLASS_0_SIZE);
+    send(small_count + 2, 16);
+    AsyncMessageManager::coalesce_flush_cb(sender, 1);
+
+    coalesced_recv.clear();
+    for (size_t i = 0; i < 4; i++)
+    {
+        AsyncMessageManager::async_message_pump(reciever, 1);
+    }
+    ASSERT_TRUE(coalesced_recv.size() == small_count + 3);
+    for (uint64_t i = 0; i < small_count + 3; i++)
+    {
+        EXPECT_TRUE(coalesced_recv[i] == i);
+    }
+
+    lf_destroy(link);
+    lf_destroy(unused_input);
+    lf_destroy(unused_output);
+    delete sender;
+    delete reciever;
+    delete_message_pool(globuff);
+    delete sender_api;
+    delete reciever_api;
+    delete mktp;
+}
+
+TEST(asyncmessagemanager, credit_backpressure)
+{
+    auto mktp = new MockThreadPool(0);
+    auto input = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto link = lf_new(16, 1, 1);
+    aid_t src;
+    src.raw = 0;
+    src.fields.lib = 2;
+    aid_t dest;
+    dest.raw = 0;
+    dest.fields.lib = 1;
+    auto globuff = provision_message_pool(1);
+    auto dapi = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, src, nullptr);
+    auto amm = new AsyncMessageManager(dapi, input, link, std::vector<name_service_update_t>(), 0, globuff);
+
+    auto make = [&](uint64_t seq) {
+        auto msg = amm->allocateMessage(src, dest, sizeof(uint64_t), REGULAR);
+        msg->type = REGULAR_MESSAGE;
+        msg->id = 0;
+        memcpy(msg->data, &seq, sizeof(uint64_t));
+        return msg;
+    };
+    EXPECT_TRUE(amm->peerCredits(dest) == 16);
+
+    /*
+        Sends beyond destination capacity are parked instead of blocking the sender
+    */
+    for (uint64_t i = 0; i < 20; i++)
+    {
+        amm->sendMessage(make(i));
+    }
+    EXPECT_TRUE(amm->peerCredits(dest) == 0);
+    auto peer = amm->peerCredit(dest);
+    EXPECT_TRUE(peer->sent == 16);
+    EXPECT_TRUE(peer->stalls == 4);
+    EXPECT_TRUE(peer->backlog == 4);
+    EXPECT_TRUE(amm->creditStatsCsv().find(",0,16,4,4,4\n") != std::string::npos);
+
+    /*
+        Non-blocking send reports would block, and leaves ownership with the caller
+    */
+    auto refused = make(100);
+    EXPECT_FALSE(amm->trySendMessage(refused));
+    msg_pool_free(globuff, refused, 0);
+
+    /*
+        Credit returns as the reciever drains, parked messages are sent in order
+    */
+    std::vector<uint64_t> recieved;
+    for (size_t i = 0; i < 8; i++)
+    {
+        auto msg = (msg_t *)lf_try_recieve(link, 0);
+        ASSERT_TRUE(msg != nullptr);
+        recieved.push_back(*(uint64_t *)msg->data);
+        msg_pool_free(globuff, msg, 0);
+    }
+    AsyncMessageManager::backpressure_retry_cb(amm, 1);
+    peer = amm->peerCredit(dest);
+    EXPECT_TRUE(peer->backlog == 0);
+    EXPECT_TRUE(peer->sent == 20);
+    EXPECT_TRUE(amm->peerCredits(dest) == 4);
+    EXPECT_TRUE(amm->trySendMessage(make(20)));
+    msg_t *msg = nullptr;
+    while ((msg = (msg_t *)lf_try_recieve(link, 0)) != nullptr)
+    {
+        recieved.push_back(*(uint64_t *)msg->data);
+        msg_pool_free(globuff, msg, 0);
+    }
+    ASSERT_TRUE(recieved.size() == 21);
+    for (uint64_t i = 0; i < 21; i++)
+    {
+        EXPECT_TRUE(recieved[i] == i);
+    }
+
+    lf_destroy(input);
+    lf_destroy(link);
+    delete amm;
+    delete_message_pool(globuff);
+    delete dapi;
+    delete mktp;
+}
+
+class MockTimerThreadPool : public MockThreadPool
+{
+public:
+    std::vector<std::pair<async_cb_t, void *>> timers;
+    MockTimerThreadPool() : MockThreadPool(0) {}
+    void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label)
+    {
+        timers.push_back(std::make_pair(cb, args));
+    }
+    void expireAll()
+    {
+        auto expired = timers;
+        timers.clear();
+        for (auto timer : expired)
+        {
+            timer.first(timer.second, 1);
+        }
+    }
+};
+
+static std::vector<int> flow_statuses;
+static size_t late_replies = 0;
+static size_t typed_after_timeout = 0;
+
+void flow_status_handler(void *ptr, int status)
+{
+    auto resp = (msg_async_response_t *)ptr;
+    EXPECT_TRUE(resp->context == &flow_statuses);
+    EXPECT_TRUE((status == 1) == (resp->msg != nullptr));
+    flow_statuses.push_back(status);
+}
+
+TEST(asyncmessagemanager, flow_timeout_and_cancel)
+{
+    auto mktp = new MockTimerThreadPool();
+    auto input = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto output = lf_new(RING_BUFFER_SIZE, 1, 1);
+    aid_t src;
+    src.raw = 0;
+    src.fields.lib = 2;
+    aid_t dest;
+    dest.raw = 0;
+    dest.fields.lib = 1;
+    aid_t other;
+    other.raw = 0;
+    other.fields.lib = 3;
+    auto globuff = provision_message_pool(1);
+    auto dapi = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, src, nullptr);
+    auto amm = new AsyncMessageManager(dapi, input, output, std::vector<name_service_update_t>(), 0, globuff);
+    amm->registerTypeCallback([](void *ptr, int status) { typed_after_timeout++; }, REGULAR_MESSAGE, nullptr);
+    amm->registerLateReplyCallback([](void *ptr, int status) { late_replies++; }, nullptr);
+
+    auto send = [&](aid_t to, uint64_t timeout_us) {
+        auto msg = amm->allocateMessage(src, to, sizeof(uint64_t), CALLBACK);
+        msg->type = REGULAR_MESSAGE;
+        msg->id = 0;
+        amm->sendMessageAsync(msg, flow_status_handler, &flow_statuses, timeout_us);
+    };
+    auto reply = [&]() {
+        auto sent = (msg_t *)lf_try_recieve(output, 0);
+        ASSERT_TRUE(sent != nullptr);
+        auto tmp = sent->src;
+        sent->src = sent->dest;
+        sent->dest = tmp;
+        lf_send(input, sent, 0);
+        AsyncMessageManager::async_message_pump(amm, 1);
+    };
+
+    /*
+        No reply before the deadline, callback is released without a message
+    */
+    flow_statuses.clear();
+    send(dest, 100);
+    ASSERT_TRUE(mktp->timers.size() == 1);
+    mktp->expireAll();
+    ASSERT_TRUE(flow_statuses.size() == 1);
+    EXPECT_TRUE(flow_statuses[0] == AMM_FLOW_TIMEOUT);
+    EXPECT_TRUE(amm->async_handler_map.size() == 0);
+
+    /*
+        Late reply is dropped, not mistaken for a typed message
+    */
+    reply();
+    EXPECT_TRUE(late_replies == 1);
+    EXPECT_TRUE(typed_after_timeout == 0);
+    EXPECT_TRUE(flow_statuses.size() == 1);
+
+    /*
+        Reply before the deadline disarms it
+    */
+    send(dest, 100);
+    reply();
+    ASSERT_TRUE(flow_statuses.size() == 2);
+    EXPECT_TRUE(flow_statuses[1] == 1);
+    mktp->expireAll();
+    EXPECT_TRUE(flow_statuses.size() == 2);
+    amm->async_handler_map.clear();
+
+    /*
+        Late reply to a flow which expired before more than the remembered history of other flows
+    */
+    flow_statuses.clear();
+    send(dest, 100);
+    auto held = (msg_t *)lf_try_recieve(output, 0);
+    ASSERT_TRUE(held != nullptr);
+    for (size_t i = 0; i < AMM_EXPIRED_FLOW_HISTORY + 10; i++)
+    {
+        send(dest, 100);
+        msg_pool_free(globuff, (msg_t *)lf_try_recieve(output, 0), 0);
+    }
+    mktp->expireAll();
+    EXPECT_TRUE(flow_statuses.size() == AMM_EXPIRED_FLOW_HISTORY + 11);
+    EXPECT_TRUE(amm->expired_flow_set.find(held->id) == nullptr);
+    auto tmp = held->src;
+    held->src = held->dest;
+    held->dest = tmp;
+    lf_send(input, held, 0);
+    AsyncMessageManager::async_message_pump(amm, 1);
+    EXPECT_TRUE(late_replies == 2);
+    EXPECT_TRUE(typed_after_timeout == 0);
+
+    /*
+        Bulk cancellation, per destination and for all flows
+    */
+    flow_statuses.clear();
+    send(dest, 0);
+    send(dest, 0);
+    send(other, 0);
+    EXPECT_TRUE(amm->cancelFlows(dest) == 2);
+    ASSERT_TRUE(flow_statuses.size() == 2);
+    EXPECT_TRUE(flow_statuses[0] == AMM_FLOW_CANCELLED && flow_statuses[1] == AMM_FLOW_CANCELLED);
+    EXPECT_TRUE(amm->cancelFlows() == 1);
+    EXPECT_TRUE(flow_statuses.size() == 3);
+    EXPECT_TRUE(amm->async_handler_map.size() == 0);
+    msg_t *msg = nullptr;
+    while ((msg = (msg_t *)lf_try_recieve(output, 0)) != nullptr)
+    {
+        msg_pool_free(globuff, msg, 0);
+    }
+
+    lf_destroy(input);
+    lf_destroy(output);
+    delete amm;
+    delete_message_pool(globuff);
+    delete dapi;
+    delete mktp;
+}
+
+class MockSchedulingThreadPool : public MockThreadPool
+{
+public:
+    std::vector<std::pair<async_cb_t, void *>> scheduled;
+    MockSchedulingThreadPool() : MockThreadPool(0) {}
+    void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label)
+    {
+        EXPECT_TRUE(id == 0);
+        scheduled.push_back(std::make_pair(cb, args));
+    }
+    void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label)
+    {
+        scheduled.push_back(std::make_pair(cb, args));
+    }
+    void runAll()
+    {
+        auto tasks = scheduled;
+        scheduled.clear();
+        for (auto task : tasks)
+        {
+            task.first(task.second, 1);
+        }
+    }
+};
+
+static std::vector<uint64_t> pending_delivered;
+
+TEST(asyncmessagemanager, pending_type_delivered_on_register)
+{
+    auto mktp = new MockSchedulingThreadPool();
+    auto input = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto output = lf_new(RING_BUFFER_SIZE, 1, 1);
+    aid_t self;
+    self.raw = 0;
+    self.fields.lib = 1;
+    aid_t peer;
+    peer.raw = 0;
+    peer.fields.lib = 2;
+    auto globuff = provision_message_pool(1);
+    auto dapi = new DiggiAPI(mktp, nullptr, nullptr, nullptr, nullptr, &loginstance, self, nullptr);
+    auto amm = new AsyncMessageManager(dapi, input, output, std::vector<name_service_update_t>(), 0, globuff);
+
+    auto recieve = [&](uint64_t value) {
+        auto msg = amm->allocateMessage(peer, self, sizeof(uint64_t), REGULAR);
+        msg->type = REGULAR_MESSAGE;
+        msg->id = 0;
+        memcpy(msg->data, &value, sizeof(uint64_t));
+        lf_send(input, msg, 0);
+        AsyncMessageManager::async_message_pump(amm, 1);
+    };
+    /*
+        tasks other than the message pump rescheduling itself
+    */
+    auto tasks = [&]() {
+        size_t count = 0;
+        for (auto task : mktp->scheduled)
+        {
+            count += (task.first != AsyncMessageManager::async_message_pump);
+        }
+        return count;
+    };
+
+    /*
+        Messages arriving before registration are parked, without any retries scheduled
+    */
+    pending_delivered.clear();
+    recieve(1);
+    recieve(2);
+    recieve(3);
+    EXPECT_TRUE(tasks() == 0);
+    ASSERT_TRUE(amm->pending_types.find(REGULAR_MESSAGE) != nullptr);
+    EXPECT_TRUE(amm->pending_types.find(REGULAR_MESSAGE)->count == 3);
+
+    /*
+        Registration schedules a single delivery, messages recieved in the interim queue behind the parked ones
+    */
+    amm->registerTypeCallback([](void *ptr, int status) {
+        auto resp = (msg_async_response_t *)ptr;
+        EXPECT_TRUE(resp->context == &pending_delivered);
+        pending_delivered.push_back(*(uint64_t *)resp->msg->data);
+    },
+                              REGULAR_MESSAGE, &pending_delivered);
+    EXPECT_TRUE(tasks() == 1);
+    EXPECT_TRUE(pending_delivered.size() == 0);
+    recieve(4);
+    EXPECT_TRUE(tasks() == 1);
+    EXPECT_TRUE(pending_delivered.size() == 0);
+    mktp->runAll();
+    ASSERT_TRUE(pending_delivered.size() == 4);
+    for (uint64_t i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(pending_delivered[i] == i + 1);
+    }
+    EXPECT_TRUE(amm->pending_types.size() == 0);
+
+    /*
+        Once flushed, messages are delivered directly
+    */
+    recieve(5);
+    EXPECT_TRUE(pending_delivered.size() == 5);
+    EXPECT_TRUE(tasks() == 0);
+
+    lf_destroy(input);
+    lf_destroy(output);
+    delete amm;
+    delete_message_pool(globuff);
+    delete dapi;
+    delete mktp;
+}
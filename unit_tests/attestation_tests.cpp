@@ -103,7 +103,7 @@ TEST(attestation_tests, no_attest)
     cli.fields.lib = 2;
     cli.fields.type = LIB;
     cli.fields.att_group = 1;
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     mlog1->SetFuncId(serv, "trusted_root_func");
     mlog2->SetFuncId(cli, "client_func");
     mlog1->SetLogLevel(LRELEASE);
@@ -201,7 +201,7 @@ TEST(attestation_tests, no_attest)
 
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
     delete mlog1;
     delete mlog2;
 }
\ No newline at end of file
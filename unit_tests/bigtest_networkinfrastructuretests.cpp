@@ -301,7 +301,7 @@ TEST(bigtest_networkinfrastructure, DISABLED_singlethread_ssl)
     mlog_srv->SetLogLevel(LRELEASE);
     auto in_b = lf_new(RING_BUFFER_SIZE, 2, 2);
     auto out_b = lf_new(RING_BUFFER_SIZE, 2, 2);
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     DiggiAPI *acontext_man = new DiggiAPI(threadpool_man, nullptr, nullptr, nullptr, nullptr, mlog_man, cli, nullptr);
     DiggiAPI *acontext_srv = new DiggiAPI(threadpool_srv, nullptr, nullptr, nullptr, nullptr, mlog_srv, serv, nullptr);
     auto amm_srv = new AsyncMessageManager(acontext_srv, in_b, out_b, std::vector<name_service_update_t>(), 0, globuff);
@@ -369,7 +369,7 @@ TEST(bigtest_networkinfrastructure, DISABLED_singlethread_ssl)
 
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
 
     delete nsl;
     delete mlog_man;
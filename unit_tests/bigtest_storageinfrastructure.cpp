@@ -141,7 +141,7 @@ TEST(bigtest_storageinfrastructure, DISABLED_filestream_stubs)
     mlog2->SetLogLevel(LRELEASE);
     auto in_b = lf_new(RING_BUFFER_SIZE, 2, 2);
     auto out_b = lf_new(RING_BUFFER_SIZE, 2, 2);
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     auto acontext1 = new DiggiAPI(threadpool1, nullptr, nullptr, nullptr, nullptr, mlog1, serv, nullptr);
     auto acontext2 = new DiggiAPI(threadpool2, nullptr, nullptr, nullptr, nullptr, mlog2, cli, nullptr);
     auto amm1 = new AsyncMessageManager(acontext1, in_b, out_b, std::vector<name_service_update_t>(), 0, globuff);
@@ -216,7 +216,7 @@ TEST(bigtest_storageinfrastructure, DISABLED_filestream_stubs)
     delete acontext2;
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
 
     delete nsl;
     delete mlog1;
@@ -246,7 +246,7 @@ TEST(bigtest_storageinfrastructure, syscall_stubs)
     mlog2->SetLogLevel(LRELEASE);
     auto in_b = lf_new(RING_BUFFER_SIZE, 2, 2);
     auto out_b = lf_new(RING_BUFFER_SIZE, 2, 2);
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     auto acontext1 = new DiggiAPI(
         threadpool1,
         nullptr,
@@ -343,7 +343,7 @@ TEST(bigtest_storageinfrastructure, syscall_stubs)
     delete acontext2;
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
 
     delete nsl;
     delete mlog1;
@@ -374,7 +374,7 @@ TEST(bigtest_storageinfrastructure, syscall_stubs_inmem)
     mlog2->SetLogLevel(LRELEASE);
     auto in_b = lf_new(RING_BUFFER_SIZE, 2, 2);
     auto out_b = lf_new(RING_BUFFER_SIZE, 2, 2);
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     auto acontext1 = new DiggiAPI(
         threadpool1,
         nullptr,
@@ -475,7 +475,7 @@ TEST(bigtest_storageinfrastructure, syscall_stubs_inmem)
     delete acontext2;
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
 
     delete nsl;
     delete mlog1;
@@ -550,7 +550,7 @@ TEST(bigtest_storageinfrastructure, sqlite_in_memory)
     mlog2->SetFuncId(cli, "storage_manager");
     mlog1->SetLogLevel(LRELEASE);
     mlog2->SetLogLevel(LRELEASE);
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
 
     auto acontext1 = new DiggiAPI(
         threadpool1,
@@ -667,7 +667,7 @@ TEST(bigtest_storageinfrastructure, sqlite_in_memory)
 
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
     delete mlog1;
     delete mlog2;
     pthread_stubs_unset_thread_manager();
@@ -695,7 +695,7 @@ TEST(bigtest_storageinfrastructure, sqlite_port)
     cli.raw = 0;
     cli.fields.lib = 2;
     cli.fields.type = LIB;
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     mlog1->SetFuncId(serv, "storage_server");
     mlog2->SetFuncId(cli, "storage_manager");
     mlog1->SetLogLevel(LRELEASE);
@@ -809,7 +809,7 @@ TEST(bigtest_storageinfrastructure, sqlite_port)
 
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
     delete mlog1;
     delete mlog2;
 
@@ -845,7 +845,7 @@ TEST(bigtest_storageinfrastructure, sqlite_port_nocrypt)
 
     auto in_b = lf_new(RING_BUFFER_SIZE, 2, 2);
     auto out_b = lf_new(RING_BUFFER_SIZE, 2, 2);
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     auto acontext1 = new DiggiAPI(
         threadpool1,
         nullptr,
@@ -964,7 +964,7 @@ TEST(bigtest_storageinfrastructure, sqlite_port_nocrypt)
     delete crypto;
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
 
     delete mlog1;
     delete mlog2;
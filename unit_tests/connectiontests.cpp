@@ -20,6 +20,18 @@ public:
     void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label)
     {
     }
+    void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label)
+    {
+        if (rounds-- > 0)
+        {
+            cb(args, 1);
+        }
+    }
+    uint64_t SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label)
+    {
+        return 0;
+    }
+    void CancelPeriodic(uint64_t timer_id) {}
     size_t physicalThreadCount()
     {
         return 1;
@@ -32,6 +44,8 @@ public:
     void SchedulerLoop() {}
     void Yield() {}
 
+    void Park(volatile int *wakeup) {}
+
     void InitializeThread() {}
 
     // Inherited via IThreadPool
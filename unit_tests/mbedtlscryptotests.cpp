@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "messaging/MbedtlsCrypto.h"
+
+/*
+    Test case 3 of the GCM specification, AES-128 without additional data
+*/
+static const uint8_t gcm_key[16] = {
+    0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08};
+static const uint8_t gcm_iv[12] = {
+    0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88};
+static const uint8_t gcm_plaintext[64] = {
+    0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+    0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+    0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+    0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55};
+static const uint8_t gcm_ciphertext[64] = {
+    0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+    0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+    0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+    0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91, 0x47, 0x3f, 0x59, 0x85};
+static const uint8_t gcm_tag[16] = {
+    0x4d, 0x5c, 0x2a, 0xf3, 0x27, 0xcd, 0x64, 0xa6, 0x2c, 0xf3, 0x5a, 0xbd, 0x2b, 0xa6, 0xfa, 0xb4};
+
+TEST(mbedtlscrypto, gcm_test_vector_in_place)
+{
+    MbedtlsCryptoImpl crypto;
+    sgx_aes_gcm_128bit_key_t key;
+    memcpy(key, gcm_key, sizeof(key));
+    uint8_t buf[64];
+    sgx_aes_gcm_128bit_tag_t tag;
+    EXPECT_TRUE(crypto.encrypt(&key, gcm_plaintext, sizeof(buf), buf, gcm_iv, sizeof(gcm_iv), NULL, 0, &tag) == SGX_SUCCESS);
+    EXPECT_TRUE(memcmp(buf, gcm_ciphertext, sizeof(buf)) == 0);
+    EXPECT_TRUE(memcmp(tag, gcm_tag, sizeof(tag)) == 0);
+
+    /*
+        decryption in place, as done for inbound messages
+    */
+    EXPECT_TRUE(crypto.decrypt(&key, buf, sizeof(buf), buf, gcm_iv, sizeof(gcm_iv), NULL, 0, &tag) == SGX_SUCCESS);
+    EXPECT_TRUE(memcmp(buf, gcm_plaintext, sizeof(buf)) == 0);
+
+    /*
+        tampered ciphertext is rejected
+    */
+    memcpy(buf, gcm_ciphertext, sizeof(buf));
+    buf[10] ^= 1;
+    EXPECT_TRUE(crypto.decrypt(&key, buf, sizeof(buf), buf, gcm_iv, sizeof(gcm_iv), NULL, 0, &tag) == SGX_ERROR_MAC_MISMATCH);
+}
+
+TEST(mbedtlscrypto, batch_matches_single_and_key_cache_eviction)
+{
+    MbedtlsCryptoImpl crypto;
+    const size_t count = 5;
+    const size_t size = 1000;
+    std::vector<uint8_t> plaintext(count * size);
+    for (size_t i = 0; i < plaintext.size(); i++)
+    {
+        plaintext[i] = (uint8_t)(i * 13);
+    }
+    std::vector<uint8_t> batch_out(count * size);
+    std::vector<uint8_t> single_out(count * size);
+    sgx_aes_gcm_128bit_tag_t batch_tags[count];
+    sgx_aes_gcm_128bit_tag_t single_tags[count];
+    uint8_t ivs[count][12];
+    memset(ivs, 0, sizeof(ivs));
+    crypto_batch_item_t items[count];
+
+    /*
+        more keys than cache slots, so earlier keys are evicted and expanded again
+    */
+    for (size_t k = 0; k < MBEDTLS_CRYPTO_KEY_SLOTS * 2; k++)
+    {
+        sgx_aes_gcm_128bit_key_t key;
+        memset(key, (int)k, sizeof(key));
+        for (size_t i = 0; i < count; i++)
+        {
+            ivs[i][0] = (uint8_t)i;
+            items[i].p_src = plaintext.data() + i * size;
+            items[i].src_len = size;
+            items[i].p_dst = batch_out.data() + i * size;
+            items[i].p_iv = ivs[i];
+            items[i].iv_len = sizeof(ivs[i]);
+            items[i].p_out_mac = &batch_tags[i];
+        }
+        ASSERT_TRUE(crypto.encryptBatch(&key, items, count) == SGX_SUCCESS);
+        for (size_t i = 0; i < count; i++)
+        {
+            ASSERT_TRUE(crypto.encrypt(&key, plaintext.data() + i * size, size, single_out.data() + i * size, ivs[i], sizeof(ivs[i]), NULL, 0, &single_tags[i]) == SGX_SUCCESS);
+            EXPECT_TRUE(memcmp(batch_tags[i], single_tags[i], sizeof(sgx_aes_gcm_128bit_tag_t)) == 0);
+        }
+        EXPECT_TRUE(batch_out == single_out);
+        EXPECT_TRUE(memcmp(batch_out.data(), plaintext.data(), size) != 0);
+    }
+}
+
+TEST(mbedtlscrypto, batch_interleaved_mixed_sizes)
+{
+    MbedtlsCryptoImpl crypto;
+    sgx_aes_gcm_128bit_key_t key;
+    memcpy(key, gcm_key, sizeof(key));
+
+    /*
+        more items than lanes, sizes around block boundaries, a nonce that is not 96 bits and an item encrypted in place
+    */
+    const size_t sizes[] = {0, 1, 15, 16, 17, 64, 200, 4096, 33, 128, 1, 70000};
+    const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+    std::vector<std::vector<uint8_t>> plaintext(count), batch_out(count);
+    uint8_t ivs[count][16];
+    sgx_aes_gcm_128bit_tag_t batch_tags[count];
+    crypto_batch_item_t items[count];
+    for (size_t i = 0; i < count; i++)
+    {
+        plaintext[i].resize(sizes[i]);
+        for (size_t j = 0; j < sizes[i]; j++)
+        {
+            plaintext[i][j] = (uint8_t)(i * 31 + j * 7);
+        }
+        batch_out[i] = (i == 5) ? plaintext[i] : std::vector<uint8_t>(sizes[i]);
+        memset(ivs[i], (int)i, sizeof(ivs[i]));
+        items[i].p_src = (i == 5) ? batch_out[i].data() : plaintext[i].data();
+        items[i].src_len = (uint32_t)sizes[i];
+        items[i].p_dst = batch_out[i].data();
+        items[i].p_iv = ivs[i];
+        items[i].iv_len = (i == 3) ? 16 : 12;
+        items[i].p_out_mac = &batch_tags[i];
+    }
+    ASSERT_TRUE(crypto.encryptBatch(&key, items, count) == SGX_SUCCESS);
+    for (size_t i = 0; i < count; i++)
+    {
+        std::vector<uint8_t> single_out(sizes[i]);
+        sgx_aes_gcm_128bit_tag_t single_tag;
+        ASSERT_TRUE(crypto.encrypt(&key, plaintext[i].data(), (uint32_t)sizes[i], single_out.data(), ivs[i], items[i].iv_len, NULL, 0, &single_tag) == SGX_SUCCESS);
+        EXPECT_TRUE(batch_out[i] == single_out) << "item " << i;
+        EXPECT_TRUE(memcmp(batch_tags[i], single_tag, sizeof(single_tag)) == 0) << "item " << i;
+    }
+}
+
+TEST(mbedtlscrypto, retired_key_is_expanded_again)
+{
+    MbedtlsCryptoImpl crypto;
+    sgx_aes_gcm_128bit_key_t key, unused;
+    memcpy(key, gcm_key, sizeof(key));
+    memset(unused, 0xaa, sizeof(unused));
+    uint8_t buf[64];
+    sgx_aes_gcm_128bit_tag_t tag;
+    EXPECT_TRUE(crypto.encrypt(&key, gcm_plaintext, sizeof(buf), buf, gcm_iv, sizeof(gcm_iv), NULL, 0, &tag) == SGX_SUCCESS);
+    crypto.retireKey(&key);
+    crypto.retireKey(&unused);
+    EXPECT_TRUE(crypto.decrypt(&key, buf, sizeof(buf), buf, gcm_iv, sizeof(gcm_iv), NULL, 0, &tag) == SGX_SUCCESS);
+    EXPECT_TRUE(memcmp(buf, gcm_plaintext, sizeof(buf)) == 0);
+    crypto.retireKey(&key);
+    EXPECT_TRUE(crypto.encrypt(&key, gcm_plaintext, sizeof(buf), buf, gcm_iv, sizeof(gcm_iv), NULL, 0, &tag) == SGX_SUCCESS);
+    EXPECT_TRUE(memcmp(buf, gcm_ciphertext, sizeof(buf)) == 0);
+    EXPECT_TRUE(memcmp(tag, gcm_tag, sizeof(tag)) == 0);
+}
@@ -51,6 +51,14 @@ public:
     void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label)
     {
     }
+    void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label)
+    {
+    }
+    uint64_t SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label)
+    {
+        return 0;
+    }
+    void CancelPeriodic(uint64_t timer_id) {}
     void Stop() {}
 
     void SetThreadId(void) {}
@@ -59,6 +67,8 @@ public:
 
     void Yield() {}
 
+    void Park(volatile int *wakeup) {}
+
     void InitializeThread() {}
 
     // Inherited via IThreadPool
@@ -208,10 +218,25 @@ public:
             sinkr(msg, 1);
         }
     }
+    void sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr, uint64_t timeout_us)
+    {
+        sendMessageAsync(msg, cb, ptr);
+    }
 
     void endAsync(msg_t *msg)
     {
     }
+    size_t cancelFlows(aid_t destination)
+    {
+        return 0;
+    }
+    size_t cancelFlows()
+    {
+        return 0;
+    }
+    void registerLateReplyCallback(async_cb_t cb, void *arg)
+    {
+    }
 
     /*one way*/
     void sendMessage(msg_t *msg)
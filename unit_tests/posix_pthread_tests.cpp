@@ -173,3 +173,137 @@ TEST(posix_pthread, test_mutex_and_recursive)
 
 
 
+#define COND_ITEMS 1000
+#define COND_CONSUMERS 3
+static ThreadPool *cond_pool = nullptr;
+static pthread_mutex_t cond_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_nonempty = PTHREAD_COND_INITIALIZER;
+static volatile int cond_queued = 0;
+static volatile int cond_produced = 0;
+static volatile int cond_consumed = 0;
+
+void *cond_consumer(void *ptr)
+{
+	i_pthread_mutex_lock(&cond_lock);
+	while (cond_consumed < COND_ITEMS) {
+		while (cond_queued == 0 && cond_produced < COND_ITEMS) {
+			i_pthread_cond_wait(&cond_nonempty, &cond_lock);
+			EXPECT_TRUE(cond_lock.__data.__owner == (int)cond_pool->currentVThreadId() + 1);
+		}
+		if (cond_queued > 0) {
+			cond_queued--;
+			cond_consumed++;
+		}
+		else {
+			break;
+		}
+	}
+	i_pthread_mutex_unlock(&cond_lock);
+	return NULL;
+}
+void *cond_producer(void *ptr)
+{
+	for (int i = 0; i < COND_ITEMS; i++) {
+		i_pthread_mutex_lock(&cond_lock);
+		cond_queued++;
+		cond_produced++;
+		if (cond_produced == COND_ITEMS) {
+			i_pthread_cond_broadcast(&cond_nonempty);
+		}
+		else {
+			i_pthread_cond_signal(&cond_nonempty);
+		}
+		i_pthread_mutex_unlock(&cond_lock);
+		if (i % 10 == 0) {
+			cond_pool->Yield();
+		}
+	}
+	return NULL;
+}
+void cond_start_cb(void *ptr, int status)
+{
+	pthread_t consumers[COND_CONSUMERS], producer;
+	for (int i = 0; i < COND_CONSUMERS; i++) {
+		EXPECT_TRUE(i_pthread_create(&consumers[i], NULL, cond_consumer, NULL) == 0);
+	}
+	EXPECT_TRUE(i_pthread_create(&producer, NULL, cond_producer, NULL) == 0);
+}
+
+TEST(posix_pthread, cond_producer_consumer)
+{
+	cond_pool = new ThreadPool(2, REGULAR_MODE, "diggi_thread", false, 4);
+	pthread_stubs_unset_thread_manager();
+	pthread_stubs_set_thread_manager(cond_pool);
+	cond_pool->Schedule(cond_start_cb, nullptr, __PRETTY_FUNCTION__);
+	while (cond_consumed < COND_ITEMS) {
+		__sync_synchronize();
+	}
+	EXPECT_TRUE(cond_queued == 0);
+	cond_pool->Stop();
+	delete cond_pool;
+}
+
+#define RWLOCK_ITERATIONS 200
+static ThreadPool *rw_pool = nullptr;
+static pthread_rwlock_t rw_lock = PTHREAD_RWLOCK_INITIALIZER;
+static volatile int rw_readers_active = 0;
+static volatile int rw_writers_active = 0;
+static volatile int rw_violations = 0;
+static volatile int rw_done = 0;
+static volatile int rw_shared = 0;
+
+void *rw_reader(void *ptr)
+{
+	for (int i = 0; i < RWLOCK_ITERATIONS; i++) {
+		EXPECT_TRUE(i_pthread_rwlock_rdlock(&rw_lock) == 0);
+		__sync_fetch_and_add(&rw_readers_active, 1);
+		if (rw_writers_active != 0) {
+			__sync_fetch_and_add(&rw_violations, 1);
+		}
+		rw_pool->Yield();
+		__sync_fetch_and_sub(&rw_readers_active, 1);
+		EXPECT_TRUE(i_pthread_rwlock_unlock(&rw_lock) == 0);
+	}
+	__sync_fetch_and_add(&rw_done, 1);
+	return NULL;
+}
+void *rw_writer(void *ptr)
+{
+	for (int i = 0; i < RWLOCK_ITERATIONS; i++) {
+		EXPECT_TRUE(i_pthread_rwlock_wrlock(&rw_lock) == 0);
+		if (__sync_fetch_and_add(&rw_writers_active, 1) != 0 || rw_readers_active != 0) {
+			__sync_fetch_and_add(&rw_violations, 1);
+		}
+		EXPECT_TRUE(i_pthread_rwlock_tryrdlock(&rw_lock) == EBUSY);
+		rw_shared++;
+		rw_pool->Yield();
+		__sync_fetch_and_sub(&rw_writers_active, 1);
+		EXPECT_TRUE(i_pthread_rwlock_unlock(&rw_lock) == 0);
+	}
+	__sync_fetch_and_add(&rw_done, 1);
+	return NULL;
+}
+void rwlock_start_cb(void *ptr, int status)
+{
+	pthread_t threads[4];
+	EXPECT_TRUE(i_pthread_create(&threads[0], NULL, rw_reader, NULL) == 0);
+	EXPECT_TRUE(i_pthread_create(&threads[1], NULL, rw_writer, NULL) == 0);
+	EXPECT_TRUE(i_pthread_create(&threads[2], NULL, rw_reader, NULL) == 0);
+	EXPECT_TRUE(i_pthread_create(&threads[3], NULL, rw_writer, NULL) == 0);
+}
+
+TEST(posix_pthread, rwlock_readers_writers)
+{
+	rw_pool = new ThreadPool(2, REGULAR_MODE, "diggi_thread", false, 4);
+	pthread_stubs_unset_thread_manager();
+	pthread_stubs_set_thread_manager(rw_pool);
+	rw_pool->Schedule(rwlock_start_cb, nullptr, __PRETTY_FUNCTION__);
+	while (rw_done < 4) {
+		__sync_synchronize();
+	}
+	EXPECT_TRUE(rw_violations == 0);
+	EXPECT_TRUE(rw_shared == 2 * RWLOCK_ITERATIONS);
+	EXPECT_TRUE(i_pthread_rwlock_destroy(&rw_lock) == 0);
+	rw_pool->Stop();
+	delete rw_pool;
+}
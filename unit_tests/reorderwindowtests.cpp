@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "messaging/ReorderWindow.h"
+
+static msg_t *reorder_message(uint64_t session_count)
+{
+    auto msg = (msg_t *)calloc(1, sizeof(msg_t));
+    msg->size = sizeof(msg_t);
+    msg->session_count = session_count;
+    return msg;
+}
+
+TEST(reorderwindow, ring_and_overflow_delivered_in_order)
+{
+    ReorderWindow window;
+    reorder_slot_t slot;
+    memset(&slot, 0, sizeof(slot));
+
+    /*
+        expected advances past several windows, so ring slots are reused.
+        Each round holds messages in reverse order, the last ones too far ahead for the ring.
+    */
+    uint64_t expected = 0;
+    const uint64_t ahead = REORDER_WINDOW_SIZE + 8;
+    for (int round = 0; round < 4; round++)
+    {
+        size_t in_ring = 0;
+        for (uint64_t i = ahead; i > 0; i--)
+        {
+            slot.msg = reorder_message(expected + i);
+            if (window.store(expected, &slot))
+            {
+                in_ring++;
+            }
+        }
+        EXPECT_TRUE(in_ring == REORDER_WINDOW_SIZE - 1);
+        EXPECT_TRUE(window.size() == ahead);
+        EXPECT_FALSE(window.take(expected, &slot));
+
+        /*
+            the expected message is delivered on arrival, then held messages follow
+        */
+        expected++;
+        while (window.take(expected, &slot))
+        {
+            EXPECT_TRUE(slot.msg->session_count == expected);
+            free(slot.msg);
+            expected++;
+        }
+        EXPECT_TRUE(window.size() == 0);
+    }
+    EXPECT_TRUE(expected == 4 * (ahead + 1));
+}
+
+TEST(reorderwindow, release_all_held)
+{
+    ReorderWindow window;
+    reorder_slot_t slot;
+    memset(&slot, 0, sizeof(slot));
+    std::vector<uint64_t> counts = {3, 1000, 7, 2};
+    for (auto count : counts)
+    {
+        slot.msg = reorder_message(count);
+        window.store(1, &slot);
+    }
+    size_t released = 0;
+    while (window.takeAny(&slot))
+    {
+        free(slot.msg);
+        released++;
+    }
+    EXPECT_TRUE(released == counts.size());
+    EXPECT_TRUE(window.size() == 0);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "lockfree_rb_q.h"
 #include <thread>
+#include <chrono>
 
 void producerlf_c(lf_buffer_t *rb, size_t id, unsigned rounds)
 {
@@ -57,4 +58,213 @@ TEST(ringbuffertests, multithreaded_8_way_test)
 	//c5.join();
 	EXPECT_TRUE(true);
 	lf_destroy(rb);
-}
\ No newline at end of file
+}
+void producerlf_batch_c(lf_buffer_t *rb, size_t id, unsigned rounds, unsigned batch)
+{
+	void *itms[16];
+	for (unsigned i = 0; i < rounds; i += batch)
+	{
+		for (unsigned j = 0; j < batch; j++)
+		{
+			itms[j] = malloc(sizeof(int));
+			memcpy(itms[j], &i, sizeof(int));
+		}
+		lf_send_batch(rb, itms, batch, id);
+	}
+}
+
+/*
+	Consumers share the total count, as a batch may hold more than a consumers fair share.
+*/
+void consumerlf_batch_c(lf_buffer_t *rb, size_t id, volatile unsigned *recieved, unsigned rounds)
+{
+	void *itms[16];
+	while (*recieved < rounds)
+	{
+		auto cnt = lf_try_recieve_batch(rb, itms, 16, id);
+		if (cnt == 0)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		for (size_t j = 0; j < cnt; j++)
+		{
+			EXPECT_TRUE(itms[j] != NULL);
+			free(itms[j]);
+		}
+		__sync_fetch_and_add(recieved, cnt);
+	}
+}
+
+TEST(ringbuffertests, batch_order_test)
+{
+	auto rb = lf_new(16, 1, 1);
+	void *in[8];
+	void *out[16];
+	for (uintptr_t i = 0; i < 8; i++)
+	{
+		in[i] = (void *)(i + 1);
+	}
+	EXPECT_TRUE(lf_try_recieve_batch(rb, out, 16, 0) == 0);
+	lf_send_batch(rb, in, 8, 0);
+	lf_send(rb, (void *)9, 0);
+
+	EXPECT_TRUE(lf_try_recieve_batch(rb, out, 4, 0) == 4);
+	EXPECT_TRUE(lf_try_recieve_batch(rb, out + 4, 16, 0) == 5);
+	for (uintptr_t i = 0; i < 9; i++)
+	{
+		EXPECT_TRUE(out[i] == (void *)(i + 1));
+	}
+	/*
+		Reservation left by a failed single recieve is completed by the batch call
+	*/
+	EXPECT_TRUE(lf_try_recieve(rb, 0) == nullptr);
+	lf_send_batch(rb, in, 2, 0);
+	EXPECT_TRUE(lf_try_recieve_batch(rb, out, 16, 0) == 2);
+	EXPECT_TRUE(out[0] == in[0] && out[1] == in[1]);
+	lf_destroy(rb);
+}
+
+TEST(ringbuffertests, try_send_full_queue)
+{
+	auto rb = lf_new(16, 1, 1);
+	auto spsc = lf_new_spsc(16);
+	EXPECT_TRUE(lf_free_slots(rb) == 16);
+	for (uintptr_t i = 0; i < 16; i++)
+	{
+		EXPECT_TRUE(lf_try_send(rb, (void *)(i + 1), 0) == 1);
+		EXPECT_TRUE(lf_try_send(spsc, (void *)(i + 1), 0) == 1);
+	}
+	EXPECT_TRUE(lf_free_slots(rb) == 0);
+	/*
+		A full queue refuses without leaving a reservation behind
+	*/
+	EXPECT_TRUE(lf_try_send(rb, (void *)17, 0) == 0);
+	EXPECT_TRUE(lf_try_send(spsc, (void *)17, 0) == 0);
+	EXPECT_TRUE(lf_try_recieve(rb, 0) == (void *)1);
+	EXPECT_TRUE(lf_try_recieve(spsc, 0) == (void *)1);
+	EXPECT_TRUE(lf_free_slots(rb) == 1);
+	EXPECT_TRUE(lf_try_send(rb, (void *)17, 0) == 1);
+	EXPECT_TRUE(lf_try_send(spsc, (void *)17, 0) == 1);
+	for (uintptr_t i = 1; i < 17; i++)
+	{
+		EXPECT_TRUE(lf_try_recieve(rb, 0) == (void *)(i + 1));
+		EXPECT_TRUE(lf_try_recieve(spsc, 0) == (void *)(i + 1));
+	}
+	EXPECT_TRUE(lf_try_recieve(rb, 0) == nullptr);
+	EXPECT_TRUE(lf_free_slots(rb) == 16);
+	lf_destroy(rb);
+	lf_destroy(spsc);
+}
+
+TEST(ringbuffertests, multithreaded_batch_test)
+{
+	auto rb = lf_new(64, 2, 2);
+	volatile unsigned recieved = 0;
+
+	std::thread p1(producerlf_batch_c, rb, 0, 40000, 8);
+	std::thread p2(producerlf_batch_c, rb, 1, 40000, 4);
+	std::thread c1(consumerlf_batch_c, rb, 0, &recieved, 80000);
+	std::thread c2(consumerlf_batch_c, rb, 1, &recieved, 80000);
+
+	p1.join();
+	p2.join();
+	c1.join();
+	c2.join();
+	EXPECT_TRUE(recieved == 80000);
+	lf_destroy(rb);
+}
+
+TEST(ringbuffertests, spsc_test)
+{
+	auto rb = lf_new_spsc(16);
+	void *out[16];
+	EXPECT_TRUE(lf_try_recieve(rb, 0) == nullptr);
+	EXPECT_TRUE(lf_try_recieve_batch(rb, out, 16, 0) == 0);
+
+	std::thread p1(producerlf_c, rb, 0, 100000);
+	std::thread c1(consumerlf_c, rb, 0, 100000);
+	p1.join();
+	c1.join();
+	EXPECT_TRUE(lf_try_recieve(rb, 0) == nullptr);
+	lf_destroy(rb);
+}
+
+/*
+	Single producer, single consumer throughput of the generic queue versus the spsc queue.
+	Numbers are only indicative when producer and consumer run on separate cores.
+*/
+void producerlf_bench_c(lf_buffer_t *rb, unsigned rounds)
+{
+	for (uintptr_t i = 1; i <= rounds; i++)
+	{
+		lf_send(rb, (void *)i, 0);
+	}
+}
+
+void consumerlf_bench_c(lf_buffer_t *rb, unsigned rounds)
+{
+	for (uintptr_t i = 1; i <= rounds; i++)
+	{
+		auto itm = lf_recieve(rb, 0);
+		if (itm != (void *)i)
+		{
+			ADD_FAILURE();
+			return;
+		}
+	}
+}
+
+double lf_bench(lf_buffer_t *rb, unsigned rounds)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::thread p1(producerlf_bench_c, rb, rounds);
+	std::thread c1(consumerlf_bench_c, rb, rounds);
+	p1.join();
+	c1.join();
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lf_destroy(rb);
+	return rounds / elapsed.count();
+}
+
+TEST(ringbuffertests, spsc_microbenchmark)
+{
+	const unsigned rounds = 1000000;
+	auto mpmc = lf_bench(lf_new(1024, 1, 1), rounds);
+	auto spsc = lf_bench(lf_new_spsc(1024), rounds);
+	printf("lockfree_rb_q mpmc: %.0f msg/s, spsc: %.0f msg/s\n", mpmc, spsc);
+	EXPECT_TRUE(mpmc > 0 && spsc > 0);
+}
+
+void consumerlf_park_c(lf_buffer_t *rb, double *waited)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	void *itm = nullptr;
+	while ((itm = lf_try_recieve(rb, 0)) == nullptr)
+	{
+		lf_park(rb, 5000000);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	*waited = elapsed.count();
+	EXPECT_TRUE(itm == (void *)1);
+}
+
+TEST(ringbuffertests, doorbell_wakeup_test)
+{
+	lf_buffer_t *queues[2] = {lf_new(16, 1, 1), lf_new_spsc(16)};
+	for (auto rb : queues)
+	{
+		lf_enable_doorbell(rb);
+		double waited = 0;
+		std::thread c1(consumerlf_park_c, rb, &waited);
+		usleep(50000);
+		lf_send(rb, (void *)1, 0);
+		c1.join();
+		/*
+			Woken by send, long before park timeout
+		*/
+		EXPECT_TRUE(waited < 1.0);
+		EXPECT_TRUE(rb->parked_ == 0);
+		lf_destroy(rb);
+	}
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "messaging/SessionKeyCache.h"
+
+/*
+    Cache with a controllable clock
+*/
+class SessionKeyCacheMockClock : public SessionKeyCache
+{
+public:
+    uint64_t clock;
+    SessionKeyCacheMockClock(std::string path, uint64_t ttl_sec) : SessionKeyCache(path, ttl_sec, new NoSeal(true)), clock(1000) {}
+
+protected:
+    uint64_t now()
+    {
+        return clock;
+    }
+};
+
+static aid_t session_key_peer(uint8_t enclave)
+{
+    aid_t id;
+    id.raw = 0;
+    id.fields.type = ENCLAVE;
+    id.fields.enclave = enclave;
+    return id;
+}
+
+TEST(sessionkeycache, expiry_and_persistence)
+{
+    const char *path = "sessionkeycachetest.sessionkeys";
+    unlink(path);
+    sgx_ec_key_128bit_t key_a;
+    sgx_ec_key_128bit_t key_b;
+    sgx_ec_key_128bit_t out;
+    memset(key_a, 0xa, sizeof(key_a));
+    memset(key_b, 0xb, sizeof(key_b));
+    {
+        SessionKeyCacheMockClock cache(path, 100);
+        EXPECT_TRUE(cache.load() == 0);
+        cache.put(session_key_peer(1), &key_a);
+        cache.clock += 50;
+        cache.put(session_key_peer(2), &key_b);
+        EXPECT_TRUE(cache.get(session_key_peer(1), &out));
+        EXPECT_TRUE(memcmp(out, key_a, sizeof(out)) == 0);
+        EXPECT_FALSE(cache.get(session_key_peer(3), &out));
+        EXPECT_TRUE(cache.persist());
+    }
+
+    /*
+        restored after restart, entries expire relative to when they were put
+    */
+    SessionKeyCacheMockClock restored(path, 100);
+    restored.clock = 1099;
+    EXPECT_TRUE(restored.load() == 2);
+    EXPECT_TRUE(restored.get(session_key_peer(2), &out));
+    EXPECT_TRUE(memcmp(out, key_b, sizeof(out)) == 0);
+    restored.clock = 1100;
+    EXPECT_FALSE(restored.get(session_key_peer(1), &out));
+    EXPECT_TRUE(restored.get(session_key_peer(2), &out));
+    restored.erase(session_key_peer(2));
+    EXPECT_TRUE(restored.size() == 0);
+
+    restored.clock = 1200;
+    EXPECT_TRUE(restored.load() == 0);
+    unlink(path);
+
+    /*
+        clock rolled back by the host after restart does not revive expired entries
+    */
+    {
+        SessionKeyCacheMockClock cache(path, 100);
+        cache.put(session_key_peer(1), &key_a);
+        cache.clock = 1200;
+        EXPECT_TRUE(cache.persist());
+    }
+    SessionKeyCacheMockClock rolled_back(path, 100);
+    rolled_back.clock = 1000;
+    EXPECT_TRUE(rolled_back.load() == 0);
+    EXPECT_FALSE(rolled_back.get(session_key_peer(1), &out));
+    unlink(path);
+}
+
+TEST(sessionkeycache, resume_key_derivation)
+{
+    sgx_ec_key_128bit_t base;
+    memset(base, 0x42, sizeof(base));
+    auto initiator = session_key_peer(1);
+    auto responder = session_key_peer(2);
+    session_resume_t resume;
+    memset(&resume, 0, sizeof(resume));
+    resume.status = SESSION_RESUME_REQUEST;
+    memset(resume.nonce_initiator, 1, SESSION_RESUME_NONCE_SIZE);
+    SessionKeyCache::resumeMac(&base, initiator, responder, &resume, resume.mac);
+    EXPECT_TRUE(SessionKeyCache::verifyResumeMac(&base, initiator, responder, &resume));
+    EXPECT_FALSE(SessionKeyCache::verifyResumeMac(&base, responder, initiator, &resume));
+    resume.nonce_initiator[0] ^= 1;
+    EXPECT_FALSE(SessionKeyCache::verifyResumeMac(&base, initiator, responder, &resume));
+
+    /*
+        both peers derive the same key, which changes with every nonce
+    */
+    sgx_ec_key_128bit_t first;
+    sgx_ec_key_128bit_t again;
+    sgx_ec_key_128bit_t second;
+    memset(resume.nonce_responder, 2, SESSION_RESUME_NONCE_SIZE);
+    SessionKeyCache::deriveResumeKey(&base, initiator, responder, &resume, &first);
+    SessionKeyCache::deriveResumeKey(&base, initiator, responder, &resume, &again);
+    EXPECT_TRUE(memcmp(first, again, sizeof(first)) == 0);
+    EXPECT_TRUE(memcmp(first, base, sizeof(first)) != 0);
+    resume.nonce_responder[0] ^= 1;
+    SessionKeyCache::deriveResumeKey(&base, initiator, responder, &resume, &second);
+    EXPECT_TRUE(memcmp(first, second, sizeof(first)) != 0);
+}
@@ -70,8 +70,12 @@ class AMockMessageManager : public IAsyncMessageManager
 
     /*await response*/
     void sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr) {}
+    void sendMessageAsync(msg_t *msg, async_cb_t cb, void *ptr, uint64_t timeout_us) {}
 
     void endAsync(msg_t *msg) {}
+    size_t cancelFlows(aid_t destination) { return 0; }
+    size_t cancelFlows() { return 0; }
+    void registerLateReplyCallback(async_cb_t cb, void *arg) {}
 
     /*one way*/
     void sendMessage(msg_t *msg) {}
@@ -115,6 +119,14 @@ public:
     void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label)
     {
     }
+    void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label)
+    {
+    }
+    uint64_t SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label)
+    {
+        return 0;
+    }
+    void CancelPeriodic(uint64_t timer_id) {}
     size_t physicalThreadCount()
     {
         return 1;
@@ -126,6 +138,8 @@ public:
 
     void Yield() {}
 
+    void Park(volatile int *wakeup) {}
+
     void InitializeThread() {}
 
     // Inherited via IThreadPool
@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <deque>
+#include "messaging/StreamChannel.h"
+#include "messaging/IMessageManager.h"
+#include "threading/IThreadPool.h"
+#include "Logging.h"
+
+class StreamMockLog : public ILog
+{
+    std::string GetfuncName()
+    {
+        return "testfunc";
+    }
+    void SetFuncId(aid_t aid, std::string name = "func")
+    {
+    }
+    void SetLogLevel(LogLevel lvl)
+    {
+    }
+    void Log(LogLevel lvl, const char *fmt, ...)
+    {
+    }
+    void Log(const char *fmt, ...)
+    {
+    }
+};
+static StreamMockLog stream_loginstance;
+
+/*
+    Message manager of one endpoint, sends are queued towards the peer endpoint
+*/
+class StreamMockMessageManager : public IMessageManager
+{
+public:
+    aid_t self;
+    StreamMockMessageManager *peer;
+    std::deque<msg_t *> inbound;
+    async_cb_t type_cb;
+    void *type_ctx;
+    size_t data_sent;
+
+    StreamMockMessageManager(aid_t self) : self(self), peer(nullptr), type_cb(nullptr), type_ctx(nullptr), data_sent(0) {}
+    void endAsync(msg_t *msg) {}
+    void Send(msg_t *msg, async_cb_t cb, void *cb_context)
+    {
+        EXPECT_TRUE(cb == nullptr);
+        EXPECT_TRUE(msg->type == DIGGI_STREAM_MESSAGE_TYPE);
+        EXPECT_TRUE(msg->size <= DIGGI_MEM_CLASS_2_SIZE);
+        if (((stream_header_t *)msg->data)->op == STREAM_DATA)
+        {
+            data_sent++;
+        }
+        peer->inbound.push_back(msg);
+    }
+    msg_t *allocateMessage(std::string destination, size_t payload_size, msg_convention_t async, msg_delivery_t delivery)
+    {
+        return nullptr;
+    }
+    msg_t *allocateMessage(aid_t destination, size_t payload_size, msg_convention_t async, msg_delivery_t delivery)
+    {
+        auto msg = (msg_t *)calloc(1, sizeof(msg_t) + payload_size);
+        msg->size = sizeof(msg_t) + payload_size;
+        msg->src = self;
+        msg->dest = destination;
+        msg->delivery = delivery;
+        return msg;
+    }
+    msg_t *allocateMessage(msg_t *msg, size_t payload_size)
+    {
+        return nullptr;
+    }
+    void registerTypeCallback(async_cb_t cb, msg_type_t type, void *ctx)
+    {
+        EXPECT_TRUE(type == DIGGI_STREAM_MESSAGE_TYPE);
+        type_cb = cb;
+        type_ctx = ctx;
+    }
+    std::map<std::string, aid_t> getfuncNames()
+    {
+        return std::map<std::string, aid_t>();
+    }
+    void deliver()
+    {
+        while (!inbound.empty())
+        {
+            auto msg = inbound.front();
+            inbound.pop_front();
+            ASSERT_TRUE(type_cb != nullptr);
+            msg_async_response_t resp;
+            resp.msg = msg;
+            resp.context = type_ctx;
+            type_cb(&resp, 1);
+            free(msg);
+        }
+    }
+};
+
+/*
+    Yielding lets the reciever consume chunks and return acknowledgements
+*/
+class StreamMockThreadPool : public IThreadPool
+{
+public:
+    StreamMockMessageManager *sender;
+    StreamMockMessageManager *reciever;
+    size_t yields;
+    StreamMockThreadPool() : sender(nullptr), reciever(nullptr), yields(0) {}
+    void Yield()
+    {
+        yields++;
+        reciever->deliver();
+        sender->deliver();
+    }
+    void Park(volatile int *wakeup) {}
+    int currentThreadId() { return 0; }
+    size_t currentVThreadId() { return 0; }
+    void Schedule(async_cb_t cb, void *args, const char *label) {}
+    void ScheduleOn(size_t id, async_cb_t cb, void *args, const char *label) {}
+    void ScheduleAfter(uint64_t delay_us, async_cb_t cb, void *args, const char *label) {}
+    uint64_t SchedulePeriodic(uint64_t period_us, async_cb_t cb, void *args, const char *label) { return 0; }
+    void CancelPeriodic(uint64_t timer_id) {}
+    size_t physicalThreadCount() { return 1; }
+    void Stop() {}
+    bool Alive() { return true; }
+};
+
+static std::vector<uint8_t> stream_recieved;
+static bool stream_closed = false;
+
+void stream_chunk_handler(void *ptr, int status)
+{
+    auto chunk = (stream_chunk_t *)ptr;
+    EXPECT_TRUE(chunk->context == &stream_recieved);
+    EXPECT_FALSE(stream_closed);
+    EXPECT_TRUE(chunk->offset == stream_recieved.size());
+    if (chunk->last)
+    {
+        stream_closed = true;
+        return;
+    }
+    EXPECT_TRUE(chunk->size > 0 && chunk->size <= STREAM_CHUNK_PAYLOAD);
+    stream_recieved.insert(stream_recieved.end(), chunk->data, chunk->data + chunk->size);
+}
+
+TEST(streamchannel, windowed_transfer_in_order)
+{
+    aid_t src;
+    src.raw = 0;
+    src.fields.lib = 2;
+    aid_t dest;
+    dest.raw = 0;
+    dest.fields.lib = 1;
+    StreamMockMessageManager sender_mm(src);
+    StreamMockMessageManager reciever_mm(dest);
+    sender_mm.peer = &reciever_mm;
+    reciever_mm.peer = &sender_mm;
+    StreamMockThreadPool tp;
+    tp.sender = &sender_mm;
+    tp.reciever = &reciever_mm;
+    StreamChannelManager sender(&sender_mm, &tp, &stream_loginstance);
+    StreamChannelManager reciever(&reciever_mm, &tp, &stream_loginstance);
+    reciever.registerStreamCallback(stream_chunk_handler, &stream_recieved);
+
+    /*
+        payload far beyond MAX_DIGGI_MEM_SIZE, with a partial last chunk
+    */
+    const size_t chunks = (STREAM_WINDOW_CHUNKS * 3) + 1;
+    const size_t total = (chunks - 1) * STREAM_CHUNK_PAYLOAD + 100;
+    std::vector<uint8_t> payload(total);
+    for (size_t i = 0; i < total; i++)
+    {
+        payload[i] = (uint8_t)(i * 7);
+    }
+    stream_recieved.clear();
+    stream_closed = false;
+    auto stream = sender.openStream(dest, CLEARTEXT);
+
+    /*
+        Written in two parts, the writer blocks whenever the window is exhausted
+    */
+    EXPECT_TRUE(sender.writeStream(stream, payload.data(), total / 2));
+    EXPECT_TRUE(sender.writeStream(stream, payload.data() + (total / 2), total - (total / 2)));
+    EXPECT_TRUE(tp.yields > 0);
+    EXPECT_TRUE(sender.inFlight(stream) <= STREAM_WINDOW_CHUNKS);
+    sender.closeStream(stream);
+    EXPECT_TRUE(sender.inFlight(stream) == 0);
+    reciever_mm.deliver();
+    sender_mm.deliver();
+
+    /*
+        chunks are not merged across writes, both halves end in a partial chunk
+    */
+    EXPECT_TRUE(sender_mm.data_sent == chunks + 1);
+    EXPECT_TRUE(stream_closed);
+    ASSERT_TRUE(stream_recieved.size() == total);
+    EXPECT_TRUE(memcmp(stream_recieved.data(), payload.data(), total) == 0);
+}
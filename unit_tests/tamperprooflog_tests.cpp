@@ -93,7 +93,7 @@ TEST(tamperprooflogtests, appendlog)
     cli.raw = 0;
     cli.fields.lib = 2;
     cli.fields.type = LIB;
-    auto globuff = provision_memory_buffer(3, MAX_DIGGI_MEM_ITEMS, MAX_DIGGI_MEM_SIZE);
+    auto globuff = provision_message_pool(3);
     mlog1->SetFuncId(serv, "storage_server");
     mlog2->SetFuncId(cli, "storage_manager");
     mlog1->SetLogLevel(LRELEASE);
@@ -202,7 +202,7 @@ TEST(tamperprooflogtests, appendlog)
 
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, MAX_DIGGI_MEM_ITEMS);
+    delete_message_pool(globuff);
     delete mlog1;
     delete mlog2;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "threading/ThreadPool.h"
 #include "threading/IThreadPool.h"
+#include "telemetry.h"
 #include <vector>
 #include <thread>
 static volatile uint64_t nextid = 0;
@@ -211,3 +212,348 @@ TEST(threadpool_tests, while_yield_pattern_2){
 	delete tp2;
 
 }
+
+#define STEAL_TASKS 2000
+static volatile uint64_t steal_done = 0;
+static volatile uint64_t pinned_misplaced = 0;
+
+void steal_task(void *ptr, int status)
+{
+	/*
+		keep task busy, so siblings observe a backlog
+	*/
+	for (volatile int i = 0; i < 20000; i++)
+		;
+	__sync_fetch_and_add(&steal_done, 1);
+}
+void pinned_task(void *ptr, int status)
+{
+	if (threadpool->currentThreadId() != 0)
+	{
+		__sync_fetch_and_add(&pinned_misplaced, 1);
+	}
+	__sync_fetch_and_add(&steal_done, 1);
+}
+void steal_producer(void *ptr, int status)
+{
+	for (unsigned i = 0; i < STEAL_TASKS; i++)
+	{
+		threadpool->Schedule(steal_task, nullptr, __PRETTY_FUNCTION__);
+		threadpool->ScheduleOn(0, pinned_task, nullptr, __PRETTY_FUNCTION__);
+	}
+}
+
+TEST(threadpool_tests, work_stealing)
+{
+	steal_done = 0;
+	pinned_misplaced = 0;
+	auto pool = new ThreadPool(4, REGULAR_MODE, "diggi_thread", true);
+	threadpool = pool;
+	/*
+		All unpinned work originates on thread 0
+	*/
+	threadpool->ScheduleOn(0, steal_producer, nullptr, __PRETTY_FUNCTION__);
+	while (steal_done < 2 * STEAL_TASKS)
+		;
+	uint64_t steals = 0;
+	for (unsigned i = 0; i < pool->physicalThreadCount(); i++)
+	{
+		steals += pool->stealCount(i);
+	}
+	EXPECT_TRUE(steals > 0);
+	EXPECT_TRUE(pool->stealCount(0) == 0);
+	EXPECT_TRUE(pinned_misplaced == 0);
+	threadpool->Stop();
+	delete threadpool;
+}
+
+TEST(threadpool_tests, work_item_cache)
+{
+	nextid = 0;
+	auto pool = new ThreadPool(2);
+	threadpool = pool;
+	/*
+		ping-pong between threads, so most work items are consumed by a thread other than their owner
+	*/
+	for (unsigned i = 0; i < threadpool->physicalThreadCount(); i++)
+	{
+		auto val = malloc(sizeof(unsigned));
+		memcpy(val, &i, sizeof(unsigned));
+		threadpool->ScheduleOn(i, schedule_a, val, __PRETTY_FUNCTION__);
+	}
+	while (nextid < TOTAL_ITTERATIONS)
+		;
+	threadpool->Stop();
+	auto pooled = pool->pooledWorkAllocations();
+	auto heap = pool->heapWorkAllocations();
+	printf("async_work_t allocations: pooled=%lu, heap=%lu, %.1f%% of heap allocations avoided\n",
+		   pooled, heap, (100.0 * pooled) / (pooled + heap));
+	EXPECT_TRUE(pooled + heap >= TOTAL_ITTERATIONS - threadpool->physicalThreadCount());
+	EXPECT_TRUE(heap == 0);
+	delete threadpool;
+}
+
+#define TIMER_COUNT 3
+static volatile uint64_t timer_armed_at = 0;
+static volatile uint64_t timer_fired = 0;
+static uint64_t timer_order[TIMER_COUNT];
+static uint64_t timer_elapsed[TIMER_COUNT];
+static volatile int timer_misplaced = 0;
+void timer_task(void *ptr, int status)
+{
+	if (threadpool->currentThreadId() != 1)
+	{
+		__sync_fetch_and_add(&timer_misplaced, 1);
+	}
+	auto idx = timer_fired;
+	timer_order[idx] = (uint64_t)ptr;
+	timer_elapsed[idx] = ThreadPool::monotonicUsec() - timer_armed_at;
+	__sync_synchronize();
+	timer_fired = idx + 1;
+}
+void timer_arm(void *ptr, int status)
+{
+	timer_armed_at = ThreadPool::monotonicUsec();
+	threadpool->ScheduleAfter(3000, timer_task, (void *)3000, __PRETTY_FUNCTION__);
+	threadpool->ScheduleAfter(1000, timer_task, (void *)1000, __PRETTY_FUNCTION__);
+	threadpool->ScheduleAfter(2000, timer_task, (void *)2000, __PRETTY_FUNCTION__);
+}
+
+TEST(threadpool_tests, schedule_after)
+{
+	timer_fired = 0;
+	timer_misplaced = 0;
+	threadpool = new ThreadPool(2);
+	threadpool->ScheduleOn(1, timer_arm, nullptr, __PRETTY_FUNCTION__);
+	while (timer_fired < TIMER_COUNT)
+		;
+	for (unsigned i = 0; i < TIMER_COUNT; i++)
+	{
+		EXPECT_TRUE(timer_order[i] == (i + 1) * 1000);
+		EXPECT_TRUE(timer_elapsed[i] >= timer_order[i]);
+	}
+	EXPECT_TRUE(timer_misplaced == 0);
+	threadpool->Stop();
+	delete threadpool;
+}
+
+#define PERIODIC_EXPIRIES 5
+static volatile uint64_t periodic_fired = 0;
+static volatile uint64_t periodic_remote_fired = 0;
+static volatile uint64_t periodic_id = 0;
+void periodic_task(void *ptr, int status)
+{
+	if (++periodic_fired == PERIODIC_EXPIRIES)
+	{
+		threadpool->CancelPeriodic(periodic_id);
+	}
+}
+void periodic_remote_task(void *ptr, int status)
+{
+	__sync_fetch_and_add(&periodic_remote_fired, 1);
+}
+void periodic_arm(void *ptr, int status)
+{
+	periodic_id = threadpool->SchedulePeriodic(200, periodic_task, nullptr, __PRETTY_FUNCTION__);
+}
+
+TEST(threadpool_tests, periodic_timer)
+{
+	periodic_fired = 0;
+	periodic_remote_fired = 0;
+	threadpool = new ThreadPool(1);
+	threadpool->ScheduleOn(0, periodic_arm, nullptr, __PRETTY_FUNCTION__);
+	/*
+		armed by thread not on pool, cancelled through owner thread
+	*/
+	auto remote_id = threadpool->SchedulePeriodic(200, periodic_remote_task, nullptr, __PRETTY_FUNCTION__);
+	EXPECT_TRUE(remote_id != 0);
+	while (periodic_fired < PERIODIC_EXPIRIES || periodic_remote_fired < PERIODIC_EXPIRIES)
+		;
+	threadpool->CancelPeriodic(remote_id);
+	usleep(10000);
+	auto remote_fired = periodic_remote_fired;
+	usleep(10000);
+	EXPECT_TRUE(periodic_fired == PERIODIC_EXPIRIES);
+	EXPECT_TRUE(periodic_remote_fired == remote_fired);
+	threadpool->Stop();
+	delete threadpool;
+}
+
+static volatile int vthread_release[2];
+static volatile int vthread_done[2];
+static volatile size_t vthread_ids[2];
+static volatile int vthread_started = 0;
+void vthread_blocking_task(void *ptr, int status)
+{
+	auto idx = (size_t)ptr;
+	vthread_ids[idx] = threadpool->currentVThreadId();
+	__sync_fetch_and_add(&vthread_started, 1);
+	while (!vthread_release[idx])
+	{
+		threadpool->Yield();
+	}
+	vthread_done[idx] = 1;
+}
+
+TEST(threadpool_tests, virtual_threads)
+{
+	auto pool = new ThreadPool(1, REGULAR_MODE, "diggi_thread", false, 4, 1 << 16);
+	threadpool = pool;
+	EXPECT_TRUE(pool->virtualThreadCount() == 4);
+	vthread_started = 0;
+	for (size_t i = 0; i < 2; i++)
+	{
+		vthread_release[i] = 0;
+		vthread_done[i] = 0;
+		threadpool->ScheduleOn(0, vthread_blocking_task, (void *)i, __PRETTY_FUNCTION__);
+	}
+	while (vthread_started < 2)
+		;
+	/*
+		first callback completes while second is still blocked, which requires it to run on a separate virtual thread
+	*/
+	vthread_release[0] = 1;
+	while (!vthread_done[0])
+		;
+	EXPECT_TRUE(vthread_done[1] == 0);
+	EXPECT_TRUE(vthread_ids[0] != vthread_ids[1]);
+	vthread_release[1] = 1;
+	while (!vthread_done[1])
+		;
+	threadpool->Stop();
+	delete threadpool;
+}
+
+TEST(threadpool_tests, virtual_threads_config)
+{
+	size_t virtual_threads = DEFAULT_VIRTUAL_THREADS;
+	EXPECT_TRUE(ThreadPool::parseVirtualThreads("4", &virtual_threads));
+	EXPECT_TRUE(virtual_threads == 4);
+	EXPECT_TRUE(ThreadPool::parseVirtualThreads(std::to_string(MAX_VIRTUAL_THREADS_PER_THREAD), &virtual_threads));
+	EXPECT_TRUE(virtual_threads == MAX_VIRTUAL_THREADS_PER_THREAD);
+	/*
+		invalid values leave the previous value in place
+	*/
+	virtual_threads = DEFAULT_VIRTUAL_THREADS;
+	EXPECT_FALSE(ThreadPool::parseVirtualThreads("0", &virtual_threads));
+	EXPECT_FALSE(ThreadPool::parseVirtualThreads("", &virtual_threads));
+	EXPECT_FALSE(ThreadPool::parseVirtualThreads("four", &virtual_threads));
+	EXPECT_FALSE(ThreadPool::parseVirtualThreads("4x", &virtual_threads));
+	EXPECT_FALSE(ThreadPool::parseVirtualThreads("-4", &virtual_threads));
+	EXPECT_FALSE(ThreadPool::parseVirtualThreads(std::to_string(MAX_VIRTUAL_THREADS_PER_THREAD + 1), &virtual_threads));
+	EXPECT_FALSE(ThreadPool::parseVirtualThreads("99999999999999999999999", &virtual_threads));
+	EXPECT_TRUE(virtual_threads == DEFAULT_VIRTUAL_THREADS);
+}
+
+#define PROFILED_TASKS 100
+static volatile uint64_t profiled_done = 0;
+static const char *profiled_label = "profiled, \"quoted\" task";
+void profiled_task(void *ptr, int status)
+{
+	__sync_fetch_and_add(&profiled_done, 1);
+}
+
+TEST(threadpool_tests, scheduler_profiling)
+{
+	auto pool = new ThreadPool(2);
+	threadpool = pool;
+	EXPECT_FALSE(pool->profilingEnabled());
+	pool->setProfiling(true);
+	profiled_done = 0;
+	for (size_t i = 0; i < PROFILED_TASKS; i++)
+	{
+		pool->ScheduleOn(i % 2, profiled_task, nullptr, profiled_label);
+	}
+	while (profiled_done < PROFILED_TASKS)
+		;
+	threadpool->Stop();
+	auto csv = pool->profileCsv();
+	EXPECT_TRUE(csv.find("thread,label,count,run_total,run_max,queue_total,queue_max,clock\n") == 0);
+	/*
+		one row per thread, label quoted and inner quotes escaped
+	*/
+	EXPECT_TRUE(csv.find("0,\"profiled, \"\"quoted\"\" task\",50,") != std::string::npos);
+	EXPECT_TRUE(csv.find("1,\"profiled, \"\"quoted\"\" task\",50,") != std::string::npos);
+	EXPECT_TRUE(csv.find("overflow") == std::string::npos);
+	/*
+		profiles are dumped along with telemetry, without shutting down
+	*/
+	remove(SCHED_PROFILE_LOG);
+	telemetry_init();
+	telemetry_write();
+	FILE *pFile = fopen(SCHED_PROFILE_LOG, "r");
+	ASSERT_TRUE(pFile != nullptr);
+	std::string dumped;
+	char buf[256];
+	size_t read = 0;
+	while ((read = fread(buf, 1, sizeof(buf), pFile)) > 0)
+	{
+		dumped.append(buf, read);
+	}
+	fclose(pFile);
+	EXPECT_EQ(dumped, csv);
+	delete threadpool;
+	/*
+		unregistered once deleted
+	*/
+	remove(SCHED_PROFILE_LOG);
+	telemetry_write();
+	EXPECT_TRUE(fopen(SCHED_PROFILE_LOG, "r") == nullptr);
+	remove("telemetry.log");
+}
+
+#define BATCH_TASKS 10000
+static volatile uint64_t batch_done = 0;
+static volatile int batch_timer_fired = 0;
+void batch_task(void *ptr, int status)
+{
+	batch_done++;
+}
+void batch_seed(void *ptr, int status)
+{
+	for (size_t i = 0; i < BATCH_TASKS; i++)
+	{
+		threadpool->Schedule(batch_task, nullptr, __PRETTY_FUNCTION__);
+	}
+}
+void batch_spin_task(void *ptr, int status)
+{
+	/*
+		queue never drains while timer is pending
+	*/
+	if (!batch_timer_fired)
+	{
+		threadpool->Schedule(batch_spin_task, nullptr, __PRETTY_FUNCTION__);
+	}
+}
+void batch_timer(void *ptr, int status)
+{
+	batch_timer_fired = 1;
+}
+void batch_budget_seed(void *ptr, int status)
+{
+	threadpool->ScheduleAfter(1000, batch_timer, nullptr, __PRETTY_FUNCTION__);
+	threadpool->Schedule(batch_spin_task, nullptr, __PRETTY_FUNCTION__);
+}
+
+TEST(threadpool_tests, batch_drain)
+{
+	auto pool = new ThreadPool(1);
+	threadpool = pool;
+	pool->setBatching(64);
+	batch_done = 0;
+	threadpool->ScheduleOn(0, batch_seed, nullptr, __PRETTY_FUNCTION__);
+	while (batch_done < BATCH_TASKS)
+		;
+	/*
+		an unbounded batch must still observe timers once its time budget is spent
+	*/
+	batch_timer_fired = 0;
+	pool->setBatching(SIZE_MAX, 100);
+	threadpool->ScheduleOn(0, batch_budget_seed, nullptr, __PRETTY_FUNCTION__);
+	while (!batch_timer_fired)
+		;
+	threadpool->Stop();
+	delete threadpool;
+}
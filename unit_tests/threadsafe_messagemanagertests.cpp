@@ -5,6 +5,7 @@
 #include "messaging/ThreadSafeMessageManager.h"
 #include "misc.h"
 #include "messaging/SecureMessageManager.h"
+#include "messaging/MbedtlsCrypto.h"
 #include <unistd.h>
 #include "runtime/DiggiUntrustedRuntime.h"
 
@@ -218,7 +219,7 @@ TEST(threadsafe_messagemanager, test_many_send_recieve)
     auto mapns = std::map<std::string, aid_t>();
     mapns[server_name] = serv;
     auto crptr = new MockCryptoImpl();
-    auto globuff = provision_memory_buffer(CONCURRENCY + 1, 1024 * 1024, 1024);
+    auto globuff = provision_message_pool(CONCURRENCY + 1);
     auto diggiapi1 = new DiggiAPI(test_threadpool, nullptr, nullptr, nullptr, nullptr, mlog, cli, nullptr);
     auto diggiapi2 = new DiggiAPI(test_threadpool, nullptr, nullptr, nullptr, nullptr, mlog, serv, nullptr);
 
@@ -282,7 +283,7 @@ TEST(threadsafe_messagemanager, test_many_send_recieve)
     delete tmmngr1;
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, 1024 * 1024);
+    delete_message_pool(globuff);
     delete mlog;
     delete test_threadpool;
     test_threadpool = nullptr;
@@ -317,7 +318,7 @@ TEST(threadsafe_messagemanager, secure_test_many_send_recieve)
     auto mapns = std::map<std::string, aid_t>();
     mapns[server_name] = serv;
     auto crptr = new MockCryptoImpl();
-    auto globuff = provision_memory_buffer(CONCURRENCY + 1, 1024 * 1024, 1024);
+    auto globuff = provision_message_pool(CONCURRENCY + 1);
     auto diggiapi1 = new DiggiAPI(test_threadpool, nullptr, nullptr, nullptr, nullptr, mlog, cli, nullptr);
     auto diggiapi2 = new DiggiAPI(test_threadpool, nullptr, nullptr, nullptr, nullptr, mlog, serv, nullptr);
 
@@ -381,7 +382,338 @@ TEST(threadsafe_messagemanager, secure_test_many_send_recieve)
     delete tmmngr1;
     lf_destroy(in_b);
     lf_destroy(out_b);
-    delete_memory_buffer(globuff, 1024 * 1024);
+    delete_message_pool(globuff);
+    delete mlog;
+    delete test_threadpool;
+    test_threadpool = nullptr;
+}
+
+TEST(threadsafe_messagemanager, secure_rekey)
+{
+    auto mlog = new TSMMMockLog();
+    test_threadpool = new ThreadPool(1);
+    auto in_b = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto out_b = lf_new(RING_BUFFER_SIZE, 1, 1);
+
+    aid_t cli;
+    cli.raw = 0;
+    cli.fields.enclave = 2;
+    cli.fields.type = ENCLAVE;
+
+    auto globuff = provision_message_pool(2);
+    auto diggiapi1 = new DiggiAPI(test_threadpool, nullptr, nullptr, nullptr, nullptr, mlog, cli, nullptr);
+    std::string conf = "{\"rekey-threshold\": \"3\"}";
+    zcstring convert(conf);
+    json_node nodeconf(convert);
+    diggiapi1->SetFuncConfig(nodeconf);
+    auto crptr = new MbedtlsCryptoImpl();
+    auto tmmngr1 = ThreadSafeMessageManager::Create<SecureMessageManager, AsyncMessageManager>(
+        diggiapi1,
+        in_b,
+        out_b,
+        new NoAttestationAPI(),
+        std::map<std::string, aid_t>(),
+        std::vector<name_service_update_t>(),
+        0,
+        globuff,
+        false,
+        nullptr,
+        false,
+        crptr);
+    auto smm = (SecureMessageManager *)tmmngr1->perthreadMngr[0];
+    EXPECT_EQ(smm->rekey_threshold, 3u);
+
+    /*
+        Two ends of one session, sharing the attested key
+    */
+    key_exchange_context_t sender, recipient;
+    memset(sender.g_sp_db.sk_key, 7, sizeof(sgx_ec_key_128bit_t));
+    memcpy(recipient.g_sp_db.sk_key, sender.g_sp_db.sk_key, sizeof(sgx_ec_key_128bit_t));
+    for (auto kec : {&sender, &recipient})
+    {
+        kec->parent_manager = smm;
+        kec->session_id = 0;
+        SecureMessageManager::resetKeyEpoch(kec);
+    }
+    uint8_t plain[32];
+    uint8_t out[sizeof(plain)];
+    size_t outlen = 0;
+    uint8_t buf[sizeof(secure_message_t) + sizeof(plain)];
+    uint8_t old_buf[sizeof(secure_message_t) + sizeof(plain)];
+
+    /*
+        Sender switches epoch every third message, recipient follows
+    */
+    for (unsigned i = 0; i < 10; i++)
+    {
+        memset(plain, i, sizeof(plain));
+        SecureMessageManager::encrypt(&sender, plain, sizeof(plain), (secure_message_t *)buf);
+        EXPECT_EQ(sender.key_epoch, i / 3);
+        SecureMessageManager::decrypt((secure_message_t *)buf, &recipient, out, &outlen);
+        EXPECT_EQ(recipient.key_epoch, sender.key_epoch);
+        EXPECT_EQ(outlen, sizeof(plain));
+        EXPECT_EQ(memcmp(out, plain, sizeof(plain)), 0);
+    }
+    EXPECT_EQ(memcmp(sender.g_sp_db.sk_key, recipient.g_sp_db.sk_key, sizeof(sgx_ec_key_128bit_t)), 0);
+
+    /*
+        Last two messages of epoch 3 are in flight when the sender switches to epoch 4
+    */
+    memset(plain, 0xAA, sizeof(plain));
+    SecureMessageManager::encrypt(&sender, plain, sizeof(plain), (secure_message_t *)old_buf);
+    SecureMessageManager::encrypt(&sender, plain, sizeof(plain), (secure_message_t *)buf);
+    EXPECT_EQ(sender.key_epoch, 3u);
+    uint8_t last_buf[sizeof(secure_message_t) + sizeof(plain)];
+    memcpy(last_buf, buf, sizeof(last_buf));
+    memset(plain, 0xBB, sizeof(plain));
+    SecureMessageManager::encrypt(&sender, plain, sizeof(plain), (secure_message_t *)buf);
+    EXPECT_EQ(sender.key_epoch, 4u);
+
+    SecureMessageManager::decrypt((secure_message_t *)buf, &recipient, out, &outlen);
+    EXPECT_EQ(recipient.key_epoch, 4u);
+    EXPECT_EQ(recipient.session_id, 1u);
+    EXPECT_EQ(recipient.prev_session_id, 1u);
+    EXPECT_EQ(memcmp(out, plain, sizeof(plain)), 0);
+
+    /*
+        Previous epoch messages decrypt with prev_key, advancing their own nonce only
+    */
+    memset(plain, 0xAA, sizeof(plain));
+    SecureMessageManager::decrypt((secure_message_t *)old_buf, &recipient, out, &outlen);
+    EXPECT_EQ(memcmp(out, plain, sizeof(plain)), 0);
+    SecureMessageManager::decrypt((secure_message_t *)last_buf, &recipient, out, &outlen);
+    EXPECT_EQ(memcmp(out, plain, sizeof(plain)), 0);
+    EXPECT_EQ(recipient.prev_session_id, 3u);
+    EXPECT_EQ(recipient.session_id, 1u);
+    EXPECT_EQ(recipient.key_epoch, 4u);
+
+    test_threadpool->Stop();
+    delete tmmngr1;
+    lf_destroy(in_b);
+    lf_destroy(out_b);
+    delete_message_pool(globuff);
+    delete mlog;
+    delete test_threadpool;
+    test_threadpool = nullptr;
+}
+
+static volatile bool test_resume_done = false;
+
+TEST(threadsafe_messagemanager, secure_resume_replay)
+{
+    auto mlog = new TSMMMockLog();
+    test_threadpool = new ThreadPool(1);
+    auto in_b = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto out_b = lf_new(RING_BUFFER_SIZE, 1, 1);
+
+    aid_t cli;
+    cli.raw = 0;
+    cli.fields.enclave = 2;
+    cli.fields.type = ENCLAVE;
+
+    auto globuff = provision_message_pool(2);
+    auto diggiapi1 = new DiggiAPI(test_threadpool, nullptr, nullptr, nullptr, nullptr, mlog, cli, nullptr);
+    auto tmmngr1 = ThreadSafeMessageManager::Create<SecureMessageManager, AsyncMessageManager>(
+        diggiapi1,
+        in_b,
+        out_b,
+        new NoAttestationAPI(),
+        std::map<std::string, aid_t>(),
+        std::vector<name_service_update_t>(),
+        0,
+        globuff,
+        false,
+        nullptr,
+        false,
+        new MbedtlsCryptoImpl());
+    auto smm = (SecureMessageManager *)tmmngr1->perthreadMngr[0];
+    smm->session_keys = new SessionKeyCache("secure_resume_replay.sessionkeys", 3600, new NoSeal(true));
+
+    /*
+        Recorded resume messages replayed against an established session leave it intact
+    */
+    test_resume_done = false;
+    test_threadpool->ScheduleOn(
+        0, [](void *ptr, int status) {
+            auto smm = (SecureMessageManager *)ptr;
+            aid_t peer;
+            peer.raw = 0;
+            peer.fields.enclave = 1;
+            peer.fields.type = ENCLAVE;
+            sgx_ec_key_128bit_t base;
+            memset(base, 9, sizeof(base));
+            smm->session_keys->put(peer, &base);
+
+            session_resume_t request;
+            memset(&request, 0, sizeof(request));
+            request.status = SESSION_RESUME_REQUEST;
+            memset(request.nonce_initiator, 1, SESSION_RESUME_NONCE_SIZE);
+            SessionKeyCache::resumeMac(&base, peer, smm->self, &request, request.mac);
+
+            session_resume_t challenge;
+            memset(&challenge, 0, sizeof(challenge));
+            EXPECT_EQ(smm->acceptResume(peer, smm->self, &request, &challenge), (uint32_t)SESSION_RESUME_CHALLENGE);
+            EXPECT_TRUE(SessionKeyCache::verifyResumeMac(&base, peer, smm->self, &challenge));
+            EXPECT_NE(smm->callback_map[peer.raw].resume_state, (uint32_t)SESSION_RESUME_DONE);
+
+            /*
+                an unanswered challenge is repeated
+            */
+            session_resume_t repeated;
+            memset(&repeated, 0, sizeof(repeated));
+            smm->acceptResume(peer, smm->self, &request, &repeated);
+            EXPECT_EQ(memcmp(repeated.nonce_responder, challenge.nonce_responder, SESSION_RESUME_NONCE_SIZE), 0);
+
+            session_resume_t confirm;
+            memset(&confirm, 0, sizeof(confirm));
+            confirm.status = SESSION_RESUME_CONFIRM;
+            memcpy(confirm.nonce_initiator, challenge.nonce_initiator, SESSION_RESUME_NONCE_SIZE);
+            memcpy(confirm.nonce_responder, challenge.nonce_responder, SESSION_RESUME_NONCE_SIZE);
+            sgx_ec_key_128bit_t derived;
+            SessionKeyCache::deriveResumeKey(&base, peer, smm->self, &confirm, &derived);
+            SessionKeyCache::resumeMac(&derived, peer, smm->self, &confirm, confirm.mac);
+            EXPECT_TRUE(smm->acceptConfirm(peer, smm->self, &confirm));
+            auto kec = &smm->callback_map[peer.raw];
+            EXPECT_EQ(kec->resume_state, (uint32_t)SESSION_RESUME_DONE);
+            EXPECT_EQ(memcmp(kec->g_sp_db.sk_key, derived, sizeof(derived)), 0);
+
+            /*
+                traffic on the resumed session, then replays of the request and the confirmation
+            */
+            kec->session_id = 5;
+            kec->session_id_inbound = 5;
+            kec->session_id_outbound = 5;
+            memset(&repeated, 0, sizeof(repeated));
+            EXPECT_EQ(smm->acceptResume(peer, smm->self, &request, &repeated), (uint32_t)SESSION_RESUME_CHALLENGE);
+            EXPECT_NE(memcmp(repeated.nonce_responder, challenge.nonce_responder, SESSION_RESUME_NONCE_SIZE), 0);
+            EXPECT_FALSE(smm->acceptConfirm(peer, smm->self, &confirm));
+            EXPECT_EQ(memcmp(kec->g_sp_db.sk_key, derived, sizeof(derived)), 0);
+            EXPECT_EQ(kec->session_id, 5u);
+            EXPECT_EQ(kec->session_id_inbound, 5u);
+            EXPECT_EQ(kec->session_id_outbound, 5u);
+            test_resume_done = true;
+        },
+        smm, __PRETTY_FUNCTION__);
+    while (!test_resume_done)
+    {
+        usleep(0);
+    }
+
+    test_threadpool->Stop();
+    delete tmmngr1;
+    lf_destroy(in_b);
+    lf_destroy(out_b);
+    delete_message_pool(globuff);
+    delete mlog;
+    delete test_threadpool;
+    test_threadpool = nullptr;
+}
+
+#define FLUSH_MESSAGES 40U
+static volatile bool test_flush_done = false;
+
+TEST(threadsafe_messagemanager, secure_flush_batch)
+{
+    auto mlog = new TSMMMockLog();
+    test_threadpool = new ThreadPool(1);
+    auto in_b = lf_new(RING_BUFFER_SIZE, 1, 1);
+    auto out_b = lf_new(RING_BUFFER_SIZE, 1, 1);
+
+    aid_t cli;
+    cli.raw = 0;
+    cli.fields.enclave = 2;
+    cli.fields.type = ENCLAVE;
+
+    auto globuff = provision_message_pool(2);
+    auto diggiapi1 = new DiggiAPI(test_threadpool, nullptr, nullptr, nullptr, nullptr, mlog, cli, nullptr);
+    std::string conf = "{\"rekey-threshold\": \"5\"}";
+    zcstring convert(conf);
+    json_node nodeconf(convert);
+    diggiapi1->SetFuncConfig(nodeconf);
+    auto crptr = new MbedtlsCryptoImpl();
+    auto tmmngr1 = ThreadSafeMessageManager::Create<SecureMessageManager, AsyncMessageManager>(
+        diggiapi1,
+        in_b,
+        out_b,
+        new NoAttestationAPI(),
+        std::map<std::string, aid_t>(),
+        std::vector<name_service_update_t>(),
+        0,
+        globuff,
+        false,
+        nullptr,
+        false,
+        crptr);
+    auto smm = (SecureMessageManager *)tmmngr1->perthreadMngr[0];
+
+    /*
+        Messages queued during attestation are flushed once the session is keyed,
+        across several encryption batches and key epochs
+    */
+    test_flush_done = false;
+    test_threadpool->ScheduleOn(
+        0, [](void *ptr, int status) {
+            auto smm = (SecureMessageManager *)ptr;
+            aid_t serv;
+            serv.raw = 0;
+            serv.fields.enclave = 1;
+            serv.fields.type = ENCLAVE;
+            auto kec = &smm->callback_map[serv.raw];
+            memset(kec->g_sp_db.sk_key, 7, sizeof(sgx_ec_key_128bit_t));
+            kec->self_id = smm->self;
+            kec->other_id = serv;
+            kec->parent_manager = smm;
+            kec->key_exchange_session_done = (async_cb_t)SecureMessageManager::SendMessageAsyncInternal;
+            kec->session_id = 0;
+            kec->session_id_inbound = 0;
+            kec->session_id_outbound = 0;
+            kec->initial = 1;
+            SecureMessageManager::resetKeyEpoch(kec);
+            for (uint64_t i = 0; i < FLUSH_MESSAGES; i++)
+            {
+                auto msg = smm->allocateMessage(serv, sizeof(uint64_t), REGULAR, ENCRYPTED);
+                msg->type = TEST_MESSAGE_QUERY_TYPE;
+                memcpy(msg->data, &i, sizeof(uint64_t));
+                kec->outputqueue.push_back(new secure_message_context_t(msg, nullptr, nullptr, smm, false, 0));
+            }
+            SecureMessageManager::flushOutputQueue(kec);
+            kec->initial = 0;
+            EXPECT_EQ(kec->outputqueue.size(), 0u);
+            test_flush_done = true;
+        },
+        smm, __PRETTY_FUNCTION__);
+    while (!test_flush_done)
+    {
+        usleep(0);
+    }
+
+    key_exchange_context_t recipient;
+    memset(recipient.g_sp_db.sk_key, 7, sizeof(sgx_ec_key_128bit_t));
+    recipient.parent_manager = smm;
+    recipient.session_id = 0;
+    SecureMessageManager::resetKeyEpoch(&recipient);
+    for (uint64_t i = 0; i < FLUSH_MESSAGES; i++)
+    {
+        msg_t *msg = nullptr;
+        while ((msg = (msg_t *)lf_try_recieve(out_b, 0)) == nullptr)
+        {
+            usleep(0);
+        }
+        EXPECT_EQ(msg->session_count, i);
+        EXPECT_EQ(msg->delivery, ENCRYPTED);
+        uint64_t out = 0;
+        size_t outlen = 0;
+        SecureMessageManager::decrypt((secure_message_t *)msg->data, &recipient, (uint8_t *)&out, &outlen);
+        EXPECT_EQ(outlen, sizeof(uint64_t));
+        EXPECT_EQ(out, i);
+    }
+    EXPECT_EQ(recipient.key_epoch, (FLUSH_MESSAGES - 1) / 5);
+
+    test_threadpool->Stop();
+    delete tmmngr1;
+    lf_destroy(in_b);
+    lf_destroy(out_b);
+    delete_message_pool(globuff);
     delete mlog;
     delete test_threadpool;
     test_threadpool = nullptr;
@@ -40,10 +40,10 @@ public:
     {
         return 0;
     }
-    void commit()
+    int commit()
     {
         commit_count++;
-        return;
+        return 0;
     }
 
     DBResult fetchone()
@@ -54,9 +54,10 @@ public:
     {
         return std::vector<DBResult>();
     }
-    void rollback()
+    int rollback()
     {
         rollback_count++;
+        return 0;
     }
     void freeDBResults()
     {